@@ -0,0 +1,138 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "EventIndex.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <string>
+
+// To compile: c++ BuildEventIndex.cpp `root-config --cflags --libs` -o build_event_index.out
+//
+// Indexing pass over a NUISANCE flat tree: builds one bitmap per Mode category, topology and
+// selection flag (see EventIndex.h) and saves them next to the input, as <file>.evidx. Runs that
+// only need some categories (e.g. "select = RES & 0pi0n" in CompareSamples.cpp) then read only the
+// matching entries.
+//
+// The saved index is loaded back and compared with the one built, and the selection parser is
+// checked against bitmaps combined by hand (nested parentheses, && and ||, !).
+//
+//     ./build_event_index.out flat_Valencia_13815.root [tree name] ["selection to test"]
+
+// Selections parsed by EventIndex::Select against the same bitmaps combined by hand
+bool CheckSelectionParser(const EventIndex& index)
+{
+    const EntryBitmap &CCQE = *index.Get("CCQE"), &RES = *index.Get("RES"), &MEC = *index.Get("2p2h");
+    const EntryBitmap &noPiNoN = *index.Get("0pi0n"), &noPiN = *index.Get("0piNn");
+
+    EntryBitmap qeOrRes0pi0n = RES;   // CCQE | (RES & 0pi0n)
+    qeOrRes0pi0n &= noPiNoN;
+    qeOrRes0pi0n |= CCQE;
+    EntryBitmap resOr2p2h0pi0n = RES; // (RES | 2p2h) & 0pi0n
+    resOr2p2h0pi0n |= MEC;
+    resOr2p2h0pi0n &= noPiNoN;
+    EntryBitmap notResN = noPiN;      // !(CCQE | (RES & !0piNn))
+    notResN.Invert();
+    notResN &= RES;
+    notResN |= CCQE;
+    notResN.Invert();
+
+    struct { const char* selection; const EntryBitmap* expected; } cases[] = {
+        {"CCQE | (RES & 0pi0n)", &qeOrRes0pi0n},
+        {"(CCQE || ((RES) && (0pi0n)))", &qeOrRes0pi0n},
+        {"((RES|2p2h) & 0pi0n)", &resOr2p2h0pi0n},
+        {"(((RES || 2p2h)) && 0pi0n)", &resOr2p2h0pi0n},
+        {"!(CCQE | (RES & !0piNn))", &notResN},
+        {"!!(!(CCQE||(RES&&!0piNn)))", &notResN},
+    };
+    bool ok = true;
+    std::string error;
+    for (const auto& test : cases)
+    {
+        EntryBitmap selected;
+        if (!index.Select(test.selection, selected, error) || !(selected == *test.expected))
+        {
+            printf("Error: selection \"%s\" %s.\n", test.selection, error.empty() ? "does not match the bitmaps combined by hand" : error.c_str());
+            ok = false;
+        }
+    }
+    for (const char* unbalanced : {"((RES)", "(RES))", "RES & (2p2h"})
+    {
+        EntryBitmap selected;
+        if (index.Select(unbalanced, selected, error))
+        {
+            printf("Error: the unbalanced selection \"%s\" was accepted.\n", unbalanced);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./build_event_index.out \n- name of the .root file"
+                  << "\n- optional: name of the tree (default FlatTree_VARS)"
+                  << "\n- optional: a selection to count, e.g. \"RES & !0pi0n\"" << std::endl;
+        return 1;
+    }
+
+    std::string treeName = argc > 2 ? argv[2] : "FlatTree_VARS";
+    TFile *file = TFile::Open(argv[1]);
+    TTree *tree = file ? (TTree*) file->Get(treeName.c_str()) : nullptr;
+    if (!tree)
+    {
+        printf("Error: could not read %s from %s.\n", treeName.c_str(), argv[1]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    EventIndex index;
+    if (!index.Build(tree))
+        return 1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string indexFile = EventIndexPath(argv[1]);
+    if (!index.Save(indexFile))
+    {
+        printf("Error: could not write %s.\n", indexFile.c_str());
+        return 1;
+    }
+
+    EventIndex loaded;
+    bool sameIndex = loaded.Load(indexFile, index.GetNEntries(), TreeSourceID(tree)) && loaded.GetNames() == index.GetNames();
+    for (const std::string& name : index.GetNames())
+        sameIndex = sameIndex && *loaded.Get(name) == *index.Get(name);
+    if (!sameIndex)
+    {
+        printf("Error: %s does not load back as the index that was built.\n", indexFile.c_str());
+        return 1;
+    }
+    if (!CheckSelectionParser(index))
+        return 1;
+
+    std::ifstream saved(indexFile, std::ios::binary | std::ios::ate);
+    printf("%lld entries indexed in %.2f s, %s: %.1f kB\n", (long long) index.GetNEntries(), seconds,
+           indexFile.c_str(), saved.tellg() / 1024.);
+    for (const std::string& name : index.GetNames())
+    {
+        Long64_t n = index.Get(name)->Count();
+        printf("  %-12s %12lld  (%5.1f%%)\n", name.c_str(), (long long) n,
+               index.GetNEntries() > 0 ? 100. * n / index.GetNEntries() : 0.);
+    }
+
+    if (argc > 3)
+    {
+        EntryBitmap selected;
+        std::string error;
+        if (!index.Select(argv[3], selected, error))
+        {
+            printf("Error: %s\n", error.c_str());
+            return 1;
+        }
+        printf("Selection \"%s\": %lld entries\n", argv[3], (long long) selected.Count());
+    }
+
+    file->Close();
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "ZoneMap.h"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// To compile: c++ BuildZoneMaps.cpp `root-config --cflags --libs` -o build_zone_maps.out
+//
+// Builds the zone map (per-cluster entries, min and max of the key scalar branches, see ZoneMap.h)
+// of one or more flat trees and saves it next to each input, as <file>.zonemap. Range cuts given
+// after --cut are checked against the maps, to see how many clusters they skip:
+//
+//     ./build_zone_maps.out flat_Valencia_13815.root flat_Valencia_2382.root --cut Enu_true 0 9 --cut bias_QE 0 1
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./build_zone_maps.out \n- names of the .root files (tree FlatTree_VARS)"
+                  << "\n- optional: --tree name of the tree \n- optional: --cut variable lo hi (repeatable)" << std::endl;
+        return 1;
+    }
+
+    std::string treeName = "FlatTree_VARS";
+    std::vector<std::string> files;
+    std::vector<RangeCut> cuts;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--tree" && a + 1 < argc)
+            treeName = argv[++a];
+        else if (arg == "--cut" && a + 3 < argc)
+        {
+            cuts.push_back({argv[a + 1], atof(argv[a + 2]), atof(argv[a + 3])});
+            a += 3;
+        } else
+            files.push_back(arg);
+    }
+
+    for (const std::string& fileName : files)
+    {
+        TFile *file = TFile::Open(fileName.c_str());
+        TTree *tree = file ? (TTree*) file->Get(treeName.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", treeName.c_str(), fileName.c_str());
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ZoneMap zones;
+        if (!zones.Build(tree))
+            return 1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::string zoneFile = ZoneMapPath(fileName);
+        if (!zones.Save(zoneFile))
+        {
+            printf("Error: could not write %s.\n", zoneFile.c_str());
+            return 1;
+        }
+        printf("%s: %d clusters, %zu columns, built in %.2f s\n", zoneFile.c_str(), zones.GetNClusters(),
+               zones.GetColumns().size(), seconds);
+
+        for (int c = 0; c < (int) zones.GetColumns().size(); c++)
+        {
+            double lo = INFINITY, hi = -INFINITY;
+            for (int k = 0; k < zones.GetNClusters(); k++)
+            {
+                lo = std::min(lo, zones.GetMin(k, c));
+                hi = std::max(hi, zones.GetMax(k, c));
+            }
+            printf("  %-16s [%g, %g]\n", zones.GetColumns()[c].c_str(), lo, hi);
+        }
+
+        if (!cuts.empty())
+        {
+            EntryBitmap candidates;
+            ZoneMapReport report;
+            zones.SelectClusters(cuts, candidates, report);
+            report.Print(fileName.c_str());
+        }
+        file->Close();
+    }
+
+    return 0;
+}
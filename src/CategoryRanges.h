@@ -0,0 +1,123 @@
+#ifndef CATEGORY_RANGES_H
+#define CATEGORY_RANGES_H
+
+#include "TFile.h"
+#include "TNamed.h"
+#include "SampleDefinitions.h"
+#include "EventIndex.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Entry ranges of a sample rewritten by ReorderByMode.cpp: the entries are grouped by Mode
+//   category (and E_nu^true range inside each category), so every category is one contiguous
+//   range [first, last) of entries, and its baskets and clusters are not shared with the other
+//   categories (the baskets are flushed after each group).
+//   The ranges are stored in the output file as a TNamed "CategoryRanges", one line per group:
+//
+//       category Enu_lo Enu_hi first last
+//
+//   A selection made only of Mode categories ("RES", "RES | 2p2h") is then read from these ranges
+//   alone (SelectCategoryRanges, used by CompareSamples.cpp), without building the event index.
+// ------------------------------------------------------------------------------------------------
+
+struct CategoryRange
+{
+    int category;
+    double enuLo, enuHi;
+    Long64_t first, last;
+};
+
+inline bool WriteCategoryRanges(TFile* file, const std::vector<CategoryRange>& ranges)
+{
+    std::stringstream text;
+    text.precision(9);
+    for (const CategoryRange& r : ranges)
+        text << r.category << " " << r.enuLo << " " << r.enuHi << " " << r.first << " " << r.last << "\n";
+    file->cd();
+    TNamed metadata("CategoryRanges", text.str().c_str());
+    return metadata.Write() > 0;
+}
+
+// False if the file was not written by ReorderByMode.cpp
+inline bool ReadCategoryRanges(TFile* file, std::vector<CategoryRange>& ranges)
+{
+    ranges.clear();
+    TNamed *metadata = file ? (TNamed*) file->Get("CategoryRanges") : nullptr;
+    if (!metadata)
+        return false;
+    std::stringstream text(metadata->GetTitle());
+    CategoryRange r;
+    while (text >> r.category >> r.enuLo >> r.enuHi >> r.first >> r.last)
+        ranges.push_back(r);
+    return !ranges.empty();
+}
+
+// Contiguous entries of one Mode category (all its E_nu^true ranges); false if it has none
+inline bool GetCategoryEntries(const std::vector<CategoryRange>& ranges, int category, Long64_t& first, Long64_t& last)
+{
+    first = -1;
+    last = -1;
+    for (const CategoryRange& r : ranges)
+        if (r.category == category && r.last > r.first)
+        {
+            first = first < 0 ? r.first : std::min(first, r.first);
+            last = std::max(last, r.last);
+        }
+    return first >= 0;
+}
+
+// Entries of a selection of Mode categories joined by | (e.g. "CCQE | 2p2h"), as the contiguous
+// ranges of the file; false if the selection has anything else, or the ranges do not fit the tree
+inline bool SelectCategoryRanges(const std::vector<CategoryRange>& ranges, const std::string& selection, Long64_t nEntries,
+                                 EntryBitmap& result)
+{
+    for (const CategoryRange& r : ranges)
+        if (r.first < 0 || r.last < r.first || r.last > nEntries)
+            return false;
+
+    std::string text = selection;
+    for (size_t pos; (pos = text.find("||")) != std::string::npos;)
+        text.erase(pos, 1); // || as |
+
+    std::vector<int> categories;
+    std::stringstream terms(text + "|");
+    std::string term;
+    while (std::getline(terms, term, '|'))
+    {
+        size_t first = term.find_first_not_of(' '), last = term.find_last_not_of(' ');
+        if (first == std::string::npos)
+            return false;
+        term = term.substr(first, last - first + 1);
+        int category = 0;
+        while (category < kNModeCategories && term != ModeCategoryName(category))
+            category++;
+        if (category == kNModeCategories)
+            return false;
+        categories.push_back(category);
+    }
+    if (categories.empty())
+        return false;
+
+    result.Resize(nEntries);
+    for (int category : categories)
+    {
+        Long64_t first, last;
+        if (GetCategoryEntries(ranges, category, first, last))
+            result.SetRange(first, last);
+    }
+    return true;
+}
+
+inline void PrintCategoryRanges(const char* label, const std::vector<CategoryRange>& ranges)
+{
+    printf("[CategoryRanges] %s\n", label);
+    for (const CategoryRange& r : ranges)
+        printf("  %-6s E_nu in [%6g, %6g) GeV: entries [%lld, %lld)  %lld events\n", ModeCategoryName(r.category), r.enuLo, r.enuHi,
+               (long long) r.first, (long long) r.last, (long long) (r.last - r.first));
+}
+
+#endif
@@ -0,0 +1,702 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TH1F.h"
+#include "TCanvas.h"
+#include "TLegend.h"
+#include "TStyle.h"
+#include "TROOT.h"
+#include "TSystem.h"
+#include "SampleDefinitions.h"
+#include "ExpressionParser.h"
+#include "HistogramRegistry.h"
+#include "PlotCache.h"
+#include "EventIndex.h"
+#include "ZoneMap.h"
+#include "CategoryRanges.h"
+#include "FluxNormalization.h"
+#include "LiveMonitor.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// To compile: c++ CompareSamples.cpp `root-config --cflags --libs` -pthread -o compare_samples.out
+//
+// Compares any number of samples in one job. Each sample is a section of a config file:
+//
+//     [DUNE]
+//     file   = flat_Valencia_13815.root
+//     [T2K]
+//     file   = flat_Valencia_2382.root
+//     [nuSCOPE]
+//     file   = flat_vec_AR23_20i_00_000_14_3_04_02_nuSCOPE_WC_total_0000.root
+//     weight = Weight
+//     efficiency = TaggingEfficiencyAr23.root:hIE_TagEff
+//
+// Keys: file (required), tree, cut (selection), reco (E_reco formula), weight, efficiency
+// (file.root:histogram, efficiency vs E_nu^true used as an extra weight), color, select (Mode
+// categories, topologies and flags combined with & | !, e.g. "RES & 0pi0n": only the matching
+// entries are read, from the bitmap index of EventIndex.h, built if needed, or from the category
+// ranges of a file reordered by ReorderByMode.cpp for a selection of categories only), range (variable lo hi,
+// repeatable; a branch or "bias": entries outside [lo, hi] are dropped and the clusters of the tree
+// that cannot match are not read, from the zone map of ZoneMap.h, built if needed), flux (file.root:
+// histogram, default FlatTree_FLUX of the sample file) and flux_range (lo hi, E_nu^true range of
+// the flux normalization). For DUNE, T2K and nuSCOPE, tree, cut and reco default to the
+// definitions of SampleDefinitions.h. cut, reco and weight are expressions with the syntax of
+// TTree::Project (see ExpressionParser.h, no Sum$).
+//
+// --norm xsec gives flux-integrated cross sections and --norm rate events per POT (times --targets),
+// from the flux histogram and the fScaleFactor branch (see FluxNormalization.h); the factors are
+// applied to the event weights while filling.
+//
+// The entries of all samples are split in chunks that run on one shared pool of threads, and every
+// histogram is overlaid for all samples: ./compare_samples.out config.txt [-j threads] [--normalize]
+// [--norm entries|xsec|rate] [--targets N] [--out dir] [--monitor port] [--monitor-file path]
+// (live progress and partial E_nu and bias histograms while the pool runs, see LiveMonitor.h).
+
+static const Long64_t TASK_ENTRIES = 200000; // Entries per task of the thread pool
+
+// ------------------------------------------------------------------------------------------------
+//                                  Samples from the config file
+// ------------------------------------------------------------------------------------------------
+struct SampleConfig
+{
+    std::string label, file, tree, cut, reco, weight, efficiency, select, flux;
+    int color;
+    TH1 *efficiencyHist = nullptr;
+    bool useFluxRange = false, useScaleFactor = false;
+    double fluxLo = 0, fluxHi = 0, normFactor = 1; // normFactor: constant of the flux normalization
+    std::vector<RangeCut> ranges;
+    bool useSelection = false;
+    EntryBitmap selection; // entries to read, from the event index and the zone map
+    Long64_t entries = 0;
+};
+
+bool ReadConfig(const std::string& fileName, std::vector<SampleConfig>& samples)
+{
+    std::ifstream in(fileName);
+    if (!in)
+    {
+        printf("Error: could not open the config file %s.\n", fileName.c_str());
+        return false;
+    }
+
+    const int colors[] = {kRed, kBlue, kGreen+2, kMagenta+1, kOrange+7, kCyan+1, kViolet-6, kTeal+3};
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        size_t first = line.find_first_not_of(" \t"), last = line.find_last_not_of(" \t\r");
+        if (first == std::string::npos)
+            continue;
+        line = line.substr(first, last - first + 1);
+
+        if (line[0] == '[')
+        {
+            SampleConfig sample;
+            sample.label = line.substr(1, line.find(']') - 1);
+            sample.color = colors[samples.size() % 8];
+            sample.tree = "FlatTree_VARS";
+            sample.cut = "1";
+            sample.weight = "1";
+
+            SampleDefinition definition;
+            if (GetSampleDefinition(sample.label, definition))
+            {
+                sample.tree = definition.treeName;
+                sample.cut = definition.flag;
+                sample.reco = definition.useQE ? "Enu_QE" : "Erecoil_minerva + ELep";
+            }
+            samples.push_back(sample);
+            continue;
+        }
+
+        size_t equal = line.find('=');
+        if (samples.empty() || equal == std::string::npos)
+        {
+            printf("Error: %s: unexpected line \"%s\".\n", fileName.c_str(), line.c_str());
+            return false;
+        }
+        std::string key = line.substr(0, line.find_last_not_of(" \t", equal - 1) + 1);
+        std::string value = line.substr(std::min(line.size(), line.find_first_not_of(" \t", equal + 1)));
+        SampleConfig& sample = samples.back();
+
+        if (key == "file")            sample.file = value;
+        else if (key == "tree")       sample.tree = value;
+        else if (key == "cut")        sample.cut = value;
+        else if (key == "reco")       sample.reco = value;
+        else if (key == "weight")     sample.weight = value;
+        else if (key == "efficiency") sample.efficiency = value;
+        else if (key == "color")      sample.color = atoi(value.c_str());
+        else if (key == "select")     sample.select = value;
+        else if (key == "flux")       sample.flux = value;
+        else if (key == "flux_range")
+        {
+            std::stringstream stream(value);
+            if (!(stream >> sample.fluxLo >> sample.fluxHi) || sample.fluxHi <= sample.fluxLo)
+            {
+                printf("Error: %s: flux_range must be \"lo hi\" with lo < hi, not \"%s\".\n", fileName.c_str(), value.c_str());
+                return false;
+            }
+            sample.useFluxRange = true;
+        }
+        else if (key == "range")
+        {
+            RangeCut range;
+            std::stringstream stream(value);
+            if (!(stream >> range.variable >> range.lo >> range.hi))
+            {
+                printf("Error: %s: range must be \"variable lo hi\", not \"%s\".\n", fileName.c_str(), value.c_str());
+                return false;
+            }
+            sample.ranges.push_back(range);
+        }
+        else
+        {
+            printf("Error: %s: unknown key \"%s\".\n", fileName.c_str(), key.c_str());
+            return false;
+        }
+    }
+
+    for (const SampleConfig& sample : samples)
+        if (sample.file.empty() || sample.reco.empty())
+        {
+            printf("Error: sample %s needs a file and a reco formula.\n", sample.label.c_str());
+            return false;
+        }
+    return !samples.empty();
+}
+
+// ------------------------------------------------------------------------------------------------
+//      Histograms of one sample: global variables, bias per mode category and per topology
+// ------------------------------------------------------------------------------------------------
+struct PlotVariable
+{
+    std::string name, axis;
+    int nbins;
+    double lo, hi;
+};
+
+std::vector<PlotVariable> GetPlotVariables()
+{
+    std::vector<PlotVariable> variables = {
+        {"Enu", "E_{#nu}^{true} [GeV]", 50, 0, 10},
+        {"bias", "E_{#nu}^{true} - E_{#nu}^{reco} [GeV]", 50, -0.5, 2.5},
+        {"bias_weighted", "(E_{#nu}^{true} - E_{#nu}^{reco})/E_{#nu}^{true}", 50, -1, 2},
+    };
+    for (int c = 0; c < kNModeCategories; c++)
+        variables.push_back({std::string("bias_") + ModeCategoryName(c), "E_{#nu}^{true} - E_{#nu}^{reco} [GeV]", 50, -0.5, 2.5});
+    for (int t = 0; t < kNTopologies; t++)
+        variables.push_back({std::string("bias_") + TopologyName(t), "E_{#nu}^{true} - E_{#nu}^{reco} [GeV]", 50, -0.5, 2.5});
+    return variables;
+}
+
+enum { kVarEnu = 0, kVarBias = 1, kVarBiasWeighted = 2, kVarBiasMode = 3, kVarBiasTopology = 3 + kNModeCategories };
+
+std::vector<BookedHistogram*> BookSample(HistogramRegistry& registry, const std::string& label)
+{
+    std::vector<BookedHistogram*> hists;
+    for (const PlotVariable& v : GetPlotVariables())
+        hists.push_back(registry.Book("h" + label + "_" + v.name, label + " " + v.name + ";" + v.axis + ";Entries", v.nbins, v.lo, v.hi));
+    return hists;
+}
+
+// Histograms shown by the live monitor: E_nu, bias and relative bias of every sample
+static const int N_MONITORED = 3;
+
+void PublishToMonitor(LiveMonitor* monitor, int slot, int sample, int nSamples, const std::vector<BookedHistogram*>& hists)
+{
+    std::vector<const BookedHistogram*> shown(nSamples * N_MONITORED, nullptr);
+    for (int v = 0; v < N_MONITORED; v++)
+        shown[sample * N_MONITORED + v] = hists[kVarEnu + v];
+    monitor->Publish(slot, shown);
+}
+
+// ------------------------------------------------------------------------------------------------
+//     One task: a range of entries of one sample, filled into histograms local to the task
+//     (nRead: the entries actually read, after the index and zone map skipping)
+// ------------------------------------------------------------------------------------------------
+struct Task
+{
+    int sample;
+    Long64_t first, last;
+};
+
+bool RunTask(const SampleConfig& sample, const Task& task, HistogramRegistry& local, std::vector<BookedHistogram*>& hists, Long64_t& nSelected,
+             Long64_t& nRead, LiveMonitor* monitor = nullptr, int slot = 0, int nSamples = 0)
+{
+    TFile *file = TFile::Open(sample.file.c_str());
+    TTree *tree = file ? (TTree*) file->Get(sample.tree.c_str()) : nullptr;
+    if (!tree)
+    {
+        printf("Error: could not read %s from %s.\n", sample.tree.c_str(), sample.file.c_str());
+        delete file;
+        return false;
+    }
+
+    // Every name used by the expressions becomes a block column, read through its leaf
+    tree->SetBranchStatus("*", false);
+    std::map<std::string, std::vector<float>> columns;
+    std::vector<std::pair<TLeaf*, float*>> leaves;
+    auto resolve = [&](const std::string& name) -> const float*
+    {
+        auto it = columns.find(name);
+        if (it != columns.end())
+            return it->second.data();
+        TLeaf *leaf = tree->GetLeaf(name.c_str());
+        if (!leaf)
+            return nullptr;
+        tree->SetBranchStatus(name.c_str(), true);
+        std::vector<float>& column = columns[name];
+        column.resize(EXPR_BLOCK);
+        leaves.push_back(std::make_pair(leaf, column.data()));
+        return column.data();
+    };
+
+    ColumnExpression cut, reco, weight;
+    std::string error;
+    const float *Enu_true = resolve("Enu_true"), *Mode = resolve("Mode");
+    const float *scaleFactor = sample.useScaleFactor ? resolve("fScaleFactor") : nullptr;
+    if (!Enu_true || !Mode || (sample.useScaleFactor && !scaleFactor) || !cut.Compile(sample.cut, resolve, error)
+        || !reco.Compile(sample.reco, resolve, error) || !weight.Compile(sample.weight, resolve, error))
+    {
+        printf("Error: sample %s: %s\n", sample.label.c_str(), error.empty() ? "no Enu_true, Mode or fScaleFactor branch" : error.c_str());
+        delete file;
+        return false;
+    }
+
+    // Range cuts: on a branch, or on the bias (nullptr)
+    std::vector<const float*> rangeColumns;
+    for (const RangeCut& range : sample.ranges)
+    {
+        rangeColumns.push_back(range.variable == "bias" ? nullptr : resolve(range.variable));
+        if (range.variable != "bias" && !rangeColumns.back())
+        {
+            printf("Error: sample %s: no branch %s for the range cut.\n", sample.label.c_str(), range.variable.c_str());
+            delete file;
+            return false;
+        }
+    }
+
+    TLeaf *leafN = tree->GetLeaf("nfsp"), *leafPdg = tree->GetLeaf("pdg");
+    if (leafN && leafPdg)
+    {
+        tree->SetBranchStatus("nfsp", true);
+        tree->SetBranchStatus("pdg", true);
+    }
+
+    hists = BookSample(local, sample.label);
+    double c[EXPR_BLOCK], r[EXPR_BLOCK], w[EXPR_BLOCK];
+    int topology[EXPR_BLOCK];
+
+    // With an index selection or a zone map, only the candidate entries of the range are read
+    std::vector<Long64_t> entries;
+    bool indexed = sample.useSelection;
+    if (indexed)
+        sample.selection.AppendEntries(entries, task.first, task.last);
+    Long64_t nTask = indexed ? (Long64_t) entries.size() : task.last - task.first;
+    nRead = nTask;
+
+    for (Long64_t offset = 0; offset < nTask; offset += EXPR_BLOCK)
+    {
+        int n = (int) std::min<Long64_t>(EXPR_BLOCK, nTask - offset);
+        for (int k = 0; k < n; k++)
+        {
+            tree->GetEntry(indexed ? entries[offset + k] : task.first + offset + k);
+            for (auto& leaf : leaves)
+                leaf.second[k] = leaf.first->GetValue();
+
+            int nPions = 0, nNeutrons = 0;
+            int nParticles = leafN && leafPdg ? (int) leafN->GetValue() : 0;
+            for (int j = 0; j < nParticles; j++)
+            {
+                int apdg = abs((int) leafPdg->GetValue(j));
+                nPions    += (apdg == 211);
+                nNeutrons += (apdg == 2112);
+            }
+            topology[k] = GetTopology(nPions, nNeutrons);
+        }
+
+        cut.Evaluate(0, n, c);
+        reco.Evaluate(0, n, r);
+        weight.Evaluate(0, n, w);
+
+        for (int k = 0; k < n; k++)
+        {
+            double wk = c[k] * w[k];
+            if (wk == 0)
+                continue;
+            if (sample.efficiencyHist)
+                wk *= sample.efficiencyHist->GetBinContent(sample.efficiencyHist->FindBin(Enu_true[k]));
+            if (sample.useFluxRange && (Enu_true[k] < sample.fluxLo || Enu_true[k] > sample.fluxHi))
+                continue;
+            wk *= sample.normFactor * (scaleFactor ? scaleFactor[k] : 1.);
+
+            double diff = Enu_true[k] - r[k];
+            bool inRange = true;
+            for (size_t i = 0; i < rangeColumns.size(); i++)
+            {
+                double x = rangeColumns[i] ? rangeColumns[i][k] : diff;
+                inRange = inRange && x >= sample.ranges[i].lo && x <= sample.ranges[i].hi;
+            }
+            if (!inRange)
+                continue;
+
+            hists[kVarEnu]->Fill(Enu_true[k], wk);
+            hists[kVarBias]->Fill(diff, wk);
+            if (Enu_true[k] > 0)
+                hists[kVarBiasWeighted]->Fill(diff / Enu_true[k], wk);
+            hists[kVarBiasMode + GetModeCategory((int) Mode[k])]->Fill(diff, wk);
+            hists[kVarBiasTopology + topology[k]]->Fill(diff, wk);
+            nSelected++;
+        }
+
+        if (monitor)
+        {
+            monitor->Count(slot, n);
+            if (monitor->PublishDue(slot, n))
+                PublishToMonitor(monitor, slot, task.sample, nSamples, hists);
+        }
+    }
+
+    file->Close();
+    delete file;
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    gStyle->SetOptStat(0);
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./compare_samples.out \n- config file (one [LABEL] section per sample, see the top of CompareSamples.cpp)"
+                  << "\n- optional: -j number of threads \n- optional: --normalize (unit area overlays)"
+                  << "\n- optional: --norm entries, xsec or rate (flux normalization) \n- optional: --targets number of target nucleons for --norm rate"
+                  << "\n- optional: --out output directory \n- optional: --monitor port and/or --monitor-file path (live progress)" << std::endl;
+        return 1;
+    }
+
+    int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    bool normalize = false;
+    int normMode = kNormEntries;
+    double targets = 1;
+    std::string outputDir = "../Comparison_Plots", monitorFile;
+    int monitorPort = 0;
+    for (int a = 2; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "-j" && a + 1 < argc)
+            nThreads = std::max(1, atoi(argv[++a]));
+        else if (arg == "--normalize")
+            normalize = true;
+        else if (arg == "--norm" && a + 1 < argc)
+        {
+            if (!ParseNormalizationMode(argv[++a], normMode))
+            {
+                printf("Error: --norm must be entries, xsec or rate, not \"%s\".\n", argv[a]);
+                return 1;
+            }
+        } else if (arg == "--targets" && a + 1 < argc)
+            targets = atof(argv[++a]);
+        else if (arg == "--out" && a + 1 < argc)
+            outputDir = argv[++a];
+        else if (arg == "--monitor" && a + 1 < argc)
+            monitorPort = atoi(argv[++a]);
+        else if (arg == "--monitor-file" && a + 1 < argc)
+            monitorFile = argv[++a];
+    }
+
+    std::vector<SampleConfig> samples;
+    if (!ReadConfig(argv[1], samples))
+        return 1;
+
+    // Plots, cache and output file all go to outputDir (../Comparison_Plots by default)
+    if (gSystem->mkdir(outputDir.c_str(), true) != 0 && gSystem->AccessPathName(outputDir.c_str()))
+    {
+        printf("Error: could not create the output directory %s.\n", outputDir.c_str());
+        return 1;
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                 Entries and efficiency histograms of every sample, list of tasks
+    // ----------------------------------------------------------------------------------------------
+    HistogramRegistry registry;
+    std::vector<std::vector<BookedHistogram*>> totals;
+    std::vector<Task> tasks;
+    Long64_t totalToRead = 0;
+
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        SampleConfig& sample = samples[s];
+        TFile *file = TFile::Open(sample.file.c_str());
+        TTree *tree = file ? (TTree*) file->Get(sample.tree.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", sample.tree.c_str(), sample.file.c_str());
+            return 1;
+        }
+        sample.entries = tree->GetEntries();
+
+        // A file written by ReorderByMode.cpp has its categories as entry ranges: a selection of
+        // categories only is read from them, without the event index
+        std::vector<CategoryRange> categoryRanges;
+        if (!sample.select.empty() && ReadCategoryRanges(file, categoryRanges)
+            && SelectCategoryRanges(categoryRanges, sample.select, sample.entries, sample.selection))
+        {
+            printf("%s: \"%s\" read from the category ranges of the file\n", sample.label.c_str(), sample.select.c_str());
+            sample.useSelection = true;
+        } else if (!sample.select.empty())
+        {
+            EventIndex index;
+            std::string indexFile = EventIndexPath(sample.file), error;
+            if (!index.Load(indexFile, sample.entries, TreeSourceID(tree)))
+            {
+                printf("%s: building the event index %s\n", sample.label.c_str(), indexFile.c_str());
+                if (!index.Build(tree))
+                    return 1;
+                if (!index.Save(indexFile))
+                    printf("Warning: could not save %s, the index will be built again next time.\n", indexFile.c_str());
+            }
+            if (!index.Select(sample.select, sample.selection, error))
+            {
+                printf("Error: sample %s: %s\n", sample.label.c_str(), error.c_str());
+                return 1;
+            }
+            sample.useSelection = true;
+        }
+
+        if (!sample.ranges.empty())
+        {
+            ZoneMap zones;
+            std::string zoneFile = ZoneMapPath(sample.file);
+            if (!zones.Load(zoneFile, sample.entries, TreeSourceID(tree)))
+            {
+                printf("%s: building the zone map %s\n", sample.label.c_str(), zoneFile.c_str());
+                if (!zones.Build(tree))
+                    return 1;
+                if (!zones.Save(zoneFile))
+                    printf("Warning: could not save %s, the zone map will be built again next time.\n", zoneFile.c_str());
+            }
+
+            std::vector<RangeCut> zoneCuts = sample.ranges;
+            for (RangeCut& cut : zoneCuts)
+                if (cut.variable == "bias")
+                    cut.variable = BiasZoneColumn(sample.reco);
+
+            EntryBitmap candidates;
+            ZoneMapReport report;
+            zones.SelectClusters(zoneCuts, candidates, report);
+            if (sample.useSelection)
+                sample.selection &= candidates;
+            else
+                sample.selection = candidates;
+            sample.useSelection = true;
+            report.Print(sample.label.c_str());
+        }
+        file->Close();
+
+        if (!sample.efficiency.empty())
+        {
+            size_t colon = sample.efficiency.rfind(':');
+            TFile *effFile = TFile::Open(sample.efficiency.substr(0, colon).c_str());
+            TH1 *eff = (effFile && colon != std::string::npos) ? (TH1*) effFile->Get(sample.efficiency.substr(colon + 1).c_str()) : nullptr;
+            if (!eff)
+            {
+                printf("Error: could not read the efficiency histogram %s.\n", sample.efficiency.c_str());
+                return 1;
+            }
+            sample.efficiencyHist = registry.Own(eff);
+            effFile->Close();
+        }
+
+        // Flux normalization: integral of the flux in the range from the cached cumulative integral
+        if (normMode != kNormEntries)
+        {
+            FluxNormalization flux;
+            std::string fluxFile = sample.file, fluxHist = "FlatTree_FLUX", error;
+            if (!sample.flux.empty())
+            {
+                size_t colon = sample.flux.rfind(':');
+                fluxFile = colon == std::string::npos ? sample.file : sample.flux.substr(0, colon);
+                fluxHist = colon == std::string::npos ? sample.flux : sample.flux.substr(colon + 1);
+            }
+            if (!flux.Load(fluxFile, fluxHist, error))
+            {
+                printf("Error: sample %s: %s.\n", sample.label.c_str(), error.c_str());
+                return 1;
+            }
+            if (!sample.useFluxRange)
+            {
+                sample.fluxLo = flux.GetLow();
+                sample.fluxHi = flux.GetHigh();
+            }
+            sample.normFactor = flux.SampleFactor(normMode, sample.fluxLo, sample.fluxHi, targets);
+            sample.useScaleFactor = true;
+            printf("%-10s flux %s: %.4g in total, %.4g in [%g, %g] GeV\n", sample.label.c_str(), fluxHist.c_str(), flux.Total(),
+                   flux.Integral(sample.fluxLo, sample.fluxHi), sample.fluxLo, sample.fluxHi);
+        }
+
+        totals.push_back(BookSample(registry, sample.label));
+        Long64_t nRead = 0;
+        for (Long64_t first = 0; first < sample.entries; first += TASK_ENTRIES)
+        {
+            Long64_t last = std::min(sample.entries, first + TASK_ENTRIES), n = last - first;
+            if (sample.useSelection)
+            {
+                n = 0;
+                sample.selection.ForEach([&](Long64_t) { n++; }, first, last);
+            }
+            if (n > 0)
+                tasks.push_back({(int) s, first, last});
+            nRead += n;
+        }
+        totalToRead += nRead;
+
+        printf("%-10s %12lld entries  cut: %s  reco: %s  weight: %s%s%s\n", sample.label.c_str(), (long long) sample.entries,
+               sample.cut.c_str(), sample.reco.c_str(), sample.weight.c_str(),
+               sample.efficiency.empty() ? "" : "  efficiency: ", sample.efficiency.c_str());
+        if (sample.useSelection)
+            printf("%-10s %12lld entries to read (select: %s, %zu range cuts)\n", "", (long long) nRead,
+                   sample.select.empty() ? "all" : sample.select.c_str(), sample.ranges.size());
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                 All the tasks of all the samples on one pool of threads
+    // ----------------------------------------------------------------------------------------------
+    ROOT::EnableThreadSafety();
+    std::atomic<size_t> nextTask(0);
+    std::atomic<bool> failed(false);
+    std::mutex mergeMutex;
+    std::vector<Long64_t> selected(samples.size(), 0), read(samples.size(), 0);
+    auto start = std::chrono::steady_clock::now();
+
+    // Live monitor: one slot per thread (the task running) and one for the merged results
+    const int nWorkers = std::min<int>(nThreads, tasks.size());
+    std::unique_ptr<LiveMonitor> monitor((monitorPort > 0 || !monitorFile.empty()) ? new LiveMonitor(nWorkers + 1, totalToRead) : nullptr);
+    if (monitor)
+    {
+        std::vector<PlotVariable> variables = GetPlotVariables();
+        for (const SampleConfig& sample : samples)
+            for (int v = 0; v < N_MONITORED; v++)
+                monitor->AddHistogram(sample.label + " " + variables[kVarEnu + v].name, variables[kVarEnu + v].nbins,
+                                      variables[kVarEnu + v].lo, variables[kVarEnu + v].hi);
+        std::string error;
+        if (monitorPort > 0 && !monitor->StartHttp(monitorPort, error))
+            printf("Warning: %s, no live monitor on HTTP.\n", error.c_str());
+        if (!monitorFile.empty())
+            monitor->StartSnapshotFile(monitorFile);
+    }
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < nWorkers; t++)
+    {
+        pool.emplace_back([&, t]()
+        {
+            for (size_t i = nextTask++; i < tasks.size() && !failed; i = nextTask++)
+            {
+                const Task& task = tasks[i];
+                HistogramRegistry local;
+                std::vector<BookedHistogram*> hists;
+                Long64_t nSelected = 0, nRead = 0;
+                if (!RunTask(samples[task.sample], task, local, hists, nSelected, nRead, monitor.get(), t, samples.size()))
+                {
+                    failed = true;
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mergeMutex);
+                for (size_t h = 0; h < hists.size(); h++)
+                    totals[task.sample][h]->Add(*hists[h]);
+                selected[task.sample] += nSelected;
+                read[task.sample] += nRead;
+                if (monitor)
+                {
+                    std::vector<const BookedHistogram*> shown;
+                    for (auto& sampleTotals : totals)
+                        for (int v = 0; v < N_MONITORED; v++)
+                            shown.push_back(sampleTotals[kVarEnu + v]);
+                    monitor->Publish(nWorkers, shown);
+                    monitor->ClearSlot(t);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : pool)
+        thread.join();
+
+    if (failed)
+        return 1;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Long64_t totalEntries = 0;
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        printf("%-10s %12lld selected events (%lld of %lld entries read)\n", samples[s].label.c_str(), (long long) selected[s],
+               (long long) read[s], (long long) samples[s].entries);
+        totalEntries += read[s];
+    }
+    printf("%zu tasks on %d threads: %lld entries read in %.2f s\n", tasks.size(), nThreads, (long long) totalEntries, seconds);
+
+    // ----------------------------------------------------------------------------------------------
+    //                           Overlays of all the samples, per variable
+    // ----------------------------------------------------------------------------------------------
+    std::vector<PlotVariable> variables = GetPlotVariables();
+    PlotCache plots(outputDir + "/.plotcache"); // only the overlays that changed are rendered again
+    for (size_t v = 0; v < variables.size(); v++)
+    {
+        TCanvas *canvas = registry.Own(new TCanvas(("c_" + variables[v].name).c_str(), variables[v].name.c_str(), 800, 600));
+        TLegend *legend = registry.Own(new TLegend(0.7, 0.9 - 0.05 * samples.size(), 0.9, 0.9));
+
+        std::vector<TH1F*> hists;
+        double maximum = 0;
+        for (size_t s = 0; s < samples.size(); s++)
+        {
+            TH1F *h = registry.Materialize(totals[s][v]);
+            if (normMode == kNormXsec)
+                h->Scale(1., "width");
+            if (normalize && h->Integral() > 0)
+                h->Scale(1. / h->Integral());
+            h->SetLineColor(samples[s].color);
+            maximum = std::max(maximum, h->GetMaximum());
+            hists.push_back(h);
+        }
+        for (size_t s = 0; s < hists.size(); s++)
+        {
+            hists[s]->SetTitle((variables[v].name + ";" + variables[v].axis + (normalize ? std::string(";Normalised entries") : std::string(";") + NormalizationAxis(normMode))).c_str());
+            hists[s]->SetMaximum(1.1 * maximum);
+            hists[s]->Draw(s == 0 ? "hist" : "hist same");
+            legend->AddEntry(hists[s], samples[s].label.c_str(), "l");
+        }
+        legend->Draw();
+        plots.SaveAs(canvas, outputDir + "/compare_" + variables[v].name + ".pdf");
+    }
+
+    TFile *output = TFile::Open((outputDir + "/compare_samples.root").c_str(), "RECREATE");
+    if (output)
+    {
+        for (auto& sampleHists : totals)
+            for (BookedHistogram* booked : sampleHists)
+            {
+                TH1F *h = booked->ToTH1F();
+                if (normMode == kNormXsec)
+                    h->Scale(1., "width");
+                h->Write();
+                delete h;
+            }
+        output->Close();
+    }
+
+    registry.PrintSummary("CompareSamples");
+    plots.PrintSummary("CompareSamples");
+    return 0;
+}
@@ -0,0 +1,536 @@
+#ifndef COMPILED_FORMULA_H
+#define COMPILED_FORMULA_H
+
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TH1.h"
+#include "TTreeFormula.h"
+#include "TInterpreter.h"
+#include "ExpressionParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Replacement for a series of TTree::Project(hist, expression, cut) calls on the same tree.
+//   Expressions and cuts (same syntax as Project, Sum$() included) are translated to C++ and
+//   compiled once by the ROOT interpreter; the resulting native functions are then called for
+//   every entry, and all the histograms are filled in a single pass over the tree.
+//   Anything the translator does not understand falls back to a TTreeFormula.
+//
+//   RunNative() does not use the interpreter at all, for short jobs where declaring the code to
+//   the interpreter costs more than the loop: the strings are parsed by ExpressionParser and
+//   evaluated on blocks of EXPR_BLOCK entries (ColumnExpression), each Sum$() being evaluated over
+//   the particles of every entry and becoming one more column. Every mode reports the time from
+//   the start of Run to the first entry read.
+// ------------------------------------------------------------------------------------------------
+
+typedef double (*FormulaFunction)(void* const* branches);
+
+class FormulaFiller
+{
+public:
+    explicit FormulaFiller(TTree* tree) : fTree(tree) {}
+
+    ~FormulaFiller()
+    {
+        for (Job& job : fJobs)
+        {
+            delete job.formulaExpr;
+            delete job.formulaCut;
+        }
+    }
+
+    // Same meaning as tree->Project(hist->GetName(), expr, cut): the cut value is the event weight
+    void Add(TH1* hist, const char* expr, const char* cut = "")
+    {
+        Job job;
+        job.hist = hist;
+        job.expr = expr;
+        job.cut = cut ? cut : "";
+        fJobs.push_back(job);
+    }
+
+    // Only the first n entries (e.g. to time the startup alone); -1 for all
+    void SetMaxEntries(Long64_t n) { fMaxEntries = n; }
+
+    // interpreted = true keeps the old behaviour (one TTree::Project per histogram), for comparisons
+    void Run(bool interpreted = false)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        if (interpreted)
+        {
+            for (Job& job : fJobs)
+                fTree->Project(job.hist->GetName(), job.expr.c_str(), job.cut.c_str(), "hist", GetNEntries());
+            printf("[FormulaFiller] %zu TTree::Project calls in %.2f s\n", fJobs.size(), SecondsSince(start));
+            return;
+        }
+
+        int nCompiled = Compile();
+        double compileTime = SecondsSince(start);
+        int nFallback = 0;
+
+        for (Job& job : fJobs)
+        {
+            if (job.compiledExpr && (job.cut.empty() || job.compiledCut))
+                continue;
+            job.formulaExpr = new TTreeFormula(("fExpr_" + std::string(job.hist->GetName())).c_str(), job.expr.c_str(), fTree);
+            if (!job.cut.empty())
+                job.formulaCut = new TTreeFormula(("fCut_" + std::string(job.hist->GetName())).c_str(), job.cut.c_str(), fTree);
+            nFallback++;
+        }
+
+        // If every formula is compiled, only the branches they use are read
+        std::vector<void*> addresses(fBranches.size());
+        if (nFallback == 0)
+            fTree->SetBranchStatus("*", false);
+        for (size_t b = 0; b < fBranches.size(); b++)
+        {
+            fTree->SetBranchStatus(fBranches[b].name.c_str(), true);
+            fTree->SetBranchAddress(fBranches[b].name.c_str(), (void*) fBranches[b].storage.data());
+            addresses[b] = fBranches[b].storage.data();
+        }
+
+        auto loopStart = std::chrono::steady_clock::now();
+        Long64_t nentries = GetNEntries();
+        double firstEntry = 0;
+        for (Long64_t i = 0; i < nentries; i++)
+        {
+            fTree->GetEntry(i);
+            if (i == 0)
+                firstEntry = SecondsSince(start);
+
+            for (Job& job : fJobs)
+            {
+                if (job.formulaExpr)
+                {
+                    FillInterpreted(job);
+                    continue;
+                }
+                double w = job.compiledCut ? job.compiledCut(addresses.data()) : 1.;
+                if (w != 0)
+                    job.hist->Fill(job.compiledExpr(addresses.data()), w);
+            }
+        }
+
+        fTree->ResetBranchAddresses();
+        fTree->SetBranchStatus("*", true);
+
+        printf("[FormulaFiller] %s: %d/%zu histograms JIT-compiled in %.2f s, %d on TTreeFormula; first entry after %.3f s, %lld entries filled in %.2f s\n",
+               fTree->GetName(), nCompiled, fJobs.size(), compileTime, nFallback, firstEntry, (long long) nentries, SecondsSince(loopStart));
+    }
+
+    // Returns false (nothing filled) if an expression cannot be evaluated without the interpreter
+    bool RunNative()
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::map<std::string, NativeColumn> columns;    // scalars: one value per entry of the block
+        std::map<std::string, NativeColumn> particles;  // arrays: the values of the current entry
+        std::vector<std::unique_ptr<NativeSum>> sums;
+        std::map<std::string, const float*> sumColumns; // "Sum$N": one value per entry of the block
+        NativeSum *current = nullptr;                   // Sum$ being bound
+        std::string error, reason;                      // reason: why a name could not be resolved
+
+        fTree->SetBranchStatus("*", false);
+        auto enable = [this](TLeaf* leaf)
+        {
+            fTree->SetBranchStatus(leaf->GetBranch()->GetName(), true);
+            if (leaf->GetLeafCount())
+                fTree->SetBranchStatus(leaf->GetLeafCount()->GetBranch()->GetName(), true);
+        };
+        auto resolveScalar = [&](const std::string& name) -> const float*
+        {
+            if (sumColumns.count(name))
+                return sumColumns[name];
+            if (columns.count(name))
+                return columns[name].values.data();
+            TLeaf *leaf = fTree->GetLeaf(name.c_str());
+            if (!leaf || leaf->GetLeafCount() || leaf->GetLenStatic() > 1)
+            {
+                reason = leaf ? "array " + name + " outside Sum$" : "no branch " + name;
+                return nullptr;
+            }
+            enable(leaf);
+            NativeColumn& column = columns[name];
+            column.leaf = leaf;
+            column.values.assign(EXPR_BLOCK, 0.f);
+            return column.values.data();
+        };
+        auto resolveParticle = [&](const std::string& name) -> const float*
+        {
+            TLeaf *leaf = fTree->GetLeaf(name.c_str());
+            if (!leaf || (!leaf->GetLeafCount() && leaf->GetLenStatic() <= 1))
+            {
+                reason = leaf ? "scalar " + name + " inside Sum$" : "no branch " + name;
+                return nullptr;
+            }
+            if (!particles.count(name))
+            {
+                enable(leaf);
+                int size = leaf->GetLenStatic() * (leaf->GetLeafCount() ? std::max(1, leaf->GetLeafCount()->GetMaximum()) : 1);
+                particles[name].leaf = leaf;
+                particles[name].values.assign(std::max(1, size), 0.f);
+            }
+            if (!current->length)
+                current->length = &particles[name];
+            return particles[name].values.data();
+        };
+        // Every Sum$ of the tree becomes a column "Sum$N", its argument a ColumnExpression on the particles
+        std::function<bool(std::unique_ptr<ExprNode>&)> extractSums = [&](std::unique_ptr<ExprNode>& node)
+        {
+            if (node->type == ExprNode::kFunction && node->op == "Sum$")
+            {
+                sums.emplace_back(new NativeSum());
+                current = sums.back().get();
+                current->values.assign(EXPR_BLOCK, 0.f);
+                if (!current->inner.Compile(std::move(node->args[0]), resolveParticle, error))
+                    return false;
+                if (!current->length)
+                {
+                    reason = "Sum$ without an array branch in its argument";
+                    return false;
+                }
+                std::string name = "Sum$" + std::to_string(sums.size() - 1);
+                sumColumns[name] = current->values.data();
+                node.reset(new ExprNode());
+                node->type = ExprNode::kColumn;
+                node->name = name;
+                return true;
+            }
+            for (auto& arg : node->args)
+                if (!extractSums(arg))
+                    return false;
+            return true;
+        };
+        auto compile = [&](const std::string& text, ColumnExpression& expression)
+        {
+            std::unique_ptr<ExprNode> root = ExpressionParser::Parse(text, error);
+            return root && extractSums(root) && expression.Compile(std::move(root), resolveScalar, error);
+        };
+
+        std::vector<ColumnExpression> exprs(fJobs.size()), cuts(fJobs.size());
+        for (size_t j = 0; j < fJobs.size(); j++)
+            if (!compile(fJobs[j].expr, exprs[j]) || (!fJobs[j].cut.empty() && !compile(fJobs[j].cut, cuts[j])))
+            {
+                printf("[FormulaFiller] \"%s\" / \"%s\" cannot run without the interpreter: %s\n", fJobs[j].expr.c_str(),
+                       fJobs[j].cut.c_str(), reason.empty() ? error.c_str() : reason.c_str());
+                fTree->SetBranchStatus("*", true);
+                return false;
+            }
+        double compileTime = SecondsSince(start);
+
+        auto loopStart = std::chrono::steady_clock::now();
+        Long64_t nentries = GetNEntries();
+        double firstEntry = 0, x[EXPR_BLOCK], w[EXPR_BLOCK], values[EXPR_BLOCK];
+        for (Long64_t offset = 0; offset < nentries; offset += EXPR_BLOCK)
+        {
+            int n = (int) std::min<Long64_t>(EXPR_BLOCK, nentries - offset);
+            for (int k = 0; k < n; k++)
+            {
+                fTree->GetEntry(offset + k);
+                if (offset + k == 0)
+                    firstEntry = SecondsSince(start);
+                for (auto& column : columns)
+                    column.second.values[k] = column.second.leaf->GetValue();
+                for (auto& column : particles)
+                {
+                    int len = std::min<int>(column.second.leaf->GetLen(), column.second.values.size());
+                    for (int p = 0; p < len; p++)
+                        column.second.values[p] = column.second.leaf->GetValue(p);
+                }
+                for (auto& sum : sums)
+                {
+                    int len = std::min<int>(sum->length->leaf->GetLen(), sum->length->values.size());
+                    double total = 0;
+                    for (int p = 0; p < len; p += EXPR_BLOCK)
+                    {
+                        int m = std::min(EXPR_BLOCK, len - p);
+                        sum->inner.Evaluate(p, m, values);
+                        for (int q = 0; q < m; q++)
+                            total += values[q];
+                    }
+                    sum->values[k] = total;
+                }
+            }
+
+            for (size_t j = 0; j < fJobs.size(); j++)
+            {
+                exprs[j].Evaluate(0, n, x);
+                if (fJobs[j].cut.empty())
+                    std::fill(w, w + n, 1.);
+                else
+                    cuts[j].Evaluate(0, n, w);
+                for (int k = 0; k < n; k++)
+                    if (w[k] != 0)
+                        fJobs[j].hist->Fill(x[k], w[k]);
+            }
+        }
+
+        fTree->SetBranchStatus("*", true);
+        printf("[FormulaFiller] %s: %zu histograms parsed in %.4f s (%zu branches, %zu Sum$), no interpreter; first entry after %.3f s, %lld entries filled in %.2f s\n",
+               fTree->GetName(), fJobs.size(), compileTime, columns.size() + particles.size(), sums.size(), firstEntry,
+               (long long) nentries, SecondsSince(loopStart));
+        return true;
+    }
+
+private:
+    struct Job
+    {
+        TH1* hist;
+        std::string expr, cut;
+        FormulaFunction compiledExpr = nullptr, compiledCut = nullptr;
+        TTreeFormula *formulaExpr = nullptr, *formulaCut = nullptr;
+    };
+
+    struct BranchBuffer
+    {
+        std::string name, type;
+        std::string length;          // "" for scalars, count leaf name or fixed size for arrays
+        std::vector<double> storage; // large enough for any fundamental type
+    };
+
+    // Scalar of a block of entries, or array of the current entry
+    struct NativeColumn
+    {
+        TLeaf* leaf = nullptr;
+        std::vector<float> values;
+    };
+
+    struct NativeSum
+    {
+        ColumnExpression inner;         // evaluated on the particles
+        NativeColumn* length = nullptr; // first array of the argument: its length is the number of terms
+        std::vector<float> values;
+    };
+
+    Long64_t GetNEntries() const
+    {
+        return fMaxEntries >= 0 ? std::min(fMaxEntries, fTree->GetEntries()) : fTree->GetEntries();
+    }
+
+    static double SecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void FillInterpreted(Job& job)
+    {
+        int n = job.formulaExpr->GetNdata();
+        int nCut = job.formulaCut ? job.formulaCut->GetNdata() : 1;
+        for (int k = 0; k < n; k++)
+        {
+            double w = job.formulaCut ? job.formulaCut->EvalInstance(nCut > 1 ? k : 0) : 1.;
+            if (w != 0)
+                job.hist->Fill(job.formulaExpr->EvalInstance(k), w);
+        }
+    }
+
+    // Index of the buffer for this branch, -1 if the tree has no such leaf
+    int RequireBranch(const std::string& name)
+    {
+        auto it = fBranchIndex.find(name);
+        if (it != fBranchIndex.end())
+            return it->second;
+
+        TLeaf *leaf = fTree->GetLeaf(name.c_str());
+        if (!leaf)
+            return -1;
+
+        BranchBuffer buffer;
+        buffer.name = name;
+        buffer.type = leaf->GetTypeName();
+        int size = leaf->GetLenStatic();
+        if (leaf->GetLeafCount())
+        {
+            buffer.length = leaf->GetLeafCount()->GetName();
+            size *= std::max(1, leaf->GetLeafCount()->GetMaximum());
+            if (RequireBranch(buffer.length) < 0)
+                return -1;
+        } else if (size > 1)
+            buffer.length = std::to_string(size);
+        buffer.storage.assign(std::max(1, size), 0.);
+
+        fBranches.push_back(buffer);
+        fBranchIndex[name] = fBranches.size() - 1;
+        return fBranches.size() - 1;
+    }
+
+    // C++ code for one node; arrays are only allowed inside Sum$(), where they are indexed by k
+    bool Translate(const ExprNode* node, std::string& code, std::string* loopLength, std::string& error)
+    {
+        switch (node->type)
+        {
+            case ExprNode::kNumber:
+            {
+                char number[32];
+                snprintf(number, sizeof(number), "%.17g", node->value);
+                code = std::string("(") + number + ")";
+                return true;
+            }
+
+            case ExprNode::kColumn:
+            {
+                int index = RequireBranch(node->name);
+                if (index < 0)
+                {
+                    error = "no branch " + node->name;
+                    return false;
+                }
+                const BranchBuffer& branch = fBranches[index];
+                fUsed.insert(index);
+                if (branch.length.empty())
+                {
+                    code = "double(v_" + branch.name + ")";
+                    return true;
+                }
+                if (!loopLength || (!loopLength->empty() && *loopLength != branch.length))
+                {
+                    error = "array " + branch.name + " outside Sum$ or with a different length";
+                    return false;
+                }
+                *loopLength = branch.length;
+                if (fBranchIndex.count(branch.length))
+                    fUsed.insert(fBranchIndex[branch.length]);
+                code = "double(v_" + branch.name + "[k])";
+                return true;
+            }
+
+            case ExprNode::kUnary:
+            {
+                std::string arg;
+                if (!Translate(node->args[0].get(), arg, loopLength, error))
+                    return false;
+                code = "double(" + node->op + arg + ")";
+                return true;
+            }
+
+            case ExprNode::kBinary:
+            {
+                std::string lhs, rhs;
+                if (!Translate(node->args[0].get(), lhs, loopLength, error) || !Translate(node->args[1].get(), rhs, loopLength, error))
+                    return false;
+                code = "double(" + lhs + " " + node->op + " " + rhs + ")";
+                return true;
+            }
+
+            case ExprNode::kFunction:
+            {
+                if (node->op == "Sum$")
+                {
+                    if (loopLength)
+                    {
+                        error = "nested Sum$";
+                        return false;
+                    }
+                    std::string inner, length;
+                    if (!Translate(node->args[0].get(), inner, &length, error))
+                        return false;
+                    if (length.empty())
+                    {
+                        error = "Sum$ of a scalar";
+                        return false;
+                    }
+                    std::string bound = isdigit((unsigned char) length[0]) ? length : "v_" + length;
+                    code = "([&]{ double s = 0; for (int k = 0; k < " + bound + "; k++) s += " + inner + "; return s; }())";
+                    return true;
+                }
+
+                std::vector<std::string> args(node->args.size());
+                for (size_t a = 0; a < node->args.size(); a++)
+                    if (!Translate(node->args[a].get(), args[a], loopLength, error))
+                        return false;
+                std::string function = (node->op == "abs") ? "fabs" : node->op;
+                code = "std::" + function + "(" + args[0] + (args.size() > 1 ? ", " + args[1] : "") + ")";
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Generated function: the branches it uses are unpacked from the address table, then the value is returned
+    bool GenerateFunction(const std::string& text, const std::string& functionName, std::string& code)
+    {
+        std::string error, body;
+        fUsed.clear();
+        std::unique_ptr<ExprNode> root = ExpressionParser::Parse(text, error);
+        if (!root || !Translate(root.get(), body, nullptr, error))
+        {
+            printf("[FormulaFiller] \"%s\" will use TTreeFormula: %s\n", text.c_str(), error.c_str());
+            return false;
+        }
+
+        code += "double " + functionName + "(void* const* b)\n{\n";
+        for (int i : fUsed)
+        {
+            const BranchBuffer& branch = fBranches[i];
+            if (branch.length.empty())
+                code += "    const " + branch.type + "& v_" + branch.name + " = *(const " + branch.type + "*) b[" + std::to_string(i) + "];\n";
+            else
+                code += "    const " + branch.type + "* v_" + branch.name + " = (const " + branch.type + "*) b[" + std::to_string(i) + "];\n";
+        }
+        code += "    return " + body + ";\n}\n";
+        return true;
+    }
+
+    // Translates all the jobs, declares them to the interpreter in one go; returns how many are native
+    int Compile()
+    {
+        static int counter = 0;
+        std::string code = "#include <cmath>\n";
+        std::vector<std::pair<FormulaFunction*, std::string>> functions;
+
+        for (Job& job : fJobs)
+        {
+            int id = counter++;
+            std::string exprName = "nuscope_formula_expr_" + std::to_string(id);
+            std::string cutName  = "nuscope_formula_cut_" + std::to_string(id);
+            std::string jobCode;
+
+            if (!GenerateFunction(job.expr, exprName, jobCode))
+                continue;
+            if (!job.cut.empty() && !GenerateFunction(job.cut, cutName, jobCode))
+                continue;
+
+            code += jobCode;
+            functions.push_back(std::make_pair(&job.compiledExpr, exprName));
+            if (!job.cut.empty())
+                functions.push_back(std::make_pair(&job.compiledCut, cutName));
+        }
+
+        if (functions.empty() || !gInterpreter->Declare(code.c_str()))
+        {
+            if (!functions.empty())
+                printf("[FormulaFiller] The interpreter could not compile the generated code, using TTreeFormula.\n");
+            return 0;
+        }
+
+        for (auto& f : functions)
+            *f.first = (FormulaFunction) gInterpreter->Calc(("(long)&" + f.second).c_str());
+
+        int nCompiled = 0;
+        for (Job& job : fJobs)
+        {
+            bool ok = job.compiledExpr && (job.cut.empty() || job.compiledCut);
+            if (!ok)
+                job.compiledExpr = job.compiledCut = nullptr;
+            nCompiled += ok;
+        }
+        return nCompiled;
+    }
+
+    TTree* fTree;
+    Long64_t fMaxEntries = -1;
+    std::vector<Job> fJobs;
+    std::vector<BranchBuffer> fBranches;
+    std::map<std::string, int> fBranchIndex;
+    std::set<int> fUsed; // branches used by the function being generated
+};
+
+#endif
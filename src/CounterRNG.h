@@ -0,0 +1,121 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Counter-based random numbers (Philox4x32-10): the random numbers are a pure function of a key
+//   and a counter, e.g. key = (input file) and counter = (entry, replica block). The same event
+//   gets the same numbers whatever the order, the thread or the process that reads it, so results
+//   are reproducible and independent of how the work is split.
+// ------------------------------------------------------------------------------------------------
+inline void Philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t) 0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t) 0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t) p1;
+        c3 = (uint32_t) p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// 64-bit FNV-1a, used to turn a file name into a key
+inline uint64_t HashString(const std::string& text)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Key from the file name only (not the directory), so the same file gives the same numbers anywhere
+inline uint64_t FileKey(const std::string& fileName)
+{
+    size_t slash = fileName.find_last_of('/');
+    return HashString(slash == std::string::npos ? fileName : fileName.substr(slash + 1));
+}
+
+// Uniform number in [0, 1) from 32 random bits
+inline float ToUniform(uint32_t bits)
+{
+    return (bits >> 8) * (1.f / 16777216.f);
+}
+
+// ------------------------------------------------------------------------------------------------
+//   Poisson(1) weights of K bootstrap replicas for one event. The weights depend only on
+//   (file, entry), so every histogram filled by the event sees the same replica weights, and the
+//   correlations between histograms (and between bins of a weighted fill) are kept.
+// ------------------------------------------------------------------------------------------------
+class PoissonBootstrap
+{
+public:
+    explicit PoissonBootstrap(int nReplicas) : fWeights((nReplicas + 3) / 4 * 4, 0.f), fNReplicas(nReplicas)
+    {
+        // Thresholds of the Poisson(1) cumulative distribution in units of 2^-32: the weight of a
+        // replica is the number of thresholds its random number passes (0 with probability 1/e, ...)
+        double cdf = 0, p = std::exp(-1.);
+        for (int k = 0; k < NTHRESHOLDS; k++)
+        {
+            cdf += p;
+            p /= (k + 1);
+            fThresholds[k] = (uint32_t) std::min(4294967295.0, std::floor(cdf * 4294967296.0));
+        }
+    }
+
+    int GetNReplicas() const { return fNReplicas; }
+
+    void SetFile(const std::string& fileName)
+    {
+        uint64_t key = FileKey(fileName);
+        fKey[0] = (uint32_t) key;
+        fKey[1] = (uint32_t) (key >> 32);
+    }
+
+    // Weights of all the replicas for this entry of the current file
+    const float* Generate(long long entry)
+    {
+        for (int block = 0; block < (int) fWeights.size() / 4; block++)
+        {
+            uint32_t counter[4] = {(uint32_t) entry, (uint32_t) ((unsigned long long) entry >> 32), (uint32_t) block, 0u};
+            uint32_t bits[4];
+            Philox4x32(counter, fKey, bits);
+
+            for (int j = 0; j < 4; j++)
+            {
+                int count = 0;
+                for (int k = 0; k < NTHRESHOLDS; k++)
+                    count += (bits[j] >= fThresholds[k]);
+                fWeights[4 * block + j] = (float) count;
+            }
+        }
+        return fWeights.data();
+    }
+
+private:
+    static const int NTHRESHOLDS = 10; // P(weight > 10) ~ 1e-8
+
+    std::vector<float> fWeights;
+    int fNReplicas;
+    uint32_t fKey[2] = {0u, 0u};
+    uint32_t fThresholds[NTHRESHOLDS];
+};
+
+#endif
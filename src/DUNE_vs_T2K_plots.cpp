@@ -4,78 +4,270 @@
 #include "TCanvas.h"
 #include "TLegend.h"
 #include "TStyle.h"
+#include "SampleDefinitions.h"
+#include "PlotDefinitions.h"
+#include "RecoEstimators.h"
+#include "MasterHistogram.h"
+#include "PreviewSampler.h"
+#include "CounterRNG.h"
+#include "HistogramRegistry.h"
+#include "PlotCache.h"
+#include "PerfCounters.h"
 #include <iostream>
+#include <chrono>
 #include <cmath>
 #include <string>
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
+#include <vector>
 
 // To compile: c++ DUNE_vs_T2K_plots.cpp `root-config --cflags --libs` -o plots.out
+//
+// Every variable is filled once into a fine-binned master histogram (see MasterHistogram.h), and the
+// plotted histograms are derived from the masters. The masters are saved in
+// ../DUNE_T2K_Plots/master_histograms.root: to change binnings or ranges without reading the trees
+// again, run with ./plots.out --masters ../DUNE_T2K_Plots/master_histograms.root
+//
+// Quick look while working on the plots: ./plots.out dune.root t2k.root --preview 0.01 processes ~1% of
+// the entries, stratified by Mode category (see PreviewSampler.h), with weights rescaled to the full
+// sample, and prints the statistical uncertainty of the preview for each category. Whole clusters
+// of entries are sampled and only the needed branches are read: compare the MB read with a full run.
+//
+// Statistical error bands: ./plots.out dune.root t2k.root --bootstrap 100 fills 100 Poisson bootstrap
+// replicas of every master in the same loop (weights from CounterRNG.h, keyed on file and entry), and
+// the bias and mode-split plots are drawn with the replica spread as a band. The replicas are saved
+// with the masters, so --masters re-plots the bands too.
+//
+// Profiling: --profile reads the hardware counters (cycles, instructions, cache and branch misses, see
+// PerfCounters.h) around GetEntry and the histogram filling of every event, and prints them per stage.
+//
+// Only the plots whose content changed are rendered (see PlotCache.h, hashes in
+// ../DUNE_T2K_Plots/.plotcache); --rebuild renders all of them.
+//
+// E_reco estimators: --estimators calorimetric,qe (or all, see RecoEstimators.h) also reads the
+// four-momenta of the particles and fills one bias master per estimator, drawn on one canvas per
+// sample. Off by default, so that the default run reads the scalar branches only.
 
 // ------------------------------------------------------------------------------------------------
-//                Function to process one tree and fill histograms
+//               Master histograms of one sample (fine bins, wide ranges)
 // ------------------------------------------------------------------------------------------------
-void ProcessTree(TTree* tree,
-                 TH1F* hEnu, TH1F* hDelta, TH1F* hDeltaWeighted,
-                 TH1F* hCCQE, TH1F* hRES, TH1F* h2p2h, TH1F* hOther,
-                 TH1F* hDeltaCCQE, TH1F* hDeltaRES, TH1F* hDelta2p2h, TH1F* hDeltaOther,
-                 bool isDUNE)
+struct SampleMasters
 {
-    int Mode;
-    Float_t Enu_true, Erecoil_minerva, ELep, Enu_QE;
-    bool flag_CCINC, flag_CC0pi;
+    MasterHistogram *Enu, *Delta, *DeltaWeighted;
+    MasterHistogram *EnuMode[kNModeCategories], *DeltaMode[kNModeCategories];
+    std::vector<RecoEstimator> estimators;
+    std::vector<MasterHistogram*> DeltaEstimator; // one per estimator
+};
 
-    tree->SetBranchAddress("Mode", &Mode);
-    tree->SetBranchAddress("Enu_true", &Enu_true);
+void BookMasters(const std::string& label, SampleMasters& m, const std::vector<RecoEstimator>& estimators)
+{
+    m.Enu           = new MasterHistogram((label + "_Enu").c_str(), "E_{#nu}^{true} [GeV]", 0.01, 0, 20);
+    m.Delta         = new MasterHistogram((label + "_Delta").c_str(), "E_{#nu}^{true} - E_{#nu}^{reco} [GeV]", 0.001, -2, 4);
+    m.DeltaWeighted = new MasterHistogram((label + "_DeltaWeighted").c_str(), "(E_{#nu}^{true} - E_{#nu}^{reco})/E_{#nu}^{true}", 0.001, -2, 3);
 
-    if (isDUNE) 
+    for (int c = 0; c < kNModeCategories; c++)
     {
-        tree->SetBranchAddress("Erecoil_minerva", &Erecoil_minerva);
-        tree->SetBranchAddress("ELep", &ELep);
-        tree->SetBranchAddress("flagCCINC", &flag_CCINC);
-    } else 
+        std::string category = ModeCategoryName(c);
+        m.EnuMode[c]   = new MasterHistogram((label + "_Enu_" + category).c_str(), "E_{#nu}^{true} [GeV]", 0.01, 0, 20);
+        m.DeltaMode[c] = new MasterHistogram((label + "_Delta_" + category).c_str(), "E_{#nu}^{true} - E_{#nu}^{reco} [GeV]", 0.001, -2, 4);
+    }
+
+    m.estimators = estimators;
+    for (const RecoEstimator& estimator : estimators)
+        m.DeltaEstimator.push_back(new MasterHistogram((label + "_DeltaEstimator_" + estimator.name).c_str(),
+                                                       "E_{#nu}^{true} - E_{#nu}^{reco} [GeV]", 0.001, -2, 4));
+}
+
+bool LoadMasters(TFile* file, const std::string& label, SampleMasters& m)
+{
+    m.Enu           = MasterHistogram::Load(file, (label + "_Enu").c_str());
+    m.Delta         = MasterHistogram::Load(file, (label + "_Delta").c_str());
+    m.DeltaWeighted = MasterHistogram::Load(file, (label + "_DeltaWeighted").c_str());
+    bool ok = m.Enu && m.Delta && m.DeltaWeighted;
+
+    for (int c = 0; c < kNModeCategories; c++)
     {
-        tree->SetBranchAddress("Enu_QE", &Enu_QE);
-        tree->SetBranchAddress("flagCC0pi", &flag_CC0pi);
+        std::string category = ModeCategoryName(c);
+        m.EnuMode[c]   = MasterHistogram::Load(file, (label + "_Enu_" + category).c_str());
+        m.DeltaMode[c] = MasterHistogram::Load(file, (label + "_Delta_" + category).c_str());
+        ok = ok && m.EnuMode[c] && m.DeltaMode[c];
     }
 
-    for (Long64_t i = 0; i < tree->GetEntries(); i++) 
+    // The estimator masters are only there if the run asked for them
+    for (const RecoEstimator& estimator : GetRecoEstimators())
     {
-        tree->GetEntry(i);
+        MasterHistogram *master = MasterHistogram::Load(file, (label + "_DeltaEstimator_" + estimator.name).c_str());
+        if (!master)
+            continue;
+        m.estimators.push_back(estimator);
+        m.DeltaEstimator.push_back(master);
+    }
+    return ok;
+}
 
-        //if ((isDUNE && !flag_CCINC) || (!isDUNE && !flag_CC0pi)) // if it's DUNE and it's not CCINC, or T2K and not CC0pi...
-        //    continue; // ... skip the event (I just want CC-inclusive events for DUNE, or CC interaction with no true pions
-                      //  in the final state for T2K)
+void WriteMasters(const SampleMasters& m)
+{
+    m.Enu->Write();
+    m.Delta->Write();
+    m.DeltaWeighted->Write();
+    for (int c = 0; c < kNModeCategories; c++)
+    {
+        m.EnuMode[c]->Write();
+        m.DeltaMode[c]->Write();
+    }
+    for (MasterHistogram* master : m.DeltaEstimator)
+        master->Write();
+}
 
-        if (isDUNE && !flag_CCINC)
-            continue;   
-        if (!isDUNE && !flag_CC0pi)
-            continue;
+// Histogram of GetProcessTreePlots() (PlotDefinitions.h), from the master of its variable and Mode category
+TH1F* DerivePlot(const SampleMasters& m, const char* name)
+{
+    const PlotDefinition* plot = FindPlot(GetProcessTreePlots(), name);
+    MasterHistogram *masters[3] = {plot->category >= 0 ? m.EnuMode[plot->category] : m.Enu,
+                                   plot->category >= 0 ? m.DeltaMode[plot->category] : m.Delta, m.DeltaWeighted};
+    return masters[plot->variable]->Derive(plot->name, plot->title, plot->nbins, plot->lo, plot->hi);
+}
 
-        float reco = isDUNE ? (Erecoil_minerva + ELep) : Enu_QE;
-        float diff = Enu_true - reco;
+// With K > 0, every master also gets K bootstrap replicas
+void EnableBootstrap(SampleMasters& m, int nReplicas)
+{
+    m.Enu->EnableBootstrap(nReplicas);
+    m.Delta->EnableBootstrap(nReplicas);
+    m.DeltaWeighted->EnableBootstrap(nReplicas);
+    for (int c = 0; c < kNModeCategories; c++)
+    {
+        m.EnuMode[c]->EnableBootstrap(nReplicas);
+        m.DeltaMode[c]->EnableBootstrap(nReplicas);
+    }
+    for (MasterHistogram* master : m.DeltaEstimator)
+        master->EnableBootstrap(nReplicas);
+}
 
-        // Fill global histos
-        hEnu->Fill(Enu_true);
-        hDelta->Fill(diff);
-        hDeltaWeighted->Fill(diff / Enu_true);
+// ------------------------------------------------------------------------------------------------
+//                Function to process one tree and fill the master histograms
+// ------------------------------------------------------------------------------------------------
+// False if the particles, read for the E_reco estimators, do not fit in the buffers of FlatTreeEvent
+bool ProcessTree(TTree* tree, SampleMasters& m, bool isDUNE, const PreviewSelection* preview = nullptr,
+                 StageProfiler* profiler = nullptr)
+{
+    int stageRead = 0, stageFill = 0;
+    if (profiler)
+    {
+        stageRead = profiler->Stage(std::string(isDUNE ? "DUNE" : "T2K") + " GetEntry");
+        stageFill = profiler->Stage(std::string(isDUNE ? "DUNE" : "T2K") + " select and fill");
+    }
 
-        // Mode-separated histos
-        if (Mode == 1) 
+    // Bootstrap replica weights of each event, the same for all the histograms it fills
+    int nReplicas = m.Enu->GetNReplicas();
+    PoissonBootstrap bootstrap(std::max(nReplicas, 1));
+    if (nReplicas > 0 && tree->GetCurrentFile())
+        bootstrap.SetFile(tree->GetCurrentFile()->GetName());
+
+    // Branches, selection and values shared with ValidationHarness.cpp (PlotDefinitions.h)
+    ProcessTreeEvent event;
+    ProcessTreeValues v;
+    SetProcessTreeBranches(tree, isDUNE, event);
+
+    // The particles of the event, for the E_reco estimators only
+    FlatTreeEvent particles;
+    EstimatorInput estimatorInput;
+    if (!SetParticleBranches(tree, particles, !m.estimators.empty(), !m.estimators.empty()))
+        return false;
+
+    TFile *file = tree->GetCurrentFile();
+    Long64_t bytesBefore = file ? file->GetBytesRead() : 0;
+    auto start = std::chrono::steady_clock::now();
+
+    // In preview mode only the sampled entries are read, each one weighted by N_category / n_category
+    Long64_t nToProcess = preview ? (Long64_t) preview->entries.size() : tree->GetEntries();
+
+    for (Long64_t n = 0; n < nToProcess; n++) 
+    {
+        Long64_t i = preview ? preview->entries[n] : n;
+        double w = preview ? preview->GetWeight(i) : 1.;
+        if (profiler)
+            profiler->Enter(stageRead);
+        tree->GetEntry(i);
+        if (profiler)
         {
-            hCCQE->Fill(Enu_true);
-            hDeltaCCQE->Fill(diff);
-        } else if (Mode == 2) 
+            profiler->Enter(stageFill);
+            profiler->CountEvents();
+        }
+
+        if (!SelectProcessTree(event, isDUNE, v))
+            continue;
+
+        if (!m.estimators.empty())
         {
-            h2p2h->Fill(Enu_true);
-            hDelta2p2h->Fill(diff);
-        } else if (Mode == 11 || Mode == 12 || Mode == 13) 
+            estimatorInput.Reset();
+            estimatorInput.AddParticles(particles.nfsp, particles.pdg, particles.px, particles.py, particles.pz, particles.E);
+        }
+
+        if (nReplicas > 0)
         {
-            hRES->Fill(Enu_true);
-            hDeltaRES->Fill(diff);
-        } else 
+            const float *rw = bootstrap.Generate(i);
+            m.Enu->Fill(v.Enu, w, rw);
+            m.Delta->Fill(v.diff, w, rw);
+            m.DeltaWeighted->Fill(v.diffWeighted, w, rw);
+            m.EnuMode[v.category]->Fill(v.Enu, w, rw);
+            m.DeltaMode[v.category]->Fill(v.diff, w, rw);
+            for (size_t e = 0; e < m.estimators.size(); e++)
+                m.DeltaEstimator[e]->Fill(v.Enu - m.estimators[e].function(estimatorInput), w, rw);
+            continue;
+        }
+
+        // Fill global histos
+        m.Enu->Fill(v.Enu, w);
+        m.Delta->Fill(v.diff, w);
+        m.DeltaWeighted->Fill(v.diffWeighted, w);
+
+        // Mode-separated histos
+        m.EnuMode[v.category]->Fill(v.Enu, w);
+        m.DeltaMode[v.category]->Fill(v.diff, w);
+
+        // Bias of each E_reco estimator
+        for (size_t e = 0; e < m.estimators.size(); e++)
+            m.DeltaEstimator[e]->Fill(v.Enu - m.estimators[e].function(estimatorInput), w);
+    }
+    if (profiler)
+        profiler->Stop();
+    tree->ResetBranchAddresses();
+
+    printf("%s: %lld of %lld entries processed in %.2f s, %.1f MB read from the file\n", isDUNE ? "DUNE" : "T2K",
+           (long long) nToProcess, (long long) tree->GetEntries(),
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+           file ? (file->GetBytesRead() - bytesBefore) / 1048576. : 0.);
+    return true;
+}
+
+// Estimated number of selected events per category in the full sample, with the preview uncertainty
+void PrintPreviewUncertainties(const char* label, const SampleMasters& m)
+{
+    printf("\n%s preview estimate of the selected events:\n", label);
+    for (int c = 0; c < kNModeCategories; c++)
+    {
+        TH1D *h = m.DeltaMode[c]->GetMaster();
+        double sum = 0, sumw2 = 0;
+        for (int b = 0; b <= h->GetNbinsX() + 1; b++)
         {
-            hOther->Fill(Enu_true);
-            hDeltaOther->Fill(diff);
+            sum += h->GetBinContent(b);
+            sumw2 += h->GetBinError(b) * h->GetBinError(b);
         }
+        printf("  %-8s %12.0f +- %-10.0f (%.1f%%)\n", ModeCategoryName(c), sum, sqrt(sumw2), sum > 0 ? 100. * sqrt(sumw2) / sum : 0.);
+    }
+}
+
+// Bootstrap error band of each histogram (filled, same colour as the line), on the current pad
+void DrawBootstrapBands(HistogramRegistry& registry, std::initializer_list<TH1F*> hists)
+{
+    for (TH1F* h : hists)
+    {
+        TH1F *band = registry.Own((TH1F*) h->Clone((std::string(h->GetName()) + "_band").c_str()));
+        band->SetFillColorAlpha(h->GetLineColor(), 0.3);
+        band->SetFillStyle(1001);
+        band->SetMarkerSize(0);
+        band->Draw("E2 same");
     }
 }
 
@@ -83,102 +275,217 @@ int main(int argc, char ** argv)
 {
     gStyle->SetOptStat(0);
 
+    // Owns the derived histograms, canvases and legends, and deletes them when main returns
+    HistogramRegistry registry;
+
     // ----------------------------------------------------------------------------------------------
     //                                   Open files and TTrees
     // ----------------------------------------------------------------------------------------------
 
     if (argc < 3) 
     {
-        std::cout << "Usage: \n- ./plots.out \n- name of the DUNE .root file \n- name of the T2K .root file" << std::endl;
+        std::cout << "Usage: \n- ./plots.out \n- name of the DUNE .root file \n- name of the T2K .root file"
+                  << "\n- optional: --preview fraction (e.g. 0.01)"
+                  << "\n- optional: --bootstrap K (number of replicas for the error bands, e.g. 100)"
+                  << "\n- optional: --rebuild (render every plot, even the unchanged ones)"
+                  << "\n- optional: --profile (hardware counters per stage of the event loop)"
+                  << "\n- optional: --estimators E_reco estimators, comma-separated (" << RecoEstimatorNames() << ", or all)"
+                  << "\nor, to re-plot without reading the trees: \n- ./plots.out --masters master_histograms.root" << std::endl;
         return 1;
     }
 
     //TFile *file_DUNE = TFile::Open("/Users/anna/Developing/PhD/nuSCOPE_Test/nuSCOPE_Scripts/DUNE_T2K_ROOT_Trees/flat_Valencia_13815.root");
     //TFile *file_T2K  = TFile::Open("/Users/anna/Developing/PhD/nuSCOPE_Test/nuSCOPE_Scripts/DUNE_T2K_ROOT_Trees/flat_Valencia_2382.root");
 
-    TFile *file_DUNE = TFile::Open(argv[1]);
-    TFile *file_T2K  = TFile::Open(argv[2]);
+    SampleMasters mDUNE, mT2K;
+    TH1F *hFluxDUNE, *hFluxT2K;
+    bool fromMasters = (std::string(argv[1]) == "--masters");
+    double previewFraction = 0.;
+    int nReplicas = 0;
+    bool rebuildPlots = false, profile = false;
+    std::string estimatorList;
+    for (int a = 3; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--preview" && a + 1 < argc)
+            previewFraction = atof(argv[++a]);
+        else if (arg == "--bootstrap" && a + 1 < argc)
+            nReplicas = atoi(argv[++a]);
+        else if (arg == "--rebuild")
+            rebuildPlots = true;
+        else if (arg == "--profile")
+            profile = true;
+        else if (arg == "--estimators" && a + 1 < argc)
+            estimatorList = argv[++a];
+    }
 
-    if (!file_DUNE || !file_T2K) 
+    std::vector<RecoEstimator> estimators;
+    if (!estimatorList.empty() && !SelectRecoEstimators(estimatorList, estimators))
     {
-        printf("Error: could not open files.\n");
+        printf("Error: unknown estimator in \"%s\" (available: %s).\n", estimatorList.c_str(), RecoEstimatorNames().c_str());
         return 1;
     }
 
-    TTree *tDUNE = (TTree*) file_DUNE->Get("FlatTree_VARS");
-    TTree *tT2K  = (TTree*) file_T2K->Get("FlatTree_VARS");
+    // Plots whose content did not change since the last run are not rendered again
+    PlotCache plots("../DUNE_T2K_Plots/.plotcache");
+    plots.SetForce(rebuildPlots);
+
+    if (fromMasters)
+    {
+        TFile *file_masters = TFile::Open(argv[2]);
+        if (!file_masters || !LoadMasters(file_masters, "DUNE", mDUNE) || !LoadMasters(file_masters, "T2K", mT2K))
+        {
+            printf("Error: could not read the master histograms from %s.\n", argv[2]);
+            return 1;
+        }
+        hFluxDUNE = (TH1F*) file_masters->Get("FluxDUNE");
+        hFluxT2K  = (TH1F*) file_masters->Get("FluxT2K");
+    } else
+    {
+        TFile *file_DUNE = TFile::Open(argv[1]);
+        TFile *file_T2K  = TFile::Open(argv[2]);
+
+        if (!file_DUNE || !file_T2K) 
+        {
+            printf("Error: could not open files.\n");
+            return 1;
+        }
+
+        TTree *tDUNE = (TTree*) file_DUNE->Get("FlatTree_VARS");
+        TTree *tT2K  = (TTree*) file_T2K->Get("FlatTree_VARS");
+
+        if (!tDUNE || !tT2K) 
+        {
+            printf("Error: could not find the TTree in one of the files.\n");
+            return 1;
+        }
+
+        hFluxDUNE = (TH1F*) file_DUNE->Get("FlatTree_FLUX");
+        hFluxT2K  = (TH1F*) file_T2K->Get("FlatTree_FLUX");
 
-    if (!tDUNE || !tT2K) 
+        // ------------------------------------------------------------------------------------------
+        //                 Process both trees (filling the master histograms, once)
+        // ------------------------------------------------------------------------------------------
+        BookMasters("DUNE", mDUNE, estimators);
+        BookMasters("T2K", mT2K, estimators);
+        if (nReplicas > 0)
+        {
+            EnableBootstrap(mDUNE, nReplicas);
+            EnableBootstrap(mT2K, nReplicas);
+        }
+
+        std::unique_ptr<StageProfiler> profiler(profile ? new StageProfiler() : nullptr);
+        if (previewFraction > 0)
+        {
+            // At least 1000 events per category (or all of them), so that rare channels are populated
+            PreviewSelection previewDUNE, previewT2K;
+            BuildStratifiedPreview(tDUNE, previewFraction, 1000, 12345, previewDUNE);
+            BuildStratifiedPreview(tT2K, previewFraction, 1000, 12345, previewT2K);
+            PrintPreviewSelection("DUNE", previewDUNE);
+            PrintPreviewSelection("T2K", previewT2K);
+
+            if (!ProcessTree(tDUNE, mDUNE, true, &previewDUNE, profiler.get()) || !ProcessTree(tT2K, mT2K, false, &previewT2K, profiler.get()))
+                return 1;
+
+            PrintPreviewUncertainties("DUNE", mDUNE);
+            PrintPreviewUncertainties("T2K", mT2K);
+        } else
+        {
+            if (!ProcessTree(tDUNE, mDUNE, true, nullptr, profiler.get()) || !ProcessTree(tT2K, mT2K, false, nullptr, profiler.get()))
+                return 1;
+        }
+        if (profiler)
+            profiler->Print("ProcessTree");
+
+        // A preview never overwrites the masters of a full run
+        const char* masterFileName = previewFraction > 0 ? "../DUNE_T2K_Plots/master_histograms_preview.root"
+                                                         : "../DUNE_T2K_Plots/master_histograms.root";
+        TFile *file_masters = TFile::Open(masterFileName, "RECREATE");
+        if (file_masters)
+        {
+            WriteMasters(mDUNE);
+            WriteMasters(mT2K);
+            hFluxDUNE->Write("FluxDUNE");
+            hFluxT2K->Write("FluxT2K");
+            file_masters->Close();
+        }
+    }
+
+    if (!hFluxDUNE || !hFluxT2K)
     {
-        printf("Error: could not find the TTree in one of the files.\n");
+        printf("Error: could not find the flux histograms.\n");
         return 1;
     }
 
     // ----------------------------------------------------------------------------------------------
     //                          Nu_mu flux comparison for DUNE and T2K
     // ----------------------------------------------------------------------------------------------
-    TH1F *hFluxDUNE = (TH1F*) file_DUNE->Get("FlatTree_FLUX");
-    TH1F *hFluxT2K  = (TH1F*) file_T2K->Get("FlatTree_FLUX");
-
     hFluxDUNE->SetLineColor(kRed);
     hFluxT2K->SetLineColor(kBlue);
 
-    TCanvas *c1 = new TCanvas("c1", "DUNE flux", 800, 600);
+    TCanvas *c1 = registry.Own(new TCanvas("c1", "DUNE flux", 800, 600));
     hFluxDUNE->GetXaxis()->SetRangeUser(0, 20);
     hFluxDUNE->SetTitle("DUNE neutrino flux;E_{#nu} [MeV];Unosc #nu_{#mu}/m^{2}/POT/GeV");
     c1->SetTitle("DUNE neutrino flux");
     hFluxDUNE->Draw("hist");
-    c1->SaveAs("../DUNE_T2K_Plots/DUNE_flux.pdf");
+    plots.SaveAs(c1, "../DUNE_T2K_Plots/DUNE_flux.pdf");
 
-    TCanvas *c1_T2K = new TCanvas("c1_T2K", "T2K flux", 800, 600);
+    TCanvas *c1_T2K = registry.Own(new TCanvas("c1_T2K", "T2K flux", 800, 600));
     hFluxT2K->GetXaxis()->SetRangeUser(0, 9);
     hFluxT2K->SetTitle("T2K neutrino flux;E_{#nu} [MeV];Unosc #nu_{#mu}/m^{2}/POT/GeV");
     c1_T2K->SetTitle("T2K neutrino flux");
     hFluxT2K->Draw("hist");
-    c1_T2K->SaveAs("../DUNE_T2K_Plots/T2K_flux.pdf");
+    plots.SaveAs(c1_T2K, "../DUNE_T2K_Plots/T2K_flux.pdf");
 
     // -------------------------------------------------------------------------------------------------------------
-    //                                   Histogram definitions 
+    //                       Histogram definitions (derived from the master histograms)
     // -------------------------------------------------------------------------------------------------------------
-    TH1F *hEnuDUNE = new TH1F("hEnuDUNE", "True neutrino energy comparison;E_{#nu}^{true} [MeV];Entries", 50, 0, 10);
-    TH1F *hEnuT2K  = new TH1F("hEnuT2K", "True neutrino energy comparison;E_{#nu}^{true} [MeV];Entries", 50, 0, 10);
-    TH1F *hDeltaDUNE = new TH1F("hDeltaDUNE", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDeltaT2K  = new TH1F("hDeltaT2K", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDeltaDUNE_Weighted = new TH1F("hDeltaDUNE_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries", 50, -1, 2);
-    TH1F *hDeltaT2K_Weighted  = new TH1F("hDeltaT2K_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries", 50, -1, 2);
-
-    TH1F *hDUNE_CCQE  = new TH1F("hDUNE_CCQE", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 10);
-    TH1F *hDUNE_RES   = new TH1F("hDUNE_RES", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 10);
-    TH1F *hDUNE_2p2h  = new TH1F("hDUNE_2p2h", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 10);
-    TH1F *hDUNE_Other = new TH1F("hDUNE_Other","DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 10);
-
-    TH1F *hT2K_CCQE   = new TH1F("hT2K_CCQE", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 12);
-    TH1F *hT2K_RES    = new TH1F("hT2K_RES", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 12);
-    TH1F *hT2K_2p2h   = new TH1F("hT2K_2p2h", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 12);
-    TH1F *hT2K_Other  = new TH1F("hT2K_Other","T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", 50, 0, 12);
-
-    TH1F *hDUNE_Delta_CCQE = new TH1F("hDUNE_Delta_CCQE", "DUNE difference between true and reco #nu energy divided by channel;E_{#nu}^{true} - E_{nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDUNE_Delta_RES  = new TH1F("hDUNE_Delta_RES", "DUNE RES DeltaE;#DeltaE [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDUNE_Delta_2p2h = new TH1F("hDUNE_Delta_2p2h","DUNE 2p2h DeltaE;#DeltaE [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDUNE_Delta_Other= new TH1F("hDUNE_Delta_Other","DUNE Other DeltaE;#DeltaE [MeV];Entries", 50, -0.5, 2.5);
-
-    TH1F *hT2K_Delta_CCQE  = new TH1F("hT2K_Delta_CCQE","T2K CCQE DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Delta_RES   = new TH1F("hT2K_Delta_RES","T2K RES DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Delta_2p2h  = new TH1F("hT2K_Delta_2p2h","T2K 2p2h DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Delta_Other = new TH1F("hT2K_Delta_Other","T2K Other DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", 50, -0.5, 2.5);
-
-    // ----------------------------------------------------------------------------------------------
-    //                           Process both trees (filling histograms)
-    // ----------------------------------------------------------------------------------------------
-    ProcessTree(tDUNE, hEnuDUNE, hDeltaDUNE, hDeltaDUNE_Weighted,
-                hDUNE_CCQE, hDUNE_RES, hDUNE_2p2h, hDUNE_Other,
-                hDUNE_Delta_CCQE, hDUNE_Delta_RES, hDUNE_Delta_2p2h, hDUNE_Delta_Other,
-                true);
-
-    ProcessTree(tT2K, hEnuT2K, hDeltaT2K, hDeltaT2K_Weighted,
-                hT2K_CCQE, hT2K_RES, hT2K_2p2h, hT2K_Other,
-                hT2K_Delta_CCQE, hT2K_Delta_RES, hT2K_Delta_2p2h, hT2K_Delta_Other,
-                false);
+    TH1F *hEnuDUNE = registry.Own(DerivePlot(mDUNE, "hEnuDUNE"));
+    TH1F *hEnuT2K  = registry.Own(DerivePlot(mT2K, "hEnuT2K"));
+    TH1F *hDeltaDUNE = registry.Own(DerivePlot(mDUNE, "hDeltaDUNE"));
+    TH1F *hDeltaT2K  = registry.Own(DerivePlot(mT2K, "hDeltaT2K"));
+    TH1F *hDeltaDUNE_Weighted = registry.Own(DerivePlot(mDUNE, "hDeltaDUNE_Weighted"));
+    TH1F *hDeltaT2K_Weighted  = registry.Own(DerivePlot(mT2K, "hDeltaT2K_Weighted"));
+
+    TH1F *hDUNE_CCQE  = registry.Own(DerivePlot(mDUNE, "hDUNE_CCQE"));
+    TH1F *hDUNE_RES   = registry.Own(DerivePlot(mDUNE, "hDUNE_RES"));
+    TH1F *hDUNE_2p2h  = registry.Own(DerivePlot(mDUNE, "hDUNE_2p2h"));
+    TH1F *hDUNE_Other = registry.Own(DerivePlot(mDUNE, "hDUNE_Other"));
+
+    TH1F *hT2K_CCQE   = registry.Own(DerivePlot(mT2K, "hT2K_CCQE"));
+    TH1F *hT2K_RES    = registry.Own(DerivePlot(mT2K, "hT2K_RES"));
+    TH1F *hT2K_2p2h   = registry.Own(DerivePlot(mT2K, "hT2K_2p2h"));
+    TH1F *hT2K_Other  = registry.Own(DerivePlot(mT2K, "hT2K_Other"));
+
+    TH1F *hDUNE_Delta_CCQE = registry.Own(DerivePlot(mDUNE, "hDUNE_Delta_CCQE"));
+    TH1F *hDUNE_Delta_RES  = registry.Own(DerivePlot(mDUNE, "hDUNE_Delta_RES"));
+    TH1F *hDUNE_Delta_2p2h = registry.Own(DerivePlot(mDUNE, "hDUNE_Delta_2p2h"));
+    TH1F *hDUNE_Delta_Other= registry.Own(DerivePlot(mDUNE, "hDUNE_Delta_Other"));
+
+    TH1F *hT2K_Delta_CCQE  = registry.Own(DerivePlot(mT2K, "hT2K_Delta_CCQE"));
+    TH1F *hT2K_Delta_RES   = registry.Own(DerivePlot(mT2K, "hT2K_Delta_RES"));
+    TH1F *hT2K_Delta_2p2h  = registry.Own(DerivePlot(mT2K, "hT2K_Delta_2p2h"));
+    TH1F *hT2K_Delta_Other = registry.Own(DerivePlot(mT2K, "hT2K_Delta_Other"));
+
+    // Bootstrap errors (if the masters have replicas) on the bias and mode-split histograms
+    bool bands = mDUNE.Delta->SetBootstrapErrors(hDeltaDUNE) && mT2K.Delta->SetBootstrapErrors(hDeltaT2K);
+    if (bands)
+    {
+        mDUNE.DeltaWeighted->SetBootstrapErrors(hDeltaDUNE_Weighted);
+        mT2K.DeltaWeighted->SetBootstrapErrors(hDeltaT2K_Weighted);
+        TH1F *dune[kNModeCategories]      = {hDUNE_CCQE, hDUNE_RES, hDUNE_2p2h, hDUNE_Other};
+        TH1F *t2k[kNModeCategories]       = {hT2K_CCQE, hT2K_RES, hT2K_2p2h, hT2K_Other};
+        TH1F *duneDelta[kNModeCategories] = {hDUNE_Delta_CCQE, hDUNE_Delta_RES, hDUNE_Delta_2p2h, hDUNE_Delta_Other};
+        TH1F *t2kDelta[kNModeCategories]  = {hT2K_Delta_CCQE, hT2K_Delta_RES, hT2K_Delta_2p2h, hT2K_Delta_Other};
+        for (int c = 0; c < kNModeCategories; c++)
+        {
+            mDUNE.EnuMode[c]->SetBootstrapErrors(dune[c]);
+            mT2K.EnuMode[c]->SetBootstrapErrors(t2k[c]);
+            mDUNE.DeltaMode[c]->SetBootstrapErrors(duneDelta[c]);
+            mT2K.DeltaMode[c]->SetBootstrapErrors(t2kDelta[c]);
+        }
+        printf("Drawing bootstrap error bands (%d replicas).\n", mDUNE.Delta->GetNReplicas());
+    }
 
     // ----------------------------------------------------------------------------------------------
     //                                       Plotting
@@ -188,46 +495,50 @@ int main(int argc, char ** argv)
     hEnuDUNE->SetLineColor(kRed);
     hEnuT2K->SetLineColor(kBlue);
 
-    TCanvas *c2 = new TCanvas("c2", "True neutrino energy comparison", 800, 600);
+    TCanvas *c2 = registry.Own(new TCanvas("c2", "True neutrino energy comparison", 800, 600));
     hEnuT2K->Draw("hist");
     hEnuDUNE->Draw("hist same");
 
-    TLegend *leg2 = new TLegend(0.7, 0.75, 0.9, 0.9);
+    TLegend *leg2 = registry.Own(new TLegend(0.7, 0.75, 0.9, 0.9));
     leg2->AddEntry(hEnuDUNE, "DUNE", "l");
     leg2->AddEntry(hEnuT2K, "T2K", "l");
     leg2->Draw();
 
-    c2->SaveAs("../DUNE_T2K_Plots/true_energy_comparison.pdf");
+    plots.SaveAs(c2, "../DUNE_T2K_Plots/true_energy_comparison.pdf");
 
     // DeltaE (E_true - E_reco) comparison
     hDeltaDUNE->SetLineColor(kRed);
     hDeltaT2K->SetLineColor(kBlue);
 
-    TCanvas *c3 = new TCanvas("c3", "True - reconstructed energy comparison", 800, 600);
+    TCanvas *c3 = registry.Own(new TCanvas("c3", "True - reconstructed energy comparison", 800, 600));
     hDeltaDUNE->Draw("hist");
     hDeltaT2K->Draw("hist same");
 
-    TLegend *leg3 = new TLegend(0.7, 0.75, 0.9, 0.9);
+    TLegend *leg3 = registry.Own(new TLegend(0.7, 0.75, 0.9, 0.9));
     leg3->AddEntry(hDeltaDUNE, "DUNE", "l");
     leg3->AddEntry(hDeltaT2K, "T2K", "l");
     leg3->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hDeltaDUNE, hDeltaT2K});
 
-    c3->SaveAs("../DUNE_T2K_Plots/delta_energy_comparison.pdf");
+    plots.SaveAs(c3, "../DUNE_T2K_Plots/delta_energy_comparison.pdf");
 
     // Weighted DeltaE [(E_true - E_reco)/E_true] comparison
     hDeltaDUNE_Weighted->SetLineColor(kRed);
     hDeltaT2K_Weighted->SetLineColor(kBlue);
 
-    TCanvas *c3_2 = new TCanvas("c3_2", "Weighted True - reconstructed energy comparison", 800, 600);
+    TCanvas *c3_2 = registry.Own(new TCanvas("c3_2", "Weighted True - reconstructed energy comparison", 800, 600));
     hDeltaDUNE_Weighted->Draw("hist");
     hDeltaT2K_Weighted->Draw("hist same");
 
-    TLegend *leg3_2 = new TLegend(0.7, 0.75, 0.9, 0.9);
+    TLegend *leg3_2 = registry.Own(new TLegend(0.7, 0.75, 0.9, 0.9));
     leg3_2->AddEntry(hDeltaDUNE_Weighted, "DUNE", "l");
     leg3_2->AddEntry(hDeltaT2K_Weighted, "T2K", "l");
     leg3_2->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hDeltaDUNE_Weighted, hDeltaT2K_Weighted});
 
-    c3_2->SaveAs("../DUNE_T2K_Plots/delta_energy_comparison_weighted.pdf");
+    plots.SaveAs(c3_2, "../DUNE_T2K_Plots/delta_energy_comparison_weighted.pdf");
 
     // Mode-separated DUNE plot
     hDUNE_CCQE->SetLineColor(kGreen+2);
@@ -235,20 +546,22 @@ int main(int argc, char ** argv)
     hDUNE_2p2h->SetLineColor(kMagenta);
     hDUNE_Other->SetLineColor(kOrange);
 
-    TCanvas *c4 = new TCanvas("c4", "DUNE events divided by channels", 800, 600);
+    TCanvas *c4 = registry.Own(new TCanvas("c4", "DUNE events divided by channels", 800, 600));
     hDUNE_Other->Draw("hist");
     hDUNE_CCQE->Draw("hist same");
     hDUNE_RES->Draw("hist same");
     hDUNE_2p2h->Draw("hist same");
 
-    TLegend *leg4 = new TLegend(0.7, 0.7, 0.9, 0.9);
+    TLegend *leg4 = registry.Own(new TLegend(0.7, 0.7, 0.9, 0.9));
     leg4->AddEntry(hDUNE_CCQE, "CCQE", "l");
     leg4->AddEntry(hDUNE_RES, "RES", "l");
     leg4->AddEntry(hDUNE_2p2h, "2p2h", "l");
     leg4->AddEntry(hDUNE_Other, "Other", "l");
     leg4->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hDUNE_CCQE, hDUNE_RES, hDUNE_2p2h, hDUNE_Other});
 
-    c4->SaveAs("../DUNE_T2K_Plots/DUNE_modes.pdf");
+    plots.SaveAs(c4, "../DUNE_T2K_Plots/DUNE_modes.pdf");
 
     // Mode-separated T2K plot
     hT2K_CCQE->SetLineColor(kGreen+2);
@@ -256,20 +569,22 @@ int main(int argc, char ** argv)
     hT2K_2p2h->SetLineColor(kMagenta);
     hT2K_Other->SetLineColor(kOrange);
 
-    TCanvas *c5 = new TCanvas("c5", "T2K events divided by channels", 800, 600);
+    TCanvas *c5 = registry.Own(new TCanvas("c5", "T2K events divided by channels", 800, 600));
     hT2K_CCQE->Draw("hist");
     hT2K_RES->Draw("hist same");
     hT2K_2p2h->Draw("hist same");
     hT2K_Other->Draw("hist same");
 
-    TLegend *leg5 = new TLegend(0.7, 0.7, 0.9, 0.9);
+    TLegend *leg5 = registry.Own(new TLegend(0.7, 0.7, 0.9, 0.9));
     leg5->AddEntry(hT2K_CCQE, "CCQE", "l");
     leg5->AddEntry(hT2K_RES, "RES", "l");
     leg5->AddEntry(hT2K_2p2h, "2p2h", "l");
     leg5->AddEntry(hT2K_Other, "Other", "l");
     leg5->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hT2K_CCQE, hT2K_RES, hT2K_2p2h, hT2K_Other});
 
-    c5->SaveAs("../DUNE_T2K_Plots/T2K_modes.pdf");
+    plots.SaveAs(c5, "../DUNE_T2K_Plots/T2K_modes.pdf");
 
     // DUNE DeltaE (E_true - E_reco) by mode
     hDUNE_Delta_CCQE->SetLineColor(kGreen+2);
@@ -277,20 +592,22 @@ int main(int argc, char ** argv)
     hDUNE_Delta_2p2h->SetLineColor(kMagenta);
     hDUNE_Delta_Other->SetLineColor(kOrange);
 
-    TCanvas *c6 = new TCanvas("c6", "DUNE DeltaE by channel", 800, 600);
+    TCanvas *c6 = registry.Own(new TCanvas("c6", "DUNE DeltaE by channel", 800, 600));
     hDUNE_Delta_CCQE->Draw("hist");
     hDUNE_Delta_RES->Draw("hist same");
     hDUNE_Delta_2p2h->Draw("hist same");
     hDUNE_Delta_Other->Draw("hist same");
 
-    TLegend *leg6 = new TLegend(0.7, 0.7, 0.9, 0.9);
+    TLegend *leg6 = registry.Own(new TLegend(0.7, 0.7, 0.9, 0.9));
     leg6->AddEntry(hDUNE_Delta_CCQE, "CCQE", "l");
     leg6->AddEntry(hDUNE_Delta_RES, "RES", "l");
     leg6->AddEntry(hDUNE_Delta_2p2h, "2p2h", "l");
     leg6->AddEntry(hDUNE_Delta_Other, "Other", "l");
     leg6->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hDUNE_Delta_CCQE, hDUNE_Delta_RES, hDUNE_Delta_2p2h, hDUNE_Delta_Other});
 
-    c6->SaveAs("../DUNE_T2K_Plots/DUNE_deltaE_modes.pdf");
+    plots.SaveAs(c6, "../DUNE_T2K_Plots/DUNE_deltaE_modes.pdf");
 
     // T2K DeltaE (E_true - E_reco) by mode
     hT2K_Delta_CCQE->SetLineColor(kGreen+2);
@@ -298,26 +615,28 @@ int main(int argc, char ** argv)
     hT2K_Delta_2p2h->SetLineColor(kMagenta+1);
     hT2K_Delta_Other->SetLineColor(kOrange);
 
-    TCanvas *c7 = new TCanvas("c7", "T2K DeltaE by channel", 800, 600);
+    TCanvas *c7 = registry.Own(new TCanvas("c7", "T2K DeltaE by channel", 800, 600));
     hT2K_Delta_CCQE->SetTitle("T2K #DeltaE = E_{#nu}^{true} - E_{#nu}^{reco} by channel;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries");
     hT2K_Delta_CCQE->Draw("hist");
     hT2K_Delta_RES->Draw("hist same");
     hT2K_Delta_2p2h->Draw("hist same");
     hT2K_Delta_Other->Draw("hist same");
 
-    TLegend *leg7 = new TLegend(0.7, 0.7, 0.9, 0.9);
+    TLegend *leg7 = registry.Own(new TLegend(0.7, 0.7, 0.9, 0.9));
     leg7->AddEntry(hT2K_Delta_CCQE, "CCQE", "l");
     leg7->AddEntry(hT2K_Delta_RES, "RES", "l");
     leg7->AddEntry(hT2K_Delta_2p2h, "2p2h", "l");
     leg7->AddEntry(hT2K_Delta_Other, "Other", "l");
     leg7->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hT2K_Delta_CCQE, hT2K_Delta_RES, hT2K_Delta_2p2h, hT2K_Delta_Other});
 
-    c7->SaveAs("../DUNE_T2K_Plots/T2K_deltaE_modes.pdf");
+    plots.SaveAs(c7, "../DUNE_T2K_Plots/T2K_deltaE_modes.pdf");
 
     // ----------------------------------------------------------------------------------------------
     //                          Comparison DUNE & T2K separated by mode
     // ----------------------------------------------------------------------------------------------
-    TCanvas *c8 = new TCanvas("c8", "DeltaE mode comparison DUNE vs T2K", 800, 600);
+    TCanvas *c8 = registry.Own(new TCanvas("c8", "DeltaE mode comparison DUNE vs T2K", 800, 600));
     hDUNE_CCQE->SetLineColor(kRed);
     hT2K_CCQE->SetLineColor(kBlue);
     hDUNE_2p2h->SetLineColor(kGreen+2);
@@ -340,7 +659,7 @@ int main(int argc, char ** argv)
     // hDUNE_Other->Draw("hist same");
     hT2K_Other->Draw("hist same");
 
-    TLegend *leg8 = new TLegend(0.6, 0.6, 0.88, 0.88);
+    TLegend *leg8 = registry.Own(new TLegend(0.6, 0.6, 0.88, 0.88));
     leg8->AddEntry(hDUNE_CCQE, "DUNE CCQE", "l");
     leg8->AddEntry(hT2K_CCQE, "T2K CCQE", "l");
     leg8->AddEntry(hDUNE_2p2h, "DUNE 2p2h", "l");
@@ -350,12 +669,30 @@ int main(int argc, char ** argv)
     leg8->AddEntry(hDUNE_Other, "DUNE Other", "l");
     leg8->AddEntry(hT2K_Other, "T2K Other", "l");
     leg8->Draw();
+    if (bands)
+        DrawBootstrapBands(registry, {hDUNE_CCQE, hT2K_CCQE, hDUNE_2p2h, hT2K_2p2h, hDUNE_RES, hT2K_RES, hDUNE_Other, hT2K_Other});
 
-    c8->SaveAs("../DUNE_T2K_Plots/DUNE_T2K_modes_comparison.pdf");
+    plots.SaveAs(c8, "../DUNE_T2K_Plots/DUNE_T2K_modes_comparison.pdf");
+
+    // ----------------------------------------------------------------------------------------------
+    //                  Energy bias of the E_reco estimators (with --estimators only)
+    // ----------------------------------------------------------------------------------------------
+    for (const SampleMasters* m : {&mDUNE, &mT2K})
+    {
+        if (m->estimators.empty())
+            continue;
+        std::string label = m == &mDUNE ? "DUNE" : "T2K";
+        TCanvas *cEstimators = registry.Own(new TCanvas(("cEstimators" + label).c_str(), (label + " energy bias by estimator").c_str(), 800, 600));
+        std::vector<TH1F*> hEstimators;
+        for (size_t e = 0; e < m->estimators.size(); e++)
+            hEstimators.push_back(registry.Own(m->DeltaEstimator[e]->Derive(("hDelta" + label + "_" + m->estimators[e].name).c_str(),
+                Form("%s energy bias, %s;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", label.c_str(), m->estimators[e].title), 50, -0.5, 2.5)));
+        DrawRecoEstimators(m->estimators, hEstimators, registry.Own(new TLegend(0.6, 0.65, 0.9, 0.9)));
+        plots.SaveAs(cEstimators, ("../DUNE_T2K_Plots/" + label + "_energy_bias_estimators.pdf").c_str());
+    }
 
-    // Close files
-    file_DUNE->Close();
-    file_T2K->Close();
+    registry.PrintSummary("DUNE vs T2K plots");
+    plots.PrintSummary("DUNE vs T2K plots");
 
     return 0;
 }
\ No newline at end of file
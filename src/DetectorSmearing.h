@@ -0,0 +1,261 @@
+#ifndef DETECTOR_SMEARING_H
+#define DETECTOR_SMEARING_H
+
+#include "CounterRNG.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Toy detector response for the GENIE final state: every particle gets a threshold (on its
+//   kinetic energy), a detection efficiency and a Gaussian energy resolution
+//       sigma/E = stochastic/sqrt(E) (+) constant
+//   and E_reco is the sum of the smeared visible energies (kinetic energy for nucleons, total energy
+//   for everything else).
+//
+//   Many toys are made for each event in the same pass: the random numbers come from the counter-based
+//   generator of CounterRNG.h, keyed on (file, entry) and counted by (particle, toy), so a toy is
+//   reproducible whatever the order of the events, and the inner loops run over contiguous arrays of
+//   toys that the compiler can vectorize.
+// ------------------------------------------------------------------------------------------------
+
+enum SmearingClass { kSmearMuon = 0, kSmearEM = 1, kSmearProton = 2, kSmearChargedPion = 3, kSmearNeutron = 4,
+                     kSmearOtherHadron = 5, kNSmearingClasses = 6 };
+
+inline const char* SmearingClassName(int c)
+{
+    static const char* names[kNSmearingClasses] = {"muon", "em", "proton", "pion", "neutron", "other"};
+    return (c >= 0 && c < kNSmearingClasses) ? names[c] : "unknown";
+}
+
+struct ParticleResolution
+{
+    double threshold;   // kinetic energy threshold [GeV]
+    double stochastic;  // sigma/E = stochastic/sqrt(E) (+) constant
+    double constant;
+    double efficiency;  // detection efficiency above threshold
+};
+
+struct SmearingModel
+{
+    ParticleResolution particle[kNSmearingClasses];
+};
+
+// Default liquid argon response (order of magnitude of the DUNE/SBN numbers)
+inline SmearingModel DefaultLArModel()
+{
+    SmearingModel model;
+    model.particle[kSmearMuon]        = {0.030, 0.00, 0.04, 1.0};
+    model.particle[kSmearEM]          = {0.030, 0.15, 0.02, 1.0};
+    model.particle[kSmearProton]      = {0.040, 0.00, 0.10, 1.0};
+    model.particle[kSmearChargedPion] = {0.100, 0.00, 0.15, 1.0};
+    model.particle[kSmearNeutron]     = {0.050, 0.00, 0.40, 0.3};
+    model.particle[kSmearOtherHadron] = {0.050, 0.30, 0.05, 1.0};
+    return model;
+}
+
+// Text file, one line per class: name threshold stochastic constant efficiency ('#' starts a comment).
+// Classes that are not in the file keep the default values.
+inline bool LoadSmearingModel(const std::string& fileName, SmearingModel& model)
+{
+    std::ifstream in(fileName);
+    if (!in)
+        return false;
+
+    model = DefaultLArModel();
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::stringstream stream(line);
+        std::string name;
+        ParticleResolution resolution;
+        if (!(stream >> name))
+            continue;
+        if (!(stream >> resolution.threshold >> resolution.stochastic >> resolution.constant >> resolution.efficiency))
+        {
+            printf("Error: bad line in %s: %s\n", fileName.c_str(), line.c_str());
+            return false;
+        }
+        int c = 0;
+        while (c < kNSmearingClasses && name != SmearingClassName(c))
+            c++;
+        if (c == kNSmearingClasses)
+        {
+            printf("Error: unknown particle class %s in %s.\n", name.c_str(), fileName.c_str());
+            return false;
+        }
+        model.particle[c] = resolution;
+    }
+    return true;
+}
+
+// Class of a final-state particle, -1 for what is never seen (neutrinos, nuclear remnants)
+inline int GetSmearingClass(int pdg)
+{
+    int apdg = abs(pdg);
+    if (apdg == 12 || apdg == 14 || apdg == 16 || apdg >= 1000000000)
+        return -1;
+    if (apdg == 13 || apdg == 15)
+        return kSmearMuon;
+    if (apdg == 11 || apdg == 22 || apdg == 111)
+        return kSmearEM;
+    if (apdg == 2212)
+        return kSmearProton;
+    if (apdg == 211)
+        return kSmearChargedPion;
+    if (apdg == 2112)
+        return kSmearNeutron;
+    return kSmearOtherHadron;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                 Toys of one event: E_reco of every toy in a contiguous array
+// ------------------------------------------------------------------------------------------------
+class SmearingEngine
+{
+public:
+    SmearingEngine(const SmearingModel& model, int nToys)
+        : fModel(model), fNToys(nToys), fPadded((nToys + 3) / 4 * 4),
+          fEreco(fPadded), fGauss(fPadded), fUniform(fPadded) {}
+
+    int GetNToys() const { return fNToys; }
+
+    void SetFile(const std::string& fileName)
+    {
+        uint64_t key = FileKey(fileName);
+        fKey[0] = (uint32_t) key;
+        fKey[1] = (uint32_t) (key >> 32);
+    }
+
+    // Event interface: BeginEvent, AddParticle for every final-state particle, then Ereco()
+    void BeginEvent(long long entry)
+    {
+        fEntry = entry;
+        fParticle = 0;
+        for (int t = 0; t < fPadded; t++)
+            fEreco[t] = 0.f;
+    }
+
+    void AddParticle(int pdg, double px, double py, double pz, double E)
+    {
+        int c = GetSmearingClass(pdg);
+        if (c < 0)
+            return;
+
+        const ParticleResolution& r = fModel.particle[c];
+        double p2 = px * px + py * py + pz * pz;
+        double kinetic = E - std::sqrt(std::fmax(E * E - p2, 0.));
+        if (kinetic < r.threshold)
+        {
+            fParticle++;
+            return;
+        }
+
+        double visible = (c == kSmearProton || c == kSmearNeutron) ? kinetic : E;
+        double sigma = std::sqrt(r.stochastic * r.stochastic / std::fmax(visible, 1e-6) + r.constant * r.constant);
+
+        GenerateRandoms(fParticle++);
+
+        const float v = (float) visible, s = (float) sigma, eff = (float) r.efficiency;
+        float* ereco = fEreco.data();
+        const float* gauss = fGauss.data();
+        const float* uniform = fUniform.data();
+        for (int t = 0; t < fPadded; t++)
+        {
+            float smeared = v * (1.f + s * gauss[t]);
+            ereco[t] += (uniform[t] < eff && smeared > 0.f) ? smeared : 0.f;
+        }
+    }
+
+    const float* Ereco() const { return fEreco.data(); }
+
+private:
+    // Standard normal and uniform numbers of all the toys for one particle of the current event
+    void GenerateRandoms(int particle)
+    {
+        const float twoPi = 6.2831853f;
+        for (int block = 0; block < fPadded / 4; block++)
+        {
+            uint32_t counter[4] = {(uint32_t) fEntry, (uint32_t) ((unsigned long long) fEntry >> 32), (uint32_t) particle, (uint32_t) block};
+            uint32_t bits[4], bitsUniform[4];
+            Philox4x32(counter, fKey, bits);
+            counter[3] |= 0x80000000u; // second stream for the efficiency
+            Philox4x32(counter, fKey, bitsUniform);
+
+            for (int j = 0; j < 2; j++)
+            {
+                // Box-Muller: u1 in (0, 1] so that the logarithm is finite
+                float u1 = ((bits[2 * j] >> 8) + 1) * (1.f / 16777216.f);
+                float u2 = ToUniform(bits[2 * j + 1]);
+                float radius = std::sqrt(-2.f * std::log(u1));
+                fGauss[4 * block + 2 * j]     = radius * std::cos(twoPi * u2);
+                fGauss[4 * block + 2 * j + 1] = radius * std::sin(twoPi * u2);
+            }
+            for (int j = 0; j < 4; j++)
+                fUniform[4 * block + j] = ToUniform(bitsUniform[j]);
+        }
+    }
+
+    SmearingModel fModel;
+    int fNToys, fPadded;
+    std::vector<float> fEreco, fGauss, fUniform;
+    uint32_t fKey[2] = {0u, 0u};
+    long long fEntry = 0;
+    int fParticle = 0;
+};
+
+// ------------------------------------------------------------------------------------------------
+//   Histograms of all the toys with the same binning, stored as [toy][bin] in one array
+//   (bin 0 underflow, nbins+1 overflow); filled from the E_reco array of an event.
+// ------------------------------------------------------------------------------------------------
+class ToyHistograms
+{
+public:
+    ToyHistograms(int nToys, int nbins, double lo, double hi)
+        : fNToys(nToys), fNBins(nbins), fLo(lo), fHi(hi), fScale(nbins / (hi - lo)),
+          fContents((size_t) nToys * (nbins + 2), 0.) {}
+
+    // Adds weight w at x = offset - sign * ereco[t] for every toy (e.g. bias = Enu_true - E_reco)
+    void Fill(double offset, double sign, const float* ereco, double w)
+    {
+        const int stride = fNBins + 2;
+        for (int t = 0; t < fNToys; t++)
+        {
+            double x = offset - sign * ereco[t];
+            int bin = (x < fLo) ? 0 : (x >= fHi ? fNBins + 1 : 1 + (int) ((x - fLo) * fScale));
+            fContents[(size_t) t * stride + bin] += w;
+        }
+    }
+
+    double GetBinContent(int toy, int bin) const { return fContents[(size_t) toy * (fNBins + 2) + bin]; }
+    int GetNToys() const { return fNToys; }
+    int GetNBins() const { return fNBins; }
+    double GetLo() const { return fLo; }
+    double GetHi() const { return fHi; }
+
+    // Mean and standard deviation over the toys of one bin
+    void GetBinSpread(int bin, double& mean, double& rms) const
+    {
+        double sum = 0, sum2 = 0;
+        for (int t = 0; t < fNToys; t++)
+        {
+            double c = GetBinContent(t, bin);
+            sum += c;
+            sum2 += c * c;
+        }
+        mean = sum / fNToys;
+        rms = std::sqrt(std::fmax(sum2 / fNToys - mean * mean, 0.));
+    }
+
+private:
+    int fNToys, fNBins;
+    double fLo, fHi, fScale;
+    std::vector<double> fContents;
+};
+
+#endif
@@ -0,0 +1,495 @@
+#ifndef EVENT_INDEX_H
+#define EVENT_INDEX_H
+
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+#include "TBranch.h"
+#include "TEntryList.h"
+#include "TFile.h"
+#include "TUUID.h"
+#include "SampleDefinitions.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Bitmap index of the entries of a flat tree: one bitmap per Mode category (CCQE, RES, 2p2h,
+//   Other), per topology (0pi0n, 0piNn, Npi0n, NpiNn) and per selection flag (every flag* branch).
+//   It is built once per file (BuildEventIndex.cpp, or EventIndex::Build) and saved next to it
+//   (EventIndexPath), so that a category study only reads the matching entries.
+//
+//   Selections combine the bitmaps with & (and), | (or), ! (not) and parentheses, e.g.
+//   "RES & !0pi0n", "flagCCINC & (CCQE | 2p2h)": the result is a bitmap computed 64 entries at a
+//   time, whose entries can be iterated directly or turned into a TEntryList.
+//
+//   On disk the bitmaps are run-length compressed: runs of empty or full 64-bit words take one
+//   word, so sparse categories cost almost nothing.
+// ------------------------------------------------------------------------------------------------
+
+class EntryBitmap
+{
+public:
+    explicit EntryBitmap(Long64_t nEntries = 0) { Resize(nEntries); }
+
+    void Resize(Long64_t nEntries)
+    {
+        fN = nEntries;
+        fWords.assign((size_t) ((nEntries + 63) / 64), 0);
+    }
+
+    Long64_t Size() const { return fN; }
+    void Set(Long64_t entry) { fWords[entry >> 6] |= 1ULL << (entry & 63); }
+    bool Test(Long64_t entry) const { return (fWords[entry >> 6] >> (entry & 63)) & 1; }
+
+    // Sets all the entries of [first, last)
+    void SetRange(Long64_t first, Long64_t last)
+    {
+        for (; first < last && (first & 63); first++)
+            Set(first);
+        for (; first + 64 <= last; first += 64)
+            fWords[first >> 6] = ~0ULL;
+        for (; first < last; first++)
+            Set(first);
+    }
+
+    Long64_t Count() const
+    {
+        Long64_t n = 0;
+        for (uint64_t word : fWords)
+            n += __builtin_popcountll(word);
+        return n;
+    }
+
+    bool operator==(const EntryBitmap& other) const { return fN == other.fN && fWords == other.fWords; }
+
+    EntryBitmap& operator&=(const EntryBitmap& other)
+    {
+        for (size_t w = 0; w < fWords.size(); w++)
+            fWords[w] &= other.fWords[w];
+        return *this;
+    }
+
+    EntryBitmap& operator|=(const EntryBitmap& other)
+    {
+        for (size_t w = 0; w < fWords.size(); w++)
+            fWords[w] |= other.fWords[w];
+        return *this;
+    }
+
+    void Invert()
+    {
+        for (uint64_t& word : fWords)
+            word = ~word;
+        ClearTail();
+    }
+
+    void SetAll()
+    {
+        for (uint64_t& word : fWords)
+            word = ~0ULL;
+        ClearTail();
+    }
+
+    // Calls f(entry) for every entry set in [first, last)
+    template <class F>
+    void ForEach(F f, Long64_t first = 0, Long64_t last = -1) const
+    {
+        if (last < 0 || last > fN)
+            last = fN;
+        for (Long64_t w = first >> 6; w < (last + 63) >> 6; w++)
+        {
+            uint64_t word = fWords[w];
+            while (word)
+            {
+                Long64_t entry = (w << 6) + __builtin_ctzll(word);
+                word &= word - 1;
+                if (entry >= first && entry < last)
+                    f(entry);
+            }
+        }
+    }
+
+    void AppendEntries(std::vector<Long64_t>& entries, Long64_t first = 0, Long64_t last = -1) const
+    {
+        ForEach([&](Long64_t entry) { entries.push_back(entry); }, first, last);
+    }
+
+    // TEntryList of the entries set, e.g. for tree->SetEntryList() and TTree::Draw/Project (caller owns it)
+    TEntryList* ToEntryList(const char* name, TTree* tree) const
+    {
+        TEntryList *list = new TEntryList(name, name, tree);
+        ForEach([&](Long64_t entry) { list->Enter(entry); });
+        return list;
+    }
+
+    // Run-length compressed: header words (type << 62 | count), type 0 = empty words, 1 = full words,
+    // 2 = count literal words that follow
+    void Write(std::ostream& out) const
+    {
+        std::vector<uint64_t> encoded;
+        size_t w = 0;
+        while (w < fWords.size())
+        {
+            size_t run = w;
+            uint64_t word = fWords[w];
+            if (word == 0 || word == ~0ULL)
+            {
+                while (run < fWords.size() && fWords[run] == word)
+                    run++;
+                encoded.push_back(((word == 0 ? 0ULL : 1ULL) << 62) | (run - w));
+            } else
+            {
+                while (run < fWords.size() && fWords[run] != 0 && fWords[run] != ~0ULL)
+                    run++;
+                encoded.push_back((2ULL << 62) | (run - w));
+                encoded.insert(encoded.end(), fWords.begin() + w, fWords.begin() + run);
+            }
+            w = run;
+        }
+        uint64_t header[2] = {(uint64_t) fN, (uint64_t) encoded.size()};
+        out.write((const char*) header, sizeof(header));
+        out.write((const char*) encoded.data(), encoded.size() * sizeof(uint64_t));
+    }
+
+    // False if the bitmap is damaged, does not have nEntries entries, or needs more than bytesLeft bytes
+    bool Read(std::istream& in, uint64_t bytesLeft, Long64_t nEntries)
+    {
+        uint64_t header[2];
+        if (bytesLeft < sizeof(header) || !in.read((char*) header, sizeof(header)) || header[0] != (uint64_t) nEntries
+            || header[1] > (bytesLeft - sizeof(header)) / sizeof(uint64_t))
+            return false;
+        std::vector<uint64_t> encoded(header[1]);
+        if (!in.read((char*) encoded.data(), encoded.size() * sizeof(uint64_t)))
+            return false;
+
+        // The runs must cover exactly the words of nEntries entries, checked before decoding
+        const uint64_t nWords = (header[0] + 63) / 64;
+        uint64_t covered = 0;
+        for (size_t i = 0; i < encoded.size(); i++)
+        {
+            uint64_t type = encoded[i] >> 62, count = encoded[i] & ((1ULL << 62) - 1);
+            if (type == 3 || count > nWords - covered || (type == 2 && count >= encoded.size() - i))
+                return false;
+            covered += count;
+            if (type == 2)
+                i += count;
+        }
+        if (covered != nWords)
+            return false;
+
+        Resize(nEntries);
+        size_t w = 0;
+        for (size_t i = 0; i < encoded.size(); i++)
+        {
+            uint64_t type = encoded[i] >> 62, count = encoded[i] & ((1ULL << 62) - 1);
+            for (uint64_t k = 0; k < count; k++, w++)
+                fWords[w] = type == 0 ? 0ULL : (type == 1 ? ~0ULL : encoded[++i]);
+        }
+        ClearTail();
+        return true;
+    }
+
+private:
+    void ClearTail()
+    {
+        if (fN & 63)
+            fWords.back() &= (1ULL << (fN & 63)) - 1;
+    }
+
+    Long64_t fN = 0;
+    std::vector<uint64_t> fWords;
+};
+
+// Index file of an input file: stored next to it
+inline std::string EventIndexPath(const std::string& inputFile)
+{
+    return inputFile + ".evidx";
+}
+
+// Identity of the file a tree was read from (its UUID, new every time the file is written from
+// scratch), saved with the index and the zone map to tell a stale one from a current one
+inline std::string TreeSourceID(TTree* tree)
+{
+    TFile *file = tree->GetCurrentFile();
+    return file ? file->GetUUID().AsString() : "";
+}
+
+class EventIndex
+{
+public:
+    // Fills the bitmaps from the tree (switches on only Mode, nfsp, pdg and the flag* branches)
+    bool Build(TTree* tree)
+    {
+        fBitmaps.clear();
+        fNEntries = tree->GetEntries();
+        fSource = TreeSourceID(tree);
+
+        std::vector<std::string> flags;
+        TObjArray *branches = tree->GetListOfBranches();
+        for (int b = 0; b < branches->GetEntries(); b++)
+        {
+            std::string name = branches->At(b)->GetName();
+            if (name.compare(0, 4, "flag") == 0)
+                flags.push_back(name);
+        }
+
+        tree->SetBranchStatus("*", false);
+        const char* needed[] = {"Mode", "nfsp", "pdg"};
+        for (const char* name : needed)
+        {
+            if (!tree->GetBranch(name))
+            {
+                printf("Error: no %s branch in the tree, cannot build the event index.\n", name);
+                return false;
+            }
+            tree->SetBranchStatus(name, true);
+        }
+        std::vector<TLeaf*> flagLeaves;
+        for (const std::string& flag : flags)
+        {
+            tree->SetBranchStatus(flag.c_str(), true);
+            flagLeaves.push_back(tree->GetLeaf(flag.c_str()));
+        }
+
+        if (!CheckMaxParticles(tree))
+            return false;
+        int Mode, nfsp, pdg[MAXPARTICLES];
+        tree->SetBranchAddress("Mode", &Mode);
+        tree->SetBranchAddress("nfsp", &nfsp);
+        tree->SetBranchAddress("pdg", pdg);
+
+        std::vector<EntryBitmap*> modes, topologies, flagBitmaps;
+        for (int c = 0; c < kNModeCategories; c++)
+            modes.push_back(&Add(ModeCategoryName(c)));
+        for (int t = 0; t < kNTopologies; t++)
+            topologies.push_back(&Add(TopologyName(t)));
+        for (const std::string& flag : flags)
+            flagBitmaps.push_back(&Add(flag));
+
+        for (Long64_t i = 0; i < fNEntries; i++)
+        {
+            tree->GetEntry(i);
+            int nPions, nNeutrons;
+            CountPionsNeutrons(std::min(nfsp, MAXPARTICLES), pdg, nPions, nNeutrons);
+            modes[GetModeCategory(Mode)]->Set(i);
+            topologies[GetTopology(nPions, nNeutrons)]->Set(i);
+            for (size_t f = 0; f < flagLeaves.size(); f++)
+                if (flagLeaves[f]->GetValue() != 0)
+                    flagBitmaps[f]->Set(i);
+        }
+
+        tree->ResetBranchAddresses();
+        return true;
+    }
+
+    bool Save(const std::string& fileName) const
+    {
+        std::ofstream out(fileName, std::ios::binary);
+        if (!out)
+            return false;
+        out.write(INDEX_MAGIC, 8);
+        uint32_t sourceLength = fSource.size();
+        out.write((const char*) &sourceLength, sizeof(sourceLength));
+        out.write(fSource.data(), sourceLength);
+        uint64_t nEntries = fNEntries;
+        out.write((const char*) &nEntries, sizeof(nEntries));
+        uint32_t nBitmaps = fBitmaps.size();
+        out.write((const char*) &nBitmaps, sizeof(nBitmaps));
+        for (const auto& bitmap : fBitmaps)
+        {
+            uint32_t length = bitmap.first.size();
+            out.write((const char*) &length, sizeof(length));
+            out.write(bitmap.first.data(), length);
+            bitmap.second.Write(out);
+        }
+        return (bool) out;
+    }
+
+    // False if the file is missing, damaged, or was built for another tree: a different number of
+    // entries, or another source file (TreeSourceID) when expectedSource is given. Every size read
+    // from the file is checked against the bytes left in it before anything is allocated.
+    bool Load(const std::string& fileName, Long64_t expectedEntries = -1, const std::string& expectedSource = "")
+    {
+        fBitmaps.clear();
+        std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+        const uint64_t fileSize = in.tellg();
+        in.seekg(0);
+        auto bytesLeft = [&]() { return fileSize - (uint64_t) in.tellg(); };
+
+        char magic[8];
+        uint32_t sourceLength, nBitmaps;
+        uint64_t nEntries;
+        if (!in.read(magic, 8) || std::string(magic, 8) != std::string(INDEX_MAGIC, 8) || !in.read((char*) &sourceLength, sizeof(sourceLength))
+            || sourceLength > bytesLeft())
+            return false;
+        fSource.assign(sourceLength, ' ');
+        if (!in.read(&fSource[0], sourceLength) || !in.read((char*) &nEntries, sizeof(nEntries)) || !in.read((char*) &nBitmaps, sizeof(nBitmaps)))
+            return false;
+        fNEntries = (Long64_t) nEntries;
+        if (fNEntries < 0 || (expectedEntries >= 0 && expectedEntries != fNEntries) || (!expectedSource.empty() && expectedSource != fSource))
+            return false;
+
+        for (uint32_t b = 0; b < nBitmaps; b++)
+        {
+            uint32_t length;
+            if (!in.read((char*) &length, sizeof(length)) || length > bytesLeft())
+                return false;
+            std::string name(length, ' ');
+            if (!in.read(&name[0], length) || !fBitmaps[name].Read(in, bytesLeft(), fNEntries))
+                return false;
+        }
+        return !fBitmaps.empty() && bytesLeft() == 0;
+    }
+
+    Long64_t GetNEntries() const { return fNEntries; }
+
+    const EntryBitmap* Get(const std::string& name) const
+    {
+        auto it = fBitmaps.find(name);
+        return it == fBitmaps.end() ? nullptr : &it->second;
+    }
+
+    std::vector<std::string> GetNames() const
+    {
+        std::vector<std::string> names;
+        for (const auto& bitmap : fBitmaps)
+            names.push_back(bitmap.first);
+        return names;
+    }
+
+    // Bitmap of a selection such as "RES & (0pi0n | 0piNn) & flagCCINC"; "all" selects everything
+    bool Select(const std::string& selection, EntryBitmap& result, std::string& error) const
+    {
+        fText = selection;
+        fPos = 0;
+        error.clear();
+        if (!ParseOr(result, error))
+            return false;
+        SkipSpaces();
+        if (fPos < fText.size())
+        {
+            error = "unexpected \"" + fText.substr(fPos) + "\" in the selection";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char* INDEX_MAGIC = "EVIDX002";
+
+    EntryBitmap& Add(const std::string& name)
+    {
+        EntryBitmap& bitmap = fBitmaps[name];
+        bitmap.Resize(fNEntries);
+        return bitmap;
+    }
+
+    // Recursive descent: or := and ('|' and)* ; and := unary ('&' unary)* ; unary := '!' unary | '(' or ')' | name
+    void SkipSpaces() const
+    {
+        while (fPos < fText.size() && fText[fPos] == ' ')
+            fPos++;
+    }
+
+    bool Accept(char op) const
+    {
+        SkipSpaces();
+        if (fPos < fText.size() && fText[fPos] == op)
+        {
+            fPos++;
+            if (fPos < fText.size() && fText[fPos] == op && (op == '&' || op == '|'))
+                fPos++; // && and || too
+            return true;
+        }
+        return false;
+    }
+
+    bool ParseOr(EntryBitmap& result, std::string& error) const
+    {
+        if (!ParseAnd(result, error))
+            return false;
+        while (Accept('|'))
+        {
+            EntryBitmap rhs;
+            if (!ParseAnd(rhs, error))
+                return false;
+            result |= rhs;
+        }
+        return true;
+    }
+
+    bool ParseAnd(EntryBitmap& result, std::string& error) const
+    {
+        if (!ParseUnary(result, error))
+            return false;
+        while (Accept('&'))
+        {
+            EntryBitmap rhs;
+            if (!ParseUnary(rhs, error))
+                return false;
+            result &= rhs;
+        }
+        return true;
+    }
+
+    bool ParseUnary(EntryBitmap& result, std::string& error) const
+    {
+        if (Accept('!'))
+        {
+            if (!ParseUnary(result, error))
+                return false;
+            result.Invert();
+            return true;
+        }
+        if (Accept('('))
+        {
+            if (!ParseOr(result, error))
+                return false;
+            if (!Accept(')'))
+            {
+                error = "missing ) in the selection";
+                return false;
+            }
+            return true;
+        }
+
+        SkipSpaces();
+        size_t start = fPos;
+        while (fPos < fText.size() && (isalnum((unsigned char) fText[fPos]) || fText[fPos] == '_'))
+            fPos++;
+        std::string name = fText.substr(start, fPos - start);
+        if (name == "all")
+        {
+            result.Resize(fNEntries);
+            result.SetAll();
+            return true;
+        }
+        const EntryBitmap *bitmap = Get(name);
+        if (!bitmap)
+        {
+            std::string names;
+            for (const std::string& known : GetNames())
+                names += " " + known;
+            error = "unknown name \"" + name + "\" in the selection (index has:" + names + ")";
+            return false;
+        }
+        result = *bitmap;
+        return true;
+    }
+
+    Long64_t fNEntries = 0;
+    std::string fSource; // TreeSourceID of the indexed tree
+    std::map<std::string, EntryBitmap> fBitmaps;
+    mutable std::string fText;
+    mutable size_t fPos = 0;
+};
+
+#endif
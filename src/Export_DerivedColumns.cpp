@@ -0,0 +1,254 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "SampleDefinitions.h"
+#include "Kinematics.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// To compile: c++ Export_DerivedColumns.cpp `root-config --cflags --libs` -o export_columns.out
+//
+// Writes the per-event derived quantities (E_reco, bias, topology, ...) as one NumPy .npy file per
+// column, so that notebooks can memory-map them without copies or re-deriving anything:
+//
+//     import numpy as np
+//     bias = np.load("columns/bias.npy", mmap_mode="r")
+//
+// pyarrow.array() and pandas wrap these numeric arrays without copying as well.
+
+static const Long64_t BATCH_SIZE = 65536; // Rows kept in memory before a record block is flushed
+static const int NPY_HEADER_SIZE = 128;   // Fixed header size, so the row count can be patched at the end
+
+// ------------------------------------------------------------------------------------------------
+//          One output column: rows are appended in blocks, the header is fixed on Close()
+// ------------------------------------------------------------------------------------------------
+template <typename T>
+class NpyColumn
+{
+public:
+    NpyColumn(const std::string& path, const char* descr) : fDescr(descr), fRows(0)
+    {
+        fFile = fopen(path.c_str(), "wb");
+        if (fFile)
+            WriteHeader(); // placeholder, rewritten once the number of rows is known
+        fBuffer.reserve(BATCH_SIZE);
+    }
+
+    ~NpyColumn() { Close(); }
+
+    bool IsOpen() const { return fFile != nullptr; }
+
+    void Push(T value)
+    {
+        fBuffer.push_back(value);
+        if ((Long64_t) fBuffer.size() == BATCH_SIZE)
+            Flush();
+    }
+
+    void Flush()
+    {
+        if (!fFile || fBuffer.empty())
+            return;
+        fwrite(fBuffer.data(), sizeof(T), fBuffer.size(), fFile);
+        fRows += fBuffer.size();
+        fBuffer.clear();
+    }
+
+    void Close()
+    {
+        if (!fFile)
+            return;
+        Flush();
+        fseek(fFile, 0, SEEK_SET);
+        WriteHeader();
+        fclose(fFile);
+        fFile = nullptr;
+    }
+
+private:
+    void WriteHeader()
+    {
+        char dict[NPY_HEADER_SIZE];
+        int len = snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (%lld,), }", fDescr, (long long) fRows);
+
+        // Magic string (6) + version (2) + header length (2) + dictionary padded with spaces, ending in '\n'
+        const int dictSize = NPY_HEADER_SIZE - 10;
+        std::string header(dict, len);
+        header.append(dictSize - len - 1, ' ');
+        header += '\n';
+
+        const unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                            (unsigned char) (dictSize & 0xff), (unsigned char) (dictSize >> 8)};
+        fwrite(preamble, 1, sizeof(preamble), fFile);
+        fwrite(header.data(), 1, header.size(), fFile);
+    }
+
+    FILE* fFile;
+    const char* fDescr;
+    Long64_t fRows;
+    std::vector<T> fBuffer;
+};
+
+// ------------------------------------------------------------------------------------------------
+//                                   All the exported columns
+// ------------------------------------------------------------------------------------------------
+struct DerivedColumns
+{
+    NpyColumn<float>   Enu_true, E_reco, bias, bias_weighted, weight;
+    NpyColumn<int8_t>  mode_category, sample;
+    NpyColumn<int32_t> mode;
+    NpyColumn<int16_t> n_pi, n_n;
+    NpyColumn<float>   Q2, W, dpT, dalphaT, dphiT; // Kinematics.h, KIN_UNDEFINED when not defined
+
+    DerivedColumns(const std::string& dir)
+        : Enu_true(dir + "/Enu_true.npy", "<f4"), E_reco(dir + "/E_reco.npy", "<f4"),
+          bias(dir + "/bias.npy", "<f4"), bias_weighted(dir + "/bias_weighted.npy", "<f4"),
+          weight(dir + "/weight.npy", "<f4"),
+          mode_category(dir + "/mode_category.npy", "|i1"), sample(dir + "/sample.npy", "|i1"),
+          mode(dir + "/mode.npy", "<i4"),
+          n_pi(dir + "/n_pi.npy", "<i2"), n_n(dir + "/n_n.npy", "<i2"),
+          Q2(dir + "/Q2.npy", "<f4"), W(dir + "/W.npy", "<f4"), dpT(dir + "/dpT.npy", "<f4"),
+          dalphaT(dir + "/dalphaT.npy", "<f4"), dphiT(dir + "/dphiT.npy", "<f4") {}
+
+    bool IsOpen() const { return Enu_true.IsOpen() && n_n.IsOpen() && dphiT.IsOpen(); }
+
+    // The kinematic columns of a block of events, in the same order as the other columns
+    void PushKinematics(KinematicsBlock& block)
+    {
+        block.Compute();
+        NpyColumn<float>* columns[kNKinematicVariables] = {&Q2, &W, &dpT, &dalphaT, &dphiT};
+        for (int v = 0; v < kNKinematicVariables; v++)
+            for (int s = 0; s < block.Size(); s++)
+                columns[v]->Push(block.Get(v, s));
+        block.Clear();
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+//                Loop over one sample and append its selected events to the columns
+// ------------------------------------------------------------------------------------------------
+Long64_t ExportSample(TTree* tree, const SampleDefinition& sample, int sampleIndex, DerivedColumns& columns)
+{
+    FlatTreeEvent event;
+    if (!SetFlatTreeBranches(tree, sample, event, true, true))
+        return -1;
+    KinematicsBlock kinematics;
+
+    Long64_t nSelected = 0;
+    Long64_t nentries = tree->GetEntries();
+    for (Long64_t i = 0; i < nentries; i++)
+    {
+        tree->GetEntry(i);
+
+        if (!event.flag)
+            continue;
+
+        int nPions, nNeutrons;
+        CountPionsNeutrons(event.nfsp, event.pdg, nPions, nNeutrons);
+
+        float reco = event.GetEreco(sample.useQE);
+        float diff = event.Enu_true - reco;
+
+        columns.Enu_true.Push(event.Enu_true);
+        columns.E_reco.Push(reco);
+        columns.bias.Push(diff);
+        columns.bias_weighted.Push(event.Enu_true > 0 ? diff / event.Enu_true : 0.f);
+        columns.weight.Push(event.Weight);
+        columns.mode_category.Push((int8_t) GetModeCategory(event.Mode));
+        columns.mode.Push(event.Mode);
+        columns.n_pi.Push((int16_t) nPions);
+        columns.n_n.Push((int16_t) nNeutrons);
+        columns.sample.Push((int8_t) sampleIndex);
+        nSelected++;
+
+        kinematics.AddFlatTreeEvent(event.Enu_true, event.nfsp, event.pdg, event.px, event.py, event.pz, event.E);
+        if (kinematics.Full())
+            columns.PushKinematics(kinematics);
+    }
+    columns.PushKinematics(kinematics);
+
+    return nSelected;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: \n- ./export_columns.out \n- output directory (must exist) \n- one or more LABEL:file.root (LABEL = DUNE, T2K or nuSCOPE)" << std::endl;
+        return 1;
+    }
+
+    std::string outputDir = argv[1];
+    DerivedColumns columns(outputDir);
+
+    if (!columns.IsOpen())
+    {
+        printf("Error: could not create the output files in %s.\n", outputDir.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> labels;
+    std::vector<Long64_t> rowsPerSample;
+
+    for (int a = 2; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        size_t colon = arg.find(':');
+        SampleDefinition sample;
+
+        if (colon == std::string::npos || !GetSampleDefinition(arg.substr(0, colon), sample))
+        {
+            printf("Error: could not understand sample \"%s\" (expected LABEL:file.root).\n", arg.c_str());
+            return 1;
+        }
+
+        TFile *file = TFile::Open(arg.substr(colon + 1).c_str());
+        if (!file)
+        {
+            printf("Error: could not open %s.\n", arg.substr(colon + 1).c_str());
+            return 1;
+        }
+
+        TTree *tree = (TTree*) file->Get(sample.treeName.c_str());
+        if (!tree)
+        {
+            printf("Error: could not find the TTree in %s.\n", file->GetName());
+            return 1;
+        }
+
+        Long64_t n = ExportSample(tree, sample, (int) labels.size(), columns);
+        if (n < 0)
+            return 1;
+        std::cout << sample.label << ": exported " << n << " selected events." << std::endl;
+
+        labels.push_back(sample.label);
+        rowsPerSample.push_back(n);
+        file->Close();
+    }
+
+    columns.Enu_true.Close(); columns.E_reco.Close(); columns.bias.Close(); columns.bias_weighted.Close();
+    columns.weight.Close(); columns.mode_category.Close(); columns.sample.Close(); columns.mode.Close();
+    columns.n_pi.Close(); columns.n_n.Close();
+    columns.Q2.Close(); columns.W.Close(); columns.dpT.Close(); columns.dalphaT.Close(); columns.dphiT.Close();
+
+    // Small manifest so the notebooks know what the integer codes mean
+    std::ofstream manifest(outputDir + "/columns.json");
+    manifest << "{\n  \"samples\": [";
+    for (size_t s = 0; s < labels.size(); s++)
+        manifest << (s ? ", " : "") << "\"" << labels[s] << "\"";
+    manifest << "],\n  \"rows_per_sample\": [";
+    for (size_t s = 0; s < rowsPerSample.size(); s++)
+        manifest << (s ? ", " : "") << rowsPerSample[s];
+    manifest << "],\n  \"mode_categories\": [";
+    for (int c = 0; c < kNModeCategories; c++)
+        manifest << (c ? ", " : "") << "\"" << ModeCategoryName(c) << "\"";
+    manifest << "],\n  \"batch_size\": " << BATCH_SIZE << "\n}\n";
+
+    std::cout << "Columns written to " << outputDir << std::endl;
+
+    return 0;
+}
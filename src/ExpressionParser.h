@@ -0,0 +1,361 @@
+#ifndef EXPRESSION_PARSER_H
+#define EXPRESSION_PARSER_H
+
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Small parser for the expressions and cuts we give to TTree::Project, e.g.
+//       "Enu_true-(Erecoil_minerva+ELep)"       or       "flagCCINC * (Mode!=1) * (Mode!=2)"
+//   The parsed tree is bound to in-memory columns and evaluated one block of events at a time,
+//   so there is no per-entry interpretation overhead.
+//   Supported: numbers, column names, + - * / ! && || == != < <= > >=, parentheses and the
+//   functions abs, fabs, sqrt, exp, log, cos, sin, pow. Sum$() over array branches is parsed too,
+//   but only the tree-based evaluation (CompiledFormula.h) can run it.
+// ------------------------------------------------------------------------------------------------
+
+static const int EXPR_BLOCK = 1024; // Events evaluated together
+
+struct ExprNode
+{
+    enum Type { kNumber, kColumn, kUnary, kBinary, kFunction };
+
+    Type type;
+    std::string op;     // operator or function name
+    std::string name;   // column name
+    double value = 0;   // constant
+    const float* column = nullptr; // bound column
+    std::vector<std::unique_ptr<ExprNode>> args;
+};
+
+class ExpressionParser
+{
+public:
+    // Returns nullptr and fills error when the string cannot be parsed
+    static std::unique_ptr<ExprNode> Parse(const std::string& text, std::string& error)
+    {
+        ExpressionParser parser(text);
+        std::unique_ptr<ExprNode> node = parser.ParseOr();
+        if (node && parser.fPos < parser.fText.size())
+            parser.Fail("unexpected \"" + parser.fText.substr(parser.fPos) + "\"");
+        error = parser.fError;
+        return parser.fError.empty() ? std::move(node) : nullptr;
+    }
+
+private:
+    explicit ExpressionParser(const std::string& text) : fText(text), fPos(0) {}
+
+    void SkipSpaces()
+    {
+        while (fPos < fText.size() && isspace((unsigned char) fText[fPos]))
+            fPos++;
+    }
+
+    bool Accept(const char* token)
+    {
+        SkipSpaces();
+        size_t len = strlen(token);
+        if (fText.compare(fPos, len, token) != 0)
+            return false;
+        // Do not read "<=" as "<" or "!=" as "!"
+        if (len == 1 && fPos + 1 < fText.size() && fText[fPos + 1] == '=' && strchr("<>!=", token[0]))
+            return false;
+        fPos += len;
+        return true;
+    }
+
+    void Fail(const std::string& message)
+    {
+        if (fError.empty())
+            fError = message + " (at position " + std::to_string(fPos) + ")";
+    }
+
+    static std::unique_ptr<ExprNode> MakeBinary(const std::string& op, std::unique_ptr<ExprNode> lhs, std::unique_ptr<ExprNode> rhs)
+    {
+        std::unique_ptr<ExprNode> node(new ExprNode);
+        node->type = ExprNode::kBinary;
+        node->op = op;
+        node->args.push_back(std::move(lhs));
+        node->args.push_back(std::move(rhs));
+        return node;
+    }
+
+    std::unique_ptr<ExprNode> ParseOr()
+    {
+        std::unique_ptr<ExprNode> lhs = ParseAnd();
+        while (lhs && Accept("||"))
+            lhs = MakeBinary("||", std::move(lhs), ParseAnd());
+        return lhs;
+    }
+
+    std::unique_ptr<ExprNode> ParseAnd()
+    {
+        std::unique_ptr<ExprNode> lhs = ParseComparison();
+        while (lhs && Accept("&&"))
+            lhs = MakeBinary("&&", std::move(lhs), ParseComparison());
+        return lhs;
+    }
+
+    std::unique_ptr<ExprNode> ParseComparison()
+    {
+        std::unique_ptr<ExprNode> lhs = ParseSum();
+        static const char* ops[] = {"==", "!=", "<=", ">=", "<", ">"};
+        while (lhs)
+        {
+            const char* found = nullptr;
+            for (const char* op : ops)
+                if (Accept(op)) { found = op; break; }
+            if (!found)
+                break;
+            lhs = MakeBinary(found, std::move(lhs), ParseSum());
+        }
+        return lhs;
+    }
+
+    std::unique_ptr<ExprNode> ParseSum()
+    {
+        std::unique_ptr<ExprNode> lhs = ParseProduct();
+        while (lhs)
+        {
+            if (Accept("+"))
+                lhs = MakeBinary("+", std::move(lhs), ParseProduct());
+            else if (Accept("-"))
+                lhs = MakeBinary("-", std::move(lhs), ParseProduct());
+            else
+                break;
+        }
+        return lhs;
+    }
+
+    std::unique_ptr<ExprNode> ParseProduct()
+    {
+        std::unique_ptr<ExprNode> lhs = ParseUnary();
+        while (lhs)
+        {
+            if (Accept("*"))
+                lhs = MakeBinary("*", std::move(lhs), ParseUnary());
+            else if (Accept("/"))
+                lhs = MakeBinary("/", std::move(lhs), ParseUnary());
+            else
+                break;
+        }
+        return lhs;
+    }
+
+    std::unique_ptr<ExprNode> ParseUnary()
+    {
+        const char* op = Accept("-") ? "-" : (Accept("!") ? "!" : nullptr);
+        if (!op)
+            return ParsePrimary();
+
+        std::unique_ptr<ExprNode> operand = ParseUnary();
+        if (!operand)
+            return nullptr;
+        std::unique_ptr<ExprNode> node(new ExprNode);
+        node->type = ExprNode::kUnary;
+        node->op = op;
+        node->args.push_back(std::move(operand));
+        return node;
+    }
+
+    std::unique_ptr<ExprNode> ParsePrimary()
+    {
+        SkipSpaces();
+        if (fPos >= fText.size())
+        {
+            Fail("unexpected end of expression");
+            return nullptr;
+        }
+
+        if (Accept("("))
+        {
+            std::unique_ptr<ExprNode> inner = ParseOr();
+            if (inner && !Accept(")"))
+                Fail("missing \")\"");
+            return inner;
+        }
+
+        char c = fText[fPos];
+        if (isdigit((unsigned char) c) || c == '.')
+        {
+            char* end = nullptr;
+            std::unique_ptr<ExprNode> node(new ExprNode);
+            node->type = ExprNode::kNumber;
+            node->value = strtod(fText.c_str() + fPos, &end);
+            fPos = end - fText.c_str();
+            return node;
+        }
+
+        if (isalpha((unsigned char) c) || c == '_')
+        {
+            size_t start = fPos;
+            while (fPos < fText.size() && (isalnum((unsigned char) fText[fPos]) || fText[fPos] == '_' || fText[fPos] == '$'))
+                fPos++;
+            std::string word = fText.substr(start, fPos - start);
+
+            std::unique_ptr<ExprNode> node(new ExprNode);
+            if (Accept("("))
+            {
+                node->type = ExprNode::kFunction;
+                node->op = word;
+                do
+                {
+                    std::unique_ptr<ExprNode> arg = ParseOr();
+                    if (!arg)
+                        return nullptr;
+                    node->args.push_back(std::move(arg));
+                } while (Accept(","));
+                if (!Accept(")"))
+                    Fail("missing \")\" after arguments of " + word);
+                if (!IsKnownFunction(word, node->args.size()))
+                    Fail("unsupported function " + word);
+            } else
+            {
+                node->type = ExprNode::kColumn;
+                node->name = word;
+            }
+            return node;
+        }
+
+        Fail(std::string("unexpected character '") + c + "'");
+        return nullptr;
+    }
+
+    static bool IsKnownFunction(const std::string& name, size_t nargs)
+    {
+        if (name == "pow")
+            return nargs == 2;
+        if (name == "Sum$")
+            return nargs == 1;
+        return nargs == 1 && (name == "abs" || name == "fabs" || name == "sqrt" || name == "exp" ||
+                              name == "log" || name == "cos" || name == "sin");
+    }
+
+    std::string fText;
+    size_t fPos;
+    std::string fError;
+};
+
+// ------------------------------------------------------------------------------------------------
+//   Expression bound to in-memory float columns (e.g. loaded once by a resident process)
+// ------------------------------------------------------------------------------------------------
+class ColumnExpression
+{
+public:
+    typedef std::function<const float*(const std::string&)> ColumnResolver;
+
+    // Parses and binds every column name; returns false (and an error message) on failure
+    bool Compile(const std::string& text, const ColumnResolver& resolve, std::string& error)
+    {
+        fRoot = ExpressionParser::Parse(text, error);
+        return fRoot && Bind(fRoot.get(), resolve, error);
+    }
+
+    // Same, from an already parsed tree (e.g. with its Sum$ terms replaced by columns)
+    bool Compile(std::unique_ptr<ExprNode> root, const ColumnResolver& resolve, std::string& error)
+    {
+        fRoot = std::move(root);
+        return fRoot && Bind(fRoot.get(), resolve, error);
+    }
+
+    // out[k] = value of the expression for event (first + k), for k < n <= EXPR_BLOCK
+    void Evaluate(long long first, int n, double* out) const { Evaluate(fRoot.get(), first, n, out); }
+
+private:
+    static bool Bind(ExprNode* node, const ColumnResolver& resolve, std::string& error)
+    {
+        if (node->type == ExprNode::kFunction && node->op == "Sum$")
+        {
+            error = "Sum$ needs array branches, not available on columns";
+            return false;
+        }
+        if (node->type == ExprNode::kColumn)
+        {
+            node->column = resolve(node->name);
+            if (!node->column)
+            {
+                error = "unknown column " + node->name;
+                return false;
+            }
+        }
+        for (auto& arg : node->args)
+            if (!Bind(arg.get(), resolve, error))
+                return false;
+        return true;
+    }
+
+    static void Evaluate(const ExprNode* node, long long first, int n, double* out)
+    {
+        switch (node->type)
+        {
+            case ExprNode::kNumber:
+                for (int k = 0; k < n; k++) out[k] = node->value;
+                return;
+
+            case ExprNode::kColumn:
+            {
+                const float* col = node->column + first;
+                for (int k = 0; k < n; k++) out[k] = col[k];
+                return;
+            }
+
+            case ExprNode::kUnary:
+                Evaluate(node->args[0].get(), first, n, out);
+                if (node->op == "-")
+                    for (int k = 0; k < n; k++) out[k] = -out[k];
+                else
+                    for (int k = 0; k < n; k++) out[k] = (out[k] == 0);
+                return;
+
+            case ExprNode::kFunction:
+            {
+                Evaluate(node->args[0].get(), first, n, out);
+                const std::string& f = node->op;
+                if (f == "pow")
+                {
+                    double rhs[EXPR_BLOCK];
+                    Evaluate(node->args[1].get(), first, n, rhs);
+                    for (int k = 0; k < n; k++) out[k] = std::pow(out[k], rhs[k]);
+                }
+                else if (f == "abs" || f == "fabs") for (int k = 0; k < n; k++) out[k] = std::fabs(out[k]);
+                else if (f == "sqrt") for (int k = 0; k < n; k++) out[k] = std::sqrt(out[k]);
+                else if (f == "exp")  for (int k = 0; k < n; k++) out[k] = std::exp(out[k]);
+                else if (f == "log")  for (int k = 0; k < n; k++) out[k] = std::log(out[k]);
+                else if (f == "cos")  for (int k = 0; k < n; k++) out[k] = std::cos(out[k]);
+                else if (f == "sin")  for (int k = 0; k < n; k++) out[k] = std::sin(out[k]);
+                return;
+            }
+
+            case ExprNode::kBinary:
+            {
+                double rhs[EXPR_BLOCK];
+                Evaluate(node->args[0].get(), first, n, out);
+                Evaluate(node->args[1].get(), first, n, rhs);
+                const std::string& op = node->op;
+                if      (op == "+")  for (int k = 0; k < n; k++) out[k] = out[k] + rhs[k];
+                else if (op == "-")  for (int k = 0; k < n; k++) out[k] = out[k] - rhs[k];
+                else if (op == "*")  for (int k = 0; k < n; k++) out[k] = out[k] * rhs[k];
+                else if (op == "/")  for (int k = 0; k < n; k++) out[k] = out[k] / rhs[k];
+                else if (op == "==") for (int k = 0; k < n; k++) out[k] = (out[k] == rhs[k]);
+                else if (op == "!=") for (int k = 0; k < n; k++) out[k] = (out[k] != rhs[k]);
+                else if (op == "<")  for (int k = 0; k < n; k++) out[k] = (out[k] <  rhs[k]);
+                else if (op == "<=") for (int k = 0; k < n; k++) out[k] = (out[k] <= rhs[k]);
+                else if (op == ">")  for (int k = 0; k < n; k++) out[k] = (out[k] >  rhs[k]);
+                else if (op == ">=") for (int k = 0; k < n; k++) out[k] = (out[k] >= rhs[k]);
+                else if (op == "&&") for (int k = 0; k < n; k++) out[k] = (out[k] != 0 && rhs[k] != 0);
+                else if (op == "||") for (int k = 0; k < n; k++) out[k] = (out[k] != 0 || rhs[k] != 0);
+                return;
+            }
+        }
+    }
+
+    std::unique_ptr<ExprNode> fRoot;
+};
+
+#endif
@@ -0,0 +1,278 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH2D.h"
+#include "TGraphErrors.h"
+#include "TCanvas.h"
+#include "TLegend.h"
+#include "TStyle.h"
+#include "TSystem.h"
+#include "SampleDefinitions.h"
+#include "SliceFitter.h"
+#include "HistogramRegistry.h"
+#include "PlotCache.h"
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// To compile: c++ FitBiasSlices.cpp `root-config --cflags --libs` -O2 -pthread -o fit_bias_slices.out
+//
+// Energy bias (E_nu^true - E_reco)/E_nu^true and energy resolution as functions of E_nu^true: the
+// bias distribution of every E_nu^true slice is fitted (SliceFitter.h) with a Gaussian and with an
+// asymmetric Gaussian, for all the selected events and for each Mode category of each sample. The
+// fits of a series of slices start from the result of the neighbouring slice, and the series are
+// fitted in parallel.
+//
+//     ./fit_bias_slices.out DUNE=flat_Valencia_13815.root T2K=flat_Valencia_2382.root
+//         [--enu 20 0 10] [--bias 120 -1 2] [--core 2] [--min 20] [-j threads] [--out ../BiasFits]
+//
+// The fits are binned Poisson likelihood fits of the unweighted counts. --core k fits only the core
+// [mean - k sigma_L, mean + k sigma_R] of each slice (0: the whole range).
+
+const int N_FIT_CATEGORIES = kNModeCategories + 1; // the Mode categories and all the events
+const char* FitCategoryName(int c) { return c == kNModeCategories ? "All" : ModeCategoryName(c); }
+
+int main(int argc, char ** argv)
+{
+    gStyle->SetOptStat(0);
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./fit_bias_slices.out \n- LABEL=file.root for each sample (DUNE, T2K or nuSCOPE)"
+                  << "\n- optional: --enu number of slices, lo, hi in GeV (default 20 0 10)"
+                  << "\n- optional: --bias number of bins, lo, hi of (E_true - E_reco)/E_true (default 120 -1 2)"
+                  << "\n- optional: --core fitted range in sigmas around the peak, 0 for all (default 2)"
+                  << "\n- optional: --min minimum number of entries of a fitted slice (default 20)"
+                  << "\n- optional: -j number of threads (default: all the cores) \n- optional: --out directory (default ../BiasFits)" << std::endl;
+        return 1;
+    }
+
+    std::vector<SampleDefinition> samples;
+    std::vector<std::string> files;
+    int nSlices = 20, nBias = 120, minEntries = 20, nThreads = std::max(1u, std::thread::hardware_concurrency());
+    double enuLo = 0, enuHi = 10, biasLo = -1, biasHi = 2, coreSigmas = 2;
+    std::string outputDir = "../BiasFits";
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--enu" && a + 3 < argc)
+        {
+            nSlices = std::max(1, atoi(argv[a + 1]));
+            enuLo = atof(argv[a + 2]);
+            enuHi = atof(argv[a + 3]);
+            a += 3;
+        } else if (arg == "--bias" && a + 3 < argc)
+        {
+            nBias = std::max(5, atoi(argv[a + 1]));
+            biasLo = atof(argv[a + 2]);
+            biasHi = atof(argv[a + 3]);
+            a += 3;
+        } else if (arg == "--core" && a + 1 < argc)
+            coreSigmas = atof(argv[++a]);
+        else if (arg == "--min" && a + 1 < argc)
+            minEntries = atoi(argv[++a]);
+        else if (arg == "-j" && a + 1 < argc)
+            nThreads = std::max(1, atoi(argv[++a]));
+        else if (arg == "--out" && a + 1 < argc)
+            outputDir = argv[++a];
+        else
+        {
+            size_t equal = arg.find('=');
+            SampleDefinition sample;
+            if (equal == std::string::npos || !GetSampleDefinition(arg.substr(0, equal), sample))
+            {
+                printf("Error: \"%s\" is not LABEL=file.root with LABEL DUNE, T2K or nuSCOPE.\n", arg.c_str());
+                return 1;
+            }
+            samples.push_back(sample);
+            files.push_back(arg.substr(equal + 1));
+        }
+    }
+    if (!(enuHi > enuLo) || !(biasHi > biasLo))
+    {
+        printf("Error: the E_nu and bias ranges need hi > lo.\n");
+        return 1;
+    }
+    if (gSystem->mkdir(outputDir.c_str(), true) != 0 && gSystem->AccessPathName(outputDir.c_str()))
+    {
+        printf("Error: could not create the output directory %s.\n", outputDir.c_str());
+        return 1;
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //     One pass per sample: counts [category][slice][bias bin], without under/overflow
+    // ----------------------------------------------------------------------------------------------
+    const size_t categorySize = (size_t) nSlices * nBias;
+    std::vector<std::vector<double>> counts(samples.size());
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        const SampleDefinition& sample = samples[s];
+        TFile *file = TFile::Open(files[s].c_str());
+        TTree *tree = file ? (TTree*) file->Get(sample.treeName.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", sample.treeName.c_str(), files[s].c_str());
+            return 1;
+        }
+        counts[s].assign(N_FIT_CATEGORIES * categorySize, 0.);
+
+        FlatTreeEvent event;
+        SetFlatTreeBranches(tree, sample, event, false);
+        Long64_t nentries = tree->GetEntries(), nFilled = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (Long64_t i = 0; i < nentries; i++)
+        {
+            tree->GetEntry(i);
+            if (!event.flag || event.Enu_true <= 0)
+                continue;
+            int slice = (int) ((event.Enu_true - enuLo) / (enuHi - enuLo) * nSlices);
+            double bias = (event.Enu_true - event.GetEreco(sample.useQE)) / event.Enu_true;
+            int bin = (int) std::floor((bias - biasLo) / (biasHi - biasLo) * nBias);
+            if (event.Enu_true < enuLo || slice >= nSlices || bin < 0 || bin >= nBias)
+                continue;
+            size_t cell = (size_t) slice * nBias + bin;
+            counts[s][GetModeCategory(event.Mode) * categorySize + cell] += 1;
+            counts[s][kNModeCategories * categorySize + cell] += 1;
+            nFilled++;
+        }
+        printf("%s: %lld of %lld entries in the slices, read in %.2f s\n", sample.label.c_str(), (long long) nFilled,
+               (long long) nentries, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        tree->ResetBranchAddresses();
+        file->Close();
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //            Series of slices of every sample, category and model, fitted in parallel
+    // ----------------------------------------------------------------------------------------------
+    std::vector<SliceChain> chains;
+    for (size_t s = 0; s < samples.size(); s++)
+        for (int c = 0; c < N_FIT_CATEGORIES; c++)
+            for (int model : {kSliceGaussian, kSliceAsymGaussian})
+            {
+                SliceChain chain;
+                chain.name = samples[s].label + "_" + FitCategoryName(c) + "_" + SliceModelName(model);
+                chain.counts = counts[s].data() + c * categorySize;
+                chain.nSlices = nSlices;
+                chain.model = model;
+                chains.push_back(chain);
+            }
+
+    auto start = std::chrono::steady_clock::now();
+    RunSliceChains(chains, nBias, biasLo, biasHi, coreSigmas, minEntries, nThreads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int nFits = 0, nOk = 0, nIterations = 0;
+    for (const SliceChain& chain : chains)
+        for (const SliceFitResult& r : chain.results)
+        {
+            nFits += r.entries >= minEntries;
+            nOk += r.ok;
+            nIterations += r.iterations;
+        }
+    printf("%d series, %d slices with at least %d entries: %d fits converged (%.1f iterations on average) in %.3f s on %d threads\n",
+           (int) chains.size(), nFits, minEntries, nOk, nOk > 0 ? (double) nIterations / nOk : 0., seconds, nThreads);
+
+    // ----------------------------------------------------------------------------------------------
+    //              Bias and resolution curves with their uncertainties, and the plots
+    // ----------------------------------------------------------------------------------------------
+    TFile *output = TFile::Open((outputDir + "/bias_fits.root").c_str(), "RECREATE");
+    if (!output)
+    {
+        printf("Error: could not write %s/bias_fits.root.\n", outputDir.c_str());
+        return 1;
+    }
+    HistogramRegistry registry;
+    PlotCache plots(outputDir + "/.plotcache");
+    const double sliceWidth = (enuHi - enuLo) / nSlices;
+    const int colors[N_FIT_CATEGORIES] = {kBlue, kRed, kGreen+2, kMagenta, kBlack};
+
+    // quantity: 0 bias (mean), 1 resolution, 2 sigma_L, 3 sigma_R
+    auto makeGraph = [&](const SliceChain& chain, int quantity)
+    {
+        static const char* names[] = {"bias", "resolution", "sigmaL", "sigmaR"};
+        static const char* titles[] = {"Energy bias", "Energy resolution", "#sigma_{L}", "#sigma_{R}"};
+        TGraphErrors *graph = registry.Own(new TGraphErrors(0));
+        graph->SetName(("g" + chain.name + "_" + names[quantity]).c_str());
+        graph->SetTitle(Form("%s %s;E_{#nu}^{true} [GeV];%s of (E_{#nu}^{true} - E_{#nu}^{reco})/E_{#nu}^{true}", chain.name.c_str(),
+                             titles[quantity], titles[quantity]));
+        for (int slice = 0; slice < chain.nSlices; slice++)
+        {
+            const SliceFitResult& r = chain.results[slice];
+            if (!r.ok)
+                continue;
+            double values[] = {r.mean, r.Resolution(), r.sigmaL, r.sigmaR};
+            double errors[] = {r.errMean, r.ErrResolution(), r.errSigmaL, r.errSigmaR};
+            int n = graph->GetN();
+            graph->SetPoint(n, enuLo + (slice + 0.5) * sliceWidth, values[quantity]);
+            graph->SetPointError(n, 0.5 * sliceWidth, errors[quantity]);
+        }
+        return graph;
+    };
+
+    size_t chainIndex = 0;
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        const std::string& label = samples[s].label;
+        std::vector<TGraphErrors*> bias[2], resolution[2];
+        for (int c = 0; c < N_FIT_CATEGORIES; c++)
+        {
+            TH2D *h = registry.Own(new TH2D(("h" + label + "_" + FitCategoryName(c) + "_bias_vs_Enu").c_str(),
+                                            Form("%s %s;E_{#nu}^{true} [GeV];(E_{#nu}^{true} - E_{#nu}^{reco})/E_{#nu}^{true}",
+                                                 label.c_str(), FitCategoryName(c)),
+                                            nSlices, enuLo, enuHi, nBias, biasLo, biasHi));
+            for (int slice = 0; slice < nSlices; slice++)
+                for (int b = 0; b < nBias; b++)
+                    h->SetBinContent(slice + 1, b + 1, counts[s][c * categorySize + (size_t) slice * nBias + b]);
+            h->Write();
+
+            for (int model : {kSliceGaussian, kSliceAsymGaussian})
+            {
+                const SliceChain& chain = chains[chainIndex++];
+                bias[model].push_back(makeGraph(chain, 0));
+                resolution[model].push_back(makeGraph(chain, 1));
+                for (TGraphErrors *graph : {bias[model].back(), resolution[model].back()})
+                    graph->Write();
+                if (model == kSliceAsymGaussian)
+                    for (int quantity : {2, 3})
+                        makeGraph(chain, quantity)->Write();
+            }
+        }
+
+        // Bias and resolution of every category, one canvas per model
+        for (int model : {kSliceGaussian, kSliceAsymGaussian})
+            for (int quantity = 0; quantity < 2; quantity++)
+            {
+                std::vector<TGraphErrors*>& graphs = quantity == 0 ? bias[model] : resolution[model];
+                std::string name = label + "_" + (quantity == 0 ? "bias" : "resolution") + "_" + SliceModelName(model);
+                TCanvas *canvas = registry.Own(new TCanvas(("c_" + name).c_str(), name.c_str(), 800, 600));
+                TLegend *legend = registry.Own(new TLegend(0.7, 0.7, 0.9, 0.9));
+                bool first = true;
+                for (int c = N_FIT_CATEGORIES - 1; c >= 0; c--) // "All" first: it sets the axes
+                {
+                    if (graphs[c]->GetN() == 0)
+                        continue;
+                    graphs[c]->SetLineColor(colors[c]);
+                    graphs[c]->SetMarkerColor(colors[c]);
+                    graphs[c]->SetMarkerStyle(20);
+                    graphs[c]->SetTitle(Form("%s %s (%s fits);E_{#nu}^{true} [GeV];%s", label.c_str(),
+                                             quantity == 0 ? "energy bias" : "energy resolution",
+                                             model == kSliceGaussian ? "Gaussian" : "asymmetric Gaussian",
+                                             quantity == 0 ? "Peak of (E_{#nu}^{true} - E_{#nu}^{reco})/E_{#nu}^{true}" : "#sigma"));
+                    graphs[c]->Draw(first ? "AP" : "P same");
+                    legend->AddEntry(graphs[c], FitCategoryName(c), "lp");
+                    first = false;
+                }
+                legend->Draw();
+                plots.SaveAs(canvas, outputDir + "/" + name + ".pdf");
+            }
+    }
+    output->Close();
+
+    registry.PrintSummary("FitBiasSlices");
+    plots.PrintSummary("FitBiasSlices");
+    return 0;
+}
@@ -0,0 +1,131 @@
+#ifndef FLUX_NORMALIZATION_H
+#define FLUX_NORMALIZATION_H
+
+#include "TFile.h"
+#include "TH1.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Normalization of the event histograms with the flux of each file (FlatTree_FLUX) and the
+//   fScaleFactor branch of the NUISANCE flat trees (flux-averaged cross section per event, in
+//   cm^2 per nucleon):
+//
+//     - entries: raw counts, as before;
+//     - xsec:    event weight x fScaleFactor, divided by the bin width when the histogram is made:
+//                flux-integrated differential cross section, cm^2/nucleon per unit of the x axis;
+//     - rate:    event weight x fScaleFactor x total integrated flux (1e-4 to go from cm^2 to the
+//                m^2 of the flux) x number of targets: events per POT (per nucleon if targets = 1).
+//
+//   The per-event factor is applied where the histograms are filled, the per-sample constant comes
+//   from here. The cumulative integral of the flux is computed once, so the flux in any energy
+//   range is O(1) (uniform binning) or O(log n) (variable binning), with a linear share of the
+//   partially covered bins. fScaleFactor is already divided by the total integrated flux, so with a
+//   restricted range [lo, hi] the cross section is renormalized to the flux in that range only,
+//   while the rate keeps the total flux: the events outside the range are dropped where the
+//   histograms are filled.
+// ------------------------------------------------------------------------------------------------
+
+enum NormalizationMode { kNormEntries = 0, kNormXsec = 1, kNormRate = 2 };
+
+inline bool ParseNormalizationMode(const std::string& text, int& mode)
+{
+    if (text == "entries")   mode = kNormEntries;
+    else if (text == "xsec") mode = kNormXsec;
+    else if (text == "rate") mode = kNormRate;
+    else
+        return false;
+    return true;
+}
+
+// y axis of the histograms in each mode
+inline const char* NormalizationAxis(int mode)
+{
+    static const char* axes[] = {"Entries", "d#sigma/dx [cm^{2}/nucleon]", "Events/POT"};
+    return (mode >= 0 && mode <= kNormRate) ? axes[mode] : "";
+}
+
+class FluxNormalization
+{
+public:
+    // Flux from a histogram (the file can be closed afterwards: the bins are copied)
+    bool Load(const TH1* flux)
+    {
+        if (!flux || flux->GetNbinsX() < 1)
+            return false;
+        const TAxis *axis = flux->GetXaxis();
+        int nbins = flux->GetNbinsX();
+        fEdges.resize(nbins + 1);
+        fCumulative.assign(nbins + 1, 0.);
+        for (int b = 1; b <= nbins; b++)
+        {
+            fEdges[b - 1] = axis->GetBinLowEdge(b);
+            fCumulative[b] = fCumulative[b - 1] + flux->GetBinContent(b) * axis->GetBinWidth(b);
+        }
+        fEdges[nbins] = axis->GetBinUpEdge(nbins);
+        fUniform = !axis->IsVariableBinSize();
+        return true;
+    }
+
+    // "file.root:histogram"
+    bool Load(const std::string& fileName, const std::string& histName, std::string& error)
+    {
+        TFile *file = TFile::Open(fileName.c_str());
+        TH1 *flux = file ? (TH1*) file->Get(histName.c_str()) : nullptr;
+        bool ok = Load(flux);
+        if (!ok)
+            error = "could not read the flux histogram " + histName + " from " + fileName;
+        if (file)
+            file->Close();
+        delete file;
+        return ok;
+    }
+
+    bool IsLoaded() const { return !fCumulative.empty(); }
+    double GetLow() const { return fEdges.front(); }
+    double GetHigh() const { return fEdges.back(); }
+    double Total() const { return fCumulative.back(); }
+
+    // Integrated flux between lo and hi (flux units x energy, e.g. nu/m^2/POT)
+    double Integral(double lo, double hi) const
+    {
+        return hi > lo ? Cumulative(hi) - Cumulative(lo) : 0.;
+    }
+
+    // Constant factor of a sample: the event weights are then multiplied by fScaleFactor
+    double SampleFactor(int mode, double lo, double hi, double targets) const
+    {
+        if (mode == kNormEntries)
+            return 1.;
+        if (mode == kNormRate)
+            return 1e-4 * Total() * targets;
+        double inRange = Integral(lo, hi);
+        return inRange > 0 ? Total() / inRange : 0.;
+    }
+
+private:
+    // Integral from the low edge of the flux to x
+    double Cumulative(double x) const
+    {
+        const int nbins = fEdges.size() - 1;
+        if (x <= fEdges.front())
+            return 0.;
+        if (x >= fEdges.back())
+            return fCumulative.back();
+
+        int b;
+        if (fUniform)
+            b = std::min(nbins - 1, (int) ((x - fEdges.front()) / (fEdges.back() - fEdges.front()) * nbins));
+        else
+            b = std::upper_bound(fEdges.begin(), fEdges.end(), x) - fEdges.begin() - 1;
+        double fraction = (x - fEdges[b]) / (fEdges[b + 1] - fEdges[b]);
+        return fCumulative[b] + fraction * (fCumulative[b + 1] - fCumulative[b]);
+    }
+
+    std::vector<double> fEdges;      // nbins + 1 edges
+    std::vector<double> fCumulative; // integral up to each edge
+    bool fUniform = true;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "TFile.h"
+#include "TH1D.h"
+#include "TCanvas.h"
+#include "TStyle.h"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// To compile: c++ HistogramClient.cpp `root-config --cflags --libs` -o histogram_client.out
+//
+// Sends one request to HistogramDaemon and prints the answer. If an output file is given the
+// histogram is also saved, as a TH1D for .root files or drawn for any other extension (.pdf, .png).
+// Example:
+//     ./histogram_client.out /tmp/nuscope_hist.sock "sample=T2K;expr=bias;cut=flagCC0pi;bins=50,-0.5,2.5" t2k_bias.pdf
+
+int main(int argc, char ** argv)
+{
+    gStyle->SetOptStat(0);
+
+    if (argc < 3)
+    {
+        std::cout << "Usage: \n- ./histogram_client.out \n- socket path \n- request (\"sample=...;expr=...;cut=...;bins=n,low,high\", LIST or SHUTDOWN) \n- optional: output file (.root, .pdf, ...)" << std::endl;
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+
+    if (fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) < 0)
+    {
+        printf("Error: could not connect to %s (is the daemon running?).\n", argv[1]);
+        return 1;
+    }
+
+    std::string request = std::string(argv[2]) + "\n";
+    if (write(fd, request.data(), request.size()) != (ssize_t) request.size())
+    {
+        printf("Error: could not send the request.\n");
+        return 1;
+    }
+    shutdown(fd, SHUT_WR); // one request per connection: the daemon sees end-of-file after it
+
+    std::string reply;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        reply.append(buffer, n);
+    close(fd);
+
+    std::istringstream in(reply);
+    std::string status;
+    in >> status;
+
+    if (status != "OK" || std::string(argv[2]) == "LIST" || std::string(argv[2]) == "SHUTDOWN")
+    {
+        std::cout << reply;
+        return status == "OK" ? 0 : 1;
+    }
+
+    int nbins;
+    double lo, hi, ms;
+    in >> nbins >> lo >> hi >> ms;
+
+    std::vector<double> sumw(nbins + 2), sumw2(nbins + 2);
+    for (double& v : sumw)  in >> v;
+    for (double& v : sumw2) in >> v;
+
+    TH1D *h = new TH1D("h", argv[2], nbins, lo, hi);
+    double total = 0;
+    for (int b = 0; b < nbins + 2; b++)
+    {
+        h->SetBinContent(b, sumw[b]);
+        h->SetBinError(b, sqrt(sumw2[b]));
+        total += sumw[b];
+    }
+
+    printf("Filled in %.2f ms, sum of weights %g (underflow %g, overflow %g)\n", ms, total, sumw[0], sumw[nbins + 1]);
+    for (int b = 1; b <= nbins; b++)
+        printf("  [%8.4f, %8.4f)  %g\n", h->GetBinLowEdge(b), h->GetBinLowEdge(b) + h->GetBinWidth(b), sumw[b]);
+
+    if (argc > 3)
+    {
+        std::string output = argv[3];
+        if (output.size() > 5 && output.substr(output.size() - 5) == ".root")
+        {
+            TFile *file = TFile::Open(output.c_str(), "RECREATE");
+            h->Write();
+            file->Close();
+        } else
+        {
+            TCanvas *c = new TCanvas("c", "Histogram from daemon", 800, 600);
+            h->SetLineColor(kRed);
+            h->Draw("hist");
+            c->SaveAs(output.c_str());
+        }
+    }
+
+    return 0;
+}
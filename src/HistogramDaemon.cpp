@@ -0,0 +1,488 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "SampleDefinitions.h"
+#include "Kinematics.h"
+#include "ExpressionParser.h"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// To compile: c++ HistogramDaemon.cpp `root-config --cflags --libs` -pthread -o histogram_daemon.out
+//
+// Long-lived process: the flat trees of the configured samples are read once into memory, then
+// histogram requests are answered over a Unix socket (see HistogramClient.cpp). One request per
+// line, fields separated by ';':
+//
+//     sample=DUNE;expr=bias;cut=flagCCINC * (mode_category==0);bins=100,0,1
+//
+// As in TTree::Project, the cut is used as the event weight (events with cut==0 are skipped),
+// and an optional weight=<expression> multiplies it. Other commands: LIST and SHUTDOWN.
+// Besides the tree branches, the derived columns mode_category, n_pi, n_n, topology, E_reco, bias,
+// bias_weighted and, if the tree has the particle four-momenta, Q2, W, dpT, dalphaT, dphiT
+// (Kinematics.h) can be used in any expression.
+
+// ------------------------------------------------------------------------------------------------
+//                             Columns of one sample, kept in memory
+// ------------------------------------------------------------------------------------------------
+struct SampleColumns
+{
+    std::string label;
+    Long64_t nEvents = 0;
+    std::map<std::string, std::vector<float>> columns;
+
+    const float* Find(const std::string& name) const
+    {
+        auto it = columns.find(name);
+        return it == columns.end() ? nullptr : it->second.data();
+    }
+};
+
+// Scalar float branches copied as they are, if present in the tree
+static const char* FLOAT_BRANCHES[] = {"Enu_true", "ELep", "Erecoil_minerva", "Enu_QE", "Q2", "W", "CosLep", "q0", "q3", "Weight"};
+static const char* FLAG_BRANCHES[]  = {"flagCCINC", "flagCC0pi"};
+
+bool LoadSample(const std::string& label, const std::string& fileName, SampleColumns& sample)
+{
+    SampleDefinition definition;
+    if (!GetSampleDefinition(label, definition))
+    {
+        printf("Error: unknown sample %s.\n", label.c_str());
+        return false;
+    }
+
+    TFile *file = TFile::Open(fileName.c_str());
+    if (!file)
+    {
+        printf("Error: could not open %s.\n", fileName.c_str());
+        return false;
+    }
+
+    TTree *tree = (TTree*) file->Get(definition.treeName.c_str());
+    if (!tree)
+    {
+        printf("Error: could not find the TTree in %s.\n", fileName.c_str());
+        return false;
+    }
+
+    if (!CheckMaxParticles(tree))
+        return false;
+
+    std::vector<std::string> floatNames, flagNames;
+    for (const char* name : FLOAT_BRANCHES)
+        if (tree->GetBranch(name))
+            floatNames.push_back(name);
+    for (const char* name : FLAG_BRANCHES)
+        if (tree->GetBranch(name))
+            flagNames.push_back(name);
+
+    std::vector<Float_t> floatValues(floatNames.size());
+    std::vector<char> flagValues(flagNames.size()); // not vector<bool>: we need addresses
+    int Mode = 0, nfsp = 0;
+    int pdg[MAXPARTICLES];
+    Float_t px[MAXPARTICLES], py[MAXPARTICLES], pz[MAXPARTICLES], E[MAXPARTICLES];
+    bool hasMomenta = tree->GetBranch("px") && tree->GetBranch("py") && tree->GetBranch("pz") && tree->GetBranch("E");
+
+    tree->SetBranchStatus("*", false);
+    for (size_t b = 0; b < floatNames.size(); b++)
+    {
+        tree->SetBranchStatus(floatNames[b].c_str(), true);
+        tree->SetBranchAddress(floatNames[b].c_str(), &floatValues[b]);
+    }
+    for (size_t b = 0; b < flagNames.size(); b++)
+    {
+        tree->SetBranchStatus(flagNames[b].c_str(), true);
+        tree->SetBranchAddress(flagNames[b].c_str(), (bool*) &flagValues[b]);
+    }
+    const char* intBranches[] = {"Mode", "nfsp", "pdg"};
+    for (const char* name : intBranches)
+        tree->SetBranchStatus(name, true);
+    tree->SetBranchAddress("Mode", &Mode);
+    tree->SetBranchAddress("nfsp", &nfsp);
+    tree->SetBranchAddress("pdg", pdg);
+    if (hasMomenta)
+    {
+        const char* momentumBranches[] = {"px", "py", "pz", "E"};
+        Float_t* arrays[] = {px, py, pz, E};
+        for (int k = 0; k < 4; k++)
+        {
+            tree->SetBranchStatus(momentumBranches[k], true);
+            tree->SetBranchAddress(momentumBranches[k], arrays[k]);
+        }
+    }
+
+    Long64_t nentries = tree->GetEntries();
+    sample.label = label;
+    sample.nEvents = nentries;
+
+    std::vector<float*> floatColumns, flagColumns;
+    for (const std::string& name : floatNames)
+    {
+        sample.columns[name].resize(nentries);
+        floatColumns.push_back(sample.columns[name].data());
+    }
+    for (const std::string& name : flagNames)
+    {
+        sample.columns[name].resize(nentries);
+        flagColumns.push_back(sample.columns[name].data());
+    }
+
+    const char* derived[] = {"Mode", "mode_category", "n_pi", "n_n", "topology", "E_reco", "bias", "bias_weighted"};
+    for (const char* name : derived)
+        sample.columns[name].resize(nentries);
+
+    float* colMode     = sample.columns["Mode"].data();
+    float* colCategory = sample.columns["mode_category"].data();
+    float* colNPi      = sample.columns["n_pi"].data();
+    float* colNN       = sample.columns["n_n"].data();
+    float* colTopology = sample.columns["topology"].data();
+    float* colReco     = sample.columns["E_reco"].data();
+    float* colBias     = sample.columns["bias"].data();
+    float* colBiasW    = sample.columns["bias_weighted"].data();
+    const float* colEnu   = sample.Find("Enu_true");
+    const float* colQE    = sample.Find("Enu_QE");
+    const float* colRecoil = sample.Find("Erecoil_minerva");
+    const float* colELep  = sample.Find("ELep");
+
+    // Q2, W (unless the tree has them already) and TKI from the four-momenta, see Kinematics.h
+    KinematicsBlock kinematics;
+    float* colKin[kNKinematicVariables] = {nullptr};
+    Long64_t kinFirst = 0;
+    if (hasMomenta)
+        for (int v = 0; v < kNKinematicVariables; v++)
+            if (!sample.Find(KinematicVariableName(v)))
+            {
+                sample.columns[KinematicVariableName(v)].resize(nentries);
+                colKin[v] = sample.columns[KinematicVariableName(v)].data();
+            }
+    auto storeKinematics = [&]()
+    {
+        kinematics.Compute();
+        for (int v = 0; v < kNKinematicVariables; v++)
+            for (int s = 0; colKin[v] && s < kinematics.Size(); s++)
+                colKin[v][kinFirst + s] = kinematics.Get(v, s);
+        kinFirst += kinematics.Size();
+        kinematics.Clear();
+    };
+
+    for (Long64_t i = 0; i < nentries; i++)
+    {
+        tree->GetEntry(i);
+
+        for (size_t b = 0; b < floatColumns.size(); b++)
+            floatColumns[b][i] = floatValues[b];
+        for (size_t b = 0; b < flagColumns.size(); b++)
+            flagColumns[b][i] = flagValues[b] ? 1.f : 0.f;
+
+        int nPions, nNeutrons;
+        CountPionsNeutrons(nfsp, pdg, nPions, nNeutrons);
+
+        colMode[i] = Mode;
+        colCategory[i] = GetModeCategory(Mode);
+        colNPi[i] = nPions;
+        colNN[i] = nNeutrons;
+        colTopology[i] = GetTopology(nPions, nNeutrons);
+
+        if (hasMomenta)
+        {
+            kinematics.AddFlatTreeEvent(colEnu ? colEnu[i] : 0.f, nfsp, pdg, px, py, pz, E);
+            if (kinematics.Full())
+                storeKinematics();
+        }
+    }
+    if (hasMomenta)
+        storeKinematics();
+
+    for (Long64_t i = 0; i < nentries; i++)
+    {
+        float reco = definition.useQE ? (colQE ? colQE[i] : 0.f)
+                                      : ((colRecoil ? colRecoil[i] : 0.f) + (colELep ? colELep[i] : 0.f));
+        colReco[i]  = reco;
+        colBias[i]  = colEnu ? colEnu[i] - reco : 0.f;
+        colBiasW[i] = (colEnu && colEnu[i] > 0) ? colBias[i] / colEnu[i] : 0.f;
+    }
+
+    file->Close();
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+//               Fill one histogram from the in-memory columns using several threads
+// ------------------------------------------------------------------------------------------------
+struct HistogramRequest
+{
+    std::string sample, expr, cut, weight;
+    int nbins = 0;
+    double lo = 0, hi = 0;
+};
+
+bool ParseRequest(const std::string& line, HistogramRequest& request, std::string& error)
+{
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ';'))
+    {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos)
+            continue;
+        std::string key = field.substr(0, eq), value = field.substr(eq + 1);
+        if (key == "sample")      request.sample = value;
+        else if (key == "expr")   request.expr = value;
+        else if (key == "cut")    request.cut = value;
+        else if (key == "weight") request.weight = value;
+        else if (key == "bins")
+        {
+            if (sscanf(value.c_str(), "%d,%lf,%lf", &request.nbins, &request.lo, &request.hi) != 3)
+            {
+                error = "bins must be nbins,low,high";
+                return false;
+            }
+        }
+    }
+
+    if (request.sample.empty() || request.expr.empty() || request.nbins <= 0 || request.hi <= request.lo)
+    {
+        error = "a request needs sample, expr and bins";
+        return false;
+    }
+    return true;
+}
+
+// Contents and sum of squared weights, bins 0 and nbins+1 being under- and overflow
+bool FillHistogram(const SampleColumns& sample, const HistogramRequest& request, int nThreads,
+                   std::vector<double>& sumw, std::vector<double>& sumw2, std::string& error)
+{
+    ColumnExpression expr, cut, weight;
+    auto resolve = [&sample](const std::string& name) { return sample.Find(name); };
+
+    if (!expr.Compile(request.expr, resolve, error))
+        return false;
+    if (!cut.Compile(request.cut.empty() ? "1" : request.cut, resolve, error))
+        return false;
+    if (!weight.Compile(request.weight.empty() ? "1" : request.weight, resolve, error))
+        return false;
+
+    const int nbins = request.nbins;
+    const double lo = request.lo, scale = nbins / (request.hi - request.lo);
+
+    std::vector<std::vector<double>> partialW(nThreads, std::vector<double>(nbins + 2, 0.));
+    std::vector<std::vector<double>> partialW2(nThreads, std::vector<double>(nbins + 2, 0.));
+    std::vector<std::thread> workers;
+
+    Long64_t chunk = (sample.nEvents + nThreads - 1) / nThreads;
+    for (int t = 0; t < nThreads; t++)
+    {
+        workers.emplace_back([&, t]()
+        {
+            double x[EXPR_BLOCK], w[EXPR_BLOCK], extra[EXPR_BLOCK];
+            std::vector<double>& hw = partialW[t];
+            std::vector<double>& hw2 = partialW2[t];
+            Long64_t end = std::min(sample.nEvents, (t + 1) * chunk);
+
+            for (Long64_t first = t * chunk; first < end; first += EXPR_BLOCK)
+            {
+                int n = (int) std::min<Long64_t>(EXPR_BLOCK, end - first);
+                cut.Evaluate(first, n, w);
+                weight.Evaluate(first, n, extra);
+                expr.Evaluate(first, n, x);
+
+                for (int k = 0; k < n; k++)
+                {
+                    double wk = w[k] * extra[k];
+                    if (wk == 0 || std::isnan(x[k])) // NaN values (0/0, sqrt of a negative...) are not filled
+                        continue;
+                    double pos = (x[k] - lo) * scale;
+                    int bin = !(pos >= 0) ? 0 : (pos >= nbins ? nbins + 1 : std::min(nbins, 1 + (int) pos));
+                    hw[bin] += wk;
+                    hw2[bin] += wk * wk;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    sumw.assign(nbins + 2, 0.);
+    sumw2.assign(nbins + 2, 0.);
+    for (int t = 0; t < nThreads; t++)
+        for (int b = 0; b < nbins + 2; b++)
+        {
+            sumw[b] += partialW[t][b];
+            sumw2[b] += partialW2[t][b];
+        }
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                                     Socket handling
+// ------------------------------------------------------------------------------------------------
+void SendAll(int fd, const std::string& text)
+{
+    size_t sent = 0;
+    while (sent < text.size())
+    {
+        ssize_t n = write(fd, text.data() + sent, text.size() - sent);
+        if (n <= 0)
+            return;
+        sent += n;
+    }
+}
+
+bool ReadLine(int fd, std::string& line)
+{
+    line.clear();
+    char c;
+    while (read(fd, &c, 1) == 1)
+    {
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+    return !line.empty();
+}
+
+// Returns false when the daemon should stop
+bool HandleRequest(const std::string& line, const std::map<std::string, SampleColumns>& samples, int nThreads, std::string& reply)
+{
+    std::ostringstream out;
+
+    if (line == "SHUTDOWN")
+    {
+        reply = "OK shutting down\n";
+        return false;
+    }
+
+    if (line == "LIST")
+    {
+        for (const auto& s : samples)
+        {
+            out << s.first << " " << s.second.nEvents << " :";
+            for (const auto& c : s.second.columns)
+                out << " " << c.first;
+            out << "\n";
+        }
+        reply = "OK " + std::to_string(samples.size()) + "\n" + out.str();
+        return true;
+    }
+
+    HistogramRequest request;
+    std::string error;
+    std::vector<double> sumw, sumw2;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!ParseRequest(line, request, error))
+    {
+        reply = "ERROR " + error + "\n";
+        return true;
+    }
+    auto it = samples.find(request.sample);
+    if (it == samples.end())
+    {
+        reply = "ERROR unknown sample " + request.sample + "\n";
+        return true;
+    }
+    if (!FillHistogram(it->second, request, nThreads, sumw, sumw2, error))
+    {
+        reply = "ERROR " + error + "\n";
+        return true;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Header, then bin contents and sums of squared weights (underflow and overflow included)
+    out.precision(10);
+    out << "OK " << request.nbins << " " << request.lo << " " << request.hi << " " << ms << "\n";
+    for (double v : sumw)  out << v << " ";
+    out << "\n";
+    for (double v : sumw2) out << v << " ";
+    out << "\n";
+    reply = out.str();
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: \n- ./histogram_daemon.out \n- socket path (e.g. /tmp/nuscope_hist.sock) \n- one or more LABEL:file.root (LABEL = DUNE, T2K or nuSCOPE) \n- optional: -j number of threads per query" << std::endl;
+        return 1;
+    }
+
+    std::string socketPath = argv[1];
+    int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::map<std::string, SampleColumns> samples;
+
+    // ----------------------------------------------------------------------------------------------
+    //                           Load all the samples once, at startup
+    // ----------------------------------------------------------------------------------------------
+    for (int a = 2; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "-j" && a + 1 < argc)
+        {
+            nThreads = std::max(1, atoi(argv[++a]));
+            continue;
+        }
+
+        size_t colon = arg.find(':');
+        if (colon == std::string::npos)
+        {
+            printf("Error: could not understand sample \"%s\" (expected LABEL:file.root).\n", arg.c_str());
+            return 1;
+        }
+
+        std::string label = arg.substr(0, colon);
+        if (!LoadSample(label, arg.substr(colon + 1), samples[label]))
+            return 1;
+        std::cout << "Loaded " << samples[label].nEvents << " events for " << label << std::endl;
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                                  Serve requests
+    // ----------------------------------------------------------------------------------------------
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socketPath.c_str());
+
+    if (server < 0 || bind(server, (sockaddr*) &address, sizeof(address)) < 0 || listen(server, 8) < 0)
+    {
+        printf("Error: could not listen on %s.\n", socketPath.c_str());
+        return 1;
+    }
+
+    std::cout << "Listening on " << socketPath << " (" << nThreads << " threads per query)" << std::endl;
+
+    bool running = true;
+    while (running)
+    {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        std::string line, reply;
+        while (running && ReadLine(client, line))
+        {
+            running = HandleRequest(line, samples, nThreads, reply);
+            SendAll(client, reply);
+        }
+        close(client);
+    }
+
+    close(server);
+    unlink(socketPath.c_str());
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+#ifndef HISTOGRAM_REGISTRY_H
+#define HISTOGRAM_REGISTRY_H
+
+#include "TCanvas.h"
+#include "TDirectory.h"
+#include "TH1.h"
+#include "TH1F.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Central owner of the histograms (and canvases, legends, ...) of a macro.
+//
+//   - Book() gives a lightweight histogram whose bins (sum of weights and sum of squared weights)
+//     are carved out of a few large arena chunks instead of one heap allocation per histogram, and
+//     which is not registered anywhere in ROOT. A TH1F is only built when it is needed: Write()
+//     builds, writes and frees them one at a time, Materialize() keeps one for drawing.
+//   - Own() takes ownership of any ROOT object created with new (histograms are detached from
+//     gDirectory): canvases, legends, derived histograms...
+//   - Everything is released in a fixed order by Clear() or by the destructor (canvases first, so
+//     that nothing drawn on them is deleted twice, then the other objects in reverse order).
+//   The memory used for the bins is reported by GetArenaBytes(), and grows only with the bins booked.
+// ------------------------------------------------------------------------------------------------
+
+static const size_t REGISTRY_CHUNK_DOUBLES = 1 << 17; // 1 MB per arena chunk
+
+class BookedHistogram
+{
+public:
+    BookedHistogram(const std::string& name, const std::string& title, int nbins, double lo, double hi, double* storage)
+        : fName(name), fTitle(title), fNBins(nbins), fLo(lo), fHi(hi), fScale(nbins / (hi - lo)),
+          fSumw(storage), fSumw2(storage + nbins + 2), fEntries(0) {}
+
+    // Same bin convention as TH1: 0 is the underflow, nbins+1 the overflow
+    int FindBin(double x) const
+    {
+        if (!(x >= fLo))
+            return 0;
+        if (x >= fHi)
+            return fNBins + 1;
+        return std::min(fNBins, 1 + (int) ((x - fLo) * fScale));
+    }
+
+    void Fill(double x, double w = 1)
+    {
+        int bin = FindBin(x);
+        fSumw[bin] += w;
+        fSumw2[bin] += w * w;
+        fEntries++;
+    }
+
+    // Adds another histogram with the same binning (e.g. the partial result of a thread)
+    void Add(const BookedHistogram& other)
+    {
+        for (int b = 0; b <= fNBins + 1; b++)
+        {
+            fSumw[b] += other.fSumw[b];
+            fSumw2[b] += other.fSumw2[b];
+        }
+        fEntries += other.fEntries;
+    }
+
+    const std::string& GetName() const { return fName; }
+    int GetNbinsX() const { return fNBins; }
+    double GetBinContent(int bin) const { return fSumw[bin]; }
+    double GetEntries() const { return fEntries; }
+
+    // TH1F copy of the histogram, not attached to any directory (the caller owns it)
+    TH1F* ToTH1F() const
+    {
+        bool addDirectory = TH1::AddDirectoryStatus();
+        TH1::AddDirectory(false);
+        TH1F *h = new TH1F(fName.c_str(), fTitle.c_str(), fNBins, fLo, fHi);
+        TH1::AddDirectory(addDirectory);
+
+        h->Sumw2();
+        for (int b = 0; b <= fNBins + 1; b++)
+        {
+            h->SetBinContent(b, fSumw[b]);
+            h->SetBinError(b, std::sqrt(fSumw2[b]));
+        }
+        h->SetEntries(fEntries);
+        return h;
+    }
+
+private:
+    std::string fName, fTitle;
+    int fNBins;
+    double fLo, fHi, fScale;
+    double *fSumw, *fSumw2; // in the registry arena
+    double fEntries;
+};
+
+class HistogramRegistry
+{
+public:
+    HistogramRegistry() : fChunkUsed(REGISTRY_CHUNK_DOUBLES) {}
+
+    ~HistogramRegistry() { Clear(); }
+
+    HistogramRegistry(const HistogramRegistry&) = delete;
+    HistogramRegistry& operator=(const HistogramRegistry&) = delete;
+
+    BookedHistogram* Book(const std::string& name, const std::string& title, int nbins, double lo, double hi)
+    {
+        fBooked.emplace_back(new BookedHistogram(name, title, nbins, lo, hi, Allocate(2 * (size_t) (nbins + 2))));
+        return fBooked.back().get();
+    }
+
+    BookedHistogram* Find(const std::string& name) const
+    {
+        for (const auto& h : fBooked)
+            if (h->GetName() == name)
+                return h.get();
+        return nullptr;
+    }
+
+    // Takes ownership of an object created with new; histograms are detached from gDirectory
+    template <class T>
+    T* Own(T* object)
+    {
+        if (!object)
+            return object;
+        if (TH1 *h = dynamic_cast<TH1*>(object))
+            h->SetDirectory(nullptr);
+        if (TCanvas *c = dynamic_cast<TCanvas*>(object))
+            fCanvases.push_back(c);
+        else
+            fObjects.push_back(object);
+        return object;
+    }
+
+    // TH1F of a booked histogram that stays alive (owned by the registry), e.g. to draw it
+    TH1F* Materialize(const BookedHistogram* booked) { return Own(booked->ToTH1F()); }
+
+    // Writes all the booked histograms to the current directory, building one TH1F at a time
+    void Write() const
+    {
+        for (const auto& booked : fBooked)
+        {
+            std::unique_ptr<TH1F> h(booked->ToTH1F());
+            h->Write();
+        }
+    }
+
+    size_t GetNBooked() const { return fBooked.size(); }
+    size_t GetArenaBytes() const { return fChunks.size() * REGISTRY_CHUNK_DOUBLES * sizeof(double) + fLargeBytes; }
+
+    void PrintSummary(const char* label) const
+    {
+        printf("[HistogramRegistry] %s: %zu booked histograms in %.1f MB of arena, %zu canvases and %zu other objects owned\n",
+               label, fBooked.size(), GetArenaBytes() / 1048576., fCanvases.size(), fObjects.size());
+    }
+
+    void Clear()
+    {
+        for (TCanvas* c : fCanvases)
+            delete c;
+        fCanvases.clear();
+        for (auto it = fObjects.rbegin(); it != fObjects.rend(); ++it)
+            delete *it;
+        fObjects.clear();
+        fBooked.clear();
+        fChunks.clear();
+        fLarge.clear();
+        fChunkUsed = REGISTRY_CHUNK_DOUBLES;
+        fLargeBytes = 0;
+    }
+
+private:
+    // Zeroed storage for n doubles; histograms larger than a chunk get their own block
+    double* Allocate(size_t n)
+    {
+        if (n > REGISTRY_CHUNK_DOUBLES)
+        {
+            fLarge.emplace_back(new double[n]());
+            fLargeBytes += n * sizeof(double);
+            return fLarge.back().get();
+        }
+        if (fChunkUsed + n > REGISTRY_CHUNK_DOUBLES)
+        {
+            fChunks.emplace_back(new double[REGISTRY_CHUNK_DOUBLES]());
+            fChunkUsed = 0;
+        }
+        double *p = fChunks.back().get() + fChunkUsed;
+        fChunkUsed += n;
+        return p;
+    }
+
+    std::vector<std::unique_ptr<BookedHistogram>> fBooked;
+    std::vector<std::unique_ptr<double[]>> fChunks, fLarge;
+    size_t fChunkUsed;
+    size_t fLargeBytes = 0;
+    std::vector<TCanvas*> fCanvases;
+    std::vector<TObject*> fObjects;
+};
+
+#endif
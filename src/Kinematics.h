@@ -0,0 +1,177 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <cmath>
+#include <cstdlib>
+
+// ------------------------------------------------------------------------------------------------
+//   Extended kinematics computed from the particle four-momenta: Q^2, hadronic invariant mass W
+//   and the transverse kinematic imbalance (delta pT, delta alphaT, delta phiT).
+//
+//   Events are processed in blocks, inside the event loop we already have (no second pass):
+//     - AddFlatTreeEvent / AddGenieEvent pick the neutrino, the lepton, the leading proton and the
+//       hadronic system of one event and store them in structure-of-arrays form;
+//     - when the block is full (or at the end of the loop), Compute() evaluates all the variables
+//       for the whole block in one loop without branches, that the compiler can vectorize;
+//     - Get(variable, slot) returns the result for the event stored in that slot.
+//   Variables that are not defined for an event (no lepton, no proton, no hadrons) are KIN_UNDEFINED,
+//   which falls in the underflow of any histogram we book.
+// ------------------------------------------------------------------------------------------------
+
+static const int KIN_BLOCK = 256;
+static const float KIN_UNDEFINED = -999.f;
+
+enum KinematicVariable { kQ2 = 0, kW = 1, kDpT = 2, kDalphaT = 3, kDphiT = 4, kNKinematicVariables = 5 };
+
+// Names used for histograms, columns and expressions; angles are in degrees
+inline const char* KinematicVariableName(int variable)
+{
+    static const char* names[kNKinematicVariables] = {"Q2", "W", "dpT", "dalphaT", "dphiT"};
+    return (variable >= 0 && variable < kNKinematicVariables) ? names[variable] : "Unknown";
+}
+
+inline const char* KinematicVariableTitle(int variable)
+{
+    static const char* titles[kNKinematicVariables] = {"Q^{2} [GeV^{2}]", "W [GeV]", "#deltap_{T} [GeV]",
+                                                       "#delta#alpha_{T} [deg]", "#delta#phi_{T} [deg]"};
+    return (variable >= 0 && variable < kNKinematicVariables) ? titles[variable] : "";
+}
+
+class KinematicsBlock
+{
+public:
+    KinematicsBlock() : fSize(0) {}
+
+    int Size() const { return fSize; }
+    bool Full() const { return fSize == KIN_BLOCK; }
+    void Clear() { fSize = 0; }
+
+    float Get(int variable, int slot) const { return fOut[variable][slot]; }
+
+    // NUISANCE flat tree: final-state particles only, neutrino along z with energy Enu_true
+    int AddFlatTreeEvent(float Enu_true, int nfsp, const int* pdg, const float* px, const float* py, const float* pz, const float* E)
+    {
+        int slot = fSize++;
+        SetNeutrino(slot, Enu_true, 0.f, 0.f, Enu_true);
+        ResetFinalState(slot);
+        for (int j = 0; j < nfsp; j++)
+            AddFinalState(slot, pdg[j], px[j], py[j], pz[j], E[j]);
+        return slot;
+    }
+
+    // GENIE gRooTracker: status 0 neutrino is the beam, status 1 particles are the final state
+    int AddGenieEvent(int n, const int* status, const int* pdg, const double (*p4)[4])
+    {
+        int slot = fSize++;
+        SetNeutrino(slot, 0.f, 0.f, 0.f, 0.f);
+        ResetFinalState(slot);
+        for (int j = 0; j < n; j++)
+        {
+            int apdg = abs(pdg[j]);
+            if (status[j] == 0 && (apdg == 12 || apdg == 14 || apdg == 16))
+                SetNeutrino(slot, p4[j][3], p4[j][0], p4[j][1], p4[j][2]);
+            else if (status[j] == 1)
+                AddFinalState(slot, pdg[j], p4[j][0], p4[j][1], p4[j][2], p4[j][3]);
+        }
+        return slot;
+    }
+
+    // All the variables of the events in the block
+    void Compute()
+    {
+        const float rad2deg = 180.f / 3.14159265f;
+        for (int i = 0; i < fSize; i++)
+        {
+            // Q^2 = -(k - k')^2
+            float q0 = fNuE[i] - fLepE[i], qx = fNuX[i] - fLepX[i], qy = fNuY[i] - fLepY[i], qz = fNuZ[i] - fLepZ[i];
+            float Q2 = qx * qx + qy * qy + qz * qz - q0 * q0;
+
+            // W^2 of the final-state hadronic system
+            float W2 = fHadE[i] * fHadE[i] - fHadX[i] * fHadX[i] - fHadY[i] * fHadY[i] - fHadZ[i] * fHadZ[i];
+
+            // Transverse plane = plane orthogonal to the neutrino direction
+            float nuP = std::sqrt(fNuX[i] * fNuX[i] + fNuY[i] * fNuY[i] + fNuZ[i] * fNuZ[i]);
+            float inv = nuP > 0 ? 1.f / nuP : 0.f;
+            float nx = fNuX[i] * inv, ny = fNuY[i] * inv, nz = fNuZ[i] * inv;
+
+            float lL = fLepX[i] * nx + fLepY[i] * ny + fLepZ[i] * nz;
+            float lx = fLepX[i] - lL * nx, ly = fLepY[i] - lL * ny, lz = fLepZ[i] - lL * nz;
+            float pL = fProtX[i] * nx + fProtY[i] * ny + fProtZ[i] * nz;
+            float px = fProtX[i] - pL * nx, py = fProtY[i] - pL * ny, pz = fProtZ[i] - pL * nz;
+            float dx = lx + px, dy = ly + py, dz = lz + pz;
+
+            float lT = std::sqrt(lx * lx + ly * ly + lz * lz);
+            float pT = std::sqrt(px * px + py * py + pz * pz);
+            float dpT = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+            float cosAlpha = -(lx * dx + ly * dy + lz * dz) / std::fmax(lT * dpT, 1e-12f);
+            float cosPhi   = -(lx * px + ly * py + lz * pz) / std::fmax(lT * pT, 1e-12f);
+            cosAlpha = std::fmin(1.f, std::fmax(-1.f, cosAlpha));
+            cosPhi   = std::fmin(1.f, std::fmax(-1.f, cosPhi));
+
+            bool hasLepton = fLepE[i] > 0 && nuP > 0;
+            bool hasTKI = hasLepton && fHasProton[i] > 0;
+
+            fOut[kQ2][i]      = hasLepton ? Q2 : KIN_UNDEFINED;
+            fOut[kW][i]       = fHadE[i] > 0 ? std::sqrt(std::fmax(W2, 0.f)) : KIN_UNDEFINED;
+            fOut[kDpT][i]     = hasTKI ? dpT : KIN_UNDEFINED;
+            fOut[kDalphaT][i] = hasTKI ? std::acos(cosAlpha) * rad2deg : KIN_UNDEFINED;
+            fOut[kDphiT][i]   = hasTKI ? std::acos(cosPhi) * rad2deg : KIN_UNDEFINED;
+        }
+    }
+
+private:
+    void SetNeutrino(int slot, float E, float x, float y, float z)
+    {
+        fNuE[slot] = E; fNuX[slot] = x; fNuY[slot] = y; fNuZ[slot] = z;
+    }
+
+    void ResetFinalState(int slot)
+    {
+        fLepE[slot] = fLepX[slot] = fLepY[slot] = fLepZ[slot] = 0.f;
+        fHadE[slot] = fHadX[slot] = fHadY[slot] = fHadZ[slot] = 0.f;
+        fProtX[slot] = fProtY[slot] = fProtZ[slot] = fHasProton[slot] = 0.f;
+        fLepCharged[slot] = false;
+    }
+
+    // Lepton: the most energetic charged lepton (the outgoing neutrino for NC events).
+    // Hadrons: everything else except nuclei. Leading proton: the one with the largest momentum.
+    void AddFinalState(int slot, int pdg, float x, float y, float z, float E)
+    {
+        int apdg = abs(pdg);
+        if (apdg >= 11 && apdg <= 16)
+        {
+            bool charged = (apdg % 2 == 1);
+            if ((charged && !fLepCharged[slot]) || (charged == fLepCharged[slot] && E > fLepE[slot]))
+            {
+                fLepE[slot] = E; fLepX[slot] = x; fLepY[slot] = y; fLepZ[slot] = z;
+                fLepCharged[slot] = charged;
+            }
+            return;
+        }
+        if (apdg >= 1000000000)
+            return;
+
+        fHadE[slot] += E; fHadX[slot] += x; fHadY[slot] += y; fHadZ[slot] += z;
+
+        if (pdg == 2212)
+        {
+            float p2 = x * x + y * y + z * z;
+            if (fHasProton[slot] == 0 || p2 > fProtX[slot] * fProtX[slot] + fProtY[slot] * fProtY[slot] + fProtZ[slot] * fProtZ[slot])
+            {
+                fProtX[slot] = x; fProtY[slot] = y; fProtZ[slot] = z;
+                fHasProton[slot] = 1.f;
+            }
+        }
+    }
+
+    int fSize;
+    float fNuE[KIN_BLOCK], fNuX[KIN_BLOCK], fNuY[KIN_BLOCK], fNuZ[KIN_BLOCK];
+    float fLepE[KIN_BLOCK], fLepX[KIN_BLOCK], fLepY[KIN_BLOCK], fLepZ[KIN_BLOCK];
+    float fHadE[KIN_BLOCK], fHadX[KIN_BLOCK], fHadY[KIN_BLOCK], fHadZ[KIN_BLOCK];
+    float fProtX[KIN_BLOCK], fProtY[KIN_BLOCK], fProtZ[KIN_BLOCK], fHasProton[KIN_BLOCK];
+    bool fLepCharged[KIN_BLOCK];
+    float fOut[kNKinematicVariables][KIN_BLOCK];
+};
+
+#endif
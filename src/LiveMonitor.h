@@ -0,0 +1,334 @@
+#ifndef LIVE_MONITOR_H
+#define LIVE_MONITOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// ------------------------------------------------------------------------------------------------
+//   Live progress of a long event loop: events processed, throughput, ETA and the partially filled
+//   histograms, served while the job runs on http://127.0.0.1:<port>/ (page refreshed every 2 s)
+//   and /status.json, and/or written every few seconds to a JSON snapshot file.
+//
+//   Every worker thread owns a slot. In the loop it only calls Count() (a plain store to a counter
+//   on its own cache line, no atomic read-modify-write) and, when PublishDue() says so (a clock
+//   check every MONITOR_CHECK_EVENTS events, at most one publication every MONITOR_PUBLISH_MS),
+//   Publish(): the bins of its histograms are copied into the back buffer of its slot and the
+//   version of the slot is incremented. The reader takes the front buffer and retries if the
+//   writer started to rewrite it meanwhile (seqlock over two buffers), so the fill path never waits on
+//   a lock; the snapshot is the sum of the last published copies of all slots.
+//
+//       LiveMonitor monitor(nThreads, nentries);
+//       monitor.AddHistogram("bias", 50, -0.5, 2.5);
+//       monitor.StartHttp(8080, error);
+//       ... in the loop of thread t: monitor.Count(t); if (monitor.PublishDue(t)) monitor.Publish(t, hists);
+// ------------------------------------------------------------------------------------------------
+
+static const int MONITOR_CHECK_EVENTS = 4096;
+static const int MONITOR_PUBLISH_MS = 500;
+
+class LiveMonitor
+{
+public:
+    LiveMonitor(int nSlots, long long totalEvents) : fTotalEvents(totalEvents), fStart(std::chrono::steady_clock::now())
+    {
+        for (int s = 0; s < nSlots; s++)
+            fSlots.emplace_back(new Slot());
+    }
+
+    ~LiveMonitor()
+    {
+        fStop = true;
+        for (std::thread& thread : fThreads)
+            thread.join();
+        if (fServer >= 0)
+            close(fServer);
+    }
+
+    LiveMonitor(const LiveMonitor&) = delete;
+    LiveMonitor& operator=(const LiveMonitor&) = delete;
+
+    // Histograms shown (the same list, in the same order, is published by every slot); before the loop
+    void AddHistogram(const std::string& name, int nbins, double lo, double hi)
+    {
+        fHists.push_back({name, nbins, lo, hi, fNValues});
+        fNValues += nbins + 2;
+        for (auto& slot : fSlots)
+            for (int b = 0; b < 2; b++)
+                slot->bins[b].assign(fNValues, 0.);
+    }
+
+    void SetTotalEvents(long long totalEvents) { fTotalEvents = totalEvents; }
+
+    // ----------------------------------------------------------------------------------------------
+    //                           Worker side: only the thread of the slot
+    // ----------------------------------------------------------------------------------------------
+    void Count(int slot, long long n = 1)
+    {
+        Slot& s = *fSlots[slot];
+        s.events.store(s.events.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    bool PublishDue(int slot, int n = 1)
+    {
+        Slot& s = *fSlots[slot];
+        if ((s.sinceCheck += n) < MONITOR_CHECK_EVENTS)
+            return false;
+        s.sinceCheck = 0;
+        auto now = std::chrono::steady_clock::now();
+        if (now - s.lastPublish < std::chrono::milliseconds(MONITOR_PUBLISH_MS))
+            return false;
+        s.lastPublish = now;
+        return true;
+    }
+
+    // H: anything with GetBinContent(bin), e.g. TH1 or BookedHistogram; same order as AddHistogram
+    template <class H>
+    void Publish(int slot, const std::vector<H*>& hists)
+    {
+        Slot& s = *fSlots[slot];
+        unsigned long long version = BeginWrite(s);
+        std::vector<double>& back = s.bins[(version + 1) & 1];
+        for (size_t h = 0; h < fHists.size() && h < hists.size(); h++)
+            for (int b = 0; b <= fHists[h].nbins + 1; b++)
+                back[fHists[h].offset + b] = hists[h] ? hists[h]->GetBinContent(b) : 0.;
+        std::atomic_thread_fence(std::memory_order_release);
+        s.version.store(version + 1, std::memory_order_release);
+    }
+
+    // The histograms of a slot start again from zero (e.g. a thread starts a new task after merging)
+    void ClearSlot(int slot)
+    {
+        Slot& s = *fSlots[slot];
+        unsigned long long version = BeginWrite(s);
+        std::fill(s.bins[(version + 1) & 1].begin(), s.bins[(version + 1) & 1].end(), 0.);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.version.store(version + 1, std::memory_order_release);
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                                  Reader side: any thread
+    // ----------------------------------------------------------------------------------------------
+    struct Snapshot
+    {
+        long long events = 0, total = 0;
+        double seconds = 0, rate = 0, eta = -1; // events/s, seconds left (-1: unknown)
+        std::vector<double> bins;               // sum over the slots, all the histograms
+    };
+
+    Snapshot TakeSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.total = fTotalEvents;
+        snapshot.bins.assign(fNValues, 0.);
+        std::vector<double> copy(fNValues);
+        for (const auto& slot : fSlots)
+        {
+            snapshot.events += slot->events.load(std::memory_order_relaxed);
+            for (int attempt = 0; attempt < 100; attempt++)
+            {
+                unsigned long long version = slot->version.load(std::memory_order_acquire);
+                const std::vector<double>& front = slot->bins[version & 1];
+                std::copy(front.begin(), front.end(), copy.begin());
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot->begun.load(std::memory_order_relaxed) < version + 2) // no write to this buffer began meanwhile
+                    break;
+            }
+            for (size_t v = 0; v < copy.size(); v++)
+                snapshot.bins[v] += copy[v];
+        }
+        snapshot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fStart).count();
+        snapshot.rate = snapshot.seconds > 0 ? snapshot.events / snapshot.seconds : 0.;
+        if (snapshot.total > 0 && snapshot.rate > 0)
+            snapshot.eta = std::max(0LL, snapshot.total - snapshot.events) / snapshot.rate;
+        return snapshot;
+    }
+
+    std::string StatusJson() const
+    {
+        Snapshot snapshot = TakeSnapshot();
+        std::ostringstream out;
+        out.precision(10);
+        out << "{\"events\": " << snapshot.events << ", \"total\": " << snapshot.total << ", \"seconds\": " << snapshot.seconds
+            << ", \"rate\": " << snapshot.rate << ", \"eta\": " << snapshot.eta << ", \"histograms\": [";
+        for (size_t h = 0; h < fHists.size(); h++)
+        {
+            out << (h ? ", " : "") << "{\"name\": \"" << fHists[h].name << "\", \"nbins\": " << fHists[h].nbins
+                << ", \"lo\": " << fHists[h].lo << ", \"hi\": " << fHists[h].hi << ", \"bins\": [";
+            for (int b = 0; b <= fHists[h].nbins + 1; b++)
+                out << (b ? ", " : "") << snapshot.bins[fHists[h].offset + b];
+            out << "]}";
+        }
+        out << "]}\n";
+        return out.str();
+    }
+
+    // Progress and one text bar chart per histogram (under/overflow not drawn)
+    std::string StatusText() const
+    {
+        Snapshot snapshot = TakeSnapshot();
+        std::ostringstream out;
+        char line[256];
+        snprintf(line, sizeof(line), "%lld / %lld events (%.1f%%), %.0f events/s, %.0f s elapsed, ETA %s\n\n", snapshot.events, snapshot.total,
+                 snapshot.total > 0 ? 100. * snapshot.events / snapshot.total : 0., snapshot.rate, snapshot.seconds,
+                 snapshot.eta >= 0 ? (std::to_string((long long) snapshot.eta) + " s").c_str() : "unknown");
+        out << line;
+        for (const Histogram& h : fHists)
+        {
+            double maximum = 0;
+            for (int b = 1; b <= h.nbins; b++)
+                maximum = std::max(maximum, snapshot.bins[h.offset + b]);
+            out << h.name << "\n";
+            for (int b = 1; b <= h.nbins; b++)
+            {
+                double content = snapshot.bins[h.offset + b];
+                snprintf(line, sizeof(line), "%9.3g %12.6g |", h.lo + (b - 1) * (h.hi - h.lo) / h.nbins, content);
+                out << line << std::string(maximum > 0 ? (int) std::lround(60 * content / maximum) : 0, '#') << "\n";
+            }
+            out << "\n";
+        }
+        return out.str();
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                          Endpoints: local HTTP server, snapshot file
+    // ----------------------------------------------------------------------------------------------
+    bool StartHttp(int port, std::string& error)
+    {
+        fServer = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (fServer < 0 || setsockopt(fServer, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0
+            || bind(fServer, (sockaddr*) &address, sizeof(address)) < 0 || listen(fServer, 8) < 0)
+        {
+            error = std::string("could not listen on 127.0.0.1:") + std::to_string(port) + " (" + strerror(errno) + ")";
+            if (fServer >= 0)
+                close(fServer);
+            fServer = -1;
+            return false;
+        }
+        fThreads.emplace_back([this]() { Serve(); });
+        printf("[LiveMonitor] progress on http://127.0.0.1:%d/ and http://127.0.0.1:%d/status.json\n", port, port);
+        return true;
+    }
+
+    // JSON snapshot written every `seconds` (to path.tmp, then renamed: readers never see half a file)
+    void StartSnapshotFile(const std::string& path, double seconds = 2.)
+    {
+        fThreads.emplace_back([this, path, seconds]()
+        {
+            auto next = std::chrono::steady_clock::now();
+            while (!fStop)
+            {
+                if (std::chrono::steady_clock::now() >= next)
+                {
+                    WriteSnapshot(path);
+                    next += std::chrono::milliseconds((long long) (1000 * seconds));
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            WriteSnapshot(path);
+        });
+        printf("[LiveMonitor] progress written to %s every %g s\n", path.c_str(), seconds);
+    }
+
+    bool WriteSnapshot(const std::string& path) const
+    {
+        std::string tmp = path + ".tmp", json = StatusJson();
+        FILE *file = fopen(tmp.c_str(), "w");
+        if (!file)
+            return false;
+        bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+        ok = (fclose(file) == 0) && ok;
+        return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct Histogram
+    {
+        std::string name;
+        int nbins;
+        double lo, hi;
+        size_t offset; // of its bins in the buffers
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<long long> events{0};
+        std::atomic<unsigned long long> version{0}; // publications completed: the front buffer is bins[version & 1]
+        std::atomic<unsigned long long> begun{0};   // publications started
+        int sinceCheck = 0;
+        std::chrono::steady_clock::time_point lastPublish;
+        std::vector<double> bins[2];
+    };
+
+    // Marks the start of a publication before the back buffer is written; returns the current version
+    static unsigned long long BeginWrite(Slot& s)
+    {
+        unsigned long long version = s.version.load(std::memory_order_relaxed);
+        s.begun.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return version;
+    }
+
+    void Serve()
+    {
+        while (!fStop)
+        {
+            pollfd pfd = {fServer, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0)
+                continue;
+            int client = accept(fServer, nullptr, nullptr);
+            if (client < 0)
+                continue;
+
+            char request[1024];
+            ssize_t n = read(client, request, sizeof(request) - 1);
+            request[n > 0 ? n : 0] = '\0';
+            bool json = strncmp(request, "GET /status.json", 16) == 0;
+            std::string body = json ? StatusJson()
+                                    : "<html><head><meta http-equiv=\"refresh\" content=\"2\"><title>LiveMonitor</title></head><body><pre>"
+                                          + StatusText() + "</pre></body></html>\n";
+            std::string reply = std::string("HTTP/1.0 200 OK\r\nContent-Type: ") + (json ? "application/json" : "text/html")
+                                + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            size_t sent = 0;
+            while (sent < reply.size())
+            {
+                ssize_t written = write(client, reply.data() + sent, reply.size() - sent);
+                if (written <= 0)
+                    break;
+                sent += written;
+            }
+            close(client);
+        }
+    }
+
+    std::vector<std::unique_ptr<Slot>> fSlots;
+    std::vector<Histogram> fHists;
+    size_t fNValues = 0;
+    long long fTotalEvents;
+    std::chrono::steady_clock::time_point fStart;
+    std::atomic<bool> fStop{false};
+    std::vector<std::thread> fThreads;
+    int fServer = -1;
+};
+
+#endif
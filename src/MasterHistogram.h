@@ -0,0 +1,185 @@
+#ifndef MASTER_HISTOGRAM_H
+#define MASTER_HISTOGRAM_H
+
+#include "TFile.h"
+#include "TH1D.h"
+#include "TH1F.h"
+#include "TH2F.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Fine-binned "master" histogram: a variable is filled only once, over a wide range, and every
+//   binning we want to plot is derived from it afterwards by summing whole master bins.
+//   If a requested edge does not fall on a master edge, the derived histogram is still produced
+//   (each master bin goes where its centre falls) but the mismatch is reported.
+//
+//   Optionally the master also holds K bootstrap replicas (EnableBootstrap), filled in the same loop
+//   with the per-event Poisson weights of CounterRNG.h. They are stored as [bin][replica], so one
+//   fill adds a contiguous row of K values; the spread of the replicas gives the statistical error
+//   of each derived bin (SetBootstrapErrors).
+// ------------------------------------------------------------------------------------------------
+class MasterHistogram
+{
+public:
+    MasterHistogram(const char* name, const char* title, double binWidth, double lo, double hi)
+    {
+        int nbins = (int) std::lround((hi - lo) / binWidth);
+        fHist = new TH1D(("master_" + std::string(name)).c_str(), title, nbins, lo, hi);
+        fHist->SetDirectory(nullptr);
+        fHist->Sumw2();
+    }
+
+    // Master previously written with Write(), so the trees do not need to be read again
+    static MasterHistogram* Load(TFile* file, const char* name)
+    {
+        TH1D *h = (TH1D*) file->Get(("master_" + std::string(name)).c_str());
+        if (!h)
+            return nullptr;
+        h->SetDirectory(nullptr);
+        MasterHistogram *master = new MasterHistogram(h);
+
+        // Replicas, if they were filled
+        TH2F *replicas = (TH2F*) file->Get(("bootstrap_" + std::string(name)).c_str());
+        if (replicas)
+        {
+            master->EnableBootstrap(replicas->GetNbinsY());
+            for (int b = 0; b <= h->GetNbinsX() + 1; b++)
+                for (int r = 0; r < master->fNReplicas; r++)
+                    master->fReplicas[(size_t) b * master->fNReplicas + r] = replicas->GetBinContent(b, r + 1);
+            delete replicas;
+        }
+        return master;
+    }
+
+    ~MasterHistogram() { delete fHist; }
+
+    void EnableBootstrap(int nReplicas)
+    {
+        fNReplicas = nReplicas;
+        fReplicas.assign((size_t) (fHist->GetNbinsX() + 2) * nReplicas, 0.f);
+    }
+
+    int GetNReplicas() const { return fNReplicas; }
+
+    void Fill(double x, double w = 1) { fHist->Fill(x, w); }
+
+    // Fill with the weights of the K replicas of this event (PoissonBootstrap::Generate)
+    void Fill(double x, double w, const float* replicaWeights)
+    {
+        int bin = fHist->Fill(x, w);
+        if (fNReplicas == 0 || bin < 0)
+            return;
+        float *row = &fReplicas[(size_t) bin * fNReplicas];
+        const float fw = (float) w;
+        for (int r = 0; r < fNReplicas; r++)
+            row[r] += fw * replicaWeights[r];
+    }
+
+    void Write() const
+    {
+        fHist->Write();
+        if (fNReplicas == 0)
+            return;
+
+        // Replicas as a 2D histogram: x = master bin (under/overflow included), y = replica
+        const TAxis *axis = fHist->GetXaxis();
+        TH2F replicas(("bootstrap_" + std::string(fHist->GetName()).substr(7)).c_str(), "bootstrap replicas",
+                      axis->GetNbins(), axis->GetXmin(), axis->GetXmax(), fNReplicas, 0, fNReplicas);
+        replicas.SetDirectory(nullptr);
+        for (int b = 0; b <= axis->GetNbins() + 1; b++)
+            for (int r = 0; r < fNReplicas; r++)
+                replicas.SetBinContent(b, r + 1, fReplicas[(size_t) b * fNReplicas + r]);
+        replicas.Write();
+    }
+
+    TH1D* GetMaster() const { return fHist; }
+
+    // Histogram with nbins in [lo, hi) built from the master bins. The number of requested edges
+    // that do not coincide with a master edge goes to nMismatched (0 means the rebinning is exact).
+    TH1F* Derive(const char* name, const char* title, int nbins, double lo, double hi, int* nMismatched = nullptr) const
+    {
+        TH1F *h = new TH1F(name, title, nbins, lo, hi);
+        h->Sumw2();
+
+        const TAxis *axis = fHist->GetXaxis();
+        const double masterLo = axis->GetXmin(), masterHi = axis->GetXmax();
+        const double masterWidth = (masterHi - masterLo) / axis->GetNbins();
+
+        int mismatched = 0;
+        for (int e = 0; e <= nbins; e++)
+        {
+            double edge = lo + e * (hi - lo) / nbins;
+            double position = (edge - masterLo) / masterWidth;
+            if (std::fabs(position - std::round(position)) > 1e-6 || edge < masterLo - 1e-9 || edge > masterHi + 1e-9)
+            {
+                if (mismatched == 0)
+                    printf("Warning: %s: edge %g is not a master edge of %s (master bin width %g, range [%g, %g])\n",
+                           name, edge, fHist->GetName(), masterWidth, masterLo, masterHi);
+                mismatched++;
+            }
+        }
+        if (mismatched > 1)
+            printf("Warning: %s: %d of %d requested edges do not match the master binning.\n", name, mismatched, nbins + 1);
+
+        std::vector<double> sumw2(nbins + 2, 0.);
+        for (int b = 0; b <= axis->GetNbins() + 1; b++)
+        {
+            // Master under/overflow go to the derived under/overflow
+            int target = (b == 0) ? 0 : (b > axis->GetNbins() ? nbins + 1 : h->FindBin(axis->GetBinCenter(b)));
+            h->SetBinContent(target, h->GetBinContent(target) + fHist->GetBinContent(b));
+            sumw2[target] += fHist->GetBinError(b) * fHist->GetBinError(b);
+        }
+        for (int b = 0; b <= nbins + 1; b++)
+            h->SetBinError(b, std::sqrt(sumw2[b]));
+        h->SetEntries(fHist->GetEntries());
+
+        if (nMismatched)
+            *nMismatched = mismatched;
+        return h;
+    }
+
+    // Replaces the errors of a histogram derived from this master by the standard deviation of its
+    // bin contents over the bootstrap replicas. Returns false if there are no replicas.
+    bool SetBootstrapErrors(TH1F* h) const
+    {
+        if (fNReplicas < 2)
+            return false;
+
+        const TAxis *axis = fHist->GetXaxis();
+        const int nbins = h->GetNbinsX();
+        std::vector<double> sums((size_t) (nbins + 2) * fNReplicas, 0.);
+        for (int b = 0; b <= axis->GetNbins() + 1; b++)
+        {
+            int target = (b == 0) ? 0 : (b > axis->GetNbins() ? nbins + 1 : h->FindBin(axis->GetBinCenter(b)));
+            const float *row = &fReplicas[(size_t) b * fNReplicas];
+            double *sum = &sums[(size_t) target * fNReplicas];
+            for (int r = 0; r < fNReplicas; r++)
+                sum[r] += row[r];
+        }
+
+        for (int b = 0; b <= nbins + 1; b++)
+        {
+            const double *sum = &sums[(size_t) b * fNReplicas];
+            double mean = 0, variance = 0;
+            for (int r = 0; r < fNReplicas; r++)
+                mean += sum[r];
+            mean /= fNReplicas;
+            for (int r = 0; r < fNReplicas; r++)
+                variance += (sum[r] - mean) * (sum[r] - mean);
+            h->SetBinError(b, std::sqrt(variance / (fNReplicas - 1)));
+        }
+        return true;
+    }
+
+private:
+    explicit MasterHistogram(TH1D* h) : fHist(h) {}
+
+    TH1D *fHist;
+    int fNReplicas = 0;
+    std::vector<float> fReplicas; // [bin][replica], bins 0..nbins+1
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1F.h"
+#include "TH1D.h"
+#include "TCanvas.h"
+#include "TLegend.h"
+#include "TStyle.h"
+#include "TSystem.h"
+#include "SampleDefinitions.h"
+#include "PdgMultiplicity.h"
+#include "HistogramRegistry.h"
+#include "PlotCache.h"
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// To compile: c++ MultiplicityTables.cpp `root-config --cflags --libs` -O2 -o multiplicity_tables.out
+//
+// Final-state multiplicity tables and topology-split energy bias for every sample (T2K included),
+// with one pass per file: the pdg array of each selected event is scanned once by the kernel of
+// PdgMultiplicity.h, which gives the counts of all the species; the N-dimensional table and every
+// topology histogram are filled from those counts.
+//
+//     ./multiplicity_tables.out DUNE=flat_Valencia_13815.root T2K=flat_Valencia_2382.root
+//         [--species "pi+-:211;pi0:111;p:2212;n:2112;gamma:22;K:321,311,310,130"] [--max 3]
+//         [--topology "CC1pi0: pi+- == 0, pi0 == 1"] (repeatable, added to 0pi0n, 0piNn, Npi0n, NpiNn,
+//         which are only made when the species have pi+- and n)
+//         [--out ../Topology_Plots]
+//
+// The samples are DUNE, T2K or nuSCOPE (selection flag and E_reco of SampleDefinitions.h).
+
+int main(int argc, char ** argv)
+{
+    gStyle->SetOptStat(0);
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./multiplicity_tables.out \n- LABEL=file.root for each sample (DUNE, T2K or nuSCOPE)"
+                  << "\n- optional: --species \"name:pdg,pdg;...\" (default pi+-, pi0, p, n, gamma, K)"
+                  << "\n- optional: --max N (last bin of each species in the table is N or more, default 3)"
+                  << "\n- optional: --topology \"name: species op count, ...\" (repeatable)"
+                  << "\n- optional: --out directory (default ../Topology_Plots)" << std::endl;
+        return 1;
+    }
+
+    std::vector<SampleDefinition> samples;
+    std::vector<std::string> files, topologyTexts;
+    std::vector<MultiplicitySpecies> species = DefaultMultiplicitySpecies();
+    std::string outputDir = "../Topology_Plots", error;
+    int maxCount = 3;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--species" && a + 1 < argc)
+        {
+            if (!ParseMultiplicitySpecies(argv[++a], species, error))
+            {
+                printf("Error: %s.\n", error.c_str());
+                return 1;
+            }
+        } else if (arg == "--max" && a + 1 < argc)
+            maxCount = std::max(1, atoi(argv[++a]));
+        else if (arg == "--topology" && a + 1 < argc)
+            topologyTexts.push_back(argv[++a]);
+        else if (arg == "--out" && a + 1 < argc)
+            outputDir = argv[++a];
+        else
+        {
+            size_t equal = arg.find('=');
+            SampleDefinition sample;
+            if (equal == std::string::npos || !GetSampleDefinition(arg.substr(0, equal), sample))
+            {
+                printf("Error: \"%s\" is not LABEL=file.root with LABEL DUNE, T2K or nuSCOPE.\n", arg.c_str());
+                return 1;
+            }
+            samples.push_back(sample);
+            files.push_back(arg.substr(equal + 1));
+        }
+    }
+
+    // The default topologies count pi+- and n: left out if --species does not have them
+    PdgMultiplicityCounter counter(species);
+    std::vector<TopologyDefinition> topologies;
+    for (const std::string& text : DefaultTopologies())
+    {
+        TopologyDefinition topology;
+        if (ParseTopology(text, counter, topology, error))
+            topologies.push_back(topology);
+        else
+            printf("Note: default topology \"%s\" left out (%s).\n", text.c_str(), error.c_str());
+    }
+    for (const std::string& text : topologyTexts)
+    {
+        TopologyDefinition topology;
+        if (!ParseTopology(text, counter, topology, error))
+        {
+            printf("Error: %s.\n", error.c_str());
+            return 1;
+        }
+        topologies.push_back(topology);
+    }
+
+    double nCells = 1;
+    for (size_t s = 0; s < species.size(); s++)
+        nCells *= maxCount + 1;
+    if (nCells > (1 << 22))
+    {
+        printf("Error: %zu species with --max %d make a table of %.0f cells, reduce one of them.\n", species.size(), maxCount, nCells);
+        return 1;
+    }
+    if (gSystem->mkdir(outputDir.c_str(), true) != 0 && gSystem->AccessPathName(outputDir.c_str()))
+    {
+        printf("Error: could not create the output directory %s.\n", outputDir.c_str());
+        return 1;
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                              One pass per sample: counts, table, bias
+    // ----------------------------------------------------------------------------------------------
+    HistogramRegistry registry;
+    std::vector<MultiplicityTable> tables;
+    std::vector<std::vector<BookedHistogram*>> hBias(samples.size());
+    std::vector<int> nSpecies(species.size());
+
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        const SampleDefinition& sample = samples[s];
+        TFile *file = TFile::Open(files[s].c_str());
+        TTree *tree = file ? (TTree*) file->Get(sample.treeName.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", sample.treeName.c_str(), files[s].c_str());
+            return 1;
+        }
+
+        tables.emplace_back(species.size(), maxCount);
+        for (const TopologyDefinition& topology : topologies)
+            hBias[s].push_back(registry.Book("h" + sample.label + "_" + topology.name,
+                                             sample.label + " " + topology.name + " energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries",
+                                             50, -0.5, 2.5));
+
+        FlatTreeEvent event;
+        if (!SetFlatTreeBranches(tree, sample, event))
+            return 1;
+        Long64_t nentries = tree->GetEntries(), nSelected = 0;
+        double countSeconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (Long64_t i = 0; i < nentries; i++)
+        {
+            tree->GetEntry(i);
+            if (!event.flag)
+                continue;
+            nSelected++;
+
+            auto countStart = std::chrono::steady_clock::now();
+            counter.Count(event.nfsp, event.pdg, nSpecies.data());
+            countSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - countStart).count();
+
+            tables[s].Fill(nSpecies.data());
+            double bias = event.Enu_true - event.GetEreco(sample.useQE);
+            for (size_t t = 0; t < topologies.size(); t++)
+                if (topologies[t].Matches(nSpecies.data()))
+                    hBias[s][t]->Fill(bias);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %lld of %lld entries selected in %.2f s, multiplicities counted in %.1f ns/event\n", sample.label.c_str(),
+               (long long) nSelected, (long long) nentries, seconds, nSelected > 0 ? 1e9 * countSeconds / nSelected : 0.);
+
+        tables[s].PrintTop(sample.label.c_str(), counter, 10);
+        for (size_t t = 0; t < topologies.size(); t++)
+            printf("  %-12s %6.2f%%\n", topologies[t].name.c_str(), nSelected > 0 ? 100. * hBias[s][t]->GetEntries() / nSelected : 0.);
+
+        tree->ResetBranchAddresses();
+        file->Close();
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                     Topology-split energy bias, one canvas per sample
+    // ----------------------------------------------------------------------------------------------
+    const int colors[] = {kOrange+7, kCyan+1, kViolet-6, kTeal+3, kRed, kBlue, kGreen+2, kMagenta+1};
+    PlotCache plots(outputDir + "/.plotcache");
+    for (size_t s = 0; s < samples.size() && !topologies.empty(); s++)
+    {
+        TCanvas *canvas = registry.Own(new TCanvas(("c_topology_" + samples[s].label).c_str(), samples[s].label.c_str(), 800, 600));
+        TLegend *legend = registry.Own(new TLegend(0.65, 0.9 - 0.05 * topologies.size(), 0.9, 0.9));
+        double maximum = 0;
+        std::vector<TH1F*> hists;
+        for (size_t t = 0; t < topologies.size(); t++)
+        {
+            TH1F *h = registry.Materialize(hBias[s][t]);
+            h->SetLineColor(colors[t % 8]);
+            maximum = std::max(maximum, h->GetMaximum());
+            hists.push_back(h);
+        }
+        for (size_t t = 0; t < hists.size(); t++)
+        {
+            hists[t]->SetMaximum(1.1 * maximum);
+            hists[t]->SetTitle((samples[s].label + " energy bias by topology;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Events").c_str());
+            hists[t]->Draw(t == 0 ? "hist" : "hist same");
+            legend->AddEntry(hists[t], topologies[t].name.c_str(), "l");
+        }
+        legend->Draw();
+        plots.SaveAs(canvas, outputDir + "/" + samples[s].label + "_bias_topology.pdf");
+    }
+
+    TFile *output = TFile::Open((outputDir + "/multiplicity_tables.root").c_str(), "RECREATE");
+    if (output)
+    {
+        for (size_t s = 0; s < samples.size(); s++)
+        {
+            TH1D *table = tables[s].ToTH1D("hMultiplicity_" + samples[s].label, samples[s].label + " final-state multiplicities;;Events", counter);
+            table->Write();
+            delete table;
+        }
+        registry.Write();
+        output->Close();
+    }
+
+    registry.PrintSummary("MultiplicityTables");
+    plots.PrintSummary("MultiplicityTables");
+    return 0;
+}
@@ -0,0 +1,125 @@
+#ifndef OSCILLATION_H
+#define OSCILLATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   nu_mu disappearance weights for a grid of (Delta m^2, sin^2 2theta) points, in the two-flavour
+//   vacuum approximation:
+//
+//       P(nu_mu -> nu_mu) = 1 - sin^2(2theta) sin^2(1.267 Delta m^2 [eV^2] L [km] / E [GeV])
+//
+//   The phase is linear in 1/E, so the table of one baseline has its nodes uniform in x = 1/E, from
+//   x = 0 (E -> infinity) to 1/OSC_EMIN: all the points share the same nodes, and for one event the
+//   node and the interpolation fraction are found once, then the probabilities of all the points are
+//   read from two contiguous rows ([node][point] layout) in a loop without trigonometric functions.
+//   Below OSC_EMIN the oscillation is far faster than any energy resolution and its average,
+//   1 - sin^2(2theta)/2, is used.
+// ------------------------------------------------------------------------------------------------
+
+static const double OSC_EMIN = 0.05; // GeV
+
+struct OscillationPoint
+{
+    double dm2;      // eV^2
+    double sin22;    // sin^2(2theta)
+};
+
+// Baselines of the samples of SampleDefinitions.h, in km (0 for unknown labels)
+inline double DefaultBaseline(const std::string& label)
+{
+    if (label == "DUNE")
+        return 1300.;
+    if (label == "T2K")
+        return 295.;
+    return 0.;
+}
+
+// Exact two-flavour survival probability, for checks
+inline double SurvivalProbability(const OscillationPoint& point, double baseline, double Enu)
+{
+    if (Enu < OSC_EMIN)
+        return 1. - 0.5 * point.sin22;
+    double s = std::sin(1.267 * point.dm2 * baseline / Enu);
+    return 1. - point.sin22 * s * s;
+}
+
+// Regular grid of points, dm2 and sin22 each from lo to hi (inclusive) in n steps
+inline std::vector<OscillationPoint> OscillationGrid(double dm2Lo, double dm2Hi, int nDm2, double sin22Lo, double sin22Hi, int nSin22)
+{
+    std::vector<OscillationPoint> points;
+    for (int i = 0; i < nDm2; i++)
+        for (int j = 0; j < nSin22; j++)
+            points.push_back({nDm2 > 1 ? dm2Lo + (dm2Hi - dm2Lo) * i / (nDm2 - 1) : dm2Lo,
+                              nSin22 > 1 ? sin22Lo + (sin22Hi - sin22Lo) * j / (nSin22 - 1) : sin22Lo});
+    return points;
+}
+
+class OscillationTable
+{
+public:
+    OscillationTable(const std::vector<OscillationPoint>& points, double baseline, int nNodes = 8192)
+        : fNPoints(points.size()), fNNodes(std::max(2, nNodes)), fBaseline(baseline)
+    {
+        fStep = (1. / OSC_EMIN) / (fNNodes - 1);
+        fTable.resize((size_t) (fNNodes + 1) * fNPoints); // one extra row so that node + 1 always exists
+        for (int k = 0; k <= fNNodes; k++)
+        {
+            double x = std::min(k, fNNodes - 1) * fStep;
+            for (int p = 0; p < fNPoints; p++)
+            {
+                double s = std::sin(1.267 * points[p].dm2 * baseline * x);
+                fTable[(size_t) k * fNPoints + p] = 1. - points[p].sin22 * s * s;
+            }
+        }
+        for (int p = 0; p < fNPoints; p++)
+            fAverage.push_back(1. - 0.5 * points[p].sin22);
+    }
+
+    int GetNPoints() const { return fNPoints; }
+    int GetNNodes() const { return fNNodes; }
+    double GetBaseline() const { return fBaseline; }
+    size_t GetBytes() const { return fTable.size() * sizeof(float); }
+
+    // Survival probability of every point at energy Enu (GeV), in probabilities[0 .. GetNPoints())
+    void Evaluate(double Enu, double* probabilities) const
+    {
+        if (!(Enu >= OSC_EMIN))
+        {
+            std::copy(fAverage.begin(), fAverage.end(), probabilities);
+            return;
+        }
+        double u = 1. / (Enu * fStep);
+        int k = std::min((int) u, fNNodes - 1);
+        double f = u - k;
+        const float *lo = &fTable[(size_t) k * fNPoints], *hi = lo + fNPoints;
+        for (int p = 0; p < fNPoints; p++)
+            probabilities[p] = lo[p] + f * (hi[p] - lo[p]);
+    }
+
+    // Largest difference with the exact probability over n energies from OSC_EMIN to eMax
+    double MaxInterpolationError(const std::vector<OscillationPoint>& points, double eMax, int n = 20000) const
+    {
+        std::vector<double> probabilities(fNPoints);
+        double maxError = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double Enu = OSC_EMIN * std::pow(eMax / OSC_EMIN, (i + 0.5) / n);
+            Evaluate(Enu, probabilities.data());
+            for (int p = 0; p < fNPoints; p++)
+                maxError = std::max(maxError, std::fabs(probabilities[p] - SurvivalProbability(points[p], fBaseline, Enu)));
+        }
+        return maxError;
+    }
+
+private:
+    int fNPoints, fNNodes;
+    double fBaseline, fStep;     // fStep in 1/GeV
+    std::vector<float> fTable;   // [node][point]
+    std::vector<double> fAverage; // below OSC_EMIN
+};
+
+#endif
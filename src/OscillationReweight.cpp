@@ -0,0 +1,273 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1F.h"
+#include "TH2D.h"
+#include "TCanvas.h"
+#include "TLegend.h"
+#include "TStyle.h"
+#include "TSystem.h"
+#include "SampleDefinitions.h"
+#include "Oscillation.h"
+#include "HistogramRegistry.h"
+#include "PlotCache.h"
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// To compile: c++ OscillationReweight.cpp `root-config --cflags --libs` -O2 -o oscillation_reweight.out
+//
+// Oscillated nu_mu disappearance spectra (E_nu^true and E_reco) of DUNE and T2K for a whole grid of
+// (Delta m^2, sin^2 2theta) points, in a single pass per sample: the survival probabilities are
+// tabulated once per baseline (Oscillation.h) and interpolated per event, and since the bin of an
+// event is the same for every point, each point only adds its probability to that bin.
+//
+//     ./oscillation_reweight.out DUNE=flat_Valencia_13815.root T2K=flat_Valencia_2382.root
+//         [--dm2 2.0e-3 3.0e-3 11] [--sin22 0.85 1.0 7] [--nodes 8192] [--exact] [--out ../Oscillation_Plots]
+//
+// LABEL=file@L sets the baseline in km (default: DUNE 1300, T2K 295). --exact computes sin^2 for every
+// event and point instead of using the tables, to compare timings and results.
+
+struct OscillatedSpectrum
+{
+    std::string name, title;
+    int nbins;
+    double lo, hi;
+    std::vector<double> sumw, sumw2; // [bin][point], bins 0 to nbins+1
+};
+
+int main(int argc, char ** argv)
+{
+    gStyle->SetOptStat(0);
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./oscillation_reweight.out \n- LABEL=file.root[@baseline km] for each sample (DUNE, T2K or nuSCOPE)"
+                  << "\n- optional: --dm2 lo hi n (eV^2, default 2.0e-3 3.0e-3 11) \n- optional: --sin22 lo hi n (default 0.85 1.0 7)"
+                  << "\n- optional: --nodes number of table nodes in 1/E (default 8192) \n- optional: --exact (no tables)"
+                  << "\n- optional: --out directory (default ../Oscillation_Plots)" << std::endl;
+        return 1;
+    }
+
+    std::vector<SampleDefinition> samples;
+    std::vector<std::string> files;
+    std::vector<double> baselines;
+    double dm2Lo = 2.0e-3, dm2Hi = 3.0e-3, sin22Lo = 0.85, sin22Hi = 1.0;
+    int nDm2 = 11, nSin22 = 7, nNodes = 8192;
+    bool exact = false;
+    std::string outputDir = "../Oscillation_Plots";
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--dm2" && a + 3 < argc)
+        {
+            dm2Lo = atof(argv[a + 1]);
+            dm2Hi = atof(argv[a + 2]);
+            nDm2 = std::max(1, atoi(argv[a + 3]));
+            a += 3;
+        } else if (arg == "--sin22" && a + 3 < argc)
+        {
+            sin22Lo = atof(argv[a + 1]);
+            sin22Hi = atof(argv[a + 2]);
+            nSin22 = std::max(1, atoi(argv[a + 3]));
+            a += 3;
+        } else if (arg == "--nodes" && a + 1 < argc)
+            nNodes = atoi(argv[++a]);
+        else if (arg == "--exact")
+            exact = true;
+        else if (arg == "--out" && a + 1 < argc)
+            outputDir = argv[++a];
+        else
+        {
+            size_t equal = arg.find('='), at = arg.find('@');
+            SampleDefinition sample;
+            if (equal == std::string::npos || !GetSampleDefinition(arg.substr(0, equal), sample))
+            {
+                printf("Error: \"%s\" is not LABEL=file.root[@baseline] with LABEL DUNE, T2K or nuSCOPE.\n", arg.c_str());
+                return 1;
+            }
+            double baseline = at != std::string::npos ? atof(arg.c_str() + at + 1) : DefaultBaseline(sample.label);
+            if (baseline <= 0)
+            {
+                printf("Error: no baseline for %s, give it as %s=file.root@km.\n", sample.label.c_str(), sample.label.c_str());
+                return 1;
+            }
+            samples.push_back(sample);
+            files.push_back(arg.substr(equal + 1, at == std::string::npos ? std::string::npos : at - equal - 1));
+            baselines.push_back(baseline);
+        }
+    }
+
+    // The output directory is created before the passes, not found missing after them
+    if (gSystem->mkdir(outputDir.c_str(), true) != 0 && gSystem->AccessPathName(outputDir.c_str()))
+    {
+        printf("Error: could not create the output directory %s.\n", outputDir.c_str());
+        return 1;
+    }
+
+    std::vector<OscillationPoint> points = OscillationGrid(dm2Lo, dm2Hi, nDm2, sin22Lo, sin22Hi, nSin22);
+    const int nPoints = points.size();
+    printf("%d oscillation points: dm2 in [%g, %g] eV^2 (%d), sin^2 2theta in [%g, %g] (%d)\n", nPoints, dm2Lo, dm2Hi, nDm2,
+           sin22Lo, sin22Hi, nSin22);
+
+    // ----------------------------------------------------------------------------------------------
+    //                 One pass per sample, all the points filled from the same event
+    // ----------------------------------------------------------------------------------------------
+    HistogramRegistry registry;
+    std::vector<std::vector<OscillatedSpectrum>> spectra(samples.size());
+    std::vector<double> probabilities(nPoints);
+
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        const SampleDefinition& sample = samples[s];
+        TFile *file = TFile::Open(files[s].c_str());
+        TTree *tree = file ? (TTree*) file->Get(sample.treeName.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", sample.treeName.c_str(), files[s].c_str());
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        OscillationTable table(points, baselines[s], nNodes);
+        if (!exact)
+            printf("%s (L = %g km): table of %d nodes x %d points (%.1f MB) in %.2f s, max interpolation error %.1e\n",
+                   sample.label.c_str(), baselines[s], table.GetNNodes(), nPoints, table.GetBytes() / 1048576.,
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                   table.MaxInterpolationError(points, 20.));
+
+        spectra[s].push_back({"Enu", "E_{#nu}^{true} [GeV]", 50, 0, 10, {}, {}});
+        spectra[s].push_back({"Ereco", "E_{#nu}^{reco} [GeV]", 50, 0, 10, {}, {}});
+        for (OscillatedSpectrum& spectrum : spectra[s])
+        {
+            spectrum.sumw.assign((size_t) (spectrum.nbins + 2) * nPoints, 0.);
+            spectrum.sumw2.assign(spectrum.sumw.size(), 0.);
+        }
+        BookedHistogram *hUnoscillated[2];
+        for (int v = 0; v < 2; v++)
+            hUnoscillated[v] = registry.Book("h" + sample.label + "_" + spectra[s][v].name + "_unosc",
+                                             sample.label + " unoscillated;" + spectra[s][v].title + ";Events",
+                                             spectra[s][v].nbins, spectra[s][v].lo, spectra[s][v].hi);
+
+        FlatTreeEvent event;
+        SetFlatTreeBranches(tree, sample, event, false);
+        Long64_t nentries = tree->GetEntries(), nSelected = 0;
+        start = std::chrono::steady_clock::now();
+        for (Long64_t i = 0; i < nentries; i++)
+        {
+            tree->GetEntry(i);
+            if (!event.flag)
+                continue;
+            nSelected++;
+
+            if (exact)
+                for (int p = 0; p < nPoints; p++)
+                    probabilities[p] = SurvivalProbability(points[p], baselines[s], event.Enu_true);
+            else
+                table.Evaluate(event.Enu_true, probabilities.data());
+
+            double values[2] = {event.Enu_true, event.GetEreco(sample.useQE)};
+            for (int v = 0; v < 2; v++)
+            {
+                OscillatedSpectrum& spectrum = spectra[s][v];
+                hUnoscillated[v]->Fill(values[v]);
+                int bin = hUnoscillated[v]->FindBin(values[v]);
+                double *sumw = &spectrum.sumw[(size_t) bin * nPoints], *sumw2 = &spectrum.sumw2[(size_t) bin * nPoints];
+                for (int p = 0; p < nPoints; p++)
+                {
+                    sumw[p] += probabilities[p];
+                    sumw2[p] += probabilities[p] * probabilities[p];
+                }
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %lld of %lld entries selected, %d points filled in %.2f s (%.1f ns per event and point, %s)\n",
+               sample.label.c_str(), (long long) nSelected, (long long) nentries, nPoints, seconds,
+               nSelected > 0 ? 1e9 * seconds / nSelected / nPoints : 0., exact ? "exact" : "tables");
+
+        tree->ResetBranchAddresses();
+        file->Close();
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //      Histograms per point, event ratio over the grid and a few spectra for each sample
+    // ----------------------------------------------------------------------------------------------
+    auto pointName = [&](int p) { return Form("dm2_%.3g_s22_%.3g", 1e3 * points[p].dm2, points[p].sin22); };
+    auto toTH1F = [&](const OscillatedSpectrum& spectrum, const std::string& label, int p)
+    {
+        TH1F *h = registry.Own(new TH1F(("h" + label + "_" + spectrum.name + "_" + pointName(p)).c_str(),
+                                        Form("%s, #Deltam^{2} = %.3g#times10^{-3} eV^{2}, sin^{2}2#theta = %.3g;%s;Events", label.c_str(),
+                                             1e3 * points[p].dm2, points[p].sin22, spectrum.title.c_str()),
+                                        spectrum.nbins, spectrum.lo, spectrum.hi));
+        for (int b = 0; b <= spectrum.nbins + 1; b++)
+        {
+            h->SetBinContent(b, spectrum.sumw[(size_t) b * nPoints + p]);
+            h->SetBinError(b, std::sqrt(spectrum.sumw2[(size_t) b * nPoints + p]));
+        }
+        return h;
+    };
+
+    TFile *output = TFile::Open((outputDir + "/oscillation_reweight.root").c_str(), "RECREATE");
+    if (!output)
+    {
+        printf("Error: could not write %s/oscillation_reweight.root.\n", outputDir.c_str());
+        return 1;
+    }
+    registry.Write();
+
+    const double dDm2 = nDm2 > 1 ? (dm2Hi - dm2Lo) / (nDm2 - 1) : 1e-4, dSin22 = nSin22 > 1 ? (sin22Hi - sin22Lo) / (nSin22 - 1) : 0.01;
+    PlotCache plots(outputDir + "/.plotcache");
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        const std::string& label = samples[s].label;
+        for (const OscillatedSpectrum& spectrum : spectra[s])
+            for (int p = 0; p < nPoints; p++)
+                toTH1F(spectrum, label, p)->Write();
+
+        // Oscillated / unoscillated number of selected events over the grid
+        TH2D *hRatio = registry.Own(new TH2D(("h" + label + "_survival").c_str(),
+                                             (label + " oscillated / unoscillated events;#Deltam^{2} [eV^{2}];sin^{2}2#theta").c_str(),
+                                             nDm2, dm2Lo - 0.5 * dDm2, dm2Hi + 0.5 * dDm2, nSin22, sin22Lo - 0.5 * dSin22, sin22Hi + 0.5 * dSin22));
+        const OscillatedSpectrum& enu = spectra[s][0];
+        double unoscillated = 0;
+        for (int b = 0; b <= enu.nbins + 1; b++)
+            unoscillated += registry.Find("h" + label + "_Enu_unosc")->GetBinContent(b);
+        for (int p = 0; p < nPoints; p++)
+        {
+            double oscillated = 0;
+            for (int b = 0; b <= enu.nbins + 1; b++)
+                oscillated += enu.sumw[(size_t) b * nPoints + p];
+            hRatio->SetBinContent(p / nSin22 + 1, p % nSin22 + 1, unoscillated > 0 ? oscillated / unoscillated : 0.);
+        }
+        hRatio->Write();
+
+        // Unoscillated spectrum and the lowest, middle and highest dm2 at the largest sin^2 2theta
+        TCanvas *canvas = registry.Own(new TCanvas(("c_osc_" + label).c_str(), label.c_str(), 800, 600));
+        TLegend *legend = registry.Own(new TLegend(0.55, 0.7, 0.9, 0.9));
+        TH1F *hUnosc = registry.Materialize(registry.Find("h" + label + "_Enu_unosc"));
+        hUnosc->SetLineColor(kBlack);
+        hUnosc->SetTitle((label + " #nu_{#mu} disappearance;E_{#nu}^{true} [GeV];Events").c_str());
+        hUnosc->Draw("hist");
+        legend->AddEntry(hUnosc, "unoscillated", "l");
+        const int shown[] = {nSin22 - 1, (nDm2 / 2) * nSin22 + nSin22 - 1, nPoints - 1};
+        const int colors[] = {kBlue, kRed, kGreen+2};
+        for (int k = 0; k < 3; k++)
+        {
+            if (k > 0 && shown[k] == shown[k - 1])
+                continue;
+            TH1F *h = toTH1F(enu, label, shown[k]);
+            h->SetLineColor(colors[k]);
+            h->Draw("hist same");
+            legend->AddEntry(h, Form("#Deltam^{2} = %.3g#times10^{-3}, sin^{2}2#theta = %.3g", 1e3 * points[shown[k]].dm2, points[shown[k]].sin22), "l");
+        }
+        legend->Draw();
+        plots.SaveAs(canvas, outputDir + "/" + label + "_oscillated_Enu.pdf");
+    }
+    output->Close();
+
+    registry.PrintSummary("OscillationReweight");
+    plots.PrintSummary("OscillationReweight");
+    return 0;
+}
@@ -0,0 +1,286 @@
+#ifndef PDG_MULTIPLICITY_H
+#define PDG_MULTIPLICITY_H
+
+#include "TH1D.h"
+#include "SampleDefinitions.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Final-state multiplicities of a configurable set of species (pi+-, pi0, p, n, gamma, K, ...)
+//   from the pdg array of a flat tree event, counted in one pass instead of one Sum$() per species
+//   and per histogram:
+//
+//     - Count() copies |pdg| once into an aligned buffer padded to a multiple of 8 (pdg 0 matches
+//       no species), then counts every code with a branchless compare-and-add loop of fixed stride
+//       that the compiler turns into SIMD instructions; the buffer stays in L1 for all the codes;
+//     - MultiplicityTable is the N-dimensional table of the counts (one axis per species, the last
+//       bin of each axis is "maxCount or more"), flattened in mixed radix;
+//     - TopologyDefinition is any topology written as ranges of counts, "NpiNn: pi+- >= 1, n >= 1",
+//       evaluated on the counts already computed, so any number of them costs no extra pass.
+// ------------------------------------------------------------------------------------------------
+
+static const int MULTIPLICITY_PADDED = (MAXPARTICLES + 7) / 8 * 8;
+
+struct MultiplicitySpecies
+{
+    std::string name;
+    std::vector<int> pdgs; // |pdg| codes counted as this species
+};
+
+inline std::vector<MultiplicitySpecies> DefaultMultiplicitySpecies()
+{
+    return {{"pi+-", {211}}, {"pi0", {111}}, {"p", {2212}}, {"n", {2112}}, {"gamma", {22}}, {"K", {321, 311, 310, 130}}};
+}
+
+// "name:pdg,pdg;name:pdg..." e.g. "pi+-:211;p:2212;K:321,311,310,130"
+inline bool ParseMultiplicitySpecies(const std::string& text, std::vector<MultiplicitySpecies>& species, std::string& error)
+{
+    species.clear();
+    std::stringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ';'))
+    {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos || colon == 0)
+        {
+            error = "species \"" + item + "\" is not name:pdg[,pdg...]";
+            return false;
+        }
+        MultiplicitySpecies s;
+        s.name = item.substr(0, colon);
+        std::stringstream codes(item.substr(colon + 1));
+        std::string code;
+        while (std::getline(codes, code, ','))
+            if (atoi(code.c_str()) != 0)
+                s.pdgs.push_back(abs(atoi(code.c_str())));
+        if (s.pdgs.empty())
+        {
+            error = "species " + s.name + " has no pdg code";
+            return false;
+        }
+        species.push_back(s);
+    }
+    if (species.empty())
+        error = "no species in \"" + text + "\"";
+    return !species.empty();
+}
+
+class PdgMultiplicityCounter
+{
+public:
+    explicit PdgMultiplicityCounter(const std::vector<MultiplicitySpecies>& species) : fSpecies(species)
+    {
+        for (size_t s = 0; s < species.size(); s++)
+            for (int code : species[s].pdgs)
+            {
+                fCodes.push_back(code);
+                fCodeSpecies.push_back(s);
+            }
+    }
+
+    int GetNSpecies() const { return fSpecies.size(); }
+    const std::string& GetName(int s) const { return fSpecies[s].name; }
+
+    int FindSpecies(const std::string& name) const
+    {
+        for (size_t s = 0; s < fSpecies.size(); s++)
+            if (fSpecies[s].name == name)
+                return s;
+        return -1;
+    }
+
+    // counts[s] = number of particles of species s among the first n of pdg
+    void Count(int n, const int* pdg, int* counts) const
+    {
+        alignas(32) int apdg[MULTIPLICITY_PADDED];
+        n = std::max(0, std::min(n, MAXPARTICLES));
+        const int padded = (n + 7) / 8 * 8;
+        for (int j = 0; j < n; j++)
+            apdg[j] = abs(pdg[j]);
+        for (int j = n; j < padded; j++)
+            apdg[j] = 0;
+
+        for (size_t s = 0; s < fSpecies.size(); s++)
+            counts[s] = 0;
+        for (size_t c = 0; c < fCodes.size(); c++)
+        {
+            const int code = fCodes[c];
+            int count = 0;
+            for (int j = 0; j < padded; j++)
+                count += (apdg[j] == code);
+            counts[fCodeSpecies[c]] += count;
+        }
+    }
+
+private:
+    std::vector<MultiplicitySpecies> fSpecies;
+    std::vector<int> fCodes, fCodeSpecies; // every (code, species) pair, flattened
+};
+
+// ------------------------------------------------------------------------------------------------
+//                       Topologies as ranges of counts of the species
+// ------------------------------------------------------------------------------------------------
+struct SpeciesCondition
+{
+    int species;
+    int lo, hi; // lo <= count <= hi
+};
+
+struct TopologyDefinition
+{
+    std::string name;
+    std::vector<SpeciesCondition> conditions;
+
+    bool Matches(const int* counts) const
+    {
+        for (const SpeciesCondition& c : conditions)
+            if (counts[c.species] < c.lo || counts[c.species] > c.hi)
+                return false;
+        return true;
+    }
+};
+
+// "name: species op count, species op count, ..." with op one of == >= <= > <
+inline bool ParseTopology(const std::string& text, const PdgMultiplicityCounter& counter, TopologyDefinition& topology, std::string& error)
+{
+    auto trim = [](const std::string& s)
+    {
+        size_t first = s.find_first_not_of(" \t"), last = s.find_last_not_of(" \t");
+        return first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+    };
+
+    size_t colon = text.find(':');
+    if (colon == std::string::npos || trim(text.substr(0, colon)).empty())
+    {
+        error = "topology \"" + text + "\" is not name: conditions";
+        return false;
+    }
+    topology.name = trim(text.substr(0, colon));
+    topology.conditions.clear();
+
+    std::stringstream items(text.substr(colon + 1));
+    std::string item;
+    while (std::getline(items, item, ','))
+    {
+        size_t op = item.find_first_of("=<>");
+        if (op == std::string::npos)
+        {
+            error = "condition \"" + trim(item) + "\" of " + topology.name + " has no ==, >=, <=, > or <";
+            return false;
+        }
+        std::string name = trim(item.substr(0, op));
+        std::string opText = item.substr(op, (op + 1 < item.size() && item[op + 1] == '=') ? 2 : 1);
+        std::string value = trim(item.substr(op + opText.size()));
+        int species = counter.FindSpecies(name);
+        if (species < 0 || value.empty() || value.find_first_not_of("0123456789") != std::string::npos || opText == "=")
+        {
+            error = "condition \"" + trim(item) + "\" of " + topology.name + " is not species op count (unknown species or count?)";
+            return false;
+        }
+
+        int count = atoi(value.c_str());
+        SpeciesCondition c = {species, 0, MAXPARTICLES};
+        if (opText == "==")      { c.lo = count; c.hi = count; }
+        else if (opText == ">=") c.lo = count;
+        else if (opText == ">")  c.lo = count + 1;
+        else if (opText == "<=") c.hi = count;
+        else                     c.hi = count - 1;
+        topology.conditions.push_back(c);
+    }
+    return true;
+}
+
+// The four topologies of SampleDefinitions.h (charged pions and neutrons)
+inline std::vector<std::string> DefaultTopologies()
+{
+    return {"0pi0n: pi+- == 0, n == 0", "0piNn: pi+- == 0, n >= 1", "Npi0n: pi+- >= 1, n == 0", "NpiNn: pi+- >= 1, n >= 1"};
+}
+
+// ------------------------------------------------------------------------------------------------
+//            N-dimensional multiplicity table (sum of weights per combination of counts)
+// ------------------------------------------------------------------------------------------------
+class MultiplicityTable
+{
+public:
+    MultiplicityTable(int nSpecies, int maxCount) : fNSpecies(nSpecies), fMaxCount(maxCount)
+    {
+        size_t nCells = 1;
+        for (int s = 0; s < nSpecies; s++)
+            nCells *= maxCount + 1;
+        fSumw.assign(nCells, 0.);
+    }
+
+    int GetNCells() const { return fSumw.size(); }
+    double GetSumw(int cell) const { return fSumw[cell]; }
+
+    int Cell(const int* counts) const
+    {
+        int cell = 0;
+        for (int s = 0; s < fNSpecies; s++)
+            cell = cell * (fMaxCount + 1) + std::min(counts[s], fMaxCount);
+        return cell;
+    }
+
+    void Fill(const int* counts, double w = 1) { fSumw[Cell(counts)] += w; }
+
+    void Add(const MultiplicityTable& other)
+    {
+        for (size_t c = 0; c < fSumw.size(); c++)
+            fSumw[c] += other.fSumw[c];
+    }
+
+    // e.g. "pi+-=1 pi0=0 p=3+ n=0 gamma=0 K=0"
+    std::string CellLabel(int cell, const PdgMultiplicityCounter& counter) const
+    {
+        std::string label;
+        for (int s = fNSpecies - 1; s >= 0; s--)
+        {
+            int count = cell % (fMaxCount + 1);
+            cell /= fMaxCount + 1;
+            label = counter.GetName(s) + "=" + std::to_string(count) + (count == fMaxCount ? "+" : "") + (label.empty() ? "" : " ") + label;
+        }
+        return label;
+    }
+
+    // Flattened table, one labelled bin per cell (not attached to any directory)
+    TH1D* ToTH1D(const std::string& name, const std::string& title, const PdgMultiplicityCounter& counter) const
+    {
+        TH1D *h = new TH1D(name.c_str(), title.c_str(), fSumw.size(), 0, fSumw.size());
+        h->SetDirectory(nullptr);
+        for (size_t c = 0; c < fSumw.size(); c++)
+        {
+            h->SetBinContent(c + 1, fSumw[c]);
+            h->GetXaxis()->SetBinLabel(c + 1, CellLabel(c, counter).c_str());
+        }
+        return h;
+    }
+
+    // The nTop most populated combinations
+    void PrintTop(const char* label, const PdgMultiplicityCounter& counter, int nTop) const
+    {
+        std::vector<int> cells(fSumw.size());
+        double total = 0;
+        for (size_t c = 0; c < fSumw.size(); c++)
+        {
+            cells[c] = c;
+            total += fSumw[c];
+        }
+        nTop = std::min(nTop, (int) cells.size());
+        std::partial_sort(cells.begin(), cells.begin() + nTop, cells.end(), [this](int a, int b) { return fSumw[a] > fSumw[b]; });
+
+        printf("[PdgMultiplicity] %s: %d most common final states of %.0f events\n", label, nTop, total);
+        for (int k = 0; k < nTop && fSumw[cells[k]] > 0; k++)
+            printf("  %6.2f%%  %s\n", total > 0 ? 100 * fSumw[cells[k]] / total : 0., CellLabel(cells[k], counter).c_str());
+    }
+
+private:
+    int fNSpecies, fMaxCount;
+    std::vector<double> fSumw;
+};
+
+#endif
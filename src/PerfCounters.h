@@ -0,0 +1,265 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// ------------------------------------------------------------------------------------------------
+//   Hardware performance counters per stage of an event loop (Linux perf_event_open): cycles,
+//   instructions, cache misses and branch misses, counted in user space for this thread.
+//
+//       StageProfiler profiler;
+//       int read = profiler.Stage("GetEntry"), fill = profiler.Stage("fill");
+//       for (...) { profiler.Enter(read); tree->GetEntry(i); profiler.Enter(fill); ...; profiler.CountEvents(); }
+//       profiler.Stop();
+//       profiler.Print("label");
+//
+//   Enter() reads the counters once (a single read() of the whole counter group) and charges what
+//   was counted since the previous call to the stage that was running: the overhead is about a
+//   microsecond per call, so the absolute wall time of a profiled run is a bit longer than normal.
+//   An interval with a failed read at either end keeps its wall time but not its counts, and Print
+//   says how many intervals of the stage were left out.
+//
+//   IPC, cache misses and branch misses per thousand instructions tell a memory-bound stage (low IPC,
+//   many cache misses) from a branch-bound one (many branch misses) or a compute/decompression-bound
+//   one (GetEntry with high IPC). When the counters cannot be opened (not Linux, containers,
+//   /proc/sys/kernel/perf_event_paranoid too strict, virtual machines without a PMU) the reason is
+//   printed once and only the wall time is reported; counters that one CPU does not have are "n/a".
+// ------------------------------------------------------------------------------------------------
+
+enum PerfCounter { kPerfCycles = 0, kPerfInstructions = 1, kPerfCacheMisses = 2, kPerfBranchMisses = 3, kNPerfCounters = 4 };
+
+inline const char* PerfCounterName(int c)
+{
+    static const char* names[kNPerfCounters] = {"cycles", "instructions", "cache-misses", "branch-misses"};
+    return (c >= 0 && c < kNPerfCounters) ? names[c] : "unknown";
+}
+
+// The four counters of the calling thread, opened as one group so that they are read together
+class PerfCounterGroup
+{
+public:
+    PerfCounterGroup()
+    {
+        for (int c = 0; c < kNPerfCounters; c++)
+            fSlot[c] = -1;
+#ifdef __linux__
+        const uint64_t configs[kNPerfCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int c = 0; c < kNPerfCounters; c++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[c];
+            attr.disabled = (fLeader < 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, fLeader, 0);
+            if (fd < 0)
+            {
+                if (fLeader < 0)
+                {
+                    fError = strerror(errno);
+                    return; // without the leader nothing can be counted
+                }
+                continue;   // this counter is not available, the others are
+            }
+            if (fLeader < 0)
+                fLeader = fd;
+            fSlot[c] = fNOpen++;
+            fFds.push_back(fd);
+        }
+        ioctl(fLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+        fError = "perf_event_open is Linux only";
+#endif
+    }
+
+    ~PerfCounterGroup()
+    {
+#ifdef __linux__
+        for (int fd : fFds)
+            close(fd);
+#endif
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool IsAvailable() const { return fLeader >= 0; }
+    bool HasCounter(int c) const { return fSlot[c] >= 0; }
+    const std::string& GetError() const { return fError; }
+
+    // Current values (0 for the counters that are not available); false if the read failed
+    bool Read(uint64_t values[kNPerfCounters]) const
+    {
+        for (int c = 0; c < kNPerfCounters; c++)
+            values[c] = 0;
+#ifdef __linux__
+        if (fLeader < 0)
+            return false;
+        uint64_t buffer[1 + kNPerfCounters]; // PERF_FORMAT_GROUP: number of counters, then their values
+        if (read(fLeader, buffer, sizeof(buffer)) < (ssize_t) ((1 + fNOpen) * sizeof(uint64_t)))
+            return false;
+        for (int c = 0; c < kNPerfCounters; c++)
+            if (fSlot[c] >= 0)
+                values[c] = buffer[1 + fSlot[c]];
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    int fLeader = -1, fNOpen = 0;
+    int fSlot[kNPerfCounters]; // position of each counter in the group, -1 if not opened
+    std::vector<int> fFds;
+    std::string fError;
+};
+
+// ------------------------------------------------------------------------------------------------
+//                   Counters and wall time accumulated per stage of a loop
+// ------------------------------------------------------------------------------------------------
+class StageProfiler
+{
+public:
+    StageProfiler()
+    {
+        if (!fCounters.IsAvailable())
+            printf("[PerfCounters] hardware counters unavailable (%s): only wall times are reported\n", fCounters.GetError().c_str());
+    }
+
+    // Index of a stage, added the first time its name is used
+    int Stage(const std::string& name)
+    {
+        for (size_t s = 0; s < fStages.size(); s++)
+            if (fStages[s].name == name)
+                return s;
+        fStages.push_back(StageTotals());
+        fStages.back().name = name;
+        return fStages.size() - 1;
+    }
+
+    // Ends the running stage (if any) and starts this one
+    void Enter(int stage)
+    {
+        Mark();
+        fCurrent = stage;
+    }
+
+    // Ends the running stage, e.g. at the end of the loop
+    void Stop()
+    {
+        Mark();
+        fCurrent = -1;
+    }
+
+    void CountEvents(long long n = 1) { fNEvents += n; }
+
+    void Print(const char* label) const
+    {
+        double totalCycles = 0, totalSeconds = 0;
+        for (const StageTotals& stage : fStages)
+        {
+            totalCycles += stage.counts[kPerfCycles];
+            totalSeconds += stage.seconds;
+        }
+
+        printf("\n[PerfCounters] %s: %lld events\n", label, fNEvents);
+        printf("  %-24s %9s %9s %6s %11s %11s %6s %11s %11s\n", "stage", "wall [s]", "ns/event", "share",
+               "cycles/ev", "instr/ev", "IPC", "cache MPKI", "branch MPKI");
+        for (const StageTotals& stage : fStages)
+        {
+            double events = fNEvents > 0 ? (double) fNEvents : 1.;
+            double cycles = stage.counts[kPerfCycles], instructions = stage.counts[kPerfInstructions];
+            double share = totalCycles > 0 ? cycles / totalCycles : (totalSeconds > 0 ? stage.seconds / totalSeconds : 0.);
+            printf("  %-24s %9.3f %9.1f %5.1f%%", stage.name.c_str(), stage.seconds, 1e9 * stage.seconds / events, 100 * share);
+
+            if (!fCounters.IsAvailable())
+            {
+                printf("\n");
+                continue;
+            }
+            bool hasCycles = fCounters.HasCounter(kPerfCycles), hasInstructions = fCounters.HasCounter(kPerfInstructions);
+            PrintValue(hasCycles, cycles / events, 11, 0);
+            PrintValue(hasInstructions, instructions / events, 11, 0);
+            PrintValue(hasCycles && hasInstructions, cycles > 0 ? instructions / cycles : 0., 6, 2);
+            PrintValue(hasInstructions && fCounters.HasCounter(kPerfCacheMisses),
+                       instructions > 0 ? 1000 * stage.counts[kPerfCacheMisses] / instructions : 0., 11, 2);
+            PrintValue(hasInstructions && fCounters.HasCounter(kPerfBranchMisses),
+                       instructions > 0 ? 1000 * stage.counts[kPerfBranchMisses] / instructions : 0., 11, 2);
+            if (stage.nInvalid > 0)
+                printf("  (counters missing for %lld of %lld intervals)", stage.nInvalid, stage.nIntervals);
+            printf("\n");
+        }
+    }
+
+private:
+    struct StageTotals
+    {
+        std::string name;
+        double seconds = 0;
+        double counts[kNPerfCounters] = {0, 0, 0, 0};
+        long long nIntervals = 0, nInvalid = 0; // invalid: a counter read failed at one end
+    };
+
+    void Mark()
+    {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t values[kNPerfCounters];
+        bool valid = fCounters.Read(values);
+
+        // An interval counts only if both of its reads succeeded (a failed read gives zeros, which
+        // would wrap around as unsigned deltas)
+        if (fCurrent >= 0)
+        {
+            StageTotals& stage = fStages[fCurrent];
+            stage.seconds += std::chrono::duration<double>(now - fLastTime).count();
+            stage.nIntervals++;
+            if (valid && fLastValid)
+                for (int c = 0; c < kNPerfCounters; c++)
+                    stage.counts[c] += values[c] - fLastValues[c];
+            else if (fCounters.IsAvailable())
+                stage.nInvalid++;
+        }
+        fLastTime = now;
+        fLastValid = valid;
+        if (valid)
+            memcpy(fLastValues, values, sizeof(values));
+    }
+
+    static void PrintValue(bool available, double value, int width, int precision)
+    {
+        if (available)
+            printf(" %*.*f", width, precision, value);
+        else
+            printf(" %*s", width, "n/a");
+    }
+
+    PerfCounterGroup fCounters;
+    std::vector<StageTotals> fStages;
+    int fCurrent = -1;
+    long long fNEvents = 0;
+    std::chrono::steady_clock::time_point fLastTime;
+    uint64_t fLastValues[kNPerfCounters] = {0, 0, 0, 0};
+    bool fLastValid = false;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef PLOT_CACHE_H
+#define PLOT_CACHE_H
+
+#include "TCanvas.h"
+#include "TVirtualPad.h"
+#include "TList.h"
+#include "TH1.h"
+#include "TGraph.h"
+#include "TLegend.h"
+#include "TLegendEntry.h"
+#include "TAxis.h"
+#include "TAttText.h"
+#include "TText.h"
+#include "TLine.h"
+#include "TBox.h"
+#include "TPave.h"
+#include "TStyle.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+// ------------------------------------------------------------------------------------------------
+//   Incremental rendering of the plots of a macro. Instead of canvas->SaveAs(path), a macro calls
+//   cache.SaveAs(canvas, path): a 64-bit hash of everything drawn on the canvas (bin contents and
+//   errors, axes, titles, draw options, colors, styles, markers, legends, pad settings, the
+//   position, size and attributes of texts, lines, boxes and panes, the same for every sub-pad,
+//   and the gStyle settings that change how they are drawn) is compared with the hash stored for
+//   that path when it was last written, and the file is only rendered again when the hash changed
+//   or the file is missing.
+//   The hashes are kept in a small text file ("hash path" per line) next to the plots.
+// ------------------------------------------------------------------------------------------------
+
+class PlotHash
+{
+public:
+    // FNV-1a over the bytes of every value added
+    void Add(const void* data, size_t n)
+    {
+        const unsigned char* bytes = (const unsigned char*) data;
+        for (size_t i = 0; i < n; i++)
+        {
+            fHash ^= bytes[i];
+            fHash *= 0x100000001b3ULL;
+        }
+    }
+    void Add(double x) { Add(&x, sizeof(x)); }
+    void Add(int x) { Add(&x, sizeof(x)); }
+    void Add(const char* text) { Add(std::string(text ? text : "")); }
+    void Add(const std::string& text)
+    {
+        Add(text.data(), text.size());
+        Add((int) text.size()); // so that "ab"+"c" and "a"+"bc" differ
+    }
+
+    uint64_t Value() const { return fHash; }
+
+private:
+    uint64_t fHash = 0xcbf29ce484222325ULL;
+};
+
+class PlotCache
+{
+public:
+    explicit PlotCache(const std::string& cacheFile) : fCacheFile(cacheFile)
+    {
+        std::ifstream in(cacheFile);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::stringstream stream(line);
+            unsigned long long hash;
+            std::string path;
+            if (stream >> std::hex >> hash >> std::ws && std::getline(stream, path))
+                fHashes[path] = hash;
+        }
+    }
+
+    ~PlotCache() { Flush(); }
+
+    PlotCache(const PlotCache&) = delete;
+    PlotCache& operator=(const PlotCache&) = delete;
+
+    // Renders every plot, whatever the stored hashes (the hashes are still updated)
+    void SetForce(bool force) { fForce = force; }
+
+    // Saves the canvas to path unless the same content was already saved there; true if it was rendered
+    bool SaveAs(TCanvas* canvas, const std::string& path)
+    {
+        PlotHash hash;
+        hash.Add(path);
+        hash.Add((int) canvas->GetWw());
+        hash.Add((int) canvas->GetWh());
+        HashStyle(hash);
+        HashPad(canvas, hash);
+
+        auto it = fHashes.find(path);
+        if (!fForce && it != fHashes.end() && it->second == hash.Value() && std::ifstream(path).good())
+        {
+            fNReused++;
+            return false;
+        }
+
+        canvas->SaveAs(path.c_str());
+        fHashes[path] = hash.Value();
+        fNRebuilt++;
+        fModified = true;
+        return true;
+    }
+
+    int GetNReused() const { return fNReused; }
+    int GetNRebuilt() const { return fNRebuilt; }
+
+    void PrintSummary(const char* label) const
+    {
+        printf("[PlotCache] %s: %d plots rebuilt, %d reused (unchanged)\n", label, fNRebuilt, fNReused);
+    }
+
+    // Writes the hashes to the cache file (done by the destructor)
+    void Flush()
+    {
+        if (!fModified)
+            return;
+        std::ofstream out(fCacheFile);
+        if (!out)
+        {
+            printf("Error: could not write the plot cache %s.\n", fCacheFile.c_str());
+            return;
+        }
+        for (const auto& entry : fHashes)
+            out << std::hex << entry.second << " " << entry.first << "\n";
+        fModified = false;
+    }
+
+private:
+    static void HashAxis(const TAxis* axis, PlotHash& hash)
+    {
+        if (!axis)
+            return;
+        hash.Add(axis->GetNbins());
+        hash.Add(axis->GetXmin());
+        hash.Add(axis->GetXmax());
+        hash.Add(axis->GetFirst());
+        hash.Add(axis->GetLast());
+        hash.Add(axis->GetTitle());
+        hash.Add((double) axis->GetTitleSize());
+        hash.Add((double) axis->GetTitleOffset());
+        hash.Add((double) axis->GetLabelSize());
+        hash.Add(axis->GetNdivisions());
+    }
+
+    static void HashHistogram(const TH1* h, PlotHash& hash)
+    {
+        hash.Add(h->GetTitle());
+        HashAxis(h->GetXaxis(), hash);
+        HashAxis(h->GetYaxis(), hash);
+        for (int b = 0; b < h->GetNcells(); b++)
+        {
+            hash.Add(h->GetBinContent(b));
+            hash.Add(h->GetBinError(b));
+        }
+        hash.Add(h->GetMaximumStored());
+        hash.Add(h->GetMinimumStored());
+        hash.Add((int) h->GetLineColor());
+        hash.Add((int) h->GetLineStyle());
+        hash.Add((int) h->GetLineWidth());
+        hash.Add((int) h->GetFillColor());
+        hash.Add((int) h->GetFillStyle());
+        hash.Add((int) h->GetMarkerColor());
+        hash.Add((int) h->GetMarkerStyle());
+        hash.Add((double) h->GetMarkerSize());
+    }
+
+    static void HashGraph(const TGraph* g, PlotHash& hash)
+    {
+        hash.Add(g->GetTitle());
+        hash.Add(g->GetN());
+        for (int i = 0; i < g->GetN(); i++)
+        {
+            hash.Add(g->GetX()[i]);
+            hash.Add(g->GetY()[i]);
+            hash.Add(g->GetErrorX(i));
+            hash.Add(g->GetErrorY(i));
+        }
+        hash.Add((int) g->GetLineColor());
+        hash.Add((int) g->GetLineStyle());
+        hash.Add((int) g->GetLineWidth());
+        hash.Add((int) g->GetFillColor());
+        hash.Add((int) g->GetMarkerColor());
+        hash.Add((int) g->GetMarkerStyle());
+    }
+
+    static void HashLegend(const TLegend* legend, PlotHash& hash)
+    {
+        hash.Add(legend->GetX1NDC());
+        hash.Add(legend->GetY1NDC());
+        hash.Add(legend->GetX2NDC());
+        hash.Add(legend->GetY2NDC());
+        hash.Add(legend->GetNColumns());
+        hash.Add((double) legend->GetTextSize());
+        TIter next(legend->GetListOfPrimitives());
+        while (TObject *object = next())
+        {
+            TLegendEntry *entry = (TLegendEntry*) object;
+            hash.Add(entry->GetLabel());
+            hash.Add(entry->GetOption());
+        }
+    }
+
+    // Position, size and line, fill and text attributes of any other primitive (TLatex, TLine, TBox,
+    // TPaveText, ...)
+    static void HashPrimitive(TObject* object, PlotHash& hash)
+    {
+        hash.Add(object->GetName());
+        hash.Add(object->GetTitle()); // e.g. the text of a TLatex
+        if (TText *text = dynamic_cast<TText*>(object))
+        {
+            hash.Add(text->GetX());
+            hash.Add(text->GetY());
+            hash.Add(text->GetNDC() ? 1 : 0);
+        } else if (TPave *pave = dynamic_cast<TPave*>(object))
+        {
+            hash.Add(pave->GetX1NDC());
+            hash.Add(pave->GetY1NDC());
+            hash.Add(pave->GetX2NDC());
+            hash.Add(pave->GetY2NDC());
+        } else if (TBox *box = dynamic_cast<TBox*>(object))
+        {
+            hash.Add(box->GetX1());
+            hash.Add(box->GetY1());
+            hash.Add(box->GetX2());
+            hash.Add(box->GetY2());
+        } else if (TLine *line = dynamic_cast<TLine*>(object))
+        {
+            hash.Add(line->GetX1());
+            hash.Add(line->GetY1());
+            hash.Add(line->GetX2());
+            hash.Add(line->GetY2());
+            hash.Add(line->GetNDC() ? 1 : 0);
+        }
+
+        if (TAttText *text = dynamic_cast<TAttText*>(object))
+        {
+            hash.Add((double) text->GetTextSize());
+            hash.Add((double) text->GetTextAngle());
+            hash.Add((int) text->GetTextAlign());
+            hash.Add((int) text->GetTextFont());
+            hash.Add((int) text->GetTextColor());
+        }
+        if (TAttLine *line = dynamic_cast<TAttLine*>(object))
+        {
+            hash.Add((int) line->GetLineColor());
+            hash.Add((int) line->GetLineStyle());
+            hash.Add((int) line->GetLineWidth());
+        }
+        if (TAttFill *fill = dynamic_cast<TAttFill*>(object))
+        {
+            hash.Add((int) fill->GetFillColor());
+            hash.Add((int) fill->GetFillStyle());
+        }
+    }
+
+    // The gStyle settings that change the rendering of the same objects (stat box, title, fonts,
+    // ticks, error bars, palette)
+    static void HashStyle(PlotHash& hash)
+    {
+        hash.Add(gStyle->GetName());
+        hash.Add(gStyle->GetOptStat());
+        hash.Add(gStyle->GetOptTitle());
+        hash.Add(gStyle->GetOptFit());
+        hash.Add(gStyle->GetPadTickX());
+        hash.Add(gStyle->GetPadTickY());
+        hash.Add((double) gStyle->GetTitleX());
+        hash.Add((double) gStyle->GetTitleY());
+        hash.Add((double) gStyle->GetTitleW());
+        hash.Add((double) gStyle->GetTitleH());
+        hash.Add((int) gStyle->GetTitleFont(""));
+        hash.Add((int) gStyle->GetTitleFont("X"));
+        hash.Add((double) gStyle->GetTitleFontSize());
+        hash.Add((int) gStyle->GetLabelFont("X"));
+        hash.Add((int) gStyle->GetTextFont());
+        hash.Add((double) gStyle->GetTextSize());
+        hash.Add((int) gStyle->GetHistLineWidth());
+        hash.Add((int) gStyle->GetFrameLineWidth());
+        hash.Add((double) gStyle->GetEndErrorSize());
+        hash.Add((double) gStyle->GetErrorX());
+        hash.Add(gStyle->GetPaintTextFormat());
+        hash.Add(gStyle->GetNumberContours());
+        hash.Add(gStyle->GetNumberOfColors());
+        for (int c = 0; c < gStyle->GetNumberOfColors(); c++)
+            hash.Add(gStyle->GetColorPalette(c));
+    }
+
+    // Everything drawn on a pad, in drawing order, with the draw options
+    static void HashPad(TVirtualPad* pad, PlotHash& hash)
+    {
+        hash.Add(pad->GetLogx());
+        hash.Add(pad->GetLogy());
+        hash.Add(pad->GetLogz());
+        hash.Add(pad->GetGridx() ? 1 : 0);
+        hash.Add(pad->GetGridy() ? 1 : 0);
+        hash.Add(pad->GetLeftMargin());
+        hash.Add(pad->GetRightMargin());
+        hash.Add(pad->GetTopMargin());
+        hash.Add(pad->GetBottomMargin());
+
+        TIter next(pad->GetListOfPrimitives());
+        while (TObject *object = next())
+        {
+            hash.Add(object->ClassName());
+            hash.Add(next.GetOption());
+            if (TVirtualPad *subPad = dynamic_cast<TVirtualPad*>(object))
+                HashPad(subPad, hash);
+            else if (TH1 *h = dynamic_cast<TH1*>(object))
+                HashHistogram(h, hash);
+            else if (TGraph *g = dynamic_cast<TGraph*>(object))
+                HashGraph(g, hash);
+            else if (TLegend *legend = dynamic_cast<TLegend*>(object))
+                HashLegend(legend, hash);
+            else
+                HashPrimitive(object, hash);
+        }
+    }
+
+    std::string fCacheFile;
+    std::map<std::string, uint64_t> fHashes;
+    int fNReused = 0, fNRebuilt = 0;
+    bool fForce = false, fModified = false;
+};
+
+#endif
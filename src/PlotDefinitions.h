@@ -0,0 +1,244 @@
+#ifndef PLOT_DEFINITIONS_H
+#define PLOT_DEFINITIONS_H
+
+#include "TTree.h"
+#include "TH1F.h"
+#include "SampleDefinitions.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   The standard plots as the macros define them, kept in one place so that ValidationHarness.cpp
+//   and StartupBenchmark.cpp run exactly the code of the macros:
+//     - test.cpp: one TTree::Project() expression and cut per histogram (unweighted), own binnings
+//     - DUNE_vs_T2K_plots.cpp: the branches, selection and values of ProcessTree (in float), filled
+//       into master histograms and derived to its own binnings
+//   The two macros do not agree on every binning (the DUNE bias per Mode category is [0,1] in
+//   test.cpp, [-0.5,2.5] in DUNE_vs_T2K_plots.cpp) nor on the form of the cuts (flag * (Mode==1)
+//   and flag && (...) in test.cpp, an early continue in ProcessTree): ValidationHarness.cpp
+//   reports both instead of choosing one.
+// ------------------------------------------------------------------------------------------------
+
+enum PlotVariable { kPlotEnu = 0, kPlotBias = 1, kPlotBiasRelative = 2 };
+
+struct PlotDefinition
+{
+    const char *name, *title;
+    const char *sample;          // DUNE or T2K
+    int variable;                // PlotVariable
+    int category;                // Mode category, -1 for all
+    int topology;                // -1 for all
+    int nbins;
+    double lo, hi;
+    const char *expression, *cut; // TTree::Project() strings, nullptr if the histogram is not filled from strings
+};
+
+// test.cpp: the histograms and the strings of its FormulaFiller (TTree::Project()) calls
+inline const std::vector<PlotDefinition>& GetTestPlots()
+{
+    static const std::vector<PlotDefinition> plots = {
+        // True neutrino energy
+        {"hEnuDUNE", "True neutrino energy comparison;E_{#nu}^{true} [GeV];Entries", "DUNE", kPlotEnu, -1, -1, 50, 0, 10,
+         "Enu_true", "flagCCINC"},
+        {"hEnuT2K", "True neutrino energy comparison;E_{#nu}^{true} [GeV];Entries", "T2K", kPlotEnu, -1, -1, 50, 0, 10,
+         "Enu_true", "flagCC0pi"},
+
+        // Energy bias
+        {"hDeltaDUNE", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries", "DUNE",
+         kPlotBias, -1, -1, 50, -0.5, 2.5, "Enu_true - (Erecoil_minerva+ELep)", "flagCCINC"},
+        {"hDeltaT2K", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries", "T2K",
+         kPlotBias, -1, -1, 50, -0.5, 2.5, "Enu_true - Enu_QE", "flagCC0pi"},
+
+        // Weighted energy bias
+        {"hDeltaDUNE_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries",
+         "DUNE", kPlotBiasRelative, -1, -1, 50, -1, 2, "(Enu_true-(Erecoil_minerva+ELep))/Enu_true", "flagCCINC"},
+        {"hDeltaT2K_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries",
+         "T2K", kPlotBiasRelative, -1, -1, 50, -1, 2, "(Enu_true-Enu_QE)/Enu_true", "flagCC0pi"},
+
+        // DUNE Mode separation: CCQE = Mode 1, RES = Mode 11, 12, 13, 2p2h = Mode 2
+        {"hDUNE_CCQE", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", "DUNE", kPlotEnu, kCCQE, -1, 50, 0, 10,
+         "Enu_true", "flagCCINC * (Mode==1)"},
+        {"hDUNE_RES", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", "DUNE", kPlotEnu, kRES, -1, 50, 0, 10,
+         "Enu_true", "flagCCINC && ( (Mode==11) || (Mode==12) || (Mode==13) )"},
+        {"hDUNE_2p2h", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", "DUNE", kPlotEnu, k2p2h, -1, 50, 0, 10,
+         "Enu_true", "flagCCINC * (Mode==2)"},
+        {"hDUNE_Other", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", "DUNE", kPlotEnu, kOther, -1, 50, 0, 10,
+         "Enu_true", "flagCCINC * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)"},
+
+        // T2K Mode separation
+        {"hT2K_CCQE", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", "T2K", kPlotEnu, kCCQE, -1, 50, 0, 12,
+         "Enu_true", "flagCC0pi * (Mode==1)"},
+        {"hT2K_RES", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", "T2K", kPlotEnu, kRES, -1, 50, 0, 12,
+         "Enu_true", "flagCC0pi && ( (Mode==11) || (Mode==12) || (Mode==13) )"},
+        {"hT2K_2p2h", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", "T2K", kPlotEnu, k2p2h, -1, 50, 0, 12,
+         "Enu_true", "flagCC0pi * (Mode==2)"},
+        {"hT2K_Other", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", "T2K", kPlotEnu, kOther, -1, 50, 0, 12,
+         "Enu_true", "flagCC0pi * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)"},
+
+        // DUNE Energy bias by mode
+        {"hDUNE_Delta_CCQE", "DUNE difference between true and reco #nu energy divided by channel;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries",
+         "DUNE", kPlotBias, kCCQE, -1, 100, 0, 1, "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC * (Mode==1)"},
+        {"hDUNE_Delta_RES", "DUNE RES DeltaE;#DeltaE [GeV];Entries", "DUNE", kPlotBias, kRES, -1, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ( (Mode==11) || (Mode==12) || (Mode==13) )"},
+        {"hDUNE_Delta_2p2h", "DUNE 2p2h DeltaE;#DeltaE [GeV];Entries", "DUNE", kPlotBias, k2p2h, -1, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC * (Mode==2)"},
+        {"hDUNE_Delta_Other", "DUNE Other DeltaE;#DeltaE [GeV];Entries", "DUNE", kPlotBias, kOther, -1, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)"},
+
+        // T2K Energy bias by mode
+        {"hT2K_Delta_CCQE", "T2K CCQE DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, kCCQE, -1, 50, -0.5, 2.5,
+         "Enu_true-Enu_QE", "flagCC0pi * (Mode==1)"},
+        {"hT2K_Delta_RES", "T2K RES DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, kRES, -1, 50, -0.5, 2.5,
+         "Enu_true-Enu_QE", "flagCC0pi && ( (Mode==11) || (Mode==12) || (Mode==13) )"},
+        {"hT2K_Delta_2p2h", "T2K 2p2h DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, k2p2h, -1, 50, -0.5, 2.5,
+         "Enu_true-Enu_QE", "flagCC0pi * (Mode==2)"},
+        {"hT2K_Delta_Other", "T2K Other DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, kOther, -1, 50, -0.5, 2.5,
+         "Enu_true-Enu_QE", "flagCC0pi * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)"},
+
+        // DUNE Energy bias by topology: pions (211), neutrons (2112)
+        {"hDUNE_0pi0n", "DUNE 0pi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "DUNE", kPlotBias, -1, k0pi0n, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))==0) && (Sum$((abs(pdg)==211))==0))"},
+        {"hDUNE_0piNn", "DUNE 0piNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "DUNE", kPlotBias, -1, k0piNn, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))>0) && (Sum$((abs(pdg)==211))==0))"},
+        {"hDUNE_Npi0n", "DUNE Npi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "DUNE", kPlotBias, -1, kNpi0n, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))==0) && (Sum$((abs(pdg)==211))>0))"},
+        {"hDUNE_NpiNn", "DUNE NpiNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "DUNE", kPlotBias, -1, kNpiNn, 200, 0, 1,
+         "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))>0) && (Sum$((abs(pdg)==211))>0))"},
+
+        // T2K Energy bias by topology: booked, not filled yet
+        {"hT2K_0pi0n", "DUNE 0pi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, -1, k0pi0n, 50, -0.5, 2.5,
+         nullptr, nullptr},
+        {"hT2K_0piNn", "DUNE 0piNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, -1, k0piNn, 50, -0.5, 2.5,
+         nullptr, nullptr},
+        {"hT2K_Npi0n", "DUNE Npi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, -1, kNpi0n, 50, -0.5, 2.5,
+         nullptr, nullptr},
+        {"hT2K_NpiNn", "DUNE NpiNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", "T2K", kPlotBias, -1, kNpiNn, 50, -0.5, 2.5,
+         nullptr, nullptr},
+    };
+    return plots;
+}
+
+// DUNE_vs_T2K_plots.cpp: the histograms derived from the masters filled by ProcessTree
+inline const std::vector<PlotDefinition>& GetProcessTreePlots()
+{
+    static const std::vector<PlotDefinition> plots = {
+        {"hEnuDUNE", "True neutrino energy comparison;E_{#nu}^{true} [MeV];Entries", "DUNE", kPlotEnu, -1, -1, 50, 0, 10, nullptr, nullptr},
+        {"hEnuT2K", "True neutrino energy comparison;E_{#nu}^{true} [MeV];Entries", "T2K", kPlotEnu, -1, -1, 50, 0, 10, nullptr, nullptr},
+        {"hDeltaDUNE", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [MeV];Entries", "DUNE",
+         kPlotBias, -1, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hDeltaT2K", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [MeV];Entries", "T2K",
+         kPlotBias, -1, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hDeltaDUNE_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries",
+         "DUNE", kPlotBiasRelative, -1, -1, 50, -1, 2, nullptr, nullptr},
+        {"hDeltaT2K_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries",
+         "T2K", kPlotBiasRelative, -1, -1, 50, -1, 2, nullptr, nullptr},
+
+        {"hDUNE_CCQE", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", "DUNE", kPlotEnu, kCCQE, -1, 50, 0, 10, nullptr, nullptr},
+        {"hDUNE_RES", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", "DUNE", kPlotEnu, kRES, -1, 50, 0, 10, nullptr, nullptr},
+        {"hDUNE_2p2h", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", "DUNE", kPlotEnu, k2p2h, -1, 50, 0, 10, nullptr, nullptr},
+        {"hDUNE_Other", "DUNE events divided by channels;E_{#nu}^{true} [MeV];Entries", "DUNE", kPlotEnu, kOther, -1, 50, 0, 10, nullptr, nullptr},
+
+        {"hT2K_CCQE", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", "T2K", kPlotEnu, kCCQE, -1, 50, 0, 12, nullptr, nullptr},
+        {"hT2K_RES", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", "T2K", kPlotEnu, kRES, -1, 50, 0, 12, nullptr, nullptr},
+        {"hT2K_2p2h", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", "T2K", kPlotEnu, k2p2h, -1, 50, 0, 12, nullptr, nullptr},
+        {"hT2K_Other", "T2K events divided by channels;E_{#nu}^{true} [MeV];Entries", "T2K", kPlotEnu, kOther, -1, 50, 0, 12, nullptr, nullptr},
+
+        {"hDUNE_Delta_CCQE", "DUNE difference between true and reco #nu energy divided by channel;E_{#nu}^{true} - E_{nu}^{reco} [MeV];Entries",
+         "DUNE", kPlotBias, kCCQE, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hDUNE_Delta_RES", "DUNE RES DeltaE;#DeltaE [MeV];Entries", "DUNE", kPlotBias, kRES, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hDUNE_Delta_2p2h", "DUNE 2p2h DeltaE;#DeltaE [MeV];Entries", "DUNE", kPlotBias, k2p2h, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hDUNE_Delta_Other", "DUNE Other DeltaE;#DeltaE [MeV];Entries", "DUNE", kPlotBias, kOther, -1, 50, -0.5, 2.5, nullptr, nullptr},
+
+        {"hT2K_Delta_CCQE", "T2K CCQE DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", "T2K", kPlotBias, kCCQE, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hT2K_Delta_RES", "T2K RES DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", "T2K", kPlotBias, kRES, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hT2K_Delta_2p2h", "T2K 2p2h DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", "T2K", kPlotBias, k2p2h, -1, 50, -0.5, 2.5, nullptr, nullptr},
+        {"hT2K_Delta_Other", "T2K Other DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [MeV];Entries", "T2K", kPlotBias, kOther, -1, 50, -0.5, 2.5, nullptr, nullptr},
+    };
+    return plots;
+}
+
+inline const PlotDefinition* FindPlot(const std::vector<PlotDefinition>& plots, const char* name)
+{
+    for (const PlotDefinition& plot : plots)
+        if (strcmp(plot.name, name) == 0)
+            return &plot;
+    return nullptr;
+}
+
+// The histogram of a test.cpp definition, in the current directory (where TTree::Project() looks for it)
+inline TH1F* BookTestPlot(const char* name)
+{
+    const PlotDefinition* plot = FindPlot(GetTestPlots(), name);
+    return plot ? new TH1F(plot->name, plot->title, plot->nbins, plot->lo, plot->hi) : nullptr;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                     ProcessTree of DUNE_vs_T2K_plots.cpp, one entry at a time
+// ------------------------------------------------------------------------------------------------
+struct ProcessTreeEvent
+{
+    int Mode;
+    Float_t Enu_true, Erecoil_minerva, ELep, Enu_QE;
+    bool flag_CCINC, flag_CC0pi;
+};
+
+// Only these branches are decompressed
+inline void SetProcessTreeBranches(TTree* tree, bool isDUNE, ProcessTreeEvent& event)
+{
+    tree->SetBranchStatus("*", false);
+    for (const char* name : {"Mode", "Enu_true"})
+        tree->SetBranchStatus(name, true);
+    tree->SetBranchAddress("Mode", &event.Mode);
+    tree->SetBranchAddress("Enu_true", &event.Enu_true);
+
+    if (isDUNE)
+    {
+        for (const char* name : {"Erecoil_minerva", "ELep", "flagCCINC"})
+            tree->SetBranchStatus(name, true);
+        tree->SetBranchAddress("Erecoil_minerva", &event.Erecoil_minerva);
+        tree->SetBranchAddress("ELep", &event.ELep);
+        tree->SetBranchAddress("flagCCINC", &event.flag_CCINC);
+    } else
+    {
+        for (const char* name : {"Enu_QE", "flagCC0pi"})
+            tree->SetBranchStatus(name, true);
+        tree->SetBranchAddress("Enu_QE", &event.Enu_QE);
+        tree->SetBranchAddress("flagCC0pi", &event.flag_CC0pi);
+    }
+}
+
+struct ProcessTreeValues
+{
+    float Enu, diff, diffWeighted;
+    int category;
+};
+
+// False if the entry is skipped: only CC-inclusive events for DUNE, CC interactions with no true
+// pions in the final state for T2K. The values are computed in float, as ProcessTree does.
+inline bool SelectProcessTree(const ProcessTreeEvent& event, bool isDUNE, ProcessTreeValues& v)
+{
+    if (isDUNE && !event.flag_CCINC)
+        return false;
+    if (!isDUNE && !event.flag_CC0pi)
+        return false;
+
+    float reco = isDUNE ? (event.Erecoil_minerva + event.ELep) : event.Enu_QE;
+    v.Enu = event.Enu_true;
+    v.diff = event.Enu_true - reco;
+    v.diffWeighted = v.diff / event.Enu_true;
+    v.category = GetModeCategory(event.Mode);
+    return true;
+}
+
+// Value of a selected entry for the plot (false if the entry is not in it): the master that
+// ProcessTree fills for the plot's variable and Mode category
+inline bool ProcessTreeValue(const PlotDefinition& plot, const ProcessTreeValues& v, float& x)
+{
+    if (plot.topology >= 0 || (plot.category >= 0 && plot.category != v.category))
+        return false;
+    x = plot.variable == kPlotEnu ? v.Enu : (plot.variable == kPlotBias ? v.diff : v.diffWeighted);
+    return true;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef PREVIEW_SAMPLER_H
+#define PREVIEW_SAMPLER_H
+
+#include "TFile.h"
+#include "TTree.h"
+#include "SampleDefinitions.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Fast preview: instead of the whole tree, only a fraction of the entries is processed.
+//   The sampling is stratified by Mode category, so that rare channels (e.g. 2p2h) keep at least
+//   minPerCategory events, and every sampled event gets the weight N_category / n_category so
+//   that the histograms estimate the full sample. Filling with these weights (and Sumw2) gives the
+//   statistical uncertainty of the preview in each bin (slightly underestimated, see below).
+//
+//   The unit of sampling is a whole cluster of the tree, not an entry: entries spread at random over
+//   the file would still decompress almost every basket. The clusters are shuffled once (seeded),
+//   and each category takes clusters in that order until it has its share of entries, so a rare
+//   category only adds clusters after the ones already taken by the common ones. An entry is
+//   sampled if its cluster is among those of its category; only the selected clusters are read, as
+//   contiguous runs of entries. Entries of one cluster are correlated, so the Sumw2 uncertainty is
+//   a lower bound.
+// ------------------------------------------------------------------------------------------------
+struct PreviewSelection
+{
+    std::vector<Long64_t> entries;     // sampled entries, in increasing order
+    std::vector<char> category;        // Mode category of every entry of the tree
+    Long64_t total[kNModeCategories];  // entries per category in the full tree
+    Long64_t sampled[kNModeCategories];
+    double weight[kNModeCategories];   // total / sampled
+    Long64_t nClusters = 0, nClustersRead = 0;
+    Long64_t bytesModePass = 0;        // read by the pass over the Mode branch
+
+    double GetWeight(Long64_t entry) const { return weight[(int) category[entry]]; }
+};
+
+// Small deterministic generator (splitmix64), so a preview can be reproduced with the same seed
+inline double PreviewUniform(uint64_t& state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Only the Mode branch is read here (and left as the only active branch); the clusters are then
+// chosen per category
+inline void BuildStratifiedPreview(TTree* tree, double fraction, Long64_t minPerCategory, uint64_t seed, PreviewSelection& selection)
+{
+    int Mode;
+    Long64_t nentries = tree->GetEntries();
+    Long64_t bytesBefore = tree->GetCurrentFile() ? tree->GetCurrentFile()->GetBytesRead() : 0;
+
+    tree->SetBranchStatus("*", false);
+    tree->SetBranchStatus("Mode", true);
+    tree->SetBranchAddress("Mode", &Mode);
+
+    selection.category.resize(nentries);
+    for (int c = 0; c < kNModeCategories; c++)
+        selection.total[c] = selection.sampled[c] = 0;
+
+    // Entries of every category in every cluster
+    std::vector<Long64_t> clusterFirst;
+    std::vector<Long64_t> clusterCounts; // [cluster][category]
+    TTree::TClusterIterator clusters = tree->GetClusterIterator(0);
+    Long64_t first;
+    while ((first = clusters()) < nentries)
+    {
+        Long64_t last = std::min(clusters.GetNextEntry(), nentries);
+        clusterFirst.push_back(first);
+        clusterCounts.resize(clusterCounts.size() + kNModeCategories, 0);
+        Long64_t *counts = &clusterCounts[clusterCounts.size() - kNModeCategories];
+        for (Long64_t i = first; i < last; i++)
+        {
+            tree->GetEntry(i);
+            int category = GetModeCategory(Mode);
+            selection.category[i] = (char) category;
+            selection.total[category]++;
+            counts[category]++;
+        }
+    }
+    clusterFirst.push_back(nentries);
+    tree->ResetBranchAddresses();
+    if (tree->GetCurrentFile())
+        selection.bytesModePass = tree->GetCurrentFile()->GetBytesRead() - bytesBefore;
+
+    Long64_t wanted[kNModeCategories];
+    for (int c = 0; c < kNModeCategories; c++)
+    {
+        Long64_t n = (Long64_t) std::llround(fraction * selection.total[c]);
+        wanted[c] = std::min(selection.total[c], std::max(n, minPerCategory));
+    }
+
+    // Clusters in a random order (Fisher-Yates); each category takes a prefix of that order
+    const Long64_t nClusters = clusterFirst.size() - 1;
+    std::vector<Long64_t> order(nClusters);
+    for (Long64_t k = 0; k < nClusters; k++)
+        order[k] = k;
+    uint64_t state = seed;
+    for (Long64_t k = nClusters - 1; k > 0; k--)
+        std::swap(order[k], order[std::min(k, (Long64_t) (PreviewUniform(state) * (k + 1)))]);
+
+    std::vector<unsigned char> takenBy(nClusters, 0); // bit c: cluster sampled for category c
+    for (int c = 0; c < kNModeCategories; c++)
+        for (Long64_t k = 0; k < nClusters && selection.sampled[c] < wanted[c]; k++)
+            if (clusterCounts[order[k] * kNModeCategories + c] > 0)
+            {
+                takenBy[order[k]] |= 1 << c;
+                selection.sampled[c] += clusterCounts[order[k] * kNModeCategories + c];
+            }
+    for (int c = 0; c < kNModeCategories; c++)
+        selection.weight[c] = selection.sampled[c] > 0 ? (double) selection.total[c] / selection.sampled[c] : 0.;
+
+    selection.entries.clear();
+    selection.nClusters = nClusters;
+    selection.nClustersRead = 0;
+    for (Long64_t k = 0; k < nClusters; k++)
+    {
+        if (!takenBy[k])
+            continue;
+        selection.nClustersRead++;
+        for (Long64_t i = clusterFirst[k]; i < clusterFirst[k + 1]; i++)
+            if (takenBy[k] & (1 << selection.category[i]))
+                selection.entries.push_back(i);
+    }
+}
+
+inline void PrintPreviewSelection(const char* label, const PreviewSelection& selection)
+{
+    printf("\n%s preview: %zu sampled entries in %lld of %lld clusters (Mode pass: %.1f MB read)\n", label, selection.entries.size(),
+           (long long) selection.nClustersRead, (long long) selection.nClusters, selection.bytesModePass / 1048576.);
+    printf("  %-8s %14s %12s %10s\n", "Category", "Total", "Sampled", "Weight");
+    for (int c = 0; c < kNModeCategories; c++)
+        printf("  %-8s %14lld %12lld %10.2f\n", ModeCategoryName(c), (long long) selection.total[c],
+               (long long) selection.sampled[c], selection.weight[c]);
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef RECO_ESTIMATORS_H
+#define RECO_ESTIMATORS_H
+
+#include "TH1F.h"
+#include "TLegend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Registry of reconstructed neutrino energy estimators. The particles of an event are summarised
+//   once (EstimatorInput: lepton kinematics and energy sums per particle type), in the particle
+//   loop the macros already have, and every selected estimator is then a cheap function of that
+//   summary, so any number of them can be compared in the same pass.
+//
+//   To add an estimator: write a function float(const EstimatorInput&) and add it to
+//   GetRecoEstimators() with a short name (used in histogram names and on the command line).
+// ------------------------------------------------------------------------------------------------
+
+static const double MASS_PROTON  = 0.938272;
+static const double MASS_NEUTRON = 0.939565;
+static const double MASS_ELECTRON = 0.000511;
+static const double MASS_MUON    = 0.105658;
+static const double MASS_TAU     = 1.77686;
+static const double QE_BINDING_ENERGY = 0.030; // GeV, argon; used by the QE formula only
+
+struct EstimatorInput
+{
+    double ELep, pLep, cosLep;   // charged lepton energy, momentum, cosine w.r.t. the beam
+    double mLep;                 // charged lepton mass, from its pdg
+    double TProtons, TNeutrons;  // kinetic energies
+    double TChargedPions;        // kinetic energies of pi+ and pi-
+    double EPionMasses;          // masses of the charged pions
+    double EOther;               // total energy of everything else (pi0, photons, kaons, ...)
+    int nProtons, nNeutrons, nPions;
+
+    void Reset()
+    {
+        ELep = pLep = cosLep = mLep = 0;
+        TProtons = TNeutrons = TChargedPions = EPionMasses = EOther = 0;
+        nProtons = nNeutrons = nPions = 0;
+    }
+
+    // One final-state particle; (nx, ny, nz) is the beam direction (unit vector)
+    void AddParticle(int pdg, double px, double py, double pz, double E, double nx = 0, double ny = 0, double nz = 1)
+    {
+        int apdg = abs(pdg);
+        double p = std::sqrt(px * px + py * py + pz * pz);
+        double mass = std::sqrt(std::fmax(E * E - p * p, 0.));
+
+        if (apdg == 11 || apdg == 13 || apdg == 15)
+        {
+            if (E > ELep)
+            {
+                ELep = E;
+                pLep = p;
+                mLep = apdg == 11 ? MASS_ELECTRON : (apdg == 13 ? MASS_MUON : MASS_TAU);
+                cosLep = p > 0 ? (px * nx + py * ny + pz * nz) / p : 0.;
+            }
+        } else if (apdg == 12 || apdg == 14 || apdg == 16 || apdg >= 1000000000)
+        {
+            return; // outgoing neutrinos and nuclear remnants are never seen
+        } else if (pdg == 2212)
+        {
+            TProtons += E - mass;
+            nProtons++;
+        } else if (pdg == 2112)
+        {
+            TNeutrons += E - mass;
+            nNeutrons++;
+        } else if (apdg == 211)
+        {
+            TChargedPions += E - mass;
+            EPionMasses += mass;
+            nPions++;
+        } else
+            EOther += E;
+    }
+
+    // The final-state particles of a NUISANCE flat tree (pdg and px, py, pz, E arrays, beam along z)
+    void AddParticles(int n, const int* pdg, const float* px, const float* py, const float* pz, const float* E)
+    {
+        for (int j = 0; j < n; j++)
+            AddParticle(pdg[j], px[j], py[j], pz[j], E[j]);
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+//                                     The estimators
+// ------------------------------------------------------------------------------------------------
+
+// Everything, neutrons included: a perfect calorimeter
+inline float EstimateCalorimetric(const EstimatorInput& in)
+{
+    return in.ELep + in.TProtons + in.TNeutrons + in.TChargedPions + in.EPionMasses + in.EOther;
+}
+
+// What is seen when neutrons escape: like calorimetric, without the neutron kinetic energy
+inline float EstimateNeutronMissing(const EstimatorInput& in)
+{
+    return in.ELep + in.TProtons + in.TChargedPions + in.EPionMasses + in.EOther;
+}
+
+// MINERvA-like recoil: kinetic energy for protons and charged pions, total energy for the rest
+inline float EstimateMinerva(const EstimatorInput& in)
+{
+    return in.ELep + in.TProtons + in.TChargedPions + in.EOther;
+}
+
+// Lepton plus proton kinetic energies only
+inline float EstimateProtonOnly(const EstimatorInput& in)
+{
+    return in.ELep + in.TProtons;
+}
+
+// Two-body QE formula from the lepton kinematics (neutron at rest with binding energy), with the
+// mass of the lepton that was seen (e, mu or tau)
+inline float EstimateQE(const EstimatorInput& in)
+{
+    const double Mn = MASS_NEUTRON - QE_BINDING_ENERGY;
+    double denominator = 2 * (Mn - in.ELep + in.pLep * in.cosLep);
+    if (in.ELep <= 0 || denominator <= 0)
+        return 0.f;
+    return (2 * Mn * in.ELep - (Mn * Mn + in.mLep * in.mLep - MASS_PROTON * MASS_PROTON)) / denominator;
+}
+
+typedef float (*RecoEstimatorFunction)(const EstimatorInput&);
+
+struct RecoEstimator
+{
+    const char* name;
+    const char* title;
+    RecoEstimatorFunction function;
+};
+
+inline const std::vector<RecoEstimator>& GetRecoEstimators()
+{
+    static const std::vector<RecoEstimator> estimators = {
+        {"calorimetric",    "Calorimetric",             EstimateCalorimetric},
+        {"neutron_missing", "Calorimetric, no neutrons", EstimateNeutronMissing},
+        {"minerva",         "MINERvA-like recoil",      EstimateMinerva},
+        {"proton_only",     "Lepton + protons",         EstimateProtonOnly},
+        {"qe",              "QE formula",               EstimateQE},
+    };
+    return estimators;
+}
+
+// Estimators from a comma-separated list of names ("all" for every estimator); false if a name is unknown
+inline bool SelectRecoEstimators(const std::string& list, std::vector<RecoEstimator>& selected)
+{
+    const std::vector<RecoEstimator>& all = GetRecoEstimators();
+    selected.clear();
+    if (list == "all")
+    {
+        selected = all;
+        return true;
+    }
+
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ','))
+    {
+        bool found = false;
+        for (const RecoEstimator& estimator : all)
+            if (name == estimator.name)
+            {
+                selected.push_back(estimator);
+                found = true;
+            }
+        if (!found)
+            return false;
+    }
+    return !selected.empty();
+}
+
+inline std::string RecoEstimatorNames()
+{
+    std::string names;
+    for (const RecoEstimator& estimator : GetRecoEstimators())
+        names += (names.empty() ? "" : ", ") + std::string(estimator.name);
+    return names;
+}
+
+// Bias histograms of the estimators (same order) overlaid on the current pad, with their legend
+inline void DrawRecoEstimators(const std::vector<RecoEstimator>& estimators, const std::vector<TH1F*>& hists, TLegend* legend)
+{
+    const int colors[] = {kRed, kBlue, kGreen+2, kMagenta+1, kOrange+7, kCyan+1, kViolet-6, kTeal+3};
+    double maximum = 0;
+    for (TH1F* h : hists)
+        maximum = std::max(maximum, h->GetMaximum());
+    for (size_t e = 0; e < hists.size(); e++)
+    {
+        hists[e]->SetLineColor(colors[e % 8]);
+        hists[e]->SetMaximum(1.1 * maximum);
+        hists[e]->Draw(e == 0 ? "hist" : "hist same");
+        legend->AddEntry(hists[e], estimators[e].title, "l");
+    }
+    legend->Draw();
+}
+
+#endif
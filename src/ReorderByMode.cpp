@@ -0,0 +1,289 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+#include "TH1.h"
+#include "SampleDefinitions.h"
+#include "CategoryRanges.h"
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// To compile: c++ ReorderByMode.cpp `root-config --cflags --libs` -o reorder_by_mode.out
+//
+// Rewrites a sample with its entries grouped by Mode category (CCQE, RES, 2p2h, Other) and,
+// optionally, by E_nu^true range inside each category, keeping the order of the entries inside a
+// group. Every category then is one contiguous range of entries (stored in the output, see
+// CategoryRanges.h), so reading only RES or 2p2h events decompresses only their baskets; the bitmaps
+// of EventIndex.h become single runs.
+//
+// It works out of core, for samples larger than the memory: one pass over the input writes every
+// entry to the temporary file of its group (as many open trees as groups, only their baskets in
+// memory), then the groups are copied one after the other to the output, the baskets flushed at the
+// end of each group so that no basket or cluster mixes two groups, and the temporary files removed.
+// Finally the output is read back and compared with the input, entry for entry and leaf by leaf:
+// the k-th entry of a group in the input must be the k-th entry of the group's range in the output.
+//
+//     ./reorder_by_mode.out flat_Valencia_13815.root flat_Valencia_13815_byMode.root [--enu 0,1,2,4]
+//         [--tree gRooTracker] [--tmp directory]
+//
+// FlatTree_VARS trees use Mode and Enu_true; gRooTracker trees use G2NeutEvtCode (same convention
+// as Mode) and the energy of the first StdHep particle (the incoming neutrino).
+
+// Group of an entry: category x number of E_nu ranges + E_nu range
+int GetGroup(int category, double Enu, const std::vector<double>& edges)
+{
+    int range = 0;
+    while (range + 1 < (int) edges.size() - 1 && Enu >= edges[range + 1])
+        range++;
+    return category * (edges.size() - 1) + range;
+}
+
+// Output read back: every entry of the input in the range of its group, in the input order, with
+// the same values in every leaf
+bool CheckReordered(TTree* tree, TTree* sorted, const std::vector<CategoryRange>& ranges, bool genie, const std::vector<double>& edges)
+{
+    if (sorted->GetEntries() != tree->GetEntries())
+    {
+        printf("Error: the output has %lld entries, the input %lld.\n", (long long) sorted->GetEntries(), (long long) tree->GetEntries());
+        return false;
+    }
+
+    std::vector<std::pair<TLeaf*, TLeaf*>> leaves; // input, output
+    TObjArray *list = tree->GetListOfLeaves();
+    for (int l = 0; l < list->GetEntries(); l++)
+    {
+        TLeaf *leaf = (TLeaf*) list->At(l);
+        TLeaf *copy = sorted->GetLeaf(leaf->GetName());
+        if (!copy)
+        {
+            printf("Error: the leaf %s is missing in the output.\n", leaf->GetName());
+            return false;
+        }
+        leaves.push_back({leaf, copy});
+    }
+    TLeaf *leafMode = tree->GetLeaf(genie ? "G2NeutEvtCode" : "Mode");
+    TLeaf *leafEnu = tree->GetLeaf(genie ? "StdHepP4" : "Enu_true");
+
+    std::vector<Long64_t> next(ranges.size());
+    for (size_t g = 0; g < ranges.size(); g++)
+        next[g] = ranges[g].first;
+    for (Long64_t i = 0; i < tree->GetEntries(); i++)
+    {
+        tree->GetEntry(i);
+        int g = GetGroup(GetModeCategory((int) leafMode->GetValue()), genie ? leafEnu->GetValue(3) : leafEnu->GetValue(), edges);
+        if (next[g] >= ranges[g].last)
+        {
+            printf("Error: the %s range of the output is shorter than in the input.\n", ModeCategoryName(ranges[g].category));
+            return false;
+        }
+        Long64_t j = next[g]++;
+        sorted->GetEntry(j);
+        for (const auto& leaf : leaves)
+        {
+            bool same = leaf.first->GetLen() == leaf.second->GetLen();
+            for (int k = 0; same && k < leaf.first->GetLen(); k++)
+            {
+                double a = leaf.first->GetValue(k), b = leaf.second->GetValue(k);
+                same = a == b || (std::isnan(a) && std::isnan(b));
+            }
+            if (!same)
+            {
+                printf("Error: entry %lld of the input and entry %lld of the output (%s) differ in %s.\n", (long long) i, (long long) j,
+                       ModeCategoryName(ranges[g].category), leaf.first->GetName());
+                return false;
+            }
+        }
+    }
+    for (size_t g = 0; g < ranges.size(); g++)
+        if (next[g] != ranges[g].last)
+        {
+            printf("Error: the %s range of the output is longer than in the input.\n", ModeCategoryName(ranges[g].category));
+            return false;
+        }
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: \n- ./reorder_by_mode.out \n- name of the input .root file \n- name of the output .root file"
+                  << "\n- optional: --enu comma-separated E_nu^true edges in GeV inside each category (e.g. 0,1,2,4)"
+                  << "\n- optional: --tree name of the tree (default FlatTree_VARS, or gRooTracker)"
+                  << "\n- optional: --tmp directory of the temporary files (default: next to the output)" << std::endl;
+        return 1;
+    }
+
+    std::string inputName = argv[1], outputName = argv[2], treeName = "FlatTree_VARS", tmpDir;
+    std::vector<double> edges;
+    for (int a = 3; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--tree" && a + 1 < argc)
+            treeName = argv[++a];
+        else if (arg == "--tmp" && a + 1 < argc)
+            tmpDir = argv[++a];
+        else if (arg == "--enu" && a + 1 < argc)
+        {
+            std::stringstream list(argv[++a]);
+            std::string edge;
+            while (std::getline(list, edge, ','))
+                edges.push_back(atof(edge.c_str()));
+        } else
+        {
+            printf("Error: unknown option \"%s\".\n", arg.c_str());
+            return 1;
+        }
+    }
+    // Below the first edge and above the last one go to the first and last range
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    if (edges.size() < 2)
+        edges = {-INFINITY, INFINITY};
+    const int nRanges = edges.size() - 1, nGroups = kNModeCategories * nRanges;
+
+    TFile *input = TFile::Open(inputName.c_str());
+    TTree *tree = input ? (TTree*) input->Get(treeName.c_str()) : nullptr;
+    if (!tree)
+    {
+        printf("Error: could not read %s from %s.\n", treeName.c_str(), inputName.c_str());
+        return 1;
+    }
+
+    bool genie = tree->GetLeaf("G2NeutEvtCode") != nullptr;
+    TLeaf *leafMode = tree->GetLeaf(genie ? "G2NeutEvtCode" : "Mode");
+    TLeaf *leafEnu = tree->GetLeaf(genie ? "StdHepP4" : "Enu_true");
+    if (!leafMode || !leafEnu)
+    {
+        printf("Error: %s needs Mode and Enu_true (flat tree) or G2NeutEvtCode and StdHepP4 (gRooTracker).\n", treeName.c_str());
+        return 1;
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //             One pass over the input: every entry to the temporary file of its group
+    // ----------------------------------------------------------------------------------------------
+    if (tmpDir.empty())
+    {
+        size_t slash = outputName.rfind('/');
+        tmpDir = slash == std::string::npos ? "." : outputName.substr(0, slash);
+    }
+    std::vector<std::string> tmpNames(nGroups);
+    std::vector<TFile*> tmpFiles(nGroups, nullptr);
+    std::vector<TTree*> tmpTrees(nGroups, nullptr);
+    std::vector<Long64_t> groupEntries(nGroups, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    Long64_t nentries = tree->GetEntries();
+    for (Long64_t i = 0; i < nentries; i++)
+    {
+        tree->GetEntry(i);
+        double Enu = genie ? leafEnu->GetValue(3) : leafEnu->GetValue(); // StdHepP4[0][3] is the neutrino energy
+        int g = GetGroup(GetModeCategory((int) leafMode->GetValue()), Enu, edges);
+
+        if (!tmpTrees[g]) // temporary files only for the groups that have entries
+        {
+            tmpNames[g] = tmpDir + "/.reorder_" + std::to_string(g) + "_" + outputName.substr(outputName.rfind('/') + 1);
+            tmpFiles[g] = TFile::Open(tmpNames[g].c_str(), "RECREATE");
+            if (!tmpFiles[g])
+            {
+                printf("Error: could not write the temporary file %s.\n", tmpNames[g].c_str());
+                return 1;
+            }
+            tmpTrees[g] = tree->CloneTree(0); // created in the temporary file, same branch buffers as the input
+        }
+        tmpTrees[g]->Fill();
+        groupEntries[g]++;
+    }
+    for (int g = 0; g < nGroups; g++)
+        if (tmpFiles[g])
+        {
+            tmpFiles[g]->cd();
+            tmpTrees[g]->Write();
+            tmpFiles[g]->Close();
+            delete tmpFiles[g];
+        }
+    double splitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // ----------------------------------------------------------------------------------------------
+    //               Groups copied one after the other, and their entry ranges saved
+    // ----------------------------------------------------------------------------------------------
+    start = std::chrono::steady_clock::now();
+    TFile *output = TFile::Open(outputName.c_str(), "RECREATE");
+    if (!output)
+    {
+        printf("Error: could not write %s.\n", outputName.c_str());
+        return 1;
+    }
+    TTree *sorted = tree->CloneTree(0);
+
+    std::vector<CategoryRange> ranges;
+    for (int g = 0; g < nGroups; g++)
+    {
+        CategoryRange range = {g / nRanges, edges[g % nRanges], edges[g % nRanges + 1], sorted->GetEntries(), sorted->GetEntries()};
+        if (!tmpNames[g].empty())
+        {
+            TFile *tmp = TFile::Open(tmpNames[g].c_str());
+            TTree *group = tmp ? (TTree*) tmp->Get(treeName.c_str()) : nullptr;
+            // sorted shares the branch buffers of the input tree: its addresses are pointed at the
+            // group's buffers for the copy (CopyEntries returns bytes, the entries are counted here)
+            Long64_t before = sorted->GetEntries();
+            if (group)
+                sorted->CopyEntries(group, -1, "", true);
+            if (!group || sorted->GetEntries() - before != groupEntries[g])
+            {
+                printf("Error: could not copy the temporary file %s.\n", tmpNames[g].c_str());
+                return 1;
+            }
+            sorted->ResetBranchAddresses(); // no address left in the group's buffers once its file is closed
+            tmp->Close();
+            delete tmp;
+            std::remove(tmpNames[g].c_str());
+            range.last = sorted->GetEntries();
+
+            // The group ends its baskets and its cluster: the next group starts on fresh ones
+            sorted->FlushBaskets();
+        }
+        ranges.push_back(range);
+    }
+
+    output->cd();
+    sorted->Write();
+    for (const char* name : {"FlatTree_FLUX", "FlatTree_EVT"}) // the flux and event-rate histograms of NUISANCE files
+        if (TH1 *h = (TH1*) input->Get(name))
+        {
+            output->cd();
+            h->Write(name);
+        }
+    WriteCategoryRanges(output, ranges);
+    output->Close();
+    double mergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // ----------------------------------------------------------------------------------------------
+    //                 Output read back and compared with the input, by category
+    // ----------------------------------------------------------------------------------------------
+    start = std::chrono::steady_clock::now();
+    TFile *check = TFile::Open(outputName.c_str());
+    TTree *reordered = check ? (TTree*) check->Get(treeName.c_str()) : nullptr;
+    if (!reordered)
+    {
+        printf("Error: could not read %s back from %s.\n", treeName.c_str(), outputName.c_str());
+        return 1;
+    }
+    if (!CheckReordered(tree, reordered, ranges, genie, edges))
+        return 1;
+    check->Close();
+    double checkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%lld entries of %s reordered into %s (%d groups): split in %.2f s, merged in %.2f s, checked in %.2f s\n",
+           (long long) nentries, treeName.c_str(), outputName.c_str(), nGroups, splitSeconds, mergeSeconds, checkSeconds);
+    PrintCategoryRanges(outputName.c_str(), ranges);
+    input->Close();
+    return 0;
+}
@@ -0,0 +1,189 @@
+#ifndef SAMPLE_DEFINITIONS_H
+#define SAMPLE_DEFINITIONS_H
+
+#include "TTree.h"
+#include "TLeaf.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// ------------------------------------------------------------------------------------------------
+//   Definitions shared by the macros: samples (DUNE, T2K, nuSCOPE), interaction mode categories
+//   and final-state topologies. Everything is header-only, so the usual one-line compilation
+//   (c++ Name_Of_Code.cpp `root-config --cflags --libs`) keeps working.
+// ------------------------------------------------------------------------------------------------
+
+static const int MAXPARTICLES = 100; // Maximum number of final-state particles in a NUISANCE flat tree
+
+// Mode categories: Mode==1 is CCQE, Mode==2 is 2p2h, Modes 11, 12, 13 are RES, everything else is "Other"
+enum ModeCategory { kCCQE = 0, kRES = 1, k2p2h = 2, kOther = 3, kNModeCategories = 4 };
+
+inline int GetModeCategory(int Mode)
+{
+    if (Mode == 1)
+        return kCCQE;
+    if (Mode == 2)
+        return k2p2h;
+    if (Mode == 11 || Mode == 12 || Mode == 13)
+        return kRES;
+    return kOther;
+}
+
+inline const char* ModeCategoryName(int category)
+{
+    static const char* names[kNModeCategories] = {"CCQE", "RES", "2p2h", "Other"};
+    return (category >= 0 && category < kNModeCategories) ? names[category] : "Unknown";
+}
+
+// Final-state topologies: (no) charged pions (211) and (no) neutrons (2112)
+enum Topology { k0pi0n = 0, k0piNn = 1, kNpi0n = 2, kNpiNn = 3, kNTopologies = 4 };
+
+inline int GetTopology(int nPions, int nNeutrons)
+{
+    return (nPions > 0 ? 2 : 0) + (nNeutrons > 0 ? 1 : 0);
+}
+
+inline const char* TopologyName(int topology)
+{
+    static const char* names[kNTopologies] = {"0pi0n", "0piNn", "Npi0n", "NpiNn"};
+    return (topology >= 0 && topology < kNTopologies) ? names[topology] : "Unknown";
+}
+
+// Same counting as Sum$(abs(pdg)==211) and Sum$(abs(pdg)==2112) in the Project() macros
+inline void CountPionsNeutrons(int nParticles, const int* pdg, int& nPions, int& nNeutrons)
+{
+    nPions = 0;
+    nNeutrons = 0;
+    for (int j = 0; j < nParticles; j++)
+    {
+        int apdg = abs(pdg[j]);
+        nPions    += (apdg == 211);
+        nNeutrons += (apdg == 2112);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+//                  How each sample is selected and how E_reco is defined for it
+// ------------------------------------------------------------------------------------------------
+struct SampleDefinition
+{
+    std::string label;     // "DUNE", "T2K", "nuSCOPE"
+    std::string treeName;  // Name of the flat tree in the file
+    std::string flag;      // Selection flag branch (flagCCINC or flagCC0pi)
+    bool useQE;            // true: E_reco = Enu_QE, false: E_reco = Erecoil_minerva + ELep
+};
+
+inline bool GetSampleDefinition(const std::string& label, SampleDefinition& sample)
+{
+    sample.label = label;
+    sample.treeName = "FlatTree_VARS";
+
+    if (label == "DUNE" || label == "nuSCOPE")
+    {
+        sample.flag = "flagCCINC";
+        sample.useQE = false;
+        return true;
+    }
+    if (label == "T2K")
+    {
+        sample.flag = "flagCC0pi";
+        sample.useQE = true;
+        return true;
+    }
+    return false;
+}
+
+// ------------------------------------------------------------------------------------------------
+//             Branches of FlatTree_VARS needed to derive E_reco, bias and topology
+// ------------------------------------------------------------------------------------------------
+struct FlatTreeEvent
+{
+    int Mode;
+    Float_t Enu_true, Erecoil_minerva, ELep, Enu_QE, Weight;
+    bool flag;
+    int nfsp;
+    int pdg[MAXPARTICLES];
+    Float_t px[MAXPARTICLES], py[MAXPARTICLES], pz[MAXPARTICLES], E[MAXPARTICLES];
+
+    float GetEreco(bool useQE) const { return useQE ? Enu_QE : (Erecoil_minerva + ELep); }
+};
+
+// The pdg and four-momentum buffers hold MAXPARTICLES particles: a tree with more in one event would
+// be read past their end, so it is refused (the count leaf, nfsp or StdHepN, keeps its maximum over
+// the whole tree)
+inline bool CheckMaxParticles(TTree* tree, const char* countLeaf = "nfsp", int maxParticles = MAXPARTICLES)
+{
+    TLeaf *leaf = tree->GetLeaf(countLeaf);
+    if (leaf && leaf->GetMaximum() > maxParticles)
+    {
+        printf("Error: %s has events with %d particles (%s), more than the %d of the buffers.\n", tree->GetName(),
+               leaf->GetMaximum(), countLeaf, maxParticles);
+        return false;
+    }
+    return true;
+}
+
+// The final-state particles, on top of the branches already switched on: nfsp and pdg, and the
+// four-momenta if asked. False if they do not fit in the buffers of FlatTreeEvent.
+inline bool SetParticleBranches(TTree* tree, FlatTreeEvent& event, bool readPdg, bool readMomenta)
+{
+    event.nfsp = 0;
+    if (!readPdg && !readMomenta)
+        return true;
+    if (!CheckMaxParticles(tree))
+        return false;
+
+    tree->SetBranchStatus("nfsp", true);
+    tree->SetBranchAddress("nfsp", &event.nfsp);
+    if (readPdg)
+    {
+        tree->SetBranchStatus("pdg", true);
+        tree->SetBranchAddress("pdg", event.pdg);
+    }
+    if (readMomenta)
+    {
+        const char* names[] = {"px", "py", "pz", "E"};
+        Float_t* arrays[] = {event.px, event.py, event.pz, event.E};
+        for (int k = 0; k < 4; k++)
+        {
+            tree->SetBranchStatus(names[k], true);
+            tree->SetBranchAddress(names[k], arrays[k]);
+        }
+    }
+    return true;
+}
+
+// Only the branches we need are switched on, the rest of the tree is never decompressed
+// (the four-momenta of the particles are only read if asked, e.g. for Kinematics.h).
+// False if the particles are asked for and do not fit in the buffers of FlatTreeEvent.
+inline bool SetFlatTreeBranches(TTree* tree, const SampleDefinition& sample, FlatTreeEvent& event, bool readParticles = true,
+                                bool readMomenta = false)
+{
+    event.Weight = 1;
+
+    tree->SetBranchStatus("*", false);
+
+    const char* scalars[] = {"Mode", "Enu_true", sample.useQE ? "Enu_QE" : "Erecoil_minerva", "ELep"};
+    for (const char* name : scalars)
+        tree->SetBranchStatus(name, true);
+    tree->SetBranchStatus(sample.flag.c_str(), true);
+
+    tree->SetBranchAddress("Mode", &event.Mode);
+    tree->SetBranchAddress("Enu_true", &event.Enu_true);
+    tree->SetBranchAddress("ELep", &event.ELep);
+    tree->SetBranchAddress(sample.flag.c_str(), &event.flag);
+    if (sample.useQE)
+        tree->SetBranchAddress("Enu_QE", &event.Enu_QE);
+    else
+        tree->SetBranchAddress("Erecoil_minerva", &event.Erecoil_minerva);
+
+    if (tree->GetBranch("Weight"))
+    {
+        tree->SetBranchStatus("Weight", true);
+        tree->SetBranchAddress("Weight", &event.Weight);
+    }
+
+    return SetParticleBranches(tree, event, readParticles, readMomenta);
+}
+
+#endif
@@ -0,0 +1,351 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1F.h"
+#include "TFileMerger.h"
+#include "SampleDefinitions.h"
+#include "RecoEstimators.h"
+#include "HistogramRegistry.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// To compile: c++ ShardDriver.cpp `root-config --cflags --libs` -o shard_driver.out
+//
+// Runs a production split in shards and merges the results:
+//
+//   ./shard_driver.out run    LABEL nShards output_dir files...   shards the file list, runs nShards local
+//                                                                 worker processes, then merges their outputs
+//   ./shard_driver.out emit   LABEL nShards output_dir files...   writes the shard lists, an HTCondor submit
+//                                                                 file and run_local.sh (local stand-in)
+//   ./shard_driver.out worker LABEL output.root files... | @list  fills the histograms for one shard
+//   ./shard_driver.out reduce output.root partials...             parallel tree reduction of partial files
+//   ./shard_driver.out merge  output.root a.root b.root           merges two files (one reduction step)
+//
+// The reduction merges the partial files pairwise, all pairs of a round in parallel, so the merge
+// takes log2(nShards) rounds instead of one serial hadd over all the files.
+
+// ------------------------------------------------------------------------------------------------
+//                              Child processes running this same program
+// ------------------------------------------------------------------------------------------------
+static std::string gSelf = "/proc/self/exe";
+
+pid_t Spawn(const std::vector<std::string>& args)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        std::vector<char*> argv;
+        argv.push_back((char*) gSelf.c_str());
+        for (const std::string& a : args)
+            argv.push_back((char*) a.c_str());
+        argv.push_back(nullptr);
+        execv(gSelf.c_str(), argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+// Waits for all the children, returns the number that failed
+int WaitAll(const std::vector<pid_t>& pids)
+{
+    int failed = 0;
+    for (pid_t pid : pids)
+    {
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    return failed;
+}
+
+// Round-robin split of the input files
+std::vector<std::vector<std::string>> MakeShards(const std::vector<std::string>& files, int nShards)
+{
+    std::vector<std::vector<std::string>> shards(std::min<size_t>(nShards, files.size()));
+    for (size_t f = 0; f < files.size(); f++)
+        shards[f % shards.size()].push_back(files[f]);
+    return shards;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                    Worker: fill the standard histograms for a list of files
+// ------------------------------------------------------------------------------------------------
+int RunWorker(const std::string& label, const std::string& outputName, std::vector<std::string> files)
+{
+    SampleDefinition sample;
+    if (!GetSampleDefinition(label, sample))
+    {
+        printf("Error: unknown sample %s.\n", label.c_str());
+        return 1;
+    }
+
+    // "@list.txt" means: read the file names from list.txt (this is what the batch jobs use)
+    if (files.size() == 1 && files[0][0] == '@')
+    {
+        std::ifstream list(files[0].substr(1));
+        files.clear();
+        std::string line;
+        while (std::getline(list, line))
+            if (!line.empty())
+                files.push_back(line);
+    }
+
+    TFile *output = TFile::Open(outputName.c_str(), "RECREATE");
+    if (!output)
+    {
+        printf("Error: could not create %s.\n", outputName.c_str());
+        return 1;
+    }
+
+    const std::string& l = label;
+    HistogramRegistry registry;
+    BookedHistogram *hEnu = registry.Book("hEnu" + l, "True neutrino energy;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
+    BookedHistogram *hDelta = registry.Book("hDelta" + l, "Energy bias;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
+    BookedHistogram *hDeltaWeighted = registry.Book("hDelta" + l + "_Weighted", "Weighted energy bias;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries", 50, -1, 2);
+    BookedHistogram *hEnuMode[kNModeCategories], *hDeltaMode[kNModeCategories], *hDeltaTopology[kNTopologies];
+
+    for (int c = 0; c < kNModeCategories; c++)
+    {
+        std::string category = ModeCategoryName(c);
+        hEnuMode[c] = registry.Book("h" + l + "_" + category, l + " " + category + ";E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
+        hDeltaMode[c] = registry.Book("h" + l + "_Delta_" + category, l + " " + category + " energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
+    }
+    for (int t = 0; t < kNTopologies; t++)
+    {
+        std::string topology = TopologyName(t);
+        hDeltaTopology[t] = registry.Book("h" + l + "_" + topology, l + " " + topology + " energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
+    }
+
+    // Energy bias of every E_reco estimator (RecoEstimators.h), from the four-momenta of the particles
+    const std::vector<RecoEstimator>& estimators = GetRecoEstimators();
+    std::vector<BookedHistogram*> hDeltaEstimator;
+    for (const RecoEstimator& estimator : estimators)
+        hDeltaEstimator.push_back(registry.Book("hDelta" + l + "_" + estimator.name,
+                                                l + " energy bias, " + estimator.title + ";E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5));
+    EstimatorInput estimatorInput;
+
+    for (const std::string& fileName : files)
+    {
+        TFile *file = TFile::Open(fileName.c_str());
+        TTree *tree = file ? (TTree*) file->Get(sample.treeName.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", sample.treeName.c_str(), fileName.c_str());
+            return 1;
+        }
+
+        FlatTreeEvent event;
+        if (!SetFlatTreeBranches(tree, sample, event, true, true))
+            return 1;
+
+        Long64_t nentries = tree->GetEntries();
+        for (Long64_t i = 0; i < nentries; i++)
+        {
+            tree->GetEntry(i);
+            if (!event.flag)
+                continue;
+
+            int nPions, nNeutrons;
+            CountPionsNeutrons(event.nfsp, event.pdg, nPions, nNeutrons);
+            float diff = event.Enu_true - event.GetEreco(sample.useQE);
+
+            hEnu->Fill(event.Enu_true);
+            hDelta->Fill(diff);
+            hDeltaWeighted->Fill(diff / event.Enu_true);
+            hEnuMode[GetModeCategory(event.Mode)]->Fill(event.Enu_true);
+            hDeltaMode[GetModeCategory(event.Mode)]->Fill(diff);
+            hDeltaTopology[GetTopology(nPions, nNeutrons)]->Fill(diff);
+
+            estimatorInput.Reset();
+            estimatorInput.AddParticles(event.nfsp, event.pdg, event.px, event.py, event.pz, event.E);
+            for (size_t e = 0; e < estimators.size(); e++)
+                hDeltaEstimator[e]->Fill(event.Enu_true - estimators[e].function(estimatorInput));
+        }
+
+        file->Close();
+    }
+
+    output->cd();
+    registry.Write();
+    output->Close();
+    registry.PrintSummary(outputName.c_str());
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                                   Merging of partial outputs
+// ------------------------------------------------------------------------------------------------
+int MergePair(const std::string& outputName, const std::string& a, const std::string& b)
+{
+    TFileMerger merger(false);
+    merger.SetPrintLevel(0);
+    if (!merger.OutputFile(outputName.c_str(), "RECREATE") || !merger.AddFile(a.c_str(), false) || !merger.AddFile(b.c_str(), false) || !merger.Merge())
+    {
+        printf("Error: could not merge %s and %s.\n", a.c_str(), b.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// Each round merges pairs in parallel (one process per pair); an odd file out goes to the next round
+int TreeReduce(const std::string& outputName, std::vector<std::string> level)
+{
+    std::vector<std::string> intermediates;
+    int round = 0;
+
+    while (level.size() > 1)
+    {
+        std::vector<std::string> next;
+        std::vector<pid_t> pids;
+
+        for (size_t i = 0; i + 1 < level.size(); i += 2)
+        {
+            std::string merged = outputName + ".round" + std::to_string(round) + "_" + std::to_string(i / 2) + ".root";
+            pids.push_back(Spawn({"merge", merged, level[i], level[i + 1]}));
+            next.push_back(merged);
+            intermediates.push_back(merged);
+        }
+        if (level.size() % 2 == 1)
+            next.push_back(level.back());
+
+        if (WaitAll(pids) > 0)
+        {
+            printf("Error: merge round %d failed.\n", round);
+            return 1;
+        }
+
+        printf("Merge round %d: %zu -> %zu files\n", round, level.size(), next.size());
+        level = next;
+        round++;
+    }
+
+    if (level.empty())
+        return 1;
+
+    // The last file is either an intermediate (just rename it) or the only partial (copy it)
+    int status = 0;
+    if (!intermediates.empty() && level[0] == intermediates.back())
+    {
+        status = rename(level[0].c_str(), outputName.c_str());
+        intermediates.pop_back();
+    } else
+    {
+        std::ifstream in(level[0], std::ios::binary);
+        std::ofstream out(outputName, std::ios::binary);
+        out << in.rdbuf();
+        status = (in && out) ? 0 : 1;
+    }
+
+    for (const std::string& file : intermediates)
+        remove(file.c_str());
+
+    return status;
+}
+
+// ------------------------------------------------------------------------------------------------
+//              Job descriptions for a batch system, plus a local stand-in to test them
+// ------------------------------------------------------------------------------------------------
+int EmitJobs(const std::string& self, const std::string& label, const std::vector<std::vector<std::string>>& shards, const std::string& dir)
+{
+    for (size_t k = 0; k < shards.size(); k++)
+    {
+        std::ofstream list(dir + "/shard_" + std::to_string(k) + ".txt");
+        for (const std::string& file : shards[k])
+            list << file << "\n";
+    }
+
+    std::ofstream submit(dir + "/shards.sub");
+    submit << "executable = " << self << "\n"
+           << "arguments  = worker " << label << " " << dir << "/partial_$(ProcId).root @" << dir << "/shard_$(ProcId).txt\n"
+           << "output     = " << dir << "/shard_$(ProcId).out\n"
+           << "error      = " << dir << "/shard_$(ProcId).err\n"
+           << "log        = " << dir << "/shards.log\n"
+           << "queue " << shards.size() << "\n";
+
+    // Same jobs run as local background processes, followed by the reduction
+    std::ofstream local(dir + "/run_local.sh");
+    local << "#!/bin/sh\n# Local stand-in for shards.sub\n";
+    for (size_t k = 0; k < shards.size(); k++)
+        local << self << " worker " << label << " " << dir << "/partial_" << k << ".root @" << dir << "/shard_" << k << ".txt &\n";
+    local << "wait\n" << self << " reduce " << dir << "/" << label << "_merged.root";
+    for (size_t k = 0; k < shards.size(); k++)
+        local << " " << dir << "/partial_" << k << ".root";
+    local << "\n";
+    local.close();
+    chmod((dir + "/run_local.sh").c_str(), 0755);
+
+    printf("Wrote %zu shard lists, %s/shards.sub and %s/run_local.sh\n", shards.size(), dir.c_str(), dir.c_str());
+    printf("After the batch jobs: %s reduce %s/%s_merged.root %s/partial_*.root\n", self.c_str(), dir.c_str(), label.c_str(), dir.c_str());
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "Usage: \n- ./shard_driver.out run|emit LABEL nShards output_dir files..."
+                  << "\n- ./shard_driver.out worker LABEL output.root files... (or @list.txt)"
+                  << "\n- ./shard_driver.out reduce output.root partial files..."
+                  << "\n- ./shard_driver.out merge output.root a.root b.root" << std::endl;
+        return 1;
+    }
+
+    if (access(gSelf.c_str(), X_OK) != 0)
+        gSelf = argv[0];
+
+    std::string command = argv[1];
+    std::vector<std::string> rest(argv + 2, argv + argc);
+
+    if (command == "worker")
+        return RunWorker(rest[0], rest[1], std::vector<std::string>(rest.begin() + 2, rest.end()));
+
+    if (command == "merge" && rest.size() == 3)
+        return MergePair(rest[0], rest[1], rest[2]);
+
+    if (command == "reduce")
+        return TreeReduce(rest[0], std::vector<std::string>(rest.begin() + 1, rest.end()));
+
+    if ((command == "run" || command == "emit") && rest.size() >= 4)
+    {
+        std::string label = rest[0];
+        int nShards = std::max(1, atoi(rest[1].c_str()));
+        std::string dir = rest[2];
+        std::vector<std::vector<std::string>> shards = MakeShards(std::vector<std::string>(rest.begin() + 3, rest.end()), nShards);
+
+        if (command == "emit")
+        {
+            char self[4096];
+            ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+            return EmitJobs(len > 0 ? std::string(self, len) : std::string(argv[0]), label, shards, dir);
+        }
+
+        std::vector<pid_t> pids;
+        std::vector<std::string> partials;
+        for (size_t k = 0; k < shards.size(); k++)
+        {
+            std::vector<std::string> args = {"worker", label, dir + "/partial_" + std::to_string(k) + ".root"};
+            args.insert(args.end(), shards[k].begin(), shards[k].end());
+            pids.push_back(Spawn(args));
+            partials.push_back(args[2]);
+        }
+
+        printf("Started %zu workers for %s\n", pids.size(), label.c_str());
+        if (WaitAll(pids) > 0)
+        {
+            printf("Error: some workers failed.\n");
+            return 1;
+        }
+
+        return TreeReduce(dir + "/" + label + "_merged.root", partials);
+    }
+
+    printf("Error: unknown command %s.\n", command.c_str());
+    return 1;
+}
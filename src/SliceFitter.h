@@ -0,0 +1,344 @@
+#ifndef SLICE_FITTER_H
+#define SLICE_FITTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Fits of the energy bias distribution in every E_nu^true slice: bias (peak position) and
+//   resolution (width), with their uncertainties.
+//
+//     - Models: Gaussian A exp(-(x - mu)^2 / 2 sigma^2), and asymmetric Gaussian with sigma_L below
+//       mu and sigma_R above (the bias has a long tail on the side of the missing energy).
+//     - Binned Poisson likelihood, NLL = sum f_i - n_i ln f_i; the gradient and the Fisher matrix
+//       sum (df_i/dp)(df_i/dq) / f_i are computed analytically, and minimized with damped Fisher
+//       scoring (Levenberg-Marquardt). Uncertainties from the inverse of the Fisher matrix.
+//     - With rangeSigmas > 0 only the core [mu - k sigma_L, mu + k sigma_R] is fitted, the range
+//       taken from the starting point and updated once after a first fit.
+//     - A chain is one series of slices (a sample, a Mode category and a model): it starts from
+//       the most populated slice (moments as the starting point) and goes to the neighbours in
+//       both directions, each fit starting from the result of the previous slice. The chains run
+//       in parallel on a pool of threads (RunSliceChains).
+// ------------------------------------------------------------------------------------------------
+
+enum SliceModel { kSliceGaussian = 0, kSliceAsymGaussian = 1 };
+
+inline const char* SliceModelName(int model)
+{
+    return model == kSliceGaussian ? "gauss" : "asymgauss";
+}
+
+struct SliceFitResult
+{
+    bool ok = false;
+    int iterations = 0;
+    double entries = 0;
+    double amplitude = 0, mean = 0, sigmaL = 0, sigmaR = 0;
+    double errMean = 0, errSigmaL = 0, errSigmaR = 0;
+    double nll = 0;
+
+    // Resolution: sigma, or the average of the two sides
+    double Resolution() const { return 0.5 * (sigmaL + sigmaR); }
+    double ErrResolution() const { return 0.5 * std::sqrt(errSigmaL * errSigmaL + errSigmaR * errSigmaR); }
+};
+
+class SliceFitter
+{
+public:
+    SliceFitter(int nbins, double lo, double hi, int model, double rangeSigmas = 2., int minEntries = 20)
+        : fNBins(nbins), fLo(lo), fWidth((hi - lo) / nbins), fModel(model), fRangeSigmas(rangeSigmas), fMinEntries(minEntries) {}
+
+    int GetNParameters() const { return fModel == kSliceGaussian ? 3 : 4; }
+
+    // counts: nbins values (no under/overflow); start: nullptr to start from the moments
+    bool Fit(const double* counts, const SliceFitResult* start, SliceFitResult& result) const
+    {
+        result = SliceFitResult();
+        for (int b = 0; b < fNBins; b++)
+            result.entries += counts[b];
+        if (result.entries < fMinEntries)
+            return false;
+
+        double p[4];
+        if (start && start->ok)
+        {
+            double peak = *std::max_element(counts, counts + fNBins);
+            p[0] = start->amplitude > 0 ? peak : 1.;
+            p[1] = start->mean;
+            p[2] = start->sigmaL;
+            p[3] = start->sigmaR;
+        } else
+            Moments(counts, p);
+
+        int first = 0, last = fNBins;
+        int iterations = 0;
+        for (int pass = 0; pass < (fRangeSigmas > 0 ? 2 : 1); pass++)
+        {
+            if (fRangeSigmas > 0)
+                CoreRange(p, first, last);
+            int n;
+            if (last - first < GetNParameters() + 1 || !Minimize(counts, first, last, p, n))
+                return false;
+            iterations += n;
+        }
+
+        double cov[16];
+        if (!Covariance(counts, first, last, p, cov))
+            return false;
+        int np = GetNParameters();
+        result.ok = true;
+        result.iterations = iterations;
+        result.amplitude = p[0];
+        result.mean = p[1];
+        result.sigmaL = p[2];
+        result.sigmaR = fModel == kSliceGaussian ? p[2] : p[3];
+        result.errMean = std::sqrt(std::max(0., cov[1 * np + 1]));
+        result.errSigmaL = std::sqrt(std::max(0., cov[2 * np + 2]));
+        result.errSigmaR = fModel == kSliceGaussian ? result.errSigmaL : std::sqrt(std::max(0., cov[3 * np + 3]));
+        result.nll = NLL(counts, first, last, p);
+        return true;
+    }
+
+private:
+    double Center(int b) const { return fLo + (b + 0.5) * fWidth; }
+
+    void Moments(const double* counts, double* p) const
+    {
+        double sw = 0, sx = 0, sxx = 0, peak = 0;
+        for (int b = 0; b < fNBins; b++)
+        {
+            double x = Center(b);
+            sw += counts[b];
+            sx += counts[b] * x;
+            sxx += counts[b] * x * x;
+            peak = std::max(peak, counts[b]);
+        }
+        double mean = sx / sw, rms = std::sqrt(std::max(sxx / sw - mean * mean, 0.));
+        p[0] = peak;
+        p[1] = mean;
+        p[2] = p[3] = std::max(rms, fWidth);
+    }
+
+    void CoreRange(const double* p, int& first, int& last) const
+    {
+        double sigmaR = fModel == kSliceGaussian ? p[2] : p[3];
+        first = std::max(0, (int) std::floor((p[1] - fRangeSigmas * p[2] - fLo) / fWidth));
+        last = std::min(fNBins, (int) std::ceil((p[1] + fRangeSigmas * sigmaR - fLo) / fWidth));
+    }
+
+    // Model in bin b and its derivatives with respect to the parameters
+    double Model(int b, const double* p, double* d) const
+    {
+        double x = Center(b), dx = x - p[1];
+        bool left = fModel == kSliceGaussian || dx < 0;
+        double sigma = left ? p[2] : p[3];
+        double u = dx / sigma, f = p[0] * std::exp(-0.5 * u * u);
+        d[0] = f / p[0];
+        d[1] = f * u / sigma;
+        d[2] = left ? f * u * u / sigma : 0.;
+        if (fModel == kSliceAsymGaussian)
+            d[3] = left ? 0. : f * u * u / sigma;
+        return f;
+    }
+
+    double NLL(const double* counts, int first, int last, const double* p) const
+    {
+        double nll = 0, d[4];
+        for (int b = first; b < last; b++)
+        {
+            double f = std::max(Model(b, p, d), 1e-300);
+            nll += f - counts[b] * std::log(f);
+        }
+        return nll;
+    }
+
+    // Gradient and Fisher matrix of the NLL
+    void Derivatives(const double* counts, int first, int last, const double* p, double* grad, double* fisher) const
+    {
+        const int np = GetNParameters();
+        std::fill(grad, grad + np, 0.);
+        std::fill(fisher, fisher + np * np, 0.);
+        double d[4];
+        for (int b = first; b < last; b++)
+        {
+            double f = std::max(Model(b, p, d), 1e-300);
+            for (int i = 0; i < np; i++)
+            {
+                grad[i] += (1. - counts[b] / f) * d[i];
+                for (int j = 0; j <= i; j++)
+                    fisher[i * np + j] += d[i] * d[j] / f;
+            }
+        }
+        for (int i = 0; i < np; i++)
+            for (int j = 0; j < i; j++)
+                fisher[j * np + i] = fisher[i * np + j];
+    }
+
+    bool Minimize(const double* counts, int first, int last, double* p, int& iterations) const
+    {
+        const int np = GetNParameters();
+        double grad[4], fisher[16], a[16], step[4], trial[4];
+        double nll = NLL(counts, first, last, p), lambda = 1e-3;
+        for (iterations = 1; iterations <= 200; iterations++)
+        {
+            Derivatives(counts, first, last, p, grad, fisher);
+            bool improved = false;
+            while (!improved && lambda < 1e10)
+            {
+                for (int i = 0; i < np * np; i++)
+                    a[i] = fisher[i];
+                for (int i = 0; i < np; i++)
+                {
+                    a[i * np + i] *= 1. + lambda;
+                    step[i] = -grad[i];
+                }
+                if (!Solve(a, step, np))
+                {
+                    lambda *= 10;
+                    continue;
+                }
+                for (int i = 0; i < np; i++)
+                    trial[i] = p[i] + step[i];
+                double trialNll = (trial[0] > 0 && trial[2] > 0 && (np < 4 || trial[3] > 0)) ? NLL(counts, first, last, trial) : INFINITY;
+                if (trialNll <= nll)
+                {
+                    improved = true;
+                    bool converged = nll - trialNll < 1e-9 * (1. + std::fabs(nll));
+                    std::copy(trial, trial + np, p);
+                    nll = trialNll;
+                    lambda = std::max(lambda * 0.1, 1e-9);
+                    if (converged)
+                        return true;
+                } else
+                    lambda *= 10;
+            }
+            if (!improved)
+                return true; // no step lowers the NLL any more: at the minimum within precision
+        }
+        return false;
+    }
+
+    bool Covariance(const double* counts, int first, int last, const double* p, double* cov) const
+    {
+        const int np = GetNParameters();
+        double grad[4], fisher[16];
+        Derivatives(counts, first, last, p, grad, fisher);
+        for (int c = 0; c < np; c++)
+        {
+            double column[4] = {0, 0, 0, 0}, a[16];
+            column[c] = 1.;
+            std::copy(fisher, fisher + np * np, a);
+            if (!Solve(a, column, np))
+                return false;
+            for (int r = 0; r < np; r++)
+                cov[r * np + c] = column[r];
+        }
+        return true;
+    }
+
+    // Gaussian elimination with partial pivoting: a x = b, the solution in b
+    static bool Solve(double* a, double* b, int n)
+    {
+        for (int c = 0; c < n; c++)
+        {
+            int pivot = c;
+            for (int r = c + 1; r < n; r++)
+                if (std::fabs(a[r * n + c]) > std::fabs(a[pivot * n + c]))
+                    pivot = r;
+            if (!(std::fabs(a[pivot * n + c]) > 1e-300))
+                return false;
+            if (pivot != c)
+            {
+                for (int k = 0; k < n; k++)
+                    std::swap(a[c * n + k], a[pivot * n + k]);
+                std::swap(b[c], b[pivot]);
+            }
+            for (int r = c + 1; r < n; r++)
+            {
+                double factor = a[r * n + c] / a[c * n + c];
+                for (int k = c; k < n; k++)
+                    a[r * n + k] -= factor * a[c * n + k];
+                b[r] -= factor * b[c];
+            }
+        }
+        for (int r = n - 1; r >= 0; r--)
+        {
+            for (int k = r + 1; k < n; k++)
+                b[r] -= a[r * n + k] * b[k];
+            b[r] /= a[r * n + r];
+        }
+        return true;
+    }
+
+    int fNBins;
+    double fLo, fWidth;
+    int fModel;
+    double fRangeSigmas;
+    int fMinEntries;
+};
+
+// ------------------------------------------------------------------------------------------------
+//            Chains of slices (warm start from the neighbours), run on a pool of threads
+// ------------------------------------------------------------------------------------------------
+struct SliceChain
+{
+    std::string name;                  // e.g. "DUNE_RES_gauss"
+    const double* counts = nullptr;    // nSlices x nbins
+    int nSlices = 0, model = kSliceGaussian;
+    std::vector<SliceFitResult> results;
+};
+
+inline void FitSliceChain(SliceChain& chain, int nbins, double lo, double hi, double rangeSigmas, int minEntries)
+{
+    SliceFitter fitter(nbins, lo, hi, chain.model, rangeSigmas, minEntries);
+    chain.results.assign(chain.nSlices, SliceFitResult());
+
+    int seed = 0;
+    double most = -1;
+    for (int s = 0; s < chain.nSlices; s++)
+    {
+        double entries = 0;
+        for (int b = 0; b < nbins; b++)
+            entries += chain.counts[(size_t) s * nbins + b];
+        if (entries > most)
+        {
+            most = entries;
+            seed = s;
+        }
+    }
+    fitter.Fit(chain.counts + (size_t) seed * nbins, nullptr, chain.results[seed]);
+
+    // Outwards from the seed; a failed slice passes on the last good result
+    for (int direction : {-1, 1})
+    {
+        const SliceFitResult *previous = chain.results[seed].ok ? &chain.results[seed] : nullptr;
+        for (int s = seed + direction; s >= 0 && s < chain.nSlices; s += direction)
+        {
+            const double *counts = chain.counts + (size_t) s * nbins;
+            if (!fitter.Fit(counts, previous, chain.results[s]) && previous)
+                fitter.Fit(counts, nullptr, chain.results[s]); // the neighbour was too far: from the moments
+            if (chain.results[s].ok)
+                previous = &chain.results[s];
+        }
+    }
+}
+
+inline void RunSliceChains(std::vector<SliceChain>& chains, int nbins, double lo, double hi, double rangeSigmas, int minEntries, int nThreads)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < std::max(1, std::min<int>(nThreads, chains.size())); t++)
+        pool.emplace_back([&]()
+        {
+            for (size_t c = next++; c < chains.size(); c = next++)
+                FitSliceChain(chains[c], nbins, lo, hi, rangeSigmas, minEntries);
+        });
+    for (std::thread& thread : pool)
+        thread.join();
+}
+
+#endif
@@ -0,0 +1,265 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1D.h"
+#include "SampleDefinitions.h"
+#include "PlotDefinitions.h"
+#include "CompiledFormula.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// To compile: c++ StartupBenchmark.cpp `root-config --cflags --libs` -O2 -o startup_benchmark.out
+//
+// Startup cost of the ways we fill the standard plots (the test.cpp histograms, strings and binnings
+// of PlotDefinitions.h), for short jobs and previews where it dominates:
+//
+//   - project    one TTree::Project per histogram: every string parsed into a TTreeFormula
+//   - jit        FormulaFiller: the strings translated to C++ and compiled by the interpreter
+//   - native     FormulaFiller::RunNative: the strings evaluated on blocks of entries, no interpreter
+//   - compiled   no strings at all: SampleDefinitions.h branches, Mode categories and topologies
+//
+// Every path runs in a fresh process (this same program with --worker), so each one pays the ROOT
+// initialization as a real macro run does. The process is timed on the first entries only (time to
+// the first processed event) and on the whole sample; the histograms of all the paths are compared
+// through a checksum of their bins.
+//
+//     ./startup_benchmark.out DUNE=flat_Valencia_13815.root T2K=flat_Valencia_2382.root [--runs 5] [--first 1]
+
+enum StartupPath { kPathProject, kPathJIT, kPathNative, kPathCompiled, kNPaths };
+const char* PATH_NAMES[kNPaths] = {"project", "jit", "native", "compiled"};
+
+// The histograms of test.cpp that are filled from strings (PlotDefinitions.h), for one sample
+std::vector<PlotDefinition> GetSamplePlots(const std::string& label)
+{
+    std::vector<PlotDefinition> plots;
+    for (const PlotDefinition& plot : GetTestPlots())
+        if (plot.expression && plot.sample == label)
+            plots.push_back(plot);
+    return plots;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                        Worker: one path, in the process that is timed
+// ------------------------------------------------------------------------------------------------
+bool FillCompiled(TTree* tree, const SampleDefinition& sample, const std::vector<PlotDefinition>& plots, const std::vector<TH1D*>& hists,
+                  Long64_t maxEntries)
+{
+    FlatTreeEvent event;
+    if (!SetFlatTreeBranches(tree, sample, event, true))
+        return false;
+    Long64_t nentries = maxEntries >= 0 ? std::min(maxEntries, tree->GetEntries()) : tree->GetEntries();
+    for (Long64_t i = 0; i < nentries; i++)
+    {
+        tree->GetEntry(i);
+        if (!event.flag)
+            continue;
+        int nPions, nNeutrons;
+        CountPionsNeutrons(event.nfsp, event.pdg, nPions, nNeutrons);
+        int category = GetModeCategory(event.Mode), topology = GetTopology(nPions, nNeutrons);
+        // In double, as TTreeFormula computes the strings
+        double reco = sample.useQE ? (double) event.Enu_QE : (double) event.Erecoil_minerva + (double) event.ELep;
+        double bias = (double) event.Enu_true - reco;
+        for (size_t h = 0; h < plots.size(); h++)
+        {
+            const PlotDefinition& plot = plots[h];
+            if ((plot.category >= 0 && plot.category != category) || (plot.topology >= 0 && plot.topology != topology))
+                continue;
+            hists[h]->Fill(plot.variable == kPlotEnu ? event.Enu_true : (plot.variable == kPlotBias ? bias : bias / event.Enu_true));
+        }
+    }
+    tree->ResetBranchAddresses();
+    return true;
+}
+
+// Prints "RESULT seconds checksum": seconds from main to the last histogram filled
+int RunWorker(int path, Long64_t maxEntries, const std::vector<std::string>& inputs, std::chrono::steady_clock::time_point start)
+{
+    double checksum = 0;
+    for (const std::string& input : inputs)
+    {
+        size_t equal = input.find('=');
+        SampleDefinition sample;
+        GetSampleDefinition(input.substr(0, equal), sample);
+        TFile *file = TFile::Open(input.substr(equal + 1).c_str());
+        TTree *tree = file ? (TTree*) file->Get(sample.treeName.c_str()) : nullptr;
+        if (!tree)
+        {
+            printf("Error: could not read %s from %s.\n", sample.treeName.c_str(), input.substr(equal + 1).c_str());
+            return 1;
+        }
+
+        file->cd(); // Project() finds the histograms by name in the current directory
+        std::vector<PlotDefinition> plots = GetSamplePlots(sample.label);
+        std::vector<TH1D*> hists;
+        for (const PlotDefinition& plot : plots)
+            hists.push_back(new TH1D(plot.name, plot.title, plot.nbins, plot.lo, plot.hi));
+
+        if (path == kPathCompiled)
+        {
+            if (!FillCompiled(tree, sample, plots, hists, maxEntries))
+                return 1;
+        } else
+        {
+            FormulaFiller filler(tree);
+            filler.SetMaxEntries(maxEntries);
+            for (size_t h = 0; h < plots.size(); h++)
+                filler.Add(hists[h], plots[h].expression, plots[h].cut);
+            if (path != kPathNative)
+                filler.Run(path == kPathProject);
+            else if (!filler.RunNative())
+                return 1;
+        }
+
+        for (TH1D* h : hists)
+            for (int b = 0; b <= h->GetNbinsX() + 1; b++)
+                checksum += (b + 1) * h->GetBinContent(b);
+        file->Close();
+    }
+    printf("RESULT %.6f %.17g\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), checksum);
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                        Driver: every path in a child process, timed
+// ------------------------------------------------------------------------------------------------
+struct WorkerRun
+{
+    bool ok = false;
+    double wall = 0, inProcess = 0, checksum = 0;
+};
+
+WorkerRun SpawnWorker(int path, Long64_t maxEntries, const std::vector<std::string>& inputs)
+{
+    std::vector<std::string> args = {"--worker", PATH_NAMES[path], std::to_string(maxEntries)};
+    args.insert(args.end(), inputs.begin(), inputs.end());
+
+    WorkerRun run;
+    int fds[2];
+    if (pipe(fds) != 0)
+        return run;
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        std::vector<char*> argv = {(char*) "/proc/self/exe"};
+        for (const std::string& a : args)
+            argv.push_back((char*) a.c_str());
+        argv.push_back(nullptr);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+
+    std::string output;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0)
+        output.append(buffer, n);
+    close(fds[0]);
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        printf("Error: the %s worker failed:\n%s\n", PATH_NAMES[path], output.c_str());
+        return run;
+    }
+    run.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t result = output.rfind("RESULT ");
+    run.ok = result != std::string::npos && sscanf(output.c_str() + result, "RESULT %lf %lf", &run.inProcess, &run.checksum) == 2;
+    return run;
+}
+
+double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0. : values[values.size() / 2];
+}
+
+int main(int argc, char ** argv)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (argc > 3 && std::string(argv[1]) == "--worker")
+    {
+        int path = std::find(PATH_NAMES, PATH_NAMES + kNPaths, std::string(argv[2])) - PATH_NAMES;
+        return RunWorker(path, atoll(argv[3]), std::vector<std::string>(argv + 4, argv + argc), start);
+    }
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./startup_benchmark.out \n- LABEL=file.root for each sample (DUNE or T2K)"
+                  << "\n- optional: --runs number of timed runs of every path (default 3)"
+                  << "\n- optional: --first number of entries of the startup runs (default 1)" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> inputs;
+    int nRuns = 3;
+    Long64_t nFirst = 1;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "--runs" && a + 1 < argc)
+            nRuns = std::max(1, atoi(argv[++a]));
+        else if (arg == "--first" && a + 1 < argc)
+            nFirst = std::max(1LL, atoll(argv[++a]));
+        else
+        {
+            size_t equal = arg.find('=');
+            SampleDefinition sample;
+            if (equal == std::string::npos || !GetSampleDefinition(arg.substr(0, equal), sample) || sample.label == "nuSCOPE")
+            {
+                printf("Error: \"%s\" is not LABEL=file.root with LABEL DUNE or T2K (the samples of test.cpp).\n", arg.c_str());
+                return 1;
+            }
+            inputs.push_back(arg);
+        }
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //        Startup (first entries only) and full runs of every path, medians over the runs
+    // ----------------------------------------------------------------------------------------------
+    double startupWall[kNPaths], startupInProcess[kNPaths], fullWall[kNPaths], checksums[kNPaths];
+    for (int path = 0; path < kNPaths; path++)
+    {
+        std::vector<double> wall, inProcess, full;
+        for (int r = 0; r < nRuns; r++)
+        {
+            WorkerRun first = SpawnWorker(path, nFirst, inputs);
+            WorkerRun all = SpawnWorker(path, -1, inputs);
+            if (!first.ok || !all.ok)
+                return 1;
+            wall.push_back(first.wall);
+            inProcess.push_back(first.inProcess);
+            full.push_back(all.wall);
+            checksums[path] = all.checksum;
+        }
+        startupWall[path] = Median(wall);
+        startupInProcess[path] = Median(inProcess);
+        fullWall[path] = Median(full);
+    }
+
+    printf("\nMedian of %d runs per path, %zu samples; startup = process running until %lld entr%s of every sample processed\n",
+           nRuns, inputs.size(), (long long) nFirst, nFirst == 1 ? "y" : "ies");
+    printf("%-10s %14s %16s %12s %10s %10s  %s\n", "path", "startup [s]", "after main [s]", "full run [s]", "startup x", "full x",
+           "histograms");
+    bool allAgree = true;
+    for (int path = 0; path < kNPaths; path++)
+    {
+        bool agree = std::fabs(checksums[path] - checksums[kPathProject]) <= 1e-6 * std::fabs(checksums[kPathProject]);
+        allAgree = allAgree && agree;
+        printf("%-10s %14.3f %16.3f %12.3f %9.1fx %9.1fx  %s\n", PATH_NAMES[path], startupWall[path], startupInProcess[path],
+               fullWall[path], startupWall[kPathProject] / startupWall[path], fullWall[kPathProject] / fullWall[path],
+               agree ? "same as project" : "DIFFERENT from project");
+    }
+    return allAgree ? 0 : 1;
+}
@@ -0,0 +1,546 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1D.h"
+#include "TROOT.h"
+#include "SampleDefinitions.h"
+#include "PlotDefinitions.h"
+#include "CompiledFormula.h"
+#include "HistogramRegistry.h"
+#include "EventIndex.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// To compile: c++ ValidationHarness.cpp `root-config --cflags --libs` -pthread -o validation_harness.out
+//
+// Differential test of the ways we fill the standard plots. A synthetic flat tree (same branches as
+// the NUISANCE FlatTree_VARS: Mode, Enu_true, ELep, Erecoil_minerva, Enu_QE, flagCCINC, flagCC0pi,
+// nfsp, pdg) is generated, and the plots are filled with the code the macros actually run, taken
+// from PlotDefinitions.h (unweighted, as in the macros):
+//
+//   test.cpp, its TTree::Project() strings and binnings:
+//   - Project (serial)         one TTree::Project per histogram: the baseline of these plots
+//   - FormulaFiller (JIT)      the same strings compiled once, all histograms in one pass (CompiledFormula.h)
+//   - FormulaFiller (native)   the same strings evaluated on blocks of entries, without the interpreter
+//
+//   DUNE_vs_T2K_plots.cpp, the branches, selection and float values of ProcessTree and its binnings:
+//   - hand loop                ProcessTree over all the entries: the baseline of these plots
+//   - threaded                 entry ranges on N threads, per-thread histograms merged (as CompareSamples.cpp)
+//   - cached columns           the selected values loaded in memory once, then filled (cold: load + fill, warm: fill)
+//   - skimmed                  only the entries of the event index selection flagCCINC | flagCC0pi (EventIndex.h)
+//
+// Every strategy is compared bin by bin (under/overflow included) with the baseline of its macro,
+// within a relative tolerance, and timed. Exit code 1 if any strategy disagrees with its baseline.
+//
+// The two macros are then compared with each other: for every histogram they both draw, the
+// binnings, the form of the test.cpp cut (flag * (...) or flag && (...)), and the bins where the
+// ProcessTree code filled on the test.cpp binning differs from TTree::Project (float vs double
+// values at the bin edges, selection). These differences are reported, they do not fail the run.
+//
+//     ./validation_harness.out [number of events, default 1000000] [-j threads] [--tolerance 1e-9] [--keep]
+
+// ------------------------------------------------------------------------------------------------
+//                                     The synthetic sample
+// ------------------------------------------------------------------------------------------------
+bool GenerateSyntheticFile(const std::string& fileName, Long64_t nEvents, unsigned seed)
+{
+    TFile *file = TFile::Open(fileName.c_str(), "RECREATE");
+    if (!file)
+        return false;
+
+    TTree *tree = new TTree("FlatTree_VARS", "Synthetic flat tree for ValidationHarness");
+    int Mode, nfsp, pdg[MAXPARTICLES];
+    Float_t Enu_true, ELep, Erecoil_minerva, Enu_QE;
+    bool flagCCINC, flagCC0pi;
+    tree->Branch("Mode", &Mode, "Mode/I");
+    tree->Branch("Enu_true", &Enu_true, "Enu_true/F");
+    tree->Branch("ELep", &ELep, "ELep/F");
+    tree->Branch("Erecoil_minerva", &Erecoil_minerva, "Erecoil_minerva/F");
+    tree->Branch("Enu_QE", &Enu_QE, "Enu_QE/F");
+    tree->Branch("flagCCINC", &flagCCINC, "flagCCINC/O");
+    tree->Branch("flagCC0pi", &flagCC0pi, "flagCC0pi/O");
+    tree->Branch("nfsp", &nfsp, "nfsp/I");
+    tree->Branch("pdg", pdg, "pdg[nfsp]/I");
+
+    TH1D *flux = new TH1D("FlatTree_FLUX", "Synthetic flux;E_{#nu} [GeV];Flux", 100, 0, 10);
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::exponential_distribution<double> energy(0.5);
+    std::normal_distribution<double> qeSmearing(1., 0.12);
+    const int modes[] = {1, 2, 11, 12, 13, 16, 21, 26, 31, 36};
+    const double modeCdf[] = {0.35, 0.45, 0.62, 0.70, 0.76, 0.79, 0.86, 0.94, 0.97, 1.00};
+    const int hadrons[] = {2212, 2212, 2212, 2112, 2112, 211, -211, 111, 22};
+
+    for (Long64_t i = 0; i < nEvents; i++)
+    {
+        double u = uniform(rng);
+        Mode = modes[std::lower_bound(modeCdf, modeCdf + 10, u) - modeCdf];
+        Enu_true = 0.2 + energy(rng);
+        ELep = Enu_true * (0.2 + 0.75 * uniform(rng));
+        Erecoil_minerva = (Enu_true - ELep) * (0.4 + 0.7 * uniform(rng));
+        Enu_QE = std::max(0., Enu_true * qeSmearing(rng));
+
+        nfsp = 1 + (int) (6 * uniform(rng) * uniform(rng));
+        pdg[0] = 13;
+        bool hasPion = false;
+        for (int j = 1; j < nfsp; j++)
+        {
+            pdg[j] = hadrons[(int) (9 * uniform(rng))];
+            hasPion = hasPion || abs(pdg[j]) == 211;
+        }
+        flagCCINC = uniform(rng) < 0.95;
+        flagCC0pi = flagCCINC && !hasPion;
+
+        flux->Fill(Enu_true);
+        tree->Fill();
+    }
+
+    tree->Write();
+    flux->Write();
+    file->Close();
+    delete file;
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+//           Filling with the ProcessTree code of DUNE_vs_T2K_plots.cpp (PlotDefinitions.h)
+// ------------------------------------------------------------------------------------------------
+// Fills the histograms of one sample (H is TH1 or BookedHistogram) with a selected entry
+template <class H>
+void FillProcessTree(const std::vector<const PlotDefinition*>& plots, const std::vector<H*>& hists, const ProcessTreeValues& v)
+{
+    float x;
+    for (size_t h = 0; h < plots.size(); h++)
+        if (ProcessTreeValue(*plots[h], v, x))
+            hists[h]->Fill(x);
+}
+
+// ------------------------------------------------------------------------------------------------
+//                       Results of a strategy: all bin contents, and the time
+// ------------------------------------------------------------------------------------------------
+struct StrategyResult
+{
+    std::string name, note;
+    double seconds = 0;
+    std::vector<std::vector<double>> contents; // [histogram][bin], bins 0 to nbins+1
+};
+
+template <class H>
+std::vector<double> BinContents(const H* h, int nbins)
+{
+    std::vector<double> contents(nbins + 2);
+    for (int b = 0; b <= nbins + 1; b++)
+        contents[b] = h->GetBinContent(b);
+    return contents;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Plots of one sample, in the order of the full list
+std::vector<const PlotDefinition*> SamplePlots(const std::vector<PlotDefinition>& plots, const std::string& label)
+{
+    std::vector<const PlotDefinition*> selected;
+    for (const PlotDefinition& plot : plots)
+        if (plot.sample == label)
+            selected.push_back(&plot);
+    return selected;
+}
+
+// Histograms of the full list split per sample
+template <class H>
+std::vector<H*> SampleHists(const std::vector<PlotDefinition>& plots, const std::vector<H*>& hists, const std::string& label)
+{
+    std::vector<H*> selected;
+    for (size_t h = 0; h < plots.size(); h++)
+        if (plots[h].sample == label)
+            selected.push_back(hists[h]);
+    return selected;
+}
+
+std::vector<TH1D*> BookTH1(const std::vector<PlotDefinition>& plots, const std::string& suffix)
+{
+    std::vector<TH1D*> hists;
+    for (const PlotDefinition& plot : plots)
+    {
+        hists.push_back(new TH1D((plot.name + suffix).c_str(), plot.title, plot.nbins, plot.lo, plot.hi));
+        hists.back()->SetDirectory(nullptr);
+    }
+    return hists;
+}
+
+StrategyResult CollectTH1(const std::string& name, const std::vector<PlotDefinition>& plots, std::vector<TH1D*>& hists, double seconds)
+{
+    StrategyResult result;
+    result.name = name;
+    result.seconds = seconds;
+    for (size_t h = 0; h < plots.size(); h++)
+    {
+        result.contents.push_back(BinContents(hists[h], plots[h].nbins));
+        delete hists[h];
+    }
+    return result;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                             The strategies for the test.cpp strings
+// ------------------------------------------------------------------------------------------------
+enum FillerMode { kFillerProject, kFillerJIT, kFillerNative };
+
+StrategyResult RunFormulaFiller(TTree* tree, const std::vector<PlotDefinition>& plots, int mode)
+{
+    static const char* suffixes[] = {"_project", "_jit", "_native"};
+    static const char* names[] = {"Project (serial)", "FormulaFiller (JIT)", "FormulaFiller (native)"};
+    std::vector<TH1D*> hists = BookTH1(plots, suffixes[mode]);
+    TDirectory *directory = gDirectory;
+    tree->GetCurrentFile()->cd(); // Project() finds the histograms by name in the current directory
+    for (TH1D* h : hists)
+        h->SetDirectory(gDirectory);
+
+    auto start = std::chrono::steady_clock::now();
+    std::string note;
+    for (const char* label : {"DUNE", "T2K"})
+    {
+        FormulaFiller filler(tree);
+        for (size_t h = 0; h < plots.size(); h++)
+            if (plots[h].sample == std::string(label))
+                filler.Add(hists[h], plots[h].expression, plots[h].cut);
+        if (mode != kFillerNative)
+            filler.Run(mode == kFillerProject);
+        else if (!filler.RunNative())
+            note = "some expressions need the interpreter";
+    }
+    double seconds = SecondsSince(start);
+
+    for (TH1D* h : hists)
+        h->SetDirectory(nullptr);
+    directory->cd();
+    StrategyResult result = CollectTH1(names[mode], plots, hists, seconds);
+    if (!note.empty())
+        result.note = note;
+    return result;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                     The strategies for the ProcessTree code of DUNE_vs_T2K_plots.cpp
+// ------------------------------------------------------------------------------------------------
+// ProcessTree over [first, last) (or over the given entries) of one sample
+template <class H>
+void LoopSample(TTree* tree, const std::vector<const PlotDefinition*>& plots, const std::vector<H*>& hists,
+                Long64_t first, Long64_t last, const std::vector<Long64_t>* entries = nullptr)
+{
+    bool isDUNE = std::string(plots[0]->sample) == "DUNE";
+    ProcessTreeEvent event;
+    ProcessTreeValues v;
+    SetProcessTreeBranches(tree, isDUNE, event);
+    Long64_t n = entries ? (Long64_t) entries->size() : last - first;
+    for (Long64_t k = 0; k < n; k++)
+    {
+        tree->GetEntry(entries ? (*entries)[k] : first + k);
+        if (SelectProcessTree(event, isDUNE, v))
+            FillProcessTree(plots, hists, v);
+    }
+    tree->ResetBranchAddresses();
+    tree->SetBranchStatus("*", true);
+}
+
+StrategyResult RunHandLoop(TTree* tree, const std::vector<PlotDefinition>& plots, const std::string& name = "hand loop")
+{
+    std::vector<TH1D*> hists = BookTH1(plots, "_loop");
+    auto start = std::chrono::steady_clock::now();
+    for (const char* label : {"DUNE", "T2K"})
+        LoopSample(tree, SamplePlots(plots, label), SampleHists(plots, hists, label), 0, tree->GetEntries());
+    return CollectTH1(name, plots, hists, SecondsSince(start));
+}
+
+StrategyResult RunThreaded(const std::string& fileName, Long64_t nEntries, const std::vector<PlotDefinition>& plots, int nThreads)
+{
+    HistogramRegistry registry;
+    std::vector<BookedHistogram*> totals;
+    for (const PlotDefinition& plot : plots)
+        totals.push_back(registry.Book(plot.name, plot.title, plot.nbins, plot.lo, plot.hi));
+
+    auto start = std::chrono::steady_clock::now();
+    std::mutex mergeMutex;
+    std::vector<std::thread> pool;
+    for (int t = 0; t < nThreads; t++)
+    {
+        pool.emplace_back([&, t]()
+        {
+            TFile *file = TFile::Open(fileName.c_str());
+            TTree *tree = file ? (TTree*) file->Get("FlatTree_VARS") : nullptr;
+            if (!tree)
+                return;
+            HistogramRegistry local;
+            std::vector<BookedHistogram*> hists;
+            for (const PlotDefinition& plot : plots)
+                hists.push_back(local.Book(plot.name, plot.title, plot.nbins, plot.lo, plot.hi));
+
+            Long64_t first = nEntries * t / nThreads, last = nEntries * (t + 1) / nThreads;
+            for (const char* label : {"DUNE", "T2K"})
+                LoopSample(tree, SamplePlots(plots, label), SampleHists(plots, hists, label), first, last);
+            file->Close();
+            delete file;
+
+            std::lock_guard<std::mutex> lock(mergeMutex);
+            for (size_t h = 0; h < hists.size(); h++)
+                totals[h]->Add(*hists[h]);
+        });
+    }
+    for (std::thread& thread : pool)
+        thread.join();
+
+    StrategyResult result;
+    result.name = "threaded (" + std::to_string(nThreads) + ")";
+    result.seconds = SecondsSince(start);
+    for (size_t h = 0; h < plots.size(); h++)
+        result.contents.push_back(BinContents(totals[h], plots[h].nbins));
+    return result;
+}
+
+std::vector<StrategyResult> RunCached(TTree* tree, const std::vector<PlotDefinition>& plots)
+{
+    std::vector<StrategyResult> results;
+    std::vector<std::vector<ProcessTreeValues>> cache(2); // values of the selected entries
+    const char* labels[2] = {"DUNE", "T2K"};
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < 2; s++)
+    {
+        bool isDUNE = s == 0;
+        ProcessTreeEvent event;
+        ProcessTreeValues v;
+        SetProcessTreeBranches(tree, isDUNE, event);
+        cache[s].reserve(tree->GetEntries());
+        for (Long64_t i = 0; i < tree->GetEntries(); i++)
+        {
+            tree->GetEntry(i);
+            if (SelectProcessTree(event, isDUNE, v))
+                cache[s].push_back(v);
+        }
+        tree->ResetBranchAddresses();
+        tree->SetBranchStatus("*", true);
+    }
+    double loadSeconds = SecondsSince(start);
+
+    for (const char* name : {"cached columns (cold)", "cached columns (warm)"})
+    {
+        std::vector<TH1D*> hists = BookTH1(plots, "_cached");
+        auto fillStart = std::chrono::steady_clock::now();
+        for (int s = 0; s < 2; s++)
+        {
+            std::vector<const PlotDefinition*> samplePlots = SamplePlots(plots, labels[s]);
+            std::vector<TH1D*> sampleHists = SampleHists(plots, hists, labels[s]);
+            for (const ProcessTreeValues& v : cache[s])
+                FillProcessTree(samplePlots, sampleHists, v);
+        }
+        double fillSeconds = SecondsSince(fillStart);
+        bool cold = results.empty();
+        results.push_back(CollectTH1(name, plots, hists, fillSeconds + (cold ? loadSeconds : 0.)));
+        if (cold)
+            results.back().note = Form("load %.2f s", loadSeconds);
+    }
+    return results;
+}
+
+StrategyResult RunSkimmed(TTree* tree, const std::vector<PlotDefinition>& plots)
+{
+    auto indexStart = std::chrono::steady_clock::now();
+    EventIndex index;
+    EntryBitmap selected;
+    std::string error;
+    if (!index.Build(tree) || !index.Select("flagCCINC | flagCC0pi", selected, error))
+        printf("Error: event index: %s\n", error.c_str());
+    double indexSeconds = SecondsSince(indexStart);
+    tree->SetBranchStatus("*", true);
+
+    std::vector<Long64_t> entries;
+    selected.AppendEntries(entries);
+
+    std::vector<TH1D*> hists = BookTH1(plots, "_skimmed");
+    auto start = std::chrono::steady_clock::now();
+    for (const char* label : {"DUNE", "T2K"})
+        LoopSample(tree, SamplePlots(plots, label), SampleHists(plots, hists, label), 0, 0, &entries);
+    StrategyResult result = CollectTH1("skimmed (event index)", plots, hists, SecondsSince(start));
+    result.note = Form("%.0f%% of entries, index built in %.2f s", 100. * entries.size() / std::max<Long64_t>(1, tree->GetEntries()), indexSeconds);
+    return result;
+}
+
+// ------------------------------------------------------------------------------------------------
+//                               Bin-by-bin comparison with the baseline
+// ------------------------------------------------------------------------------------------------
+struct Comparison
+{
+    int nBins = 0, nMismatched = 0;
+    double maxRelative = 0;
+    std::string worst; // histogram and bin of the largest difference
+};
+
+Comparison Compare(const std::vector<double>& baseline, const std::vector<double>& other, const char* name, double tolerance,
+                   Comparison comparison = Comparison())
+{
+    for (size_t b = 0; b < baseline.size(); b++)
+    {
+        double a = baseline[b], c = other[b];
+        double relative = std::fabs(a - c) / std::max(1., std::fabs(a));
+        comparison.nBins++;
+        if (relative > tolerance)
+            comparison.nMismatched++;
+        if (relative > comparison.maxRelative)
+        {
+            comparison.maxRelative = relative;
+            comparison.worst = Form("%s bin %zu: %.6g vs %.6g", name, b, a, c);
+        }
+    }
+    return comparison;
+}
+
+// Prints the strategies of one macro against the first one; false if any of them disagrees
+bool PrintStrategies(const char* title, const std::vector<StrategyResult>& results, const std::vector<PlotDefinition>& plots,
+                     double tolerance)
+{
+    const StrategyResult& baseline = results[0];
+    bool allAgree = true;
+    printf("\n%s: %zu histograms, tolerance %.1e (relative, per bin)\n", title, plots.size(), tolerance);
+    printf("%-26s %9s %8s %12s %10s  %s\n", "strategy", "time [s]", "speedup", "mismatched", "max diff", "notes");
+    for (const StrategyResult& result : results)
+    {
+        Comparison comparison;
+        for (size_t h = 0; h < plots.size(); h++)
+            comparison = Compare(baseline.contents[h], result.contents[h], plots[h].name, tolerance, comparison);
+        allAgree = allAgree && comparison.nMismatched == 0;
+        printf("%-26s %9.3f %7.1fx %5d/%-6d %10.2e  %s%s%s\n", result.name.c_str(), result.seconds,
+               result.seconds > 0 ? baseline.seconds / result.seconds : 0., comparison.nMismatched, comparison.nBins,
+               comparison.maxRelative, result.note.c_str(), comparison.nMismatched ? "  worst: " : "",
+               comparison.nMismatched ? comparison.worst.c_str() : "");
+    }
+    return allAgree;
+}
+
+std::string Binning(const PlotDefinition& plot)
+{
+    return Form("%d [%g,%g]", plot.nbins, plot.lo, plot.hi);
+}
+
+int main(int argc, char ** argv)
+{
+    Long64_t nEvents = 1000000;
+    int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    double tolerance = 1e-9;
+    bool keep = false;
+    for (int a = 1; a < argc; a++)
+    {
+        std::string arg = argv[a];
+        if (arg == "-j" && a + 1 < argc)
+            nThreads = std::max(1, atoi(argv[++a]));
+        else if (arg == "--tolerance" && a + 1 < argc)
+            tolerance = atof(argv[++a]);
+        else if (arg == "--keep")
+            keep = true;
+        else if (arg == "-h" || arg == "--help" || atoll(argv[a]) <= 0)
+        {
+            std::cout << "Usage: \n- ./validation_harness.out \n- optional: number of synthetic events (default 1000000)"
+                      << "\n- optional: -j threads \n- optional: --tolerance relative tolerance per bin (default 1e-9)"
+                      << "\n- optional: --keep (keep the synthetic file validation_synthetic.root)" << std::endl;
+            return 1;
+        } else
+            nEvents = atoll(argv[a]);
+    }
+
+    const std::string fileName = "validation_synthetic.root";
+    auto start = std::chrono::steady_clock::now();
+    if (!GenerateSyntheticFile(fileName, nEvents, 20240611))
+    {
+        printf("Error: could not write %s.\n", fileName.c_str());
+        return 1;
+    }
+    printf("%lld synthetic events written to %s in %.2f s\n", (long long) nEvents, fileName.c_str(), SecondsSince(start));
+
+    TFile *file = TFile::Open(fileName.c_str());
+    TTree *tree = file ? (TTree*) file->Get("FlatTree_VARS") : nullptr;
+    if (!tree)
+    {
+        printf("Error: could not read back %s.\n", fileName.c_str());
+        return 1;
+    }
+
+    ROOT::EnableThreadSafety();
+
+    // The histograms test.cpp fills from strings, and those DUNE_vs_T2K_plots.cpp derives from ProcessTree
+    std::vector<PlotDefinition> testPlots, processTreePlots = GetProcessTreePlots();
+    for (const PlotDefinition& plot : GetTestPlots())
+        if (plot.expression)
+            testPlots.push_back(plot);
+
+    std::vector<StrategyResult> testResults;
+    testResults.push_back(RunFormulaFiller(tree, testPlots, kFillerProject));
+    testResults.push_back(RunFormulaFiller(tree, testPlots, kFillerJIT));
+    testResults.push_back(RunFormulaFiller(tree, testPlots, kFillerNative));
+
+    std::vector<StrategyResult> processTreeResults;
+    processTreeResults.push_back(RunHandLoop(tree, processTreePlots));
+    processTreeResults.push_back(RunThreaded(fileName, tree->GetEntries(), processTreePlots, nThreads));
+    for (StrategyResult& result : RunCached(tree, processTreePlots))
+        processTreeResults.push_back(result);
+    processTreeResults.push_back(RunSkimmed(tree, processTreePlots));
+
+    // The ProcessTree code on the test.cpp binnings of the histograms both macros draw
+    std::vector<PlotDefinition> sharedPlots;
+    std::vector<size_t> sharedIndex; // position in testPlots
+    for (size_t h = 0; h < testPlots.size(); h++)
+        if (FindPlot(processTreePlots, testPlots[h].name))
+        {
+            sharedPlots.push_back(testPlots[h]);
+            sharedIndex.push_back(h);
+        }
+    StrategyResult crossCheck = RunHandLoop(tree, sharedPlots, "ProcessTree, test.cpp binning");
+
+    // ----------------------------------------------------------------------------------------------
+    //                                           Report
+    // ----------------------------------------------------------------------------------------------
+    bool allAgree = PrintStrategies("test.cpp (TTree::Project strings)", testResults, testPlots, tolerance);
+    allAgree = PrintStrategies("DUNE_vs_T2K_plots.cpp (ProcessTree)", processTreeResults, processTreePlots, tolerance) && allAgree;
+
+    printf("\nDifferences between the macros, for the %zu histograms both draw\n", sharedPlots.size());
+    printf("%-20s %-16s %-20s %-15s %s\n", "histogram", "test.cpp", "DUNE_vs_T2K_plots", "test.cpp cut", "ProcessTree vs Project, test.cpp binning");
+    int nDifferentBinnings = 0, nDifferentContents = 0;
+    for (size_t k = 0; k < sharedPlots.size(); k++)
+    {
+        const PlotDefinition& test = sharedPlots[k];
+        const PlotDefinition& other = *FindPlot(processTreePlots, test.name);
+        bool sameBinning = test.nbins == other.nbins && test.lo == other.lo && test.hi == other.hi;
+        nDifferentBinnings += sameBinning ? 0 : 1;
+        const char* cutForm = strstr(test.cut, "&&") ? "flag && (...)" : (strchr(test.cut, '*') ? "flag * (...)" : "flag");
+
+        Comparison comparison = Compare(testResults[0].contents[sharedIndex[k]], crossCheck.contents[k], test.name, tolerance);
+        nDifferentContents += comparison.nMismatched ? 1 : 0;
+        printf("%-20s %-16s %-20s %-15s %d/%d bins differ%s%s\n", test.name, Binning(test).c_str(),
+               sameBinning ? "same" : Binning(other).c_str(), cutForm, comparison.nMismatched, comparison.nBins,
+               comparison.nMismatched ? ", worst: " : "", comparison.nMismatched ? comparison.worst.c_str() : "");
+    }
+    printf("%d of %zu binnings differ between the macros; the ProcessTree code gives different contents than the test.cpp strings for %d.\n",
+           nDifferentBinnings, sharedPlots.size(), nDifferentContents);
+
+    printf("\n%s\n", allAgree ? "All strategies agree with the baseline of their macro."
+                              : "Some strategies DISAGREE with the baseline of their macro.");
+
+    file->Close();
+    if (!keep)
+    {
+        std::remove(fileName.c_str());
+        std::remove(EventIndexPath(fileName).c_str());
+    }
+    return allAgree ? 0 : 1;
+}
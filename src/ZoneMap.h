@@ -0,0 +1,282 @@
+#ifndef ZONE_MAP_H
+#define ZONE_MAP_H
+
+#include "TTree.h"
+#include "TLeaf.h"
+#include "EventIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------------
+//   Zone map of a flat tree: for every cluster of the tree (the unit in which baskets are flushed,
+//   so the unit of decompression), the number of entries and the minimum and maximum of the key
+//   scalar branches, plus the two bias definitions (Enu_true - Erecoil_minerva - ELep and
+//   Enu_true - Enu_QE). It is saved next to the input (ZoneMapPath).
+//
+//   A range cut (variable in [lo, hi]) cannot be passed by any entry of a cluster whose [min, max]
+//   does not overlap [lo, hi]: SelectClusters() gives the entries of the clusters that can still
+//   pass all the cuts, and counts the clusters that are skipped. The skipping is conservative: the
+//   cuts must still be applied to the entries that are read. NaN values are left out of the min and
+//   max (a NaN passes no range cut): a cluster with no other value has the empty range [inf, -inf],
+//   written as "inf -inf" in the file.
+//
+//   The min and max are computed and stored in double, the bias columns as Enu_true - (reco), like
+//   the double evaluation of the cut expressions, so that a value on the edge of a cluster is never
+//   out of its bounds. The map records the UUID of the input file (TreeSourceID): a map built for
+//   another file is not loaded.
+// ------------------------------------------------------------------------------------------------
+
+// Key scalar branches (the ones that are not in the tree are left out)
+static const char* ZONE_MAP_BRANCHES[] = {"Enu_true", "ELep", "Erecoil_minerva", "Enu_QE", "Q2", "W", "Weight"};
+
+struct RangeCut
+{
+    std::string variable;
+    double lo, hi;
+};
+
+struct ZoneMapReport
+{
+    int nClusters = 0, nSkipped = 0;
+    Long64_t nEntriesSkipped = 0;
+    std::vector<std::string> notIndexed; // variables of the cuts without a zone map column
+
+    void Print(const char* label) const
+    {
+        printf("[ZoneMap] %s: %d of %d clusters skipped (%lld entries not read)\n", label, nSkipped, nClusters,
+               (long long) nEntriesSkipped);
+        for (const std::string& variable : notIndexed)
+            printf("[ZoneMap] %s: no zone map for %s, its cut does not skip clusters\n", label, variable.c_str());
+    }
+};
+
+inline std::string ZoneMapPath(const std::string& inputFile)
+{
+    return inputFile + ".zonemap";
+}
+
+// Zone map column of the bias Enu_true - reco for a reco formula ("bias" if it has none)
+inline std::string BiasZoneColumn(const std::string& reco)
+{
+    std::string compact;
+    for (char c : reco)
+        if (c != ' ')
+            compact += c;
+    if (compact == "Enu_QE")
+        return "bias_QE";
+    if (compact == "Erecoil_minerva+ELep" || compact == "ELep+Erecoil_minerva")
+        return "bias_minerva";
+    return "bias";
+}
+
+class ZoneMap
+{
+public:
+    // One pass over the key branches (only those are switched on)
+    bool Build(TTree* tree)
+    {
+        fNEntries = tree->GetEntries();
+        fSource = TreeSourceID(tree);
+        fColumns.clear();
+        fFirst.clear();
+        fMin.clear();
+        fMax.clear();
+
+        tree->SetBranchStatus("*", false);
+        std::vector<TLeaf*> leaves;
+        for (const char* name : ZONE_MAP_BRANCHES)
+            if (tree->GetBranch(name))
+            {
+                tree->SetBranchStatus(name, true);
+                leaves.push_back(tree->GetLeaf(name));
+                fColumns.push_back(name);
+            }
+        int iEnu = GetColumn("Enu_true"), iELep = GetColumn("ELep"), iRecoil = GetColumn("Erecoil_minerva"), iQE = GetColumn("Enu_QE");
+        bool biasMinerva = iEnu >= 0 && iELep >= 0 && iRecoil >= 0, biasQE = iEnu >= 0 && iQE >= 0;
+        if (biasMinerva)
+            fColumns.push_back("bias_minerva");
+        if (biasQE)
+            fColumns.push_back("bias_QE");
+        if (fColumns.empty())
+        {
+            printf("Error: none of the key branches is in the tree, cannot build the zone map.\n");
+            return false;
+        }
+
+        const size_t nColumns = fColumns.size();
+        std::vector<double> values(nColumns);
+        TTree::TClusterIterator clusters = tree->GetClusterIterator(0);
+        Long64_t first;
+        while ((first = clusters()) < fNEntries)
+        {
+            Long64_t last = std::min(clusters.GetNextEntry(), fNEntries);
+            fFirst.push_back(first);
+            size_t offset = fMin.size();
+            fMin.resize(offset + nColumns, INFINITY);
+            fMax.resize(offset + nColumns, -INFINITY);
+
+            for (Long64_t i = first; i < last; i++)
+            {
+                tree->GetEntry(i);
+                size_t c = 0;
+                for (; c < leaves.size(); c++)
+                    values[c] = leaves[c]->GetValue();
+                if (biasMinerva)
+                    values[c++] = values[iEnu] - (values[iRecoil] + values[iELep]);
+                if (biasQE)
+                    values[c++] = values[iEnu] - values[iQE];
+
+                for (c = 0; c < nColumns; c++)
+                {
+                    if (std::isnan(values[c]))
+                        continue;
+                    fMin[offset + c] = std::min(fMin[offset + c], values[c]);
+                    fMax[offset + c] = std::max(fMax[offset + c], values[c]);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Text file: header, column names, then "first min max min max ..." per cluster
+    bool Save(const std::string& fileName) const
+    {
+        std::ofstream out(fileName);
+        if (!out)
+            return false;
+        out << "ZONEMAP2 " << fNEntries << " " << fFirst.size() << " " << (fSource.empty() ? "-" : fSource) << "\n";
+        for (const std::string& column : fColumns)
+            out << column << " ";
+        out << "\n";
+        out.precision(17); // exact for doubles
+        for (size_t k = 0; k < fFirst.size(); k++)
+        {
+            out << fFirst[k];
+            for (size_t c = 0; c < fColumns.size(); c++)
+            {
+                out << " ";
+                WriteValue(out, fMin[k * fColumns.size() + c]);
+                out << " ";
+                WriteValue(out, fMax[k * fColumns.size() + c]);
+            }
+            out << "\n";
+        }
+        return (bool) out;
+    }
+
+    // False if the file is missing or damaged, or was built for a tree with a different number of
+    // entries or from another file (TreeSourceID, when expectedSource is given)
+    bool Load(const std::string& fileName, Long64_t expectedEntries = -1, const std::string& expectedSource = "")
+    {
+        std::ifstream in(fileName);
+        std::string magic, line, column;
+        size_t nClusters;
+        if (!(in >> magic >> fNEntries >> nClusters >> fSource) || magic != "ZONEMAP2" || !std::getline(in, line) || !std::getline(in, line))
+            return false;
+        if (fSource == "-")
+            fSource.clear();
+        if ((expectedEntries >= 0 && expectedEntries != fNEntries) || (!expectedSource.empty() && expectedSource != fSource)
+            || nClusters > (size_t) std::max<Long64_t>(fNEntries, 1))
+            return false;
+
+        fColumns.clear();
+        std::stringstream names(line);
+        while (names >> column)
+            fColumns.push_back(column);
+
+        fFirst.resize(nClusters);
+        fMin.resize(nClusters * fColumns.size());
+        fMax.resize(nClusters * fColumns.size());
+        for (size_t k = 0; k < nClusters; k++)
+        {
+            if (!(in >> fFirst[k]) || fFirst[k] < 0 || fFirst[k] > fNEntries || (k > 0 && fFirst[k] < fFirst[k - 1]))
+                return false;
+            for (size_t c = 0; c < fColumns.size(); c++)
+                if (!ReadValue(in, fMin[k * fColumns.size() + c]) || !ReadValue(in, fMax[k * fColumns.size() + c]))
+                    return false;
+        }
+        return true;
+    }
+
+    int GetNClusters() const { return fFirst.size(); }
+    Long64_t GetClusterFirst(int k) const { return fFirst[k]; }
+    Long64_t GetClusterLast(int k) const { return k + 1 < (int) fFirst.size() ? fFirst[k + 1] : fNEntries; }
+    const std::vector<std::string>& GetColumns() const { return fColumns; }
+
+    int GetColumn(const std::string& name) const
+    {
+        for (size_t c = 0; c < fColumns.size(); c++)
+            if (fColumns[c] == name)
+                return c;
+        return -1;
+    }
+
+    double GetMin(int cluster, int column) const { return fMin[cluster * fColumns.size() + column]; }
+    double GetMax(int cluster, int column) const { return fMax[cluster * fColumns.size() + column]; }
+
+    // Entries of the clusters that may pass all the cuts (cuts on unknown variables never skip)
+    void SelectClusters(const std::vector<RangeCut>& cuts, EntryBitmap& candidates, ZoneMapReport& report) const
+    {
+        std::vector<int> columns;
+        report = ZoneMapReport();
+        for (const RangeCut& cut : cuts)
+        {
+            columns.push_back(GetColumn(cut.variable));
+            if (columns.back() < 0)
+                report.notIndexed.push_back(cut.variable);
+        }
+
+        candidates.Resize(fNEntries);
+        report.nClusters = fFirst.size();
+        for (int k = 0; k < (int) fFirst.size(); k++)
+        {
+            bool mayPass = true;
+            for (size_t i = 0; i < cuts.size() && mayPass; i++)
+                if (columns[i] >= 0) // with a relative margin for the rounding of other evaluation orders
+                    mayPass = GetMax(k, columns[i]) >= cuts[i].lo - 1e-6 * (1 + std::fabs(cuts[i].lo))
+                              && GetMin(k, columns[i]) <= cuts[i].hi + 1e-6 * (1 + std::fabs(cuts[i].hi));
+
+            if (mayPass)
+                candidates.SetRange(GetClusterFirst(k), GetClusterLast(k));
+            else
+            {
+                report.nSkipped++;
+                report.nEntriesSkipped += GetClusterLast(k) - GetClusterFirst(k);
+            }
+        }
+    }
+
+private:
+    // The infinities written as "inf" and "-inf", which operator>> cannot read but strtod can
+    static void WriteValue(std::ostream& out, double value)
+    {
+        if (std::isinf(value))
+            out << (value > 0 ? "inf" : "-inf");
+        else
+            out << value;
+    }
+
+    static bool ReadValue(std::istream& in, double& value)
+    {
+        std::string token;
+        if (!(in >> token))
+            return false;
+        char *end;
+        value = std::strtod(token.c_str(), &end);
+        return end != token.c_str() && *end == '\0';
+    }
+
+    Long64_t fNEntries = 0;
+    std::vector<std::string> fColumns;
+    std::vector<Long64_t> fFirst;   // first entry of every cluster
+    std::vector<double> fMin, fMax; // [cluster][column]
+    std::string fSource;            // TreeSourceID of the input
+};
+
+#endif
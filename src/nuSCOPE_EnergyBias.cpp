@@ -5,23 +5,47 @@
 #include "TLegend.h"
 #include "TStyle.h"
 #include "TLatex.h"
+#include "PlotCache.h"
+#include "SampleDefinitions.h"
+#include "RecoEstimators.h"
 #include <iostream>
+#include <algorithm>
 #include <cmath>
 #include <string>
+#include <vector>
 
 // To compile: c++ nuSCOPE_EnergyBias.cpp `root-config --cflags --libs` -o nuscope_energybias.out
+//
+// The E_reco estimators of RecoEstimators.h are compared in one extra pass over the flat tree (from
+// the four-momenta of the particles): --estimators takes a comma-separated list (default: all).
 
 int main(int argc, char ** argv) 
 {
     gStyle->SetOptStat(0);
 
+    // Plots whose content did not change since the last run are not rendered again
+    PlotCache plots("../nuSCOPE_Plots/noTaggingEfficiency/.plotcache");
+
     // ----------------------------------------------------------------------------------------------
     //                                   Open file and TTree 
     // ----------------------------------------------------------------------------------------------
 
     if (argc < 2) 
     {
-        std::cout << "Usage: \n- ./nuscope_energybias.out \n- name of the nuSCOPE .root file\n - name of the tagging .root file" << std::endl;
+        std::cout << "Usage: \n- ./nuscope_energybias.out \n- name of the nuSCOPE .root file\n - name of the tagging .root file"
+                  << "\n- optional: --estimators E_reco estimators, comma-separated (" << RecoEstimatorNames() << ", or all)" << std::endl;
+        return 1;
+    }
+
+    std::string estimatorList = "all";
+    for (int a = 2; a < argc; a++)
+        if (std::string(argv[a]) == "--estimators" && a + 1 < argc)
+            estimatorList = argv[++a];
+
+    std::vector<RecoEstimator> estimators;
+    if (!SelectRecoEstimators(estimatorList, estimators))
+    {
+        printf("Error: unknown estimator in \"%s\" (available: %s).\n", estimatorList.c_str(), RecoEstimatorNames().c_str());
         return 1;
     }
 
@@ -55,7 +79,7 @@ int main(int argc, char ** argv)
     hFluxNuSCOPE->SetTitle("nuSCOPE neutrino flux;E_{#nu} [GeV];Unosc #nu_{#mu}/m^{2}/POT/GeV");
     c1->SetTitle("nuSCOPE neutrino flux");
     hFluxNuSCOPE->Draw("hist");
-    c1->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/nuSCOPE_flux.pdf");
+    plots.SaveAs(c1, "../nuSCOPE_Plots/noTaggingEfficiency/nuSCOPE_flux.pdf");
 
     // -------------------------------------------------------------------------------------------------------------
     //                                         Histogram definitions 
@@ -80,6 +104,12 @@ int main(int argc, char ** argv)
     TH1F *hNuSCOPE_Npi0n = new TH1F("hNuSCOPE_Npi0n", "nuSCOPE Npi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
     TH1F *hNuSCOPE_NpiNn = new TH1F("hNuSCOPE_NpiNn", "nuSCOPE NpiNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
 
+    // Energy bias for each selected E_reco estimator
+    std::vector<TH1F*> hBiasEstimator;
+    for (const RecoEstimator& estimator : estimators)
+        hBiasEstimator.push_back(new TH1F(Form("hDeltaNuSCOPE_%s", estimator.name), Form("Energy bias, %s;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", estimator.title),
+                                          50, -0.5, 2.5));
+
     // -------------------------------------------------------------------------------------------------------------
     //                                    Filling histograms from TTree
     // -------------------------------------------------------------------------------------------------------------
@@ -109,6 +139,25 @@ int main(int argc, char ** argv)
     tNuSCOPE -> Project("hNuSCOPE_Npi0n", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))==0) && (Sum$((abs(pdg)==211))>0))", "hist"); // N pions, no neutrons
     tNuSCOPE -> Project("hNuSCOPE_NpiNn", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))>0) && (Sum$((abs(pdg)==211))>0))", "hist"); // N pions, N neutrons
 
+    // Energy bias by E_reco estimator: one loop, the particles of each event summarised once for all of them
+    SampleDefinition sample;
+    GetSampleDefinition("nuSCOPE", sample);
+    FlatTreeEvent event;
+    if (!SetFlatTreeBranches(tNuSCOPE, sample, event, true, true))
+        return 1;
+    EstimatorInput estimatorInput;
+    for (Long64_t i = 0; i < tNuSCOPE->GetEntries(); i++)
+    {
+        tNuSCOPE->GetEntry(i);
+        if (!event.flag)
+            continue;
+        estimatorInput.Reset();
+        estimatorInput.AddParticles(event.nfsp, event.pdg, event.px, event.py, event.pz, event.E);
+        for (size_t e = 0; e < estimators.size(); e++)
+            hBiasEstimator[e]->Fill(event.Enu_true - estimators[e].function(estimatorInput));
+    }
+    tNuSCOPE->ResetBranchAddresses();
+
     // ----------------------------------------------------------------------------------------------
     //                                       Plotting
     // ----------------------------------------------------------------------------------------------
@@ -116,7 +165,7 @@ int main(int argc, char ** argv)
     hLepEnergyNuSCOPE->SetLineColor(kRed);
     TCanvas *cLep = new TCanvas("cLep", "Lepton energy", 800, 600);
     hLepEnergyNuSCOPE->Draw("hist");
-    cLep->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/lepton_energy.pdf");
+    plots.SaveAs(cLep, "../nuSCOPE_Plots/noTaggingEfficiency/lepton_energy.pdf");
 
     // True E_nu
     hEnuNuSCOPE->SetLineColor(kRed);
@@ -128,7 +177,7 @@ int main(int argc, char ** argv)
     leg2->AddEntry(hEnuNuSCOPE, "nuSCOPE", "l");
     leg2->Draw();
 
-    c2->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/true_energy.pdf");
+    plots.SaveAs(c2, "../nuSCOPE_Plots/noTaggingEfficiency/true_energy.pdf");
 
     // Energy bias (E_true - E_reco) 
     hDeltaNuSCOPE->SetLineColor(kRed);
@@ -140,7 +189,7 @@ int main(int argc, char ** argv)
     leg3->AddEntry(hDeltaNuSCOPE, "nuSCOPE", "l");
     leg3->Draw();
 
-    c3->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/energy_bias.pdf");
+    plots.SaveAs(c3, "../nuSCOPE_Plots/noTaggingEfficiency/energy_bias.pdf");
 
     // Weighted energy bias [(E_true - E_reco)/E_true]
     hDeltaNuSCOPE_Weighted->SetLineColor(kRed);
@@ -152,7 +201,7 @@ int main(int argc, char ** argv)
     leg3_2->AddEntry(hDeltaNuSCOPE_Weighted, "nuSCOPE", "l");
     leg3_2->Draw();
 
-    c3_2->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/delta_energy_weighted.pdf");
+    plots.SaveAs(c3_2, "../nuSCOPE_Plots/noTaggingEfficiency/delta_energy_weighted.pdf");
 
     // Mode-separated NuSCOPE plot
     hNuSCOPE_CCQE->SetLineColor(kGreen+2);
@@ -173,7 +222,7 @@ int main(int argc, char ** argv)
     leg4->AddEntry(hNuSCOPE_Other, "Other", "l");
     leg4->Draw();
 
-    c4->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/nuSCOPE_modes.pdf");
+    plots.SaveAs(c4, "../nuSCOPE_Plots/noTaggingEfficiency/nuSCOPE_modes.pdf");
 
     // NuSCOPE Energy bias split by mode of interaction and topology
     TCanvas *c6 = new TCanvas("c6", "nuSCOPE DeltaE by channel", 1000, 800);
@@ -265,10 +314,17 @@ int main(int argc, char ** argv)
     label2.SetTextSize(0.04);
     label2.DrawLatex(0.15, 0.93, "nuSCOPE: Energy bias by final-state topology");
 
-    c6->SaveAs("../nuSCOPE_Plots/noTaggingEfficiency/nuSCOPE_deltaE_modes_split.pdf");
+    plots.SaveAs(c6, "../nuSCOPE_Plots/noTaggingEfficiency/nuSCOPE_deltaE_modes_split.pdf");
+
+    // Energy bias of the different E_reco estimators
+    TCanvas *cEstimators = new TCanvas("cEstimators", "Energy bias by estimator", 800, 600);
+    DrawRecoEstimators(estimators, hBiasEstimator, new TLegend(0.6, 0.65, 0.9, 0.9));
+    plots.SaveAs(cEstimators, "../nuSCOPE_Plots/noTaggingEfficiency/energy_bias_estimators.pdf");
 
     // Close files
     file_NuSCOPE->Close();
 
+    plots.PrintSummary("nuSCOPE energy bias");
+
     return 0;
 }
\ No newline at end of file
@@ -1,28 +1,72 @@
 #include "TFile.h"
 #include "TTree.h"
+#include "TBranch.h"
 #include "TH1F.h"
 #include "TCanvas.h"
 #include "TLegend.h"
 #include "TStyle.h"
 #include "TLatex.h"
+#include "PlotCache.h"
+#include "PerfCounters.h"
+#include "LiveMonitor.h"
+#include "Kinematics.h"
+#include "SampleDefinitions.h"
+#include "RecoEstimators.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <memory>
 
 // To compile: c++ nuSCOPE_EnergyBias_Genie.cpp `root-config --cflags --libs` -o nuscope_energybias_Genie.out
+//
+// Several E_reco definitions can be compared in the same pass (see RecoEstimators.h): the optional third
+// argument is a comma-separated list of estimators (default: all), each one gets its own bias histogram.
+// With --monitor PORT the progress and the partial histograms are served on http://127.0.0.1:PORT/
+// while the loop runs, with --monitor-file path they are written there as JSON (LiveMonitor.h).
 static const int MAXCELLS = 100;
 
 int main(int argc, char ** argv) 
 {
     gStyle->SetOptStat(0);
 
+    // Plots whose content did not change since the last run are not rendered again
+    PlotCache plots("../nuSCOPE_Plots/withTaggingEfficiency/.plotcache");
+
     // ----------------------------------------------------------------------------------------------
     //                                   Open file and TTree 
     // ----------------------------------------------------------------------------------------------
 
     if (argc < 3) 
     {
-        std::cout << "Usage: \n- ./nuscope_energybias_Genie.out \n- name of the nuSCOPE .root file\n - name of the tagging .root file" << std::endl;
+        std::cout << "Usage: \n- ./nuscope_energybias_Genie.out \n- name of the nuSCOPE .root file\n - name of the tagging .root file"
+                  << "\n- optional: E_reco estimators, comma-separated (" << RecoEstimatorNames() << ", or all)"
+                  << "\n- optional: --profile (hardware counters per stage of the event loop)"
+                  << "\n- optional: --monitor port and/or --monitor-file path (live progress)" << std::endl;
+        return 1;
+    }
+
+    std::string estimatorList = "all";
+    bool profile = false;
+    int monitorPort = 0;
+    std::string monitorFile;
+    for (int a = 3; a < argc; a++)
+    {
+        if (std::string(argv[a]) == "--profile")
+            profile = true;
+        else if (std::string(argv[a]) == "--monitor" && a + 1 < argc)
+            monitorPort = atoi(argv[++a]);
+        else if (std::string(argv[a]) == "--monitor-file" && a + 1 < argc)
+            monitorFile = argv[++a];
+        else
+            estimatorList = argv[a];
+    }
+
+    std::vector<RecoEstimator> estimators;
+    if (!SelectRecoEstimators(estimatorList, estimators))
+    {
+        printf("Error: unknown estimator in \"%s\" (available: %s).\n", estimatorList.c_str(), RecoEstimatorNames().c_str());
         return 1;
     }
 
@@ -74,39 +118,116 @@ int main(int argc, char ** argv)
     TH1F *hNuSCOPE_Npi0n = new TH1F("hNuSCOPE_Npi0n", "nuSCOPE Npi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
     TH1F *hNuSCOPE_NpiNn = new TH1F("hNuSCOPE_NpiNn", "nuSCOPE NpiNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
 
+    // Extended kinematics (see Kinematics.h): Q^2, W and transverse kinematic imbalance
+    const int kinBins[kNKinematicVariables]  = {50, 60, 50, 36, 36};
+    const double kinLo[kNKinematicVariables] = {0, 0, 0, 0, 0};
+    const double kinHi[kNKinematicVariables] = {4, 3, 1, 180, 180};
+    TH1F *hKinNuSCOPE[kNKinematicVariables];
+    for (int v = 0; v < kNKinematicVariables; v++)
+        hKinNuSCOPE[v] = new TH1F(Form("hNuSCOPE_%s", KinematicVariableName(v)), Form("nuSCOPE %s;%s;Entries", KinematicVariableName(v), KinematicVariableTitle(v)),
+                                  kinBins[v], kinLo[v], kinHi[v]);
+
+    // Energy bias for each selected E_reco estimator
+    std::vector<TH1F*> hBiasEstimator;
+    for (const RecoEstimator& estimator : estimators)
+        hBiasEstimator.push_back(new TH1F(Form("hDeltaNuSCOPE_%s", estimator.name), Form("Energy bias, %s;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", estimator.title),
+                                          50, -0.5, 2.5));
+
     std::cout << "\n\n Created histograms.\n";
 
     // -------------------------------------------------------------------------------------------------------------
     //                                    Filling histograms with variables
     // -------------------------------------------------------------------------------------------------------------
     int NParticles, Particles_PDG[MAXCELLS], Particles_Status[MAXCELLS];
-    double eventWeight, Particle_X4[MAXCELLS][4], Particle_P4[MAXCELLS][4]; // 4-position and 4-momentum
-
-    tNuSCOPE->SetBranchAddress("StdHepN", &NParticles);
-    tNuSCOPE->SetBranchAddress("StdHepStatus", &Particles_Status);
-    tNuSCOPE->SetBranchAddress("StdHepPdg", &Particles_PDG);
-    tNuSCOPE->SetBranchAddress("StdHepX4", &Particle_X4);
-    tNuSCOPE->SetBranchAddress("StdHepP4", &Particle_P4);
-    tNuSCOPE->SetBranchAddress("EvtWght", &eventWeight);
+    double eventWeight, Particle_P4[MAXCELLS][4]; // 4-momentum
+
+    // Only the branches below are read. Every event needs StdHepP4 (E_nu^true is the energy of the
+    // incoming neutrino), so the saving is StdHepX4, as large as StdHepP4 and never used here
+    TBranch *bN = nullptr, *bStatus = nullptr, *bPdg = nullptr, *bP4 = nullptr, *bWeight = nullptr;
+    tNuSCOPE->SetBranchStatus("*", false);
+    for (const char* name : {"StdHepN", "StdHepStatus", "StdHepPdg", "StdHepP4", "EvtWght"})
+        tNuSCOPE->SetBranchStatus(name, true);
+    tNuSCOPE->SetBranchAddress("StdHepN", &NParticles, &bN);
+    tNuSCOPE->SetBranchAddress("StdHepStatus", &Particles_Status, &bStatus);
+    tNuSCOPE->SetBranchAddress("StdHepPdg", &Particles_PDG, &bPdg);
+    tNuSCOPE->SetBranchAddress("StdHepP4", &Particle_P4, &bP4);
+    tNuSCOPE->SetBranchAddress("EvtWght", &eventWeight, &bWeight);
+    if (!bN || !bStatus || !bPdg || !bP4 || !bWeight)
+    {
+        printf("Error: StdHepN, StdHepStatus, StdHepPdg, StdHepP4 and EvtWght are needed in gRooTracker.\n");
+        return 1;
+    }
+    if (!CheckMaxParticles(tNuSCOPE, "StdHepN", MAXCELLS))
+        return 1;
 
     std::cout << "\n\n Saved branches in the tree.\n";
 
     double Erecoil_minerva, Elep, Enu_true, E_reco;
+    EstimatorInput estimatorInput;
+
+    // The kinematics are computed one block of events at a time, in this same loop
+    KinematicsBlock kinematics;
+    double kinWeights[KIN_BLOCK];
+    auto fillKinematics = [&]()
+    {
+        kinematics.Compute();
+        for (int v = 0; v < kNKinematicVariables; v++)
+            for (int s = 0; s < kinematics.Size(); s++)
+                hKinNuSCOPE[v]->Fill(kinematics.Get(v, s), kinWeights[s]);
+        kinematics.Clear();
+    };
+
+    // With --profile: hardware counters of GetEntry, the particle loop and the filling (PerfCounters.h)
+    std::unique_ptr<StageProfiler> profiler(profile ? new StageProfiler() : nullptr);
+    int stageRead = 0, stageParticles = 0, stageFill = 0;
+    if (profiler)
+    {
+        stageRead = profiler->Stage("GetEntry");
+        stageParticles = profiler->Stage("particle loop");
+        stageFill = profiler->Stage("histograms and kinematics");
+    }
 
     Long64_t nentries = tNuSCOPE->GetEntries();
+
+    // Live progress: the loop publishes copies of these histograms, the monitor threads serve them
+    std::vector<TH1F*> monitored = {hEnuNuSCOPE, hDeltaNuSCOPE, hDeltaNuSCOPE_Weighted, hELepNuSCOPE};
+    std::unique_ptr<LiveMonitor> monitor((monitorPort > 0 || !monitorFile.empty()) ? new LiveMonitor(1, nentries) : nullptr);
+    if (monitor)
+    {
+        for (TH1F* h : monitored)
+            monitor->AddHistogram(h->GetName(), h->GetNbinsX(), h->GetXaxis()->GetXmin(), h->GetXaxis()->GetXmax());
+        std::string error;
+        if (monitorPort > 0 && !monitor->StartHttp(monitorPort, error))
+            printf("Warning: %s, no live monitor on HTTP.\n", error.c_str());
+        if (!monitorFile.empty())
+            monitor->StartSnapshotFile(monitorFile);
+    }
+
+    Long64_t bytesBefore = file_NuSCOPE->GetBytesRead();
     for (Long64_t i = 0; i < nentries; i++) 
     {
+        if (profiler)
+            profiler->Enter(stageRead);
         tNuSCOPE->GetEntry(i);
+        if (profiler)
+        {
+            profiler->Enter(stageParticles);
+            profiler->CountEvents();
+        }
     
         Enu_true = 0;
         Erecoil_minerva = 0;
         Elep = 0;
         E_reco = 0;
+        estimatorInput.Reset();
+        double beamX = 0, beamY = 0, beamZ = 1; // direction of the incoming neutrino (it comes first in StdHep)
 
         for (int j = 0; j < NParticles; j++)
         {
             if (Particles_Status[j] == 1) // Means these are final state
             {
+                estimatorInput.AddParticle(Particles_PDG[j], Particle_P4[j][0], Particle_P4[j][1], Particle_P4[j][2], Particle_P4[j][3], beamX, beamY, beamZ);
+
                 if (Particles_PDG[j] == 13)
                     Elep += Particle_P4[j][3];
                 else if (Particles_PDG[j] == 2122 || abs(Particles_PDG[j]) == 211)
@@ -117,10 +238,22 @@ int main(int argc, char ** argv)
             else if (Particles_Status[j] == 0) // For neutrinos in initial state
             {
                 if (abs(Particles_PDG[j]) == 14)
+                {
                     Enu_true += Particle_P4[j][3];
+                    double p = sqrt(Particle_P4[j][0]*Particle_P4[j][0] + Particle_P4[j][1]*Particle_P4[j][1] + Particle_P4[j][2]*Particle_P4[j][2]);
+                    if (p > 0)
+                    {
+                        beamX = Particle_P4[j][0] / p;
+                        beamY = Particle_P4[j][1] / p;
+                        beamZ = Particle_P4[j][2] / p;
+                    }
+                }
             }
         }
 
+        if (profiler)
+            profiler->Enter(stageFill);
+
         E_reco = Erecoil_minerva + Elep;
 
         hELepNuSCOPE->Fill(Elep);
@@ -128,6 +261,30 @@ int main(int argc, char ** argv)
         hDeltaNuSCOPE->Fill((Enu_true - E_reco), eventWeight);
         if (Enu_true > 0)
             hDeltaNuSCOPE_Weighted->Fill( ((Enu_true - E_reco)/Enu_true) , eventWeight);
+
+        for (size_t e = 0; e < estimators.size(); e++)
+            hBiasEstimator[e]->Fill(Enu_true - estimators[e].function(estimatorInput), eventWeight);
+
+        kinWeights[kinematics.AddGenieEvent(NParticles, Particles_Status, Particles_PDG, Particle_P4)] = eventWeight;
+        if (kinematics.Full())
+            fillKinematics();
+
+        if (monitor)
+        {
+            monitor->Count(0);
+            if (monitor->PublishDue(0))
+                monitor->Publish(0, monitored);
+        }
+    }
+    fillKinematics();
+    if (monitor)
+        monitor->Publish(0, monitored);
+    Long64_t bytesRead = file_NuSCOPE->GetBytesRead() - bytesBefore;
+    printf("Event loop read %.1f MB (%.0f bytes/event)\n", bytesRead / 1e6, nentries > 0 ? (double) bytesRead / nentries : 0.);
+    if (profiler)
+    {
+        profiler->Stop();
+        profiler->Print("nuSCOPE GENIE event loop");
     }
 
     // ----------------------------------------------------------------------------------------------
@@ -137,7 +294,7 @@ int main(int argc, char ** argv)
     hELepNuSCOPE->SetLineColor(kRed);
     TCanvas *cLep = new TCanvas("cLep", "Lepton energy", 800, 600);
     hELepNuSCOPE->Draw("hist");
-    cLep->SaveAs("../nuSCOPE_Plots/withTaggingEfficiency/lepton_energy.pdf");
+    plots.SaveAs(cLep, "../nuSCOPE_Plots/withTaggingEfficiency/lepton_energy.pdf");
     
     // True E_nu
     hEnuNuSCOPE->SetLineColor(kRed);
@@ -149,7 +306,7 @@ int main(int argc, char ** argv)
     leg2->AddEntry(hEnuNuSCOPE, "nuSCOPE", "l");
     leg2->Draw();
 
-    c2->SaveAs("../nuSCOPE_Plots/withTaggingEfficiency/true_energy.pdf");
+    plots.SaveAs(c2, "../nuSCOPE_Plots/withTaggingEfficiency/true_energy.pdf");
 
     // Energy bias (E_true - E_reco) 
     hDeltaNuSCOPE->SetLineColor(kRed);
@@ -161,7 +318,7 @@ int main(int argc, char ** argv)
     leg3->AddEntry(hDeltaNuSCOPE, "nuSCOPE", "l");
     leg3->Draw();
 
-    c3->SaveAs("../nuSCOPE_Plots/withTaggingEfficiency/energy_bias.pdf");
+    plots.SaveAs(c3, "../nuSCOPE_Plots/withTaggingEfficiency/energy_bias.pdf");
 
     // Weighted energy bias [(E_true - E_reco)/E_true]
     hDeltaNuSCOPE_Weighted->SetLineColor(kRed);
@@ -173,7 +330,21 @@ int main(int argc, char ** argv)
     leg3_2->AddEntry(hDeltaNuSCOPE_Weighted, "nuSCOPE", "l");
     leg3_2->Draw();
 
-    c3_2->SaveAs("../nuSCOPE_Plots/withTaggingEfficiency/delta_energy_weighted.pdf");
+    plots.SaveAs(c3_2, "../nuSCOPE_Plots/withTaggingEfficiency/delta_energy_weighted.pdf");
+
+    // Energy bias of the different E_reco estimators
+    TCanvas *cEstimators = new TCanvas("cEstimators", "Energy bias by estimator", 800, 600);
+    DrawRecoEstimators(estimators, hBiasEstimator, new TLegend(0.6, 0.65, 0.9, 0.9));
+    plots.SaveAs(cEstimators, "../nuSCOPE_Plots/withTaggingEfficiency/energy_bias_estimators.pdf");
+
+    // Q^2, W and transverse kinematic imbalance
+    for (int v = 0; v < kNKinematicVariables; v++)
+    {
+        hKinNuSCOPE[v]->SetLineColor(kRed);
+        TCanvas *cKin = new TCanvas(Form("cKin_%s", KinematicVariableName(v)), KinematicVariableName(v), 800, 600);
+        hKinNuSCOPE[v]->Draw("hist");
+        plots.SaveAs(cKin, Form("../nuSCOPE_Plots/withTaggingEfficiency/kinematics_%s.pdf", KinematicVariableName(v)));
+    }
 
     /*
     // Mode-separated NuSCOPE plot
@@ -195,7 +366,7 @@ int main(int argc, char ** argv)
     leg4->AddEntry(hNuSCOPE_Other, "Other", "l");
     leg4->Draw();
 
-    c4->SaveAs("../nuSCOPE_Plots/withTaggingEfficiency/nuSCOPE_modes.pdf");
+    plots.SaveAs(c4, "../nuSCOPE_Plots/withTaggingEfficiency/nuSCOPE_modes.pdf");
 
     // NuSCOPE Energy bias split by mode of interaction and topology
     TCanvas *c6 = new TCanvas("c6", "nuSCOPE DeltaE by channel", 1000, 800);
@@ -287,11 +458,13 @@ int main(int argc, char ** argv)
     label2.SetTextSize(0.04);
     label2.DrawLatex(0.15, 0.93, "nuSCOPE: Energy bias by final-state topology");
 
-    c6->SaveAs("../nuSCOPE_Plots/withTaggingEfficiency/nuSCOPE_deltaE_modes_split.pdf");
+    plots.SaveAs(c6, "../nuSCOPE_Plots/withTaggingEfficiency/nuSCOPE_deltaE_modes_split.pdf");
     */
 
     // Close files
     file_NuSCOPE->Close();
 
+    plots.PrintSummary("nuSCOPE energy bias (GENIE)");
+
     return 0;
 }
\ No newline at end of file
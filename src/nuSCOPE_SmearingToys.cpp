@@ -0,0 +1,189 @@
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1F.h"
+#include "TH2F.h"
+#include "TCanvas.h"
+#include "TLegend.h"
+#include "TStyle.h"
+#include "TSystem.h"
+#include "SampleDefinitions.h"
+#include "DetectorSmearing.h"
+#include "RecoEstimators.h"
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+// To compile: c++ nuSCOPE_SmearingToys.cpp `root-config --cflags --libs` -o nuscope_smearing_toys.out
+//
+// Energy bias of nuSCOPE with a toy detector response (see DetectorSmearing.h): for every event of
+// the GENIE file, nToys smeared versions of E_reco are made in the same pass, and the bias histogram
+// of every toy is accumulated. The result is the bias with perfect truth energies (calorimetric
+// estimator), the mean of the toys with their spread as a band, and all the toy histograms (TH2F).
+//
+//     ./nuscope_smearing_toys.out nuSCOPE_test.root 1000 [resolution_model.txt]
+//
+// Model file: one line per particle class (muon, em, proton, pion, neutron, other) with
+// threshold [GeV], stochastic term, constant term and efficiency, e.g. "neutron 0.05 0 0.4 0.3".
+
+static const int MAXCELLS = 100; // particles per event in the StdHep buffers (GENIE allows up to 250)
+
+int main(int argc, char ** argv)
+{
+    gStyle->SetOptStat(0);
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: \n- ./nuscope_smearing_toys.out \n- name of the nuSCOPE GENIE .root file"
+                  << "\n- optional: number of toys (default 1000) \n- optional: resolution model file" << std::endl;
+        return 1;
+    }
+
+    int nToys = argc > 2 ? atoi(argv[2]) : 1000;
+    if (nToys < 1)
+    {
+        printf("Error: the number of toys must be positive.\n");
+        return 1;
+    }
+
+    SmearingModel model = DefaultLArModel();
+    if (argc > 3 && !LoadSmearingModel(argv[3], model))
+    {
+        printf("Error: could not read the resolution model %s.\n", argv[3]);
+        return 1;
+    }
+
+    printf("Resolution model:\n  %-8s %10s %10s %10s %10s\n", "class", "threshold", "stochastic", "constant", "efficiency");
+    for (int c = 0; c < kNSmearingClasses; c++)
+        printf("  %-8s %10.3f %10.3f %10.3f %10.3f\n", SmearingClassName(c), model.particle[c].threshold,
+               model.particle[c].stochastic, model.particle[c].constant, model.particle[c].efficiency);
+
+    const char* outputDir = "../nuSCOPE_Plots/smearing";
+    if (gSystem->mkdir(outputDir, true) != 0 && gSystem->AccessPathName(outputDir))
+    {
+        printf("Error: could not create the output directory %s.\n", outputDir);
+        return 1;
+    }
+
+    TFile *file_NuSCOPE = TFile::Open(argv[1]);
+    if (!file_NuSCOPE)
+    {
+        printf("Error: could not open the file.\n");
+        return 1;
+    }
+
+    TTree *tNuSCOPE = (TTree*) file_NuSCOPE->Get("gRooTracker");
+    if (!tNuSCOPE)
+    {
+        printf("Error: could not find the TTree in the file.\n");
+        return 1;
+    }
+
+    // ----------------------------------------------------------------------------------------------
+    //                          Branches (only the ones we need are read)
+    // ----------------------------------------------------------------------------------------------
+    int NParticles, Particles_PDG[MAXCELLS], Particles_Status[MAXCELLS];
+    double eventWeight, Particle_P4[MAXCELLS][4];
+
+    tNuSCOPE->SetBranchStatus("*", false);
+    const char* branches[] = {"StdHepN", "StdHepStatus", "StdHepPdg", "StdHepP4", "EvtWght"};
+    for (const char* name : branches)
+        tNuSCOPE->SetBranchStatus(name, true);
+    tNuSCOPE->SetBranchAddress("StdHepN", &NParticles);
+    tNuSCOPE->SetBranchAddress("StdHepStatus", &Particles_Status);
+    tNuSCOPE->SetBranchAddress("StdHepPdg", &Particles_PDG);
+    tNuSCOPE->SetBranchAddress("StdHepP4", &Particle_P4);
+    tNuSCOPE->SetBranchAddress("EvtWght", &eventWeight);
+    if (!CheckMaxParticles(tNuSCOPE, "StdHepN", MAXCELLS))
+        return 1;
+
+    // ----------------------------------------------------------------------------------------------
+    //                                  Toys, in a single pass
+    // ----------------------------------------------------------------------------------------------
+    const int nbins = 50;
+    const double lo = -0.5, hi = 2.5;
+    TH1F *hBiasTruth = new TH1F("hBiasTruth", "nuSCOPE energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", nbins, lo, hi);
+    ToyHistograms toys(nToys, nbins, lo, hi);
+
+    SmearingEngine engine(model, nToys);
+    engine.SetFile(argv[1]);
+    EstimatorInput truth;
+
+    auto start = std::chrono::steady_clock::now();
+    Long64_t nentries = tNuSCOPE->GetEntries();
+    for (Long64_t i = 0; i < nentries; i++)
+    {
+        tNuSCOPE->GetEntry(i);
+
+        double Enu_true = 0;
+        truth.Reset();
+        engine.BeginEvent(i);
+
+        for (int j = 0; j < NParticles; j++)
+        {
+            if (Particles_Status[j] == 0 && abs(Particles_PDG[j]) == 14)
+                Enu_true += Particle_P4[j][3];
+            else if (Particles_Status[j] == 1)
+            {
+                truth.AddParticle(Particles_PDG[j], Particle_P4[j][0], Particle_P4[j][1], Particle_P4[j][2], Particle_P4[j][3]);
+                engine.AddParticle(Particles_PDG[j], Particle_P4[j][0], Particle_P4[j][1], Particle_P4[j][2], Particle_P4[j][3]);
+            }
+        }
+
+        hBiasTruth->Fill(Enu_true - EstimateCalorimetric(truth), eventWeight);
+        toys.Fill(Enu_true, 1., engine.Ereco(), eventWeight);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\n%lld events x %d toys in %.2f s: %.3g toys x events/s\n", (long long) nentries, nToys, seconds,
+           seconds > 0 ? (double) nentries * nToys / seconds : 0.);
+
+    // ----------------------------------------------------------------------------------------------
+    //                       Toy mean and spread, all toys in a TH2F
+    // ----------------------------------------------------------------------------------------------
+    TH1F *hBiasToys = new TH1F("hBiasToys", "nuSCOPE energy bias, smeared;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", nbins, lo, hi);
+    TH2F *hBiasAllToys = new TH2F("hBiasAllToys", "Energy bias of every toy;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Toy", nbins, lo, hi, nToys, 0, nToys);
+    for (int b = 0; b <= nbins + 1; b++)
+    {
+        double mean, rms;
+        toys.GetBinSpread(b, mean, rms);
+        hBiasToys->SetBinContent(b, mean);
+        hBiasToys->SetBinError(b, rms);
+        for (int t = 0; t < nToys; t++)
+            hBiasAllToys->SetBinContent(b, t + 1, toys.GetBinContent(t, b));
+    }
+
+    hBiasTruth->SetLineColor(kBlack);
+    hBiasToys->SetLineColor(kRed);
+    hBiasToys->SetFillColorAlpha(kRed, 0.3);
+    hBiasToys->SetMarkerSize(0);
+
+    TCanvas *c1 = new TCanvas("c1", "Energy bias with detector smearing", 800, 600);
+    hBiasToys->SetMaximum(1.1 * std::max(hBiasTruth->GetMaximum(), hBiasToys->GetMaximum()));
+    hBiasToys->Draw("E2");
+    hBiasToys->Draw("hist same");
+    hBiasTruth->Draw("hist same");
+
+    TLegend *leg1 = new TLegend(0.6, 0.75, 0.9, 0.9);
+    leg1->AddEntry(hBiasTruth, "Truth (calorimetric)", "l");
+    leg1->AddEntry(hBiasToys, Form("Smeared, mean of %d toys", nToys), "lf");
+    leg1->Draw();
+
+    c1->SaveAs(Form("%s/energy_bias_smearing_toys.pdf", outputDir));
+
+    TFile *file_out = TFile::Open(Form("%s/smearing_toys.root", outputDir), "RECREATE");
+    if (!file_out)
+    {
+        printf("Error: could not write %s/smearing_toys.root.\n", outputDir);
+        return 1;
+    }
+    hBiasTruth->Write();
+    hBiasToys->Write();
+    hBiasAllToys->Write();
+    file_out->Close();
+
+    file_NuSCOPE->Close();
+
+    return 0;
+}
@@ -5,23 +5,33 @@
 #include "TLegend.h"
 #include "TStyle.h"
 #include "TLatex.h"
+#include "PlotCache.h"
+#include "CompiledFormula.h"
+#include "PlotDefinitions.h"
 #include <iostream>
 #include <cmath>
 #include <string>
 
 // To compile: c++ test.cpp `root-config --cflags --libs` -o test.out
+// The histograms are filled through FormulaFiller (CompiledFormula.h): the Project()-style strings
+// are JIT-compiled once and all histograms are filled in one pass per tree. Add --interpreted as
+// last argument to use the old TTree::Project calls instead (e.g. to compare timings), or --native
+// to evaluate them without the interpreter (fastest startup, see StartupBenchmark.cpp).
 
 int main(int argc, char ** argv) 
 {
     gStyle->SetOptStat(0);
 
+    // Plots whose content did not change since the last run are not rendered again
+    PlotCache plots("../Test_new_plots/.plotcache");
+
     // ----------------------------------------------------------------------------------------------
     //                                   Open files and TTrees
     // ----------------------------------------------------------------------------------------------
 
     if (argc < 3) 
     {
-        std::cout << "Usage: \n- ./plots.out \n- name of the DUNE .root file \n- name of the T2K .root file" << std::endl;
+        std::cout << "Usage: \n- ./plots.out \n- name of the DUNE .root file \n- name of the T2K .root file \n- optional: --interpreted or --native" << std::endl;
         return 1;
     }
 
@@ -30,6 +40,8 @@ int main(int argc, char ** argv)
 
     TFile *file_DUNE = TFile::Open(argv[1]);
     TFile *file_T2K  = TFile::Open(argv[2]);
+    bool interpreted = (argc > 3 && std::string(argv[3]) == "--interpreted");
+    bool native = (argc > 3 && std::string(argv[3]) == "--native");
 
     if (!file_DUNE || !file_T2K) 
     {
@@ -60,102 +72,69 @@ int main(int argc, char ** argv)
     hFluxDUNE->SetTitle("DUNE neutrino flux;E_{#nu} [GeV];Unosc #nu_{#mu}/m^{2}/POT/GeV");
     c1->SetTitle("DUNE neutrino flux");
     hFluxDUNE->Draw("hist");
-    c1->SaveAs("../Test_new_plots/DUNE_flux.pdf");
+    plots.SaveAs(c1, "../Test_new_plots/DUNE_flux.pdf");
 
     TCanvas *c1_T2K = new TCanvas("c1_T2K", "T2K flux", 800, 600);
     hFluxT2K->GetXaxis()->SetRangeUser(0, 9);
     hFluxT2K->SetTitle("T2K neutrino flux;E_{#nu} [GeV];Unosc #nu_{#mu}/m^{2}/POT/GeV");
     c1_T2K->SetTitle("T2K neutrino flux");
     hFluxT2K->Draw("hist");
-    c1_T2K->SaveAs("../Test_new_plots/T2K_flux.pdf");
+    plots.SaveAs(c1_T2K, "../Test_new_plots/T2K_flux.pdf");
 
     // -------------------------------------------------------------------------------------------------------------
     //                                   Histogram definitions 
     // -------------------------------------------------------------------------------------------------------------
-    TH1F *hEnuDUNE = new TH1F("hEnuDUNE", "True neutrino energy comparison;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
-    TH1F *hEnuT2K  = new TH1F("hEnuT2K", "True neutrino energy comparison;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
-    TH1F *hDeltaDUNE = new TH1F("hDeltaDUNE", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDeltaT2K  = new TH1F("hDeltaT2K", "Comparison between true and reconstructed neutrino energy;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hDeltaDUNE_Weighted = new TH1F("hDeltaDUNE_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries", 50, -1, 2);
-    TH1F *hDeltaT2K_Weighted  = new TH1F("hDeltaT2K_Weighted", "Weighted difference between true and reconstructed neutrino energy;(E_{#nu}^{true} - E_{nu}^{reco})/E_{#nu}^{true};Entries", 50, -1, 2);
-
-    TH1F *hDUNE_CCQE  = new TH1F("hDUNE_CCQE", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
-    TH1F *hDUNE_RES   = new TH1F("hDUNE_RES", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
-    TH1F *hDUNE_2p2h  = new TH1F("hDUNE_2p2h", "DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
-    TH1F *hDUNE_Other = new TH1F("hDUNE_Other","DUNE events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 10);
-
-    TH1F *hT2K_CCQE   = new TH1F("hT2K_CCQE", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 12);
-    TH1F *hT2K_RES    = new TH1F("hT2K_RES", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 12);
-    TH1F *hT2K_2p2h   = new TH1F("hT2K_2p2h", "T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 12);
-    TH1F *hT2K_Other  = new TH1F("hT2K_Other","T2K events divided by channels;E_{#nu}^{true} [GeV];Entries", 50, 0, 12);
-
-    TH1F *hDUNE_Delta_CCQE = new TH1F("hDUNE_Delta_CCQE", "DUNE difference between true and reco #nu energy divided by channel;E_{#nu}^{true} - E_{nu}^{reco} [GeV];Entries", 100, 0, 1);
-    TH1F *hDUNE_Delta_RES  = new TH1F("hDUNE_Delta_RES", "DUNE RES DeltaE;#DeltaE [GeV];Entries", 200, 0, 1);
-    TH1F *hDUNE_Delta_2p2h = new TH1F("hDUNE_Delta_2p2h","DUNE 2p2h DeltaE;#DeltaE [GeV];Entries", 200, 0, 1);
-    TH1F *hDUNE_Delta_Other= new TH1F("hDUNE_Delta_Other","DUNE Other DeltaE;#DeltaE [GeV];Entries", 200, 0, 1);
-
-    TH1F *hT2K_Delta_CCQE  = new TH1F("hT2K_Delta_CCQE","T2K CCQE DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Delta_RES   = new TH1F("hT2K_Delta_RES","T2K RES DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Delta_2p2h  = new TH1F("hT2K_Delta_2p2h","T2K 2p2h DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Delta_Other = new TH1F("hT2K_Delta_Other","T2K Other DeltaE;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-
-    TH1F *hDUNE_0pi0n = new TH1F("hDUNE_0pi0n", "DUNE 0pi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
-    TH1F *hDUNE_0piNn = new TH1F("hDUNE_0piNn", "DUNE 0piNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
-    TH1F *hDUNE_Npi0n = new TH1F("hDUNE_Npi0n", "DUNE Npi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
-    TH1F *hDUNE_NpiNn = new TH1F("hDUNE_NpiNn", "DUNE NpiNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 200, 0, 1);
-
-    TH1F *hT2K_0pi0n = new TH1F("hT2K_0pi0n", "DUNE 0pi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_0piNn = new TH1F("hT2K_0piNn", "DUNE 0piNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_Npi0n = new TH1F("hT2K_Npi0n", "DUNE Npi0n energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-    TH1F *hT2K_NpiNn = new TH1F("hT2K_NpiNn", "DUNE NpiNn energy bias;E_{#nu}^{true} - E_{#nu}^{reco} [GeV];Entries", 50, -0.5, 2.5);
-
-    // Testing another way to process trees. Example:
-    //TH1D* h_test = new TH1D("h_test_name");
+    TH1F *hEnuDUNE = BookTestPlot("hEnuDUNE");
+    TH1F *hEnuT2K  = BookTestPlot("hEnuT2K");
+    TH1F *hDeltaDUNE = BookTestPlot("hDeltaDUNE");
+    TH1F *hDeltaT2K  = BookTestPlot("hDeltaT2K");
+    TH1F *hDeltaDUNE_Weighted = BookTestPlot("hDeltaDUNE_Weighted");
+    TH1F *hDeltaT2K_Weighted  = BookTestPlot("hDeltaT2K_Weighted");
+
+    TH1F *hDUNE_CCQE  = BookTestPlot("hDUNE_CCQE");
+    TH1F *hDUNE_RES   = BookTestPlot("hDUNE_RES");
+    TH1F *hDUNE_2p2h  = BookTestPlot("hDUNE_2p2h");
+    TH1F *hDUNE_Other = BookTestPlot("hDUNE_Other");
+
+    TH1F *hT2K_CCQE   = BookTestPlot("hT2K_CCQE");
+    TH1F *hT2K_RES    = BookTestPlot("hT2K_RES");
+    TH1F *hT2K_2p2h   = BookTestPlot("hT2K_2p2h");
+    TH1F *hT2K_Other  = BookTestPlot("hT2K_Other");
+
+    TH1F *hDUNE_Delta_CCQE = BookTestPlot("hDUNE_Delta_CCQE");
+    TH1F *hDUNE_Delta_RES  = BookTestPlot("hDUNE_Delta_RES");
+    TH1F *hDUNE_Delta_2p2h = BookTestPlot("hDUNE_Delta_2p2h");
+    TH1F *hDUNE_Delta_Other= BookTestPlot("hDUNE_Delta_Other");
+
+    TH1F *hT2K_Delta_CCQE  = BookTestPlot("hT2K_Delta_CCQE");
+    TH1F *hT2K_Delta_RES   = BookTestPlot("hT2K_Delta_RES");
+    TH1F *hT2K_Delta_2p2h  = BookTestPlot("hT2K_Delta_2p2h");
+    TH1F *hT2K_Delta_Other = BookTestPlot("hT2K_Delta_Other");
+
+    TH1F *hDUNE_0pi0n = BookTestPlot("hDUNE_0pi0n");
+    TH1F *hDUNE_0piNn = BookTestPlot("hDUNE_0piNn");
+    TH1F *hDUNE_Npi0n = BookTestPlot("hDUNE_Npi0n");
+    TH1F *hDUNE_NpiNn = BookTestPlot("hDUNE_NpiNn");
+
+    TH1F *hT2K_0pi0n = BookTestPlot("hT2K_0pi0n");
+    TH1F *hT2K_0piNn = BookTestPlot("hT2K_0piNn");
+    TH1F *hT2K_Npi0n = BookTestPlot("hT2K_Npi0n");
+    TH1F *hT2K_NpiNn = BookTestPlot("hT2K_NpiNn");
+
+    // Same strings as in TTree::Project(), compiled once and filled in a single pass per tree. Example:
     //tree->Project("h_test_name", "Enu_QE/Enu_true", "flagCCINC*(Mode==2)", "hist")
+    FormulaFiller fillDUNE(tDUNE);
+    FormulaFiller fillT2K(tT2K);
+
+    // Expressions and cuts of every histogram in PlotDefinitions.h (the T2K topologies are booked, not filled)
+    for (const PlotDefinition& plot : GetTestPlots())
+        if (plot.expression)
+            (std::string(plot.sample) == "DUNE" ? fillDUNE : fillT2K).Add((TH1*) gDirectory->Get(plot.name), plot.expression, plot.cut);
 
-    // True neutrino energy
-    tDUNE  -> Project("hEnuDUNE", "Enu_true", "flagCCINC", "hist");
-    tT2K   -> Project("hEnuT2K", "Enu_true", "flagCC0pi", "hist");
-
-    // Energy bias
-    tDUNE  -> Project("hDeltaDUNE", "Enu_true - (Erecoil_minerva+ELep)", "flagCCINC", "hist");
-    tT2K   -> Project("hDeltaT2K", "Enu_true - Enu_QE", "flagCC0pi", "hist");
-
-    // Weighted energy bias
-    tDUNE  -> Project("hDeltaDUNE_Weighted", "(Enu_true-(Erecoil_minerva+ELep))/Enu_true", "flagCCINC", "hist");
-    tT2K   -> Project("hDeltaT2K_Weighted", "(Enu_true-Enu_QE)/Enu_true", "flagCC0pi", "hist");
-
-    // DUNE Mode separation
-    tDUNE  -> Project("hDUNE_CCQE", "Enu_true", "flagCCINC * (Mode==1)", "hist"); // CCQE = Mode 1
-    tDUNE  -> Project("hDUNE_2p2h", "Enu_true", "flagCCINC * (Mode==2)", "hist"); // 2p2h = Mode 2 
-    tDUNE  -> Project("hDUNE_RES", "Enu_true", "flagCCINC && ( (Mode==11) || (Mode==12) || (Mode==13) )", "hist"); // RES = Mode 11, 12, 13
-    tDUNE  -> Project("hDUNE_Other", "Enu_true", "flagCCINC * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)", "hist"); // "Other"
-
-    // T2K Mode separation
-    tT2K   -> Project("hT2K_CCQE", "Enu_true", "flagCC0pi * (Mode==1)", "hist");
-    tT2K   -> Project("hT2K_2p2h", "Enu_true", "flagCC0pi * (Mode==2)", "hist");
-    tT2K   -> Project("hT2K_RES", "Enu_true", "flagCC0pi && ( (Mode==11) || (Mode==12) || (Mode==13) )", "hist");
-    tT2K   -> Project("hT2K_Other", "Enu_true", "flagCC0pi * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)", "hist");
-
-    // DUNE Energy bias by mode or topology
-    tDUNE  -> Project("hDUNE_Delta_CCQE", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC * (Mode==1)", "hist"); // CCQE = Mode 1
-    tDUNE  -> Project("hDUNE_Delta_2p2h", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC * (Mode==2)", "hist"); // 2p2h = Mode 2 
-    tDUNE  -> Project("hDUNE_Delta_RES", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ( (Mode==11) || (Mode==12) || (Mode==13) )", "hist"); // RES = Mode 11, 12, 13
-    tDUNE  -> Project("hDUNE_Delta_Other", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)", "hist"); // "Other"
-    tDUNE  -> Project("hDUNE_0pi0n", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))==0) && (Sum$((abs(pdg)==211))==0))", "hist"); // No pions (211), no neutrons (2112)
-    tDUNE  -> Project("hDUNE_0piNn", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))>0) && (Sum$((abs(pdg)==211))==0))", "hist"); // No pions, N neutrons
-    tDUNE  -> Project("hDUNE_Npi0n", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))==0) && (Sum$((abs(pdg)==211))>0))", "hist"); // N pions, no neutrons
-    tDUNE  -> Project("hDUNE_NpiNn", "Enu_true-(Erecoil_minerva+ELep)", "flagCCINC && ((Sum$((abs(pdg)==2112))>0) && (Sum$((abs(pdg)==211))>0))", "hist"); // N pions, N neutrons
-
-    // T2K Energy bias by mode or topology
-    tT2K   -> Project("hT2K_Delta_CCQE", "Enu_true-Enu_QE", "flagCC0pi * (Mode==1)", "hist");
-    tT2K   -> Project("hT2K_Delta_2p2h", "Enu_true-Enu_QE", "flagCC0pi * (Mode==2)", "hist");
-    tT2K   -> Project("hT2K_Delta_RES", "Enu_true-Enu_QE", "flagCC0pi && ( (Mode==11) || (Mode==12) || (Mode==13) )", "hist");
-    tT2K   -> Project("hT2K_Delta_Other", "Enu_true-Enu_QE", "flagCC0pi * (Mode!=1) * (Mode!=2) * (Mode!=11) * (Mode!=12) * (Mode!=13)", "hist");
-    // tT2K   -> Project("hT2K_0pi0n", "Enu_true-(Erecoil_minerva+ELep)", "", "hist");
-    // tT2K   -> Project("hT2K_0piNn", "Enu_true-(Erecoil_minerva+ELep)", "", "hist");
-    // tT2K   -> Project("hT2K_Npi0n", "Enu_true-(Erecoil_minerva+ELep)", "", "hist");
-    // tT2K   -> Project("hT2K_NpiNn", "Enu_true-(Erecoil_minerva+ELep)", "", "hist");
+    if (!native || !fillDUNE.RunNative())
+        fillDUNE.Run(interpreted);
+    if (!native || !fillT2K.RunNative())
+        fillT2K.Run(interpreted);
 
     // ----------------------------------------------------------------------------------------------
     //                                       Plotting
@@ -174,7 +153,7 @@ int main(int argc, char ** argv)
     leg2->AddEntry(hEnuT2K, "T2K", "l");
     leg2->Draw();
 
-    c2->SaveAs("../Test_new_plots/true_energy_comparison.pdf");
+    plots.SaveAs(c2, "../Test_new_plots/true_energy_comparison.pdf");
 
     // DeltaE (E_true - E_reco) comparison
     hDeltaDUNE->SetLineColor(kRed);
@@ -189,7 +168,7 @@ int main(int argc, char ** argv)
     leg3->AddEntry(hDeltaT2K, "T2K", "l");
     leg3->Draw();
 
-    c3->SaveAs("../Test_new_plots/delta_energy_comparison.pdf");
+    plots.SaveAs(c3, "../Test_new_plots/delta_energy_comparison.pdf");
 
     // Weighted DeltaE [(E_true - E_reco)/E_true] comparison
     hDeltaDUNE_Weighted->SetLineColor(kRed);
@@ -204,7 +183,7 @@ int main(int argc, char ** argv)
     leg3_2->AddEntry(hDeltaT2K_Weighted, "T2K", "l");
     leg3_2->Draw();
 
-    c3_2->SaveAs("../Test_new_plots/delta_energy_comparison_weighted.pdf");
+    plots.SaveAs(c3_2, "../Test_new_plots/delta_energy_comparison_weighted.pdf");
 
     // Mode-separated DUNE plot
     hDUNE_CCQE->SetLineColor(kGreen+2);
@@ -225,7 +204,7 @@ int main(int argc, char ** argv)
     leg4->AddEntry(hDUNE_Other, "Other", "l");
     leg4->Draw();
 
-    c4->SaveAs("../Test_new_plots/DUNE_modes.pdf");
+    plots.SaveAs(c4, "../Test_new_plots/DUNE_modes.pdf");
 
     // Mode-separated T2K plot
     hT2K_CCQE->SetLineColor(kGreen+2);
@@ -246,7 +225,7 @@ int main(int argc, char ** argv)
     leg5->AddEntry(hT2K_Other, "Other", "l");
     leg5->Draw();
 
-    c5->SaveAs("../Test_new_plots/T2K_modes.pdf");
+    plots.SaveAs(c5, "../Test_new_plots/T2K_modes.pdf");
 
     // DUNE Energy bias split by mode of interaction and topology
     TCanvas *c6 = new TCanvas("c6", "DUNE DeltaE by channel", 1000, 800);
@@ -339,7 +318,7 @@ int main(int argc, char ** argv)
     label2.DrawLatex(0.15, 0.93, "DUNE: Energy bias by final-state topology");
 
     // Save plot
-    c6->SaveAs("../Test_new_plots/DUNE_deltaE_modes_split.pdf");
+    plots.SaveAs(c6, "../Test_new_plots/DUNE_deltaE_modes_split.pdf");
 
     // T2K DeltaE (E_true - E_reco) by mode
     hT2K_Delta_CCQE->SetLineColor(kGreen+2);
@@ -361,7 +340,7 @@ int main(int argc, char ** argv)
     leg7->AddEntry(hT2K_Delta_Other, "Other", "l");
     leg7->Draw();
 
-    c7->SaveAs("../Test_new_plots/T2K_deltaE_modes.pdf");
+    plots.SaveAs(c7, "../Test_new_plots/T2K_deltaE_modes.pdf");
 
     // ----------------------------------------------------------------------------------------------
     //                          Comparison DUNE & T2K separated by mode
@@ -400,11 +379,13 @@ int main(int argc, char ** argv)
     leg8->AddEntry(hT2K_Other, "T2K Other", "l");
     leg8->Draw();
 
-    c8->SaveAs("../Test_new_plots/DUNE_T2K_modes_comparison.pdf");
+    plots.SaveAs(c8, "../Test_new_plots/DUNE_T2K_modes_comparison.pdf");
 
     // Close files
     file_DUNE->Close();
     file_T2K->Close();
 
+    plots.PrintSummary("DUNE vs T2K (test)");
+
     return 0;
 }
\ No newline at end of file